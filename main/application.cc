@@ -1,6 +1,7 @@
 #include "application.h"
 #include "board.h"
 #include "display.h"
+#include "display_benchmark.h"
 #include "system_info.h"
 #include "audio_codec.h"
 #include "mqtt_protocol.h"
@@ -9,8 +10,10 @@
 #include "mcp_server.h"
 #include "assets.h"
 #include "settings.h"
+#include "task_profiler.h"
 
 #include <cstring>
+#include <cstdlib>
 #include <esp_log.h>
 #include <cJSON.h>
 #include <driver/gpio.h>
@@ -22,6 +25,7 @@
 
 Application::Application() {
     event_group_ = xEventGroupCreate();
+    server_events_ = xQueueCreate(SERVER_EVENT_QUEUE_LENGTH, sizeof(ServerEvent));
 
 #if CONFIG_USE_DEVICE_AEC && CONFIG_USE_SERVER_AEC
 #error "CONFIG_USE_DEVICE_AEC and CONFIG_USE_SERVER_AEC cannot be enabled at the same time"
@@ -51,6 +55,7 @@ Application::~Application() {
         esp_timer_stop(clock_timer_handle_);
         esp_timer_delete(clock_timer_handle_);
     }
+    vQueueDelete(server_events_);
     vEventGroupDelete(event_group_);
 }
 
@@ -68,6 +73,12 @@ void Application::Initialize() {
     // Print board name/version info
     display->SetChatMessage("system", SystemInfo::GetUserAgent().c_str());
 
+#if CONFIG_USE_DISPLAY_BENCHMARK
+    if (auto lvgl_display = dynamic_cast<LvglDisplay*>(display)) {
+        DisplayBenchmark(lvgl_display).Run();
+    }
+#endif
+
     // Setup the audio service
     auto codec = board.GetAudioCodec();
     audio_service_.Initialize(codec);
@@ -93,6 +104,10 @@ void Application::Initialize() {
     // Start the clock timer to update the status bar
     esp_timer_start_periodic(clock_timer_handle_, 1000000);
 
+#if CONFIG_USE_TASK_PROFILER
+    TaskProfiler::GetInstance().Start();
+#endif
+
     // Add MCP common tools (only once during initialization)
     auto& mcp_server = McpServer::GetInstance();
     mcp_server.AddCommonTools();
@@ -217,7 +232,13 @@ void Application::Run() {
 
         if (bits & MAIN_EVENT_SEND_AUDIO) {
             while (auto packet = audio_service_.PopPacketFromSendQueue()) {
-                if (protocol_ && !protocol_->SendAudio(std::move(packet))) {
+                bool sent = !protocol_ || protocol_->SendAudio(*packet);
+                if (sent) {
+                    audio_service_.ReportPacketSent(*packet);
+                }
+                audio_service_.ReleasePacket(std::move(packet));
+                if (!sent) {
+                    audio_service_.ReportSendFailure();
                     break;
                 }
             }
@@ -252,6 +273,14 @@ void Application::Run() {
             if (clock_ticks_ % 10 == 0) {
                 SystemInfo::PrintHeapStats();
             }
+
+#if CONFIG_USE_AUDIO_TELEMETRY
+            // Report the audio metrics with the next tick the audio channel is open
+            if (++telemetry_ticks_ >= CONFIG_AUDIO_TELEMETRY_INTERVAL_SECONDS && protocol_ && protocol_->IsAudioChannelOpened()) {
+                telemetry_ticks_ = 0;
+                protocol_->SendTelemetry("audio", audio_service_.GetMetricsJson());
+            }
+#endif
         }
     }
 }
@@ -429,7 +458,7 @@ void Application::CheckNewVersion() {
         retry_delay = 10; // Reset retry delay
 
         if (ota_->HasNewVersion()) {
-            if (UpgradeFirmware(ota_->GetFirmwareUrl(), ota_->GetFirmwareVersion())) {
+            if (UpgradeFirmware(ota_->GetFirmwareUrl(), ota_->GetFirmwareVersion(), ota_->GetFirmwarePatchUrl())) {
                 return; // This line will never be reached after reboot
             }
             // If upgrade failed, continue to normal operation
@@ -491,10 +520,30 @@ void Application::InitializeProtocol() {
         xEventGroupSetBits(event_group_, MAIN_EVENT_ERROR);
     });
     
+    // Larger frames and a lower bitrate save bandwidth on 4G
+    if (board.GetBoardType() == "ml307") {
+        protocol_->SetUplinkAudioParams(60, CONFIG_OPUS_CELLULAR_BITRATE);
+    } else {
+        protocol_->SetUplinkAudioParams(OPUS_FRAME_DURATION_MS, CONFIG_OPUS_BITRATE);
+    }
+
+    protocol_->SetAudioPacketAllocator([this]() {
+        return audio_service_.AcquirePacket();
+    }, [this](std::unique_ptr<AudioStreamPacket> packet) {
+        audio_service_.ReleasePacket(std::move(packet));
+    });
+
     protocol_->OnIncomingAudio([this](std::unique_ptr<AudioStreamPacket> packet) {
+#if CONFIG_USE_LOW_LATENCY_PLAYBACK
+        // Audio may arrive before the scheduled state change, it is held until the turn is released
+        audio_service_.PushPacketToPrebuffer(std::move(packet), tts_turn_);
+#else
         if (GetDeviceState() == kDeviceStateSpeaking) {
             audio_service_.PushPacketToDecodeQueue(std::move(packet));
+        } else {
+            audio_service_.ReleasePacket(std::move(packet));
         }
+#endif
     });
     
     protocol_->OnAudioChannelOpened([this, codec, &board]() {
@@ -503,6 +552,8 @@ void Application::InitializeProtocol() {
             ESP_LOGW(TAG, "Server sample rate %d does not match device output sample rate %d, resampling may cause distortion",
                 protocol_->server_sample_rate(), codec->output_sample_rate());
         }
+        audio_service_.SetEncoderParams(protocol_->uplink_frame_duration(), protocol_->uplink_bitrate());
+        audio_service_.SetUplinkHeaderSize(protocol_->audio_header_size());
     });
     
     protocol_->OnAudioChannelClosed([this, &board]() {
@@ -514,83 +565,28 @@ void Application::InitializeProtocol() {
         });
     });
     
+    protocol_->OnIncomingMessage([this](const ServerMessage& message) {
+        return DispatchServerMessage(message);
+    });
+    // Messages with nested payloads are parsed with cJSON
     protocol_->OnIncomingJson([this, display](const cJSON* root) {
-        // Parse JSON data
         auto type = cJSON_GetObjectItem(root, "type");
-        if (strcmp(type->valuestring, "tts") == 0) {
-            auto state = cJSON_GetObjectItem(root, "state");
-            if (strcmp(state->valuestring, "start") == 0) {
-                Schedule([this]() {
-                    aborted_ = false;
-                    SetDeviceState(kDeviceStateSpeaking);
-                });
-            } else if (strcmp(state->valuestring, "stop") == 0) {
-                Schedule([this]() {
-                    if (GetDeviceState() == kDeviceStateSpeaking) {
-                        if (listening_mode_ == kListeningModeManualStop) {
-                            SetDeviceState(kDeviceStateIdle);
-                        } else {
-                            SetDeviceState(kDeviceStateListening);
-                        }
-                    }
-                });
-            } else if (strcmp(state->valuestring, "sentence_start") == 0) {
-                auto text = cJSON_GetObjectItem(root, "text");
-                if (cJSON_IsString(text)) {
-                    ESP_LOGI(TAG, "<< %s", text->valuestring);
-                    Schedule([this, display, message = std::string(text->valuestring)]() {
-                        display->SetChatMessage("assistant", message.c_str());
-                    });
-                }
-            }
-        } else if (strcmp(type->valuestring, "stt") == 0) {
-            auto text = cJSON_GetObjectItem(root, "text");
-            if (cJSON_IsString(text)) {
-                ESP_LOGI(TAG, ">> %s", text->valuestring);
-                Schedule([this, display, message = std::string(text->valuestring)]() {
-                    display->SetChatMessage("user", message.c_str());
-                });
-            }
-        } else if (strcmp(type->valuestring, "llm") == 0) {
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(emotion)) {
-                Schedule([this, display, emotion_str = std::string(emotion->valuestring)]() {
-                    display->SetEmotion(emotion_str.c_str());
-                });
-            }
-        } else if (strcmp(type->valuestring, "mcp") == 0) {
+        if (strcmp(type->valuestring, "mcp") == 0) {
             auto payload = cJSON_GetObjectItem(root, "payload");
             if (cJSON_IsObject(payload)) {
                 McpServer::GetInstance().ParseMessage(payload);
             }
-        } else if (strcmp(type->valuestring, "system") == 0) {
-            auto command = cJSON_GetObjectItem(root, "command");
-            if (cJSON_IsString(command)) {
-                ESP_LOGI(TAG, "System command: %s", command->valuestring);
-                if (strcmp(command->valuestring, "reboot") == 0) {
-                    // Do a reboot if user requests a OTA update
-                    Schedule([this]() {
-                        Reboot();
-                    });
-                } else {
-                    ESP_LOGW(TAG, "Unknown system command: %s", command->valuestring);
-                }
-            }
-        } else if (strcmp(type->valuestring, "alert") == 0) {
-            auto status = cJSON_GetObjectItem(root, "status");
-            auto message = cJSON_GetObjectItem(root, "message");
-            auto emotion = cJSON_GetObjectItem(root, "emotion");
-            if (cJSON_IsString(status) && cJSON_IsString(message) && cJSON_IsString(emotion)) {
-                Alert(status->valuestring, message->valuestring, emotion->valuestring, Lang::Sounds::OGG_VIBRATION);
-            } else {
-                ESP_LOGW(TAG, "Alert command requires status, message and emotion");
-            }
 #if CONFIG_RECEIVE_CUSTOM_MESSAGE
         } else if (strcmp(type->valuestring, "custom") == 0) {
             auto payload = cJSON_GetObjectItem(root, "payload");
-            ESP_LOGI(TAG, "Received custom message: %s", cJSON_PrintUnformatted(root));
+            auto root_json = cJSON_PrintUnformatted(root);
+            ESP_LOGI(TAG, "Received custom message: %s", root_json);
+            cJSON_free(root_json);
             if (cJSON_IsObject(payload)) {
-                Schedule([this, display, payload_str = std::string(cJSON_PrintUnformatted(payload))]() {
+                auto payload_json = cJSON_PrintUnformatted(payload);
+                std::string payload_str(payload_json);
+                cJSON_free(payload_json);
+                Schedule([this, display, payload_str = std::move(payload_str)]() {
                     display->SetChatMessage("system", payload_str.c_str());
                 });
             } else {
@@ -605,6 +601,169 @@ void Application::InitializeProtocol() {
     protocol_->Start();
 }
 
+bool Application::DispatchServerMessage(const ServerMessage& message) {
+    // Indexed by ServerMessageType, nullptr for the messages parsed with cJSON
+    static const ServerMessageHandler handlers[] = {
+        nullptr,                                // kServerMessageUnknown
+        nullptr,                                // kServerMessageHello
+        nullptr,                                // kServerMessageGoodbye
+        &Application::HandleTtsMessage,         // kServerMessageTts
+        &Application::HandleSttMessage,         // kServerMessageStt
+        &Application::HandleLlmMessage,         // kServerMessageLlm
+        nullptr,                                // kServerMessageMcp
+        &Application::HandleSystemMessage,      // kServerMessageSystem
+        &Application::HandleAlertMessage,       // kServerMessageAlert
+        nullptr,                                // kServerMessageCustom
+    };
+    static_assert(sizeof(handlers) / sizeof(handlers[0]) == kServerMessageTypeCount, "One handler per message type");
+
+    auto handler = handlers[message.type];
+    return handler != nullptr && (this->*handler)(message);
+}
+
+bool Application::CopyServerEventText(ServerEvent& event, const JsonSlice& text) {
+    char* out = event.text;
+    if (text.length >= sizeof(event.text)) {
+        event.long_text = (char*)malloc(text.length + 1);
+        if (event.long_text == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate %u bytes for the message text", (unsigned)text.length + 1);
+            return false;
+        }
+        out = event.long_text;
+    }
+    text.CopyTo(out);
+    return true;
+}
+
+void Application::PostServerEvent(const ServerEvent& event) {
+    /*
+     * The event is copied into the queue, and a task that only captures this takes its place among
+     * the scheduled tasks, so events run in order with whatever else was scheduled. The network task
+     * never waits for the main loop: when the queue is full, the event is carried by the task itself.
+     */
+    if (xQueueSend(server_events_, &event, 0) == pdTRUE) {
+        Schedule([this]() {
+            ServerEvent queued;
+            if (xQueueReceive(server_events_, &queued, 0) == pdTRUE) {
+                HandleServerEvent(queued);
+            }
+        });
+    } else {
+        ESP_LOGW(TAG, "Server event queue is full, the main loop is busy");
+        Schedule([this, event]() {
+            HandleServerEvent(event);
+        });
+    }
+}
+
+bool Application::HandleTtsMessage(const ServerMessage& message) {
+    ServerEvent event = {};
+    if (message.state.Equals("start")) {
+        event.type = kServerEventTtsStart;
+        // Counted here instead of in the main task, so the audio that follows is tagged right away
+        event.turn = ++tts_turn_;
+        PostServerEvent(event);
+    } else if (message.state.Equals("stop")) {
+        event.type = kServerEventTtsStop;
+        PostServerEvent(event);
+    } else if (message.state.Equals("sentence_start") && message.text.present()) {
+        event.type = kServerEventSentence;
+        if (CopyServerEventText(event, message.text)) {
+            ESP_LOGI(TAG, "<< %s", event.get_text());
+            PostServerEvent(event);
+        }
+    }
+    return true;
+}
+
+bool Application::HandleSttMessage(const ServerMessage& message) {
+    audio_service_.MarkResponseStart();
+    if (message.text.present()) {
+        ServerEvent event = {};
+        event.type = kServerEventStt;
+        if (CopyServerEventText(event, message.text)) {
+            ESP_LOGI(TAG, ">> %s", event.get_text());
+            PostServerEvent(event);
+        }
+    }
+    return true;
+}
+
+bool Application::HandleLlmMessage(const ServerMessage& message) {
+    if (message.emotion.present()) {
+        ServerEvent event = {};
+        event.type = kServerEventEmotion;
+        if (CopyServerEventText(event, message.emotion)) {
+            PostServerEvent(event);
+        }
+    }
+    return true;
+}
+
+bool Application::HandleSystemMessage(const ServerMessage& message) {
+    if (message.command.present()) {
+        auto command = message.command.ToString();
+        ESP_LOGI(TAG, "System command: %s", command.c_str());
+        if (command == "reboot") {
+            // Do a reboot if user requests a OTA update
+            ServerEvent event = {};
+            event.type = kServerEventReboot;
+            PostServerEvent(event);
+        } else {
+            ESP_LOGW(TAG, "Unknown system command: %s", command.c_str());
+        }
+    }
+    return true;
+}
+
+bool Application::HandleAlertMessage(const ServerMessage& message) {
+    if (message.status.present() && message.message.present() && message.emotion.present()) {
+        Alert(message.status.ToString().c_str(), message.message.ToString().c_str(),
+            message.emotion.ToString().c_str(), Lang::Sounds::OGG_VIBRATION);
+    } else {
+        ESP_LOGW(TAG, "Alert command requires status, message and emotion");
+    }
+    return true;
+}
+
+void Application::HandleServerEvent(const ServerEvent& event) {
+    auto display = Board::GetInstance().GetDisplay();
+    switch (event.type) {
+    case kServerEventTtsStart:
+        aborted_ = false;
+#if CONFIG_USE_LOW_LATENCY_PLAYBACK
+        // A reply right after another one, the state change handler does not run again
+        if (GetDeviceState() == kDeviceStateSpeaking) {
+            audio_service_.FlushPrebuffer(event.turn);
+        }
+#endif
+        SetDeviceState(kDeviceStateSpeaking);
+        break;
+    case kServerEventTtsStop:
+        if (GetDeviceState() == kDeviceStateSpeaking) {
+            if (listening_mode_ == kListeningModeManualStop) {
+                SetDeviceState(kDeviceStateIdle);
+            } else {
+                SetDeviceState(kDeviceStateListening);
+            }
+        }
+        break;
+    case kServerEventSentence:
+        display->SetChatMessage("assistant", event.get_text());
+        break;
+    case kServerEventStt:
+        display->SetChatMessage("user", event.get_text());
+        break;
+    case kServerEventEmotion:
+        display->SetEmotion(event.get_text());
+        break;
+    case kServerEventReboot:
+        Reboot();
+        break;
+    }
+    free(event.long_text);
+}
+
 void Application::ShowActivationCode(const std::string& code, const std::string& message) {
     struct digit_sound {
         char digit;
@@ -759,7 +918,7 @@ void Application::HandleWakeWordDetectedEvent() {
     auto state = GetDeviceState();
     
     if (state == kDeviceStateIdle) {
-        audio_service_.EncodeWakeWord();
+        audio_service_.CaptureWakeWordAudio();
 
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
@@ -772,9 +931,10 @@ void Application::HandleWakeWordDetectedEvent() {
         auto wake_word = audio_service_.GetLastWakeWord();
         ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
 #if CONFIG_SEND_WAKE_WORD_DATA
-        // Encode and send the wake word data to the server
+        // Send the wake word audio, already encoded while listening for it
         while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
+            protocol_->SendAudio(*packet);
+            audio_service_.ReleasePacket(std::move(packet));
         }
         // Set the chat state to wake word detected
         protocol_->SendWakeWordDetected(wake_word);
@@ -809,6 +969,13 @@ void Application::HandleStateChangedEvent() {
             display->SetEmotion("neutral");
             audio_service_.EnableVoiceProcessing(false);
             audio_service_.EnableWakeWordDetection(true);
+            audio_service_.ClearPrebuffer();
+#if CONFIG_USE_WEBSOCKET_KEEP_WARM
+            // Get the next session ready in the background while idle, so waking up skips the handshake
+            if (protocol_) {
+                protocol_->PrewarmAudioChannel();
+            }
+#endif
             break;
         case kDeviceStateConnecting:
             display->SetStatus(Lang::Strings::CONNECTING);
@@ -818,6 +985,8 @@ void Application::HandleStateChangedEvent() {
         case kDeviceStateListening:
             display->SetStatus(Lang::Strings::LISTENING);
             display->SetEmotion("neutral");
+            // Late audio of the previous reply is held back, and dropped when the next reply starts
+            audio_service_.ClearPrebuffer();
 
             // Make sure the audio processor is running
             if (!audio_service_.IsAudioProcessorRunning()) {
@@ -842,6 +1011,10 @@ void Application::HandleStateChangedEvent() {
                 audio_service_.EnableWakeWordDetection(audio_service_.IsAfeWakeWord());
             }
             audio_service_.ResetDecoder();
+#if CONFIG_USE_LOW_LATENCY_PLAYBACK
+            // After ResetDecoder, which would discard the flushed packets
+            audio_service_.FlushPrebuffer(tts_turn_);
+#endif
             break;
         case kDeviceStateWifiConfiguring:
             audio_service_.EnableVoiceProcessing(false);
@@ -887,7 +1060,7 @@ void Application::Reboot() {
     esp_restart();
 }
 
-bool Application::UpgradeFirmware(const std::string& url, const std::string& version) {
+bool Application::UpgradeFirmware(const std::string& url, const std::string& version, const std::string& patch_url) {
     auto& board = Board::GetInstance();
     auto display = board.GetDisplay();
 
@@ -913,13 +1086,16 @@ bool Application::UpgradeFirmware(const std::string& url, const std::string& ver
     audio_service_.Stop();
     vTaskDelay(pdMS_TO_TICKS(1000));
 
-    bool upgrade_success = Ota::Upgrade(upgrade_url, [display](int progress, size_t speed) {
+    auto progress_callback = [display](int progress, size_t speed) {
         std::thread([display, progress, speed]() {
             char buffer[32];
             snprintf(buffer, sizeof(buffer), "%d%% %uKB/s", progress, speed / 1024);
             display->SetChatMessage("system", buffer);
         }).detach();
-    });
+    };
+
+    // Try the much smaller delta patch first, the full image is still there if it cannot be applied
+    bool upgrade_success = Ota::Upgrade(upgrade_url, patch_url, progress_callback);
 
     if (!upgrade_success) {
         // Upgrade failed, restart audio service and continue running
@@ -947,7 +1123,7 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
     auto state = GetDeviceState();
     
     if (state == kDeviceStateIdle) {
-        audio_service_.EncodeWakeWord();
+        audio_service_.CaptureWakeWordAudio();
 
         if (!protocol_->IsAudioChannelOpened()) {
             SetDeviceState(kDeviceStateConnecting);
@@ -959,9 +1135,10 @@ void Application::WakeWordInvoke(const std::string& wake_word) {
 
         ESP_LOGI(TAG, "Wake word detected: %s", wake_word.c_str());
 #if CONFIG_USE_AFE_WAKE_WORD || CONFIG_USE_CUSTOM_WAKE_WORD
-        // Encode and send the wake word data to the server
+        // Send the wake word audio, already encoded while listening for it
         while (auto packet = audio_service_.PopWakeWordPacket()) {
-            protocol_->SendAudio(std::move(packet));
+            protocol_->SendAudio(*packet);
+            audio_service_.ReleasePacket(std::move(packet));
         }
         // Set the chat state to wake word detected
         protocol_->SendWakeWordDetected(wake_word);
@@ -4,12 +4,14 @@
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
 #include <esp_timer.h>
 
 #include <string>
 #include <mutex>
 #include <deque>
 #include <memory>
+#include <atomic>
 
 #include "protocol.h"
 #include "ota.h"
@@ -32,6 +34,30 @@
 #define MAIN_EVENT_STOP_LISTENING       (1 << 11)
 #define MAIN_EVENT_STATE_CHANGED        (1 << 12)
 
+// Events beyond this are copied into a scheduled task instead
+#define SERVER_EVENT_QUEUE_LENGTH 8
+// Longer texts are allocated on the heap
+#define SERVER_EVENT_TEXT_SIZE 192
+
+enum ServerEventType : uint8_t {
+    kServerEventTtsStart,
+    kServerEventTtsStop,
+    kServerEventSentence,
+    kServerEventStt,
+    kServerEventEmotion,
+    kServerEventReboot,
+};
+
+// A server message handed from the network task to the main task, copied through a queue
+struct ServerEvent {
+    ServerEventType type;
+    uint32_t turn;
+    char* long_text;
+    char text[SERVER_EVENT_TEXT_SIZE];
+
+    const char* get_text() const { return long_text != nullptr ? long_text : text; }
+};
+
 
 enum AecMode {
     kAecOff,
@@ -105,7 +131,7 @@ public:
 
     void Reboot();
     void WakeWordInvoke(const std::string& wake_word);
-    bool UpgradeFirmware(const std::string& url, const std::string& version = "");
+    bool UpgradeFirmware(const std::string& url, const std::string& version = "", const std::string& patch_url = "");
     bool CanEnterSleepMode();
     void SendMcpMessage(const std::string& payload);
     void SetAecMode(AecMode mode);
@@ -126,6 +152,7 @@ private:
 
     std::mutex mutex_;
     std::deque<std::function<void()>> main_tasks_;
+    QueueHandle_t server_events_ = nullptr;
     std::unique_ptr<Protocol> protocol_;
     EventGroupHandle_t event_group_ = nullptr;
     esp_timer_handle_t clock_timer_handle_ = nullptr;
@@ -141,6 +168,8 @@ private:
     bool assets_version_checked_ = false;
     bool play_popup_on_listening_ = false;  // Flag to play popup sound after state changes to listening
     int clock_ticks_ = 0;
+    int telemetry_ticks_ = 0;
+    std::atomic<uint32_t> tts_turn_{0};     // Counts the tts start messages, tags the downlink audio of each reply
     TaskHandle_t activation_task_handle_ = nullptr;
 
 
@@ -153,6 +182,18 @@ private:
     void HandleNetworkDisconnectedEvent();
     void HandleActivationDoneEvent();
     void HandleWakeWordDetectedEvent();
+    void HandleServerEvent(const ServerEvent& event);
+
+    // Server message handlers, called on the network task
+    using ServerMessageHandler = bool (Application::*)(const ServerMessage& message);
+    bool DispatchServerMessage(const ServerMessage& message);
+    bool HandleTtsMessage(const ServerMessage& message);
+    bool HandleSttMessage(const ServerMessage& message);
+    bool HandleLlmMessage(const ServerMessage& message);
+    bool HandleSystemMessage(const ServerMessage& message);
+    bool HandleAlertMessage(const ServerMessage& message);
+    bool CopyServerEventText(ServerEvent& event, const JsonSlice& text);
+    void PostServerEvent(const ServerEvent& event);
 
     // Activation task (runs in background)
     void ActivationTask();
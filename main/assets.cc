@@ -10,14 +10,26 @@
 #include <spi_flash_mmap.h>
 #endif
 
+#include "settings.h"
+#include "downloader.h"
+#include "delta_patch.h"
+
 #include <esp_log.h>
 #include <esp_timer.h>
 #include <cbin_font.h>
+#include <cstring>
+#include <numeric>
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 
 #define TAG "Assets"
 #define PARTITION_LABEL "assets"
 
+// Files, checksum and length of the data after the header
+#define ASSETS_HEADER_SIZE 12
+
 struct mmap_assets_table {
     char asset_name[32];          /*!< Name of the asset */
     uint32_t asset_size;          /*!< Size of the asset */
@@ -121,14 +133,31 @@ bool Assets::LoadSrmodelsFromIndex(Assets* assets, cJSON* root) {
 uint32_t Assets::LvglStrategy::CalculateChecksum(const char* data, uint32_t length) {
     uint32_t checksum = 0;
     for (uint32_t i = 0; i < length; i++) {
-        checksum += data[i];
+        checksum += (uint8_t)data[i];
     }
     return checksum & 0xFFFF;
 }
 
+uint32_t Assets::LvglStrategy::GetPartitionKey(const esp_partition_t* partition, const char* header, uint32_t header_length) {
+    /* FNV-1a of the partition address, the header and the asset table, which holds the size and offset of every asset */
+    uint32_t hash = 2166136261u;
+    hash = (hash ^ partition->address) * 16777619u;
+    for (uint32_t i = 0; i < header_length; i++) {
+        hash = (hash ^ (uint8_t)header[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static int CompareAssetName(const mmap_assets_table* item, const char* name) {
+    // Names fill the whole field when they are 32 bytes long, without a terminating zero
+    return strncmp(item->asset_name, name, sizeof(item->asset_name));
+}
+
 bool Assets::LvglStrategy::InitializePartition(Assets* assets) {
     assets->partition_valid_ = false;
-    assets_.clear();
+    table_ = nullptr;
+    table_size_ = 0;
+    sorted_index_.clear();
 
     if (!Assets::FindPartition(assets)) {
         return false;
@@ -155,30 +184,53 @@ bool Assets::LvglStrategy::InitializePartition(Assets* assets) {
     uint32_t stored_chksum = *(uint32_t*)(mmap_root_ + 4);
     uint32_t stored_len = *(uint32_t*)(mmap_root_ + 8);
 
-    if (stored_len > assets->partition_->size - 12) {
+    if (stored_len > assets->partition_->size - ASSETS_HEADER_SIZE) {
         ESP_LOGD(TAG, "The stored_len (0x%lx) is greater than the partition size (0x%lx) - 12", stored_len, assets->partition_->size);
         return false;
     }
-
-    auto start_time = esp_timer_get_time();
-    uint32_t calculated_checksum = CalculateChecksum(mmap_root_ + 12, stored_len);
-    auto end_time = esp_timer_get_time();
-    ESP_LOGI(TAG, "The checksum calculation time is %d ms", int((end_time - start_time) / 1000));
-
-    if (calculated_checksum != stored_chksum) {
-        ESP_LOGE(TAG, "The calculated checksum (0x%lx) does not match the stored checksum (0x%lx)", calculated_checksum, stored_chksum);
+    if (stored_files > stored_len / sizeof(mmap_assets_table)) {
+        ESP_LOGE(TAG, "The asset table of %lu files does not fit in the stored_len (0x%lx)", stored_files, stored_len);
         return false;
     }
 
+    // The checksum covers the whole partition, so it is verified only once for every partition content,
+    // either while downloading it or on the first boot, and the result is kept in NVS
+    uint32_t table_length = stored_files * sizeof(mmap_assets_table);
+    uint32_t partition_key = GetPartitionKey(assets->partition_, mmap_root_, ASSETS_HEADER_SIZE + table_length);
+    Settings settings("assets", true);
+    bool verified = (uint32_t)settings.GetInt("verified") == partition_key;
+    if (!verified && !assets->download_verified_) {
+        auto start_time = esp_timer_get_time();
+        uint32_t calculated_checksum = CalculateChecksum(mmap_root_ + ASSETS_HEADER_SIZE, stored_len);
+        auto end_time = esp_timer_get_time();
+        ESP_LOGI(TAG, "The checksum calculation time is %d ms", int((end_time - start_time) / 1000));
+
+        if (calculated_checksum != stored_chksum) {
+            ESP_LOGE(TAG, "The calculated checksum (0x%lx) does not match the stored checksum (0x%lx)", calculated_checksum, stored_chksum);
+            return false;
+        }
+    }
+    if (!verified) {
+        settings.SetInt("verified", (int32_t)partition_key);
+    }
+    assets->download_verified_ = false;
+
     checksum_valid_ = true;
 
-    for (uint32_t i = 0; i < stored_files; i++) {
-        auto item = (const mmap_assets_table*)(mmap_root_ + 12 + i * sizeof(mmap_assets_table));
-        auto asset = Asset{
-            .size = static_cast<size_t>(item->asset_size),
-            .offset = static_cast<size_t>(12 + sizeof(mmap_assets_table) * stored_files + item->asset_offset)
-        };
-        assets_[item->asset_name] = asset;
+    table_ = (const mmap_assets_table*)(mmap_root_ + ASSETS_HEADER_SIZE);
+    table_size_ = stored_files;
+    data_offset_ = ASSETS_HEADER_SIZE + table_length;
+
+    // Tables from build.py are sorted by name and searched in place
+    for (uint32_t i = 1; i < table_size_; i++) {
+        if (CompareAssetName(&table_[i - 1], table_[i].asset_name) > 0) {
+            sorted_index_.resize(table_size_);
+            std::iota(sorted_index_.begin(), sorted_index_.end(), 0);
+            std::sort(sorted_index_.begin(), sorted_index_.end(), [this](uint32_t a, uint32_t b) {
+                return CompareAssetName(&table_[a], table_[b].asset_name) < 0;
+            });
+            break;
+        }
     }
     return checksum_valid_;
 }
@@ -190,23 +242,50 @@ void Assets::LvglStrategy::UnApplyPartition(Assets* assets) {
         mmap_root_ = nullptr;
     }
     checksum_valid_ = false;
-    assets_.clear();
+    table_ = nullptr;
+    table_size_ = 0;
+    sorted_index_.clear();
     (void)assets; // Unused parameter
 }
 
+const mmap_assets_table* Assets::LvglStrategy::FindAsset(const std::string& name) const {
+    // Binary search by name
+    uint32_t low = 0;
+    uint32_t high = table_size_;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        auto item = &table_[sorted_index_.empty() ? middle : sorted_index_[middle]];
+        int result = CompareAssetName(item, name.c_str());
+        if (result < 0) {
+            low = middle + 1;
+        } else if (result > 0) {
+            high = middle;
+        } else {
+            return item;
+        }
+    }
+    return nullptr;
+}
+
 bool Assets::LvglStrategy::GetAssetData(Assets* assets, const std::string& name, void*& ptr, size_t& size) {
-    auto asset = assets_.find(name);
-    if (asset == assets_.end()) {
+    auto asset = FindAsset(name);
+    if (asset == nullptr) {
+        return false;
+    }
+    // Every asset is prefixed with the "ZZ" magic
+    size_t offset = data_offset_ + asset->asset_offset;
+    if (offset + 2 + asset->asset_size > assets->partition_->size) {
+        ESP_LOGE(TAG, "The asset %s at 0x%x is out of the partition", name.c_str(), offset);
         return false;
     }
-    auto data = (const char*)(mmap_root_ + asset->second.offset);
+    auto data = (const char*)(mmap_root_ + offset);
     if (data[0] != 'Z' || data[1] != 'Z') {
         ESP_LOGE(TAG, "The asset %s is not valid with magic %02x%02x", name.c_str(), data[0], data[1]);
         return false;
     }
 
     ptr = static_cast<void*>(const_cast<char*>(data + 2));
-    size = asset->second.size;
+    size = asset->asset_size;
     return true;
 }
 
@@ -428,117 +507,181 @@ bool Assets::Download(std::string url, std::function<void(int progress, size_t s
     // 取消当前资源分区的内存映射
     UnApplyPartition();
 
-    // 下载新的资源文件
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
-    
-    if (!http->Open("GET", url)) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection");
-        return false;
-    }
-
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get assets, status code: %d", http->GetStatusCode());
-        return false;
+    // 分区内容即将改变，清除已缓存的校验结果
+    {
+        Settings settings("assets", true);
+        settings.EraseKey("verified");
     }
+    download_verified_ = false;
 
-    size_t content_length = http->GetBodyLength();
-    if (content_length == 0) {
-        ESP_LOGE(TAG, "Failed to get content length");
-        return false;
-    }
-
-    if (content_length > partition_->size) {
-        ESP_LOGE(TAG, "Assets file size (%u) is larger than partition size (%lu)", content_length, partition_->size);
-        return false;
-    }
-
-    // 定义扇区大小为4KB（ESP32的标准扇区大小）
+    // 下载新的资源文件，网络接收与擦除写入在两个任务中并行进行
     const size_t SECTOR_SIZE = esp_partition_get_main_flash_sector_size();
-    
-    // 计算需要擦除的扇区数量
-    size_t sectors_to_erase = (content_length + SECTOR_SIZE - 1) / SECTOR_SIZE; // 向上取整
-    size_t total_erase_size = sectors_to_erase * SECTOR_SIZE;
-    
-    ESP_LOGI(TAG, "Sector size: %u, content length: %u, sectors to erase: %u, total erase size: %u", 
-             SECTOR_SIZE, content_length, sectors_to_erase, total_erase_size);
-    
-    // 写入新的资源文件到分区，一边erase一边写入
-    char buffer[512];
-    size_t total_written = 0;
-    size_t recent_written = 0;
-    size_t current_sector = 0;
-    auto last_calc_time = esp_timer_get_time();
-    
-    while (true) {
-        int ret = http->Read(buffer, sizeof(buffer));
-        if (ret < 0) {
-            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
+    size_t erased_size = 0;
+    uint32_t checksum = 0; // 头部之后所有字节的和，与 spiffs_assets_gen.py 的计算方式相同
+
+    // 增量补丁在当前分区上就地重建新资源，按扇区缓冲，内容未变的扇区不擦写
+    std::unique_ptr<DeltaPatch> patch;
+    std::vector<uint8_t> sector;
+    size_t sector_offset = 0;
+    size_t rewritten_sectors = 0;
+    auto flush_sector = [&]() -> bool {
+        if (sector.empty()) {
+            return true;
+        }
+        bool changed = false;
+        uint8_t flash[256];
+        for (size_t i = 0; i < sector.size() && !changed; i += sizeof(flash)) {
+            size_t n = std::min(sizeof(flash), sector.size() - i);
+            if (esp_partition_read(partition_, sector_offset + i, flash, n) != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to read assets partition at offset %u", sector_offset + i);
+                return false;
+            }
+            changed = memcmp(flash, &sector[i], n) != 0;
+        }
+        if (changed) {
+            esp_err_t err = esp_partition_erase_range(partition_, sector_offset, SECTOR_SIZE);
+            if (err == ESP_OK) {
+                err = esp_partition_write(partition_, sector_offset, sector.data(), sector.size());
+            }
+            if (err != ESP_OK) {
+                ESP_LOGE(TAG, "Failed to rewrite the sector at offset %u: %s", sector_offset, esp_err_to_name(err));
+                return false;
+            }
+            rewritten_sectors++;
+        }
+        sector_offset += SECTOR_SIZE;
+        sector.clear();
+        return true;
+    };
+
+    // 增量补丁要校验当前资源的 SHA-256，在下载开始前算好，免得在接收回调里读完整个分区
+    DeltaPatch::SourceDigest source = {};
+    bool source_hashed = false;
+    uint32_t current_header[3];
+    if (esp_partition_read(partition_, 0, current_header, sizeof(current_header)) == ESP_OK &&
+        current_header[2] <= partition_->size - ASSETS_HEADER_SIZE) {
+        source_hashed = DeltaPatch::HashSource([this](size_t offset, uint8_t* data, size_t size) -> bool {
+            return esp_partition_read(partition_, offset, data, size) == ESP_OK;
+        }, ASSETS_HEADER_SIZE + current_header[2], source);
+    }
+
+    Downloader downloader;
+    // 服务器上的文件变了就从头下载；就地补丁一旦改写了扇区，补丁的源数据已不完整，只能失败
+    downloader.OnRestart([&]() -> bool {
+        if (patch && rewritten_sectors > 0) {
+            ESP_LOGE(TAG, "The assets changed on the server after the patch rewrote the partition");
             return false;
         }
+        patch.reset();
+        sector.clear();
+        sector_offset = 0;
+        erased_size = 0;
+        checksum = 0;
+        return true;
+    });
+    bool success = downloader.Download(url, [&](size_t offset, const uint8_t* data, size_t size) -> bool {
+        if (offset == 0 && DeltaPatch::IsPatch(data, size)) {
+            sector.reserve(SECTOR_SIZE);
+            patch = std::make_unique<DeltaPatch>([this](size_t offset, uint8_t* data, size_t size) -> bool {
+                return esp_partition_read(partition_, offset, data, size) == ESP_OK;
+            }, [&](const uint8_t* data, size_t size) -> bool {
+                while (size > 0) {
+                    size_t n = std::min(size, SECTOR_SIZE - sector.size());
+                    sector.insert(sector.end(), data, data + n);
+                    data += n;
+                    size -= n;
+                    if (sector.size() == SECTOR_SIZE && !flush_sector()) {
+                        return false;
+                    }
+                }
+                return true;
+            });
+            if (source_hashed) {
+                patch->SetSourceDigest(source);
+            }
+            // 只有生成时保证不会读取已改写扇区的补丁才能就地应用
+            patch->OnHeader([&]() -> bool {
+                if (!patch->in_place() || patch->target_size() > partition_->size || SECTOR_SIZE != DELTA_PATCH_SECTOR_SIZE) {
+                    ESP_LOGE(TAG, "The patch cannot be applied to the assets partition in place");
+                    return false;
+                }
+                return true;
+            });
+        }
+        if (patch) {
+            return patch->Feed(data, size);
+        }
 
-        if (ret == 0) {
-            break;
+        size_t content_length = downloader.content_length();
+        if (offset == 0) {
+            if (content_length > partition_->size) {
+                ESP_LOGE(TAG, "Assets file size (%u) is larger than partition size (%lu)", content_length, partition_->size);
+                return false;
+            }
+            ESP_LOGI(TAG, "Sector size: %u, content length: %u, chunk size: %u", SECTOR_SIZE, content_length, downloader.chunk_size());
         }
 
-        // 检查是否需要擦除新的扇区
-        size_t write_end_offset = total_written + ret;
-        size_t needed_sectors = (write_end_offset + SECTOR_SIZE - 1) / SECTOR_SIZE;
-        
-        // 擦除需要的新扇区
-        while (current_sector < needed_sectors) {
-            size_t sector_start = current_sector * SECTOR_SIZE;
-            size_t sector_end = (current_sector + 1) * SECTOR_SIZE;
-            
-            // 确保擦除范围不超过分区大小
-            if (sector_end > partition_->size) {
-                ESP_LOGE(TAG, "Sector end (%u) exceeds partition size (%lu)", sector_end, partition_->size);
+        // 擦除这一块数据所需的扇区
+        size_t erase_end = (offset + size + SECTOR_SIZE - 1) / SECTOR_SIZE * SECTOR_SIZE;
+        if (erase_end > erased_size) {
+            if (erase_end > partition_->size) {
+                ESP_LOGE(TAG, "Sector end (%u) exceeds partition size (%lu)", erase_end, partition_->size);
                 return false;
             }
-            
-            ESP_LOGD(TAG, "Erasing sector %u (offset: %u, size: %u)", current_sector, sector_start, SECTOR_SIZE);
-            esp_err_t err = esp_partition_erase_range(partition_, sector_start, SECTOR_SIZE);
+            esp_err_t err = esp_partition_erase_range(partition_, erased_size, erase_end - erased_size);
             if (err != ESP_OK) {
-                ESP_LOGE(TAG, "Failed to erase sector %u at offset %u: %s", current_sector, sector_start, esp_err_to_name(err));
+                ESP_LOGE(TAG, "Failed to erase sectors at offset %u: %s", erased_size, esp_err_to_name(err));
                 return false;
             }
-            
-            current_sector++;
+            erased_size = erase_end;
         }
 
         // 写入数据到分区
-        esp_err_t err = esp_partition_write(partition_, total_written, buffer, ret);
+        esp_err_t err = esp_partition_write(partition_, offset, data, size);
         if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write to assets partition at offset %u: %s", total_written, esp_err_to_name(err));
+            ESP_LOGE(TAG, "Failed to write to assets partition at offset %u: %s", offset, esp_err_to_name(err));
             return false;
         }
 
-        total_written += ret;
-        recent_written += ret;
-
-        // 计算进度和速度
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || total_written == content_length || ret == 0) {
-            size_t progress = total_written * 100 / content_length;
-            size_t speed = recent_written; // 每秒的字节数
-            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %u B/s, Sectors erased: %u", 
-                     progress, total_written, content_length, speed, current_sector);
-            if (progress_callback) {
-                progress_callback(progress, speed);
-            }
-            last_calc_time = esp_timer_get_time();
-            recent_written = 0; // 重置最近写入的字节数
+        for (size_t i = offset < ASSETS_HEADER_SIZE ? ASSETS_HEADER_SIZE - offset : 0; i < size; i++) {
+            checksum += data[i];
         }
-    }
-    
-    http->Close();
+        return true;
+    }, progress_callback);
 
-    if (total_written != content_length) {
-        ESP_LOGE(TAG, "Downloaded size (%u) does not match expected size (%u)", total_written, content_length);
+    if (!success) {
         return false;
     }
 
-    ESP_LOGI(TAG, "Assets download completed, total written: %u bytes, total sectors erased: %u", 
-             total_written, current_sector);
+    if (patch) {
+        // 补丁校验了重建结果的 SHA-256，无需再计算校验和
+        if (!patch->Finish() || !flush_sector()) {
+            return false;
+        }
+        ESP_LOGI(TAG, "Assets patched in place, %u bytes, %u sectors rewritten", patch->target_size(), rewritten_sectors);
+        download_verified_ = true;
+        if (!InitializePartition()) {
+            ESP_LOGE(TAG, "Failed to re-initialize assets partition");
+            return false;
+        }
+        return true;
+    }
+
+    size_t total_written = downloader.content_length();
+    ESP_LOGI(TAG, "Assets download completed, total written: %u bytes, total erased: %u bytes", total_written, erased_size);
+
+    // 下载时已计算校验和，重新初始化时无需再次读取整个分区
+    uint32_t header[3];
+    if (total_written > ASSETS_HEADER_SIZE &&
+        esp_partition_read(partition_, 0, header, sizeof(header)) == ESP_OK &&
+        header[2] == total_written - ASSETS_HEADER_SIZE) {
+        if ((checksum & 0xFFFF) != header[1]) {
+            ESP_LOGE(TAG, "The checksum of the downloaded assets (0x%lx) does not match the stored checksum (0x%lx)",
+                checksum & 0xFFFF, header[1]);
+            return false;
+        }
+        download_verified_ = true;
+    }
 
     // 重新初始化资源分区
     if (!InitializePartition()) {
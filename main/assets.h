@@ -8,17 +8,13 @@
 #include <cJSON.h>
 #include <esp_partition.h>
 #include <model_path.h>
-#include <map>
-#include <string>
+#include <vector>
 
 #if HAVE_LVGL
 #include <spi_flash_mmap.h>
 #endif
 
-struct Asset {
-    size_t size;
-    size_t offset;
-};
+struct mmap_assets_table;
 
 class Assets {
 public:
@@ -62,10 +58,18 @@ private:
         bool GetAssetData(Assets* assets, const std::string& name, void*& ptr, size_t& size) override;
     private:
         static uint32_t CalculateChecksum(const char* data, uint32_t length);
-        std::map<std::string, Asset> assets_;
+        static uint32_t GetPartitionKey(const esp_partition_t* partition, const char* header, uint32_t header_length);
+        const mmap_assets_table* FindAsset(const std::string& name) const;
+
         esp_partition_mmap_handle_t mmap_handle_ = 0;
         const char* mmap_root_ = nullptr;
         bool checksum_valid_ = false;
+        // The asset table in the partition, searched in place. Tables built by older tools are not sorted by
+        // name, for those sorted_index_ holds the table positions in name order.
+        const mmap_assets_table* table_ = nullptr;
+        uint32_t table_size_ = 0;
+        size_t data_offset_ = 0;
+        std::vector<uint32_t> sorted_index_;
     };
     
     class EmoteStrategy : public AssetStrategy {
@@ -82,6 +86,7 @@ private:
 protected:
     const esp_partition_t* partition_ = nullptr;
     bool partition_valid_ = false;
+    bool download_verified_ = false;  // The checksum of the partition was verified while downloading it
     std::string default_assets_url_;
     srmodel_list_t* models_list_ = nullptr;
 };
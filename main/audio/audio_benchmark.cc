@@ -0,0 +1,123 @@
+#include "audio_benchmark.h"
+
+#include <esp_log.h>
+#include <string>
+
+#define TAG "AudioBenchmark"
+
+static const char* const kQueueNames[kAudioBenchmarkQueueCount] = {
+    "encode", "send", "decode", "playback"
+};
+
+void AudioBenchmark::LatencyStats::Add(int64_t latency_us) {
+    if (latency_us < 0) {
+        latency_us = 0;
+    }
+    count++;
+    sum_us += latency_us;
+    if (latency_us < min_us) {
+        min_us = latency_us;
+    }
+    if (latency_us > max_us) {
+        max_us = latency_us;
+    }
+    int bucket = latency_us / 1000 / AUDIO_BENCHMARK_LATENCY_BUCKET_MS;
+    if (bucket >= AUDIO_BENCHMARK_LATENCY_BUCKETS) {
+        bucket = AUDIO_BENCHMARK_LATENCY_BUCKETS - 1;
+    }
+    buckets[bucket]++;
+}
+
+int AudioBenchmark::LatencyStats::Percentile(int percent) const {
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t target = (count * percent + 99) / 100;
+    uint32_t accumulated = 0;
+    for (int i = 0; i < AUDIO_BENCHMARK_LATENCY_BUCKETS; i++) {
+        accumulated += buckets[i];
+        if (accumulated >= target) {
+            // Report the upper bound of the bucket
+            return (i + 1) * AUDIO_BENCHMARK_LATENCY_BUCKET_MS;
+        }
+    }
+    return AUDIO_BENCHMARK_LATENCY_BUCKETS * AUDIO_BENCHMARK_LATENCY_BUCKET_MS;
+}
+
+void AudioBenchmark::RecordUplinkLatency(int frame_duration, int64_t latency_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uplink_[frame_duration].Add(latency_us);
+}
+
+void AudioBenchmark::RecordDownlinkLatency(int frame_duration, int64_t latency_us) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    downlink_[frame_duration].Add(latency_us);
+}
+
+void AudioBenchmark::RecordQueueDepth(AudioBenchmarkQueue queue, size_t depth) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& stats = queues_[queue];
+    if (depth > stats.high_water_mark) {
+        stats.high_water_mark = depth;
+    }
+    if (depth > AUDIO_BENCHMARK_MAX_QUEUE_DEPTH) {
+        depth = AUDIO_BENCHMARK_MAX_QUEUE_DEPTH;
+    }
+    stats.depth_histogram[depth]++;
+}
+
+void AudioBenchmark::RecordDrop(AudioBenchmarkQueue queue) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queues_[queue].drops++;
+}
+
+void AudioBenchmark::RecordUnderrun() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    underruns_++;
+}
+
+void AudioBenchmark::PrintLatency(const char* name, const std::map<int, LatencyStats>& stats) {
+    for (auto& [frame_duration, latency] : stats) {
+        if (latency.count == 0) {
+            continue;
+        }
+        ESP_LOGI(TAG, "%s @%dms: n=%lu avg=%lldms min=%lldms max=%lldms p50<=%dms p95<=%dms p99<=%dms",
+            name, frame_duration, (unsigned long)latency.count,
+            latency.sum_us / latency.count / 1000, latency.min_us / 1000, latency.max_us / 1000,
+            latency.Percentile(50), latency.Percentile(95), latency.Percentile(99));
+    }
+}
+
+void AudioBenchmark::PrintReport() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    PrintLatency("mic->send", uplink_);
+    PrintLatency("decode->speaker", downlink_);
+
+    for (int i = 0; i < kAudioBenchmarkQueueCount; i++) {
+        auto& stats = queues_[i];
+        std::string histogram;
+        for (int depth = 0; depth <= AUDIO_BENCHMARK_MAX_QUEUE_DEPTH; depth++) {
+            if (stats.depth_histogram[depth] == 0) {
+                continue;
+            }
+            if (!histogram.empty()) {
+                histogram += " ";
+            }
+            histogram += std::to_string(depth) + (depth == AUDIO_BENCHMARK_MAX_QUEUE_DEPTH ? "+:" : ":");
+            histogram += std::to_string(stats.depth_histogram[depth]);
+        }
+        ESP_LOGI(TAG, "queue %-8s hwm=%lu drops=%lu depth [%s]", kQueueNames[i],
+            (unsigned long)stats.high_water_mark, (unsigned long)stats.drops, histogram.c_str());
+    }
+    ESP_LOGI(TAG, "playback underruns=%lu", (unsigned long)underruns_);
+}
+
+void AudioBenchmark::Reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    uplink_.clear();
+    downlink_.clear();
+    for (auto& stats : queues_) {
+        stats = QueueStats();
+    }
+    underruns_ = 0;
+}
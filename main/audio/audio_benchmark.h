@@ -0,0 +1,72 @@
+#ifndef AUDIO_BENCHMARK_H
+#define AUDIO_BENCHMARK_H
+
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Latency benchmark for the AudioService pipeline.
+ *
+ * Uplink latency is measured from the moment the last PCM chunk of a frame is read from the codec
+ * until the encoded packet is pushed to the send queue.
+ * Downlink latency is measured from the moment an Opus packet is pushed to the decode queue
+ * until its PCM has been written to the codec.
+ *
+ * Results are grouped by frame duration, so 20 ms and 60 ms runs can be compared in one report.
+ */
+
+#define AUDIO_BENCHMARK_LATENCY_BUCKET_MS 10
+#define AUDIO_BENCHMARK_LATENCY_BUCKETS 50
+#define AUDIO_BENCHMARK_MAX_QUEUE_DEPTH 40
+
+enum AudioBenchmarkQueue {
+    kAudioBenchmarkQueueEncode,
+    kAudioBenchmarkQueueSend,
+    kAudioBenchmarkQueueDecode,
+    kAudioBenchmarkQueuePlayback,
+    kAudioBenchmarkQueueCount,
+};
+
+class AudioBenchmark {
+public:
+    void RecordUplinkLatency(int frame_duration, int64_t latency_us);
+    void RecordDownlinkLatency(int frame_duration, int64_t latency_us);
+    void RecordQueueDepth(AudioBenchmarkQueue queue, size_t depth);
+    void RecordDrop(AudioBenchmarkQueue queue);
+    void RecordUnderrun();
+
+    void PrintReport();
+    void Reset();
+
+private:
+    struct LatencyStats {
+        uint32_t count = 0;
+        int64_t sum_us = 0;
+        int64_t min_us = INT64_MAX;
+        int64_t max_us = 0;
+        // The last bucket also counts everything above the histogram range
+        uint32_t buckets[AUDIO_BENCHMARK_LATENCY_BUCKETS] = {0};
+
+        void Add(int64_t latency_us);
+        int Percentile(int percent) const;
+    };
+
+    struct QueueStats {
+        uint32_t drops = 0;
+        uint32_t high_water_mark = 0;
+        // The last bucket also counts everything above AUDIO_BENCHMARK_MAX_QUEUE_DEPTH
+        uint32_t depth_histogram[AUDIO_BENCHMARK_MAX_QUEUE_DEPTH + 1] = {0};
+    };
+
+    std::mutex mutex_;
+    std::map<int, LatencyStats> uplink_;
+    std::map<int, LatencyStats> downlink_;
+    QueueStats queues_[kAudioBenchmarkQueueCount];
+    uint32_t underruns_ = 0;
+
+    void PrintLatency(const char* name, const std::map<int, LatencyStats>& stats);
+};
+
+#endif // AUDIO_BENCHMARK_H
@@ -0,0 +1,100 @@
+#ifndef AUDIO_BUFFER_POOL_H
+#define AUDIO_BUFFER_POOL_H
+
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct AudioBufferPoolStatistics {
+    uint32_t capacity = 0;
+    uint32_t free = 0;
+    uint32_t in_use = 0;
+    uint32_t high_water_mark = 0;  // Most objects in use at the same time
+    uint32_t misses = 0;           // Acquire() on an empty pool, fell back to the heap
+    uint32_t overflows = 0;        // Release() on a full pool, the object was freed
+};
+
+/*
+ * Fixed-capacity pool of preallocated objects.
+ *
+ * Objects keep their buffers (e.g. the payload vector) when they go back to the pool,
+ * so once every buffer has grown to its working size the hot path stops allocating.
+ * If the pool runs dry Acquire() falls back to the heap, and the extra object is kept
+ * by Release() as long as there is room, so objects lost elsewhere are replaced over time.
+ *
+ * Acquire() and Release() may be called from any task.
+ */
+template <typename T>
+class AudioBufferPool {
+public:
+    explicit AudioBufferPool(size_t capacity) : capacity_(capacity) {
+        free_.reserve(capacity);
+        for (size_t i = 0; i < capacity; i++) {
+            free_.push_back(std::make_unique<T>());
+        }
+    }
+
+    AudioBufferPool(const AudioBufferPool&) = delete;
+    AudioBufferPool& operator=(const AudioBufferPool&) = delete;
+
+    std::unique_ptr<T> Acquire() {
+        std::unique_ptr<T> object;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!free_.empty()) {
+                object = std::move(free_.back());
+                free_.pop_back();
+            } else {
+                misses_++;
+            }
+            in_use_++;
+            if (in_use_ > high_water_mark_) {
+                high_water_mark_ = in_use_;
+            }
+        }
+        if (!object) {
+            object = std::make_unique<T>();
+        }
+        return object;
+    }
+
+    void Release(std::unique_ptr<T> object) {
+        if (!object) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (in_use_ > 0) {
+            in_use_--;
+        }
+        if (free_.size() < capacity_) {
+            free_.push_back(std::move(object));
+        } else {
+            overflows_++;
+        }
+    }
+
+    AudioBufferPoolStatistics GetStatistics() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        AudioBufferPoolStatistics stats;
+        stats.capacity = capacity_;
+        stats.free = free_.size();
+        stats.in_use = in_use_;
+        stats.high_water_mark = high_water_mark_;
+        stats.misses = misses_;
+        stats.overflows = overflows_;
+        return stats;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<T>> free_;
+    size_t capacity_;
+    uint32_t in_use_ = 0;
+    uint32_t high_water_mark_ = 0;
+    uint32_t misses_ = 0;
+    uint32_t overflows_ = 0;
+};
+
+#endif // AUDIO_BUFFER_POOL_H
@@ -0,0 +1,85 @@
+#include "audio_dsp.h"
+
+#include <cmath>
+
+static inline int16_t ClampToInt16(int32_t value) {
+    return (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+}
+
+int32_t AudioDspVolumeFactor(int volume) {
+    return pow(double(volume) / 100.0, 2) * 65536;
+}
+
+void AudioDspScaleToInt32(const int16_t* __restrict src, int32_t* __restrict dst, size_t samples, int32_t factor) {
+    if (factor < 0 || factor > 65536) {
+        // Only a factor outside the volume range can overflow
+        for (size_t i = 0; i < samples; i++) {
+            int64_t value = int64_t(src[i]) * factor;
+            dst[i] = (value > INT32_MAX) ? INT32_MAX : (value < INT32_MIN) ? INT32_MIN : (int32_t)value;
+        }
+        return;
+    }
+
+    // |src * factor| <= 32768 * 65536 fits in 32 bits, so the product needs no saturation
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        int32_t s0 = src[i], s1 = src[i + 1], s2 = src[i + 2], s3 = src[i + 3];
+        dst[i] = s0 * factor;
+        dst[i + 1] = s1 * factor;
+        dst[i + 2] = s2 * factor;
+        dst[i + 3] = s3 * factor;
+    }
+    for (; i < samples; i++) {
+        dst[i] = int32_t(src[i]) * factor;
+    }
+}
+
+void AudioDspInt32ToInt16(const int32_t* __restrict src, int16_t* __restrict dst, size_t samples, int shift) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        int32_t s0 = src[i] >> shift, s1 = src[i + 1] >> shift, s2 = src[i + 2] >> shift, s3 = src[i + 3] >> shift;
+        dst[i] = ClampToInt16(s0);
+        dst[i + 1] = ClampToInt16(s1);
+        dst[i + 2] = ClampToInt16(s2);
+        dst[i + 3] = ClampToInt16(s3);
+    }
+    for (; i < samples; i++) {
+        dst[i] = ClampToInt16(src[i] >> shift);
+    }
+}
+
+void AudioDspApplyGain(int16_t* __restrict data, size_t samples, int32_t gain) {
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        int32_t s0 = data[i] * gain, s1 = data[i + 1] * gain, s2 = data[i + 2] * gain, s3 = data[i + 3] * gain;
+        data[i] = ClampToInt16(s0);
+        data[i + 1] = ClampToInt16(s1);
+        data[i + 2] = ClampToInt16(s2);
+        data[i + 3] = ClampToInt16(s3);
+    }
+    for (; i < samples; i++) {
+        data[i] = ClampToInt16(data[i] * gain);
+    }
+}
+
+void AudioDspExtractChannel(const int16_t* src, int16_t* dst, size_t frames, int channels, int channel) {
+    // Reading ahead of the write position, so extracting in place is safe
+    src += channel;
+    if (channels == 2) {
+        size_t i = 0;
+        for (; i + 4 <= frames; i += 4) {
+            int16_t s0 = src[2 * i], s1 = src[2 * i + 2], s2 = src[2 * i + 4], s3 = src[2 * i + 6];
+            dst[i] = s0;
+            dst[i + 1] = s1;
+            dst[i + 2] = s2;
+            dst[i + 3] = s3;
+        }
+        for (; i < frames; i++) {
+            dst[i] = src[2 * i];
+        }
+        return;
+    }
+    for (size_t i = 0; i < frames; i++) {
+        dst[i] = src[i * channels];
+    }
+}
@@ -0,0 +1,31 @@
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Sample format kernels shared by the codecs and the audio input path.
+ *
+ * Each kernel returns exactly what the per-sample loop it replaced returned, including the
+ * [-INT16_MAX, INT16_MAX] clamp of 16-bit outputs. The inner loops handle four samples per
+ * iteration and use restrict pointers, so the compiler keeps the samples in registers and does
+ * not reload them after every store.
+ */
+
+// (volume / 100)^2 * 65536 for a volume of 0-100, the factor of AudioDspScaleToInt32
+int32_t AudioDspVolumeFactor(int volume);
+
+// dst = src * factor, saturated to int32
+void AudioDspScaleToInt32(const int16_t* src, int32_t* dst, size_t samples, int32_t factor);
+
+// dst = src >> shift, clamped to +-INT16_MAX
+void AudioDspInt32ToInt16(const int32_t* src, int16_t* dst, size_t samples, int shift);
+
+// data = data * gain, clamped to +-INT16_MAX
+void AudioDspApplyGain(int16_t* data, size_t samples, int32_t gain);
+
+// Copy one channel out of interleaved frames. dst may be src, to extract in place
+void AudioDspExtractChannel(const int16_t* src, int16_t* dst, size_t frames, int channels, int channel = 0);
+
+#endif // AUDIO_DSP_H
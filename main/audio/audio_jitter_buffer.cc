@@ -0,0 +1,185 @@
+#include "audio_jitter_buffer.h"
+
+#include <esp_log.h>
+#include <algorithm>
+
+#define TAG "AudioJitterBuffer"
+
+AudioJitterBuffer::AudioJitterBuffer(AudioBufferPool<AudioStreamPacket>& pool) : pool_(pool) {
+    slots_.resize(AUDIO_JITTER_BUFFER_CAPACITY);
+}
+
+void AudioJitterBuffer::Push(std::unique_ptr<AudioStreamPacket> packet) {
+    received_++;
+    if (packet->sequence == 0) {
+        packet->sequence = last_sequence_ + 1;
+    }
+    if (packet->frame_duration > 0) {
+        frame_duration_ms_ = packet->frame_duration;
+    }
+    uint32_t sequence = packet->sequence;
+
+    if (count_ == 0 && !playing_) {
+        /* Start of a stream, or of a new stream after the previous one drained */
+        next_sequence_ = sequence;
+        last_sequence_ = sequence;
+        buffering_since_us_ = packet->enqueue_time_us;
+        last_arrival_time_us_ = 0;
+    }
+
+    int32_t offset = (int32_t)(sequence - next_sequence_);
+    if (offset < 0 && offset > -AUDIO_JITTER_BUFFER_CAPACITY) {
+        /* While buffering, an earlier packet moves the start back, as long as everything still fits */
+        if (playing_ || last_sequence_ - sequence >= AUDIO_JITTER_BUFFER_CAPACITY) {
+            late_++;
+            pool_.Release(std::move(packet));
+            return;
+        }
+        next_sequence_ = sequence;
+    } else if (offset < 0 || offset >= AUDIO_JITTER_BUFFER_CAPACITY) {
+        ESP_LOGW(TAG, "Sequence jumped from %lu to %lu, flushing %u packets",
+            (unsigned long)next_sequence_, (unsigned long)sequence, (unsigned)count_);
+        dropped_ += count_;
+        Clear();
+        next_sequence_ = sequence;
+        last_sequence_ = sequence;
+        buffering_since_us_ = packet->enqueue_time_us;
+        last_arrival_time_us_ = 0;
+    }
+
+    auto& slot = Slot(sequence);
+    if (slot) {
+        /* Duplicate */
+        late_++;
+        pool_.Release(std::move(packet));
+        return;
+    }
+    if ((int32_t)(sequence - last_sequence_) > 0) {
+        last_sequence_ = sequence;
+    }
+    UpdateJitter(sequence, packet->enqueue_time_us);
+    slot = std::move(packet);
+    count_++;
+    depth_ = count_;
+}
+
+void AudioJitterBuffer::UpdateJitter(uint32_t sequence, int64_t arrival_time_us) {
+    int64_t frame_us = frame_duration_ms_ * 1000LL;
+    if (last_arrival_time_us_ > 0 && (int32_t)(sequence - last_arrival_sequence_) > 0) {
+        int64_t expected = (int64_t)(sequence - last_arrival_sequence_) * frame_us;
+        int64_t deviation = (arrival_time_us - last_arrival_time_us_) - expected;
+        if (deviation < 0) {
+            deviation = -deviation;
+        }
+        jitter_us_ += (deviation - jitter_us_) / 16;
+    }
+    if (last_arrival_time_us_ == 0 || (int32_t)(sequence - last_arrival_sequence_) > 0) {
+        last_arrival_sequence_ = sequence;
+        last_arrival_time_us_ = arrival_time_us;
+    }
+
+    int min_depth = std::max(1, AUDIO_JITTER_MIN_MS / frame_duration_ms_);
+    int max_depth = std::max(min_depth, AUDIO_JITTER_MAX_MS / frame_duration_ms_);
+    int target = std::clamp((int)((3 * jitter_us_ + frame_us - 1) / frame_us), min_depth, max_depth);
+    if (target >= target_depth_) {
+        target_depth_ = target;
+        target_since_us_ = arrival_time_us;
+    } else if (arrival_time_us - target_since_us_ >= AUDIO_JITTER_DECAY_MS * 1000LL) {
+        /* Steady for a while, give back one frame of latency */
+        target_depth_--;
+        target_since_us_ = arrival_time_us;
+    }
+    target_depth_stat_ = target_depth_;
+    jitter_ms_ = jitter_us_ / 1000;
+}
+
+void AudioJitterBuffer::TakeSlot(uint32_t sequence, std::unique_ptr<AudioStreamPacket>& packet) {
+    packet = std::move(Slot(sequence));
+    count_--;
+    depth_ = count_;
+}
+
+AudioJitterResult AudioJitterBuffer::Pop(std::unique_ptr<AudioStreamPacket>& packet, int64_t now_us) {
+    if (count_ == 0) {
+        if (playing_) {
+            playing_ = false;
+            underruns_++;
+        }
+        return kAudioJitterNone;
+    }
+
+    if (!playing_) {
+        if (GetWaitTime(now_us) > 0) {
+            return kAudioJitterNone;
+        }
+        playing_ = true;
+        concealed_run_ = 0;
+    }
+
+    if (Slot(next_sequence_)) {
+        TakeSlot(next_sequence_++, packet);
+        concealed_run_ = 0;
+        return kAudioJitterPacket;
+    }
+
+    /* The next packet is missing although later ones have arrived */
+    if (concealed_run_ < AUDIO_JITTER_MAX_CONCEALED_FRAMES) {
+        concealed_run_++;
+        concealed_++;
+        next_sequence_++;
+        return kAudioJitterLost;
+    }
+
+    /* Too many lost in a row, concealing more would only sound worse */
+    while (!Slot(next_sequence_)) {
+        next_sequence_++;
+        skipped_++;
+    }
+    TakeSlot(next_sequence_++, packet);
+    concealed_run_ = 0;
+    return kAudioJitterPacket;
+}
+
+const AudioStreamPacket* AudioJitterBuffer::Peek() const {
+    if (count_ == 0) {
+        return nullptr;
+    }
+    return Slot(next_sequence_).get();
+}
+
+int64_t AudioJitterBuffer::GetWaitTime(int64_t now_us) const {
+    if (count_ == 0) {
+        return -1;
+    }
+    if (playing_ || (int)count_ >= target_depth_) {
+        return 0;
+    }
+    int64_t ready_time_us = buffering_since_us_ + (int64_t)target_depth_ * frame_duration_ms_ * 1000;
+    return std::max<int64_t>(ready_time_us - now_us, 0);
+}
+
+void AudioJitterBuffer::Clear() {
+    for (auto& slot : slots_) {
+        if (slot) {
+            pool_.Release(std::move(slot));
+        }
+    }
+    count_ = 0;
+    depth_ = 0;
+    playing_ = false;
+    concealed_run_ = 0;
+}
+
+AudioJitterStatistics AudioJitterBuffer::GetStatistics() const {
+    AudioJitterStatistics stats;
+    stats.received = received_.load();
+    stats.late = late_.load();
+    stats.concealed = concealed_.load();
+    stats.skipped = skipped_.load();
+    stats.dropped = dropped_.load();
+    stats.underruns = underruns_.load();
+    stats.depth = depth_.load();
+    stats.target_depth = target_depth_stat_.load();
+    stats.jitter_ms = jitter_ms_.load();
+    return stats;
+}
@@ -0,0 +1,111 @@
+#ifndef AUDIO_JITTER_BUFFER_H
+#define AUDIO_JITTER_BUFFER_H
+
+#include <memory>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include "audio_buffer_pool.h"
+#include "protocol.h"
+
+/*
+ * Jitter buffer for the downlink Opus packets, owned by the opus codec task.
+ *
+ * Packets are stored by sequence number, so reordered packets are played in order and duplicates or
+ * packets that arrive after their turn are dropped. Packets without a sequence number (WebSocket,
+ * PlaySound) are numbered in arrival order.
+ *
+ * Playback starts when the target depth is buffered, or when the first packet has waited as long
+ * as the target depth lasts, so the tail of a short stream is not held back. The target depth follows
+ * the inter-arrival jitter of the stream (RFC 3550 estimator): it grows at once when the jitter rises,
+ * and while arrivals stay steady it comes down one frame every AUDIO_JITTER_DECAY_MS, to no less than
+ * AUDIO_JITTER_MIN_MS, so one burst does not keep the latency up for the rest of the session.
+ *
+ * When the next packet is missing but later ones have arrived, Pop() reports a lost frame, and the
+ * caller conceals it with Opus FEC / PLC. Runs of more than AUDIO_JITTER_MAX_CONCEALED_FRAMES
+ * are skipped instead.
+ */
+
+#define AUDIO_JITTER_BUFFER_CAPACITY 32      // Power of two, so sequence wrap-around keeps the slots in order
+#define AUDIO_JITTER_MIN_MS 60
+#define AUDIO_JITTER_MAX_MS 600
+#define AUDIO_JITTER_DECAY_MS 2000
+#define AUDIO_JITTER_MAX_CONCEALED_FRAMES 3
+
+enum AudioJitterResult {
+    kAudioJitterNone,   // Nothing to play yet
+    kAudioJitterPacket, // The next packet is returned
+    kAudioJitterLost,   // The next packet is missing and should be concealed
+};
+
+struct AudioJitterStatistics {
+    uint32_t received = 0;
+    uint32_t late = 0;          // Arrived after their turn, or duplicates
+    uint32_t concealed = 0;     // Lost frames replaced by FEC / PLC
+    uint32_t skipped = 0;       // Lost frames skipped without concealment
+    uint32_t dropped = 0;       // Flushed because the stream jumped too far ahead
+    uint32_t underruns = 0;     // Ran empty while playing
+    uint32_t depth = 0;
+    uint32_t target_depth = 0;
+    uint32_t jitter_ms = 0;
+};
+
+class AudioJitterBuffer {
+public:
+    explicit AudioJitterBuffer(AudioBufferPool<AudioStreamPacket>& pool);
+
+    /* Packets that are not kept go back to the pool */
+    void Push(std::unique_ptr<AudioStreamPacket> packet);
+    AudioJitterResult Pop(std::unique_ptr<AudioStreamPacket>& packet, int64_t now_us);
+    /* The next packet to play, used for FEC after a lost frame */
+    const AudioStreamPacket* Peek() const;
+    /* Microseconds until Pop() may return something while buffering, -1 if it only depends on new packets */
+    int64_t GetWaitTime(int64_t now_us) const;
+    void Clear();
+
+    bool Full() const { return count_ >= AUDIO_JITTER_BUFFER_CAPACITY; }
+    /* May be called from any task */
+    bool Empty() const { return depth_ == 0; }
+    AudioJitterStatistics GetStatistics() const;
+
+private:
+    AudioBufferPool<AudioStreamPacket>& pool_;
+    std::vector<std::unique_ptr<AudioStreamPacket>> slots_;
+    size_t count_ = 0;
+    bool playing_ = false;
+    uint32_t next_sequence_ = 0;
+    uint32_t last_sequence_ = 0;
+    int concealed_run_ = 0;
+    int frame_duration_ms_ = 60;
+    int64_t buffering_since_us_ = 0;
+
+    // Jitter estimate
+    uint32_t last_arrival_sequence_ = 0;
+    int64_t last_arrival_time_us_ = 0;
+    int64_t jitter_us_ = 0;
+    int target_depth_ = 1;
+    int64_t target_since_us_ = 0;   // Last time the jitter asked for the target depth or more
+
+    std::atomic<uint32_t> received_{0};
+    std::atomic<uint32_t> late_{0};
+    std::atomic<uint32_t> concealed_{0};
+    std::atomic<uint32_t> skipped_{0};
+    std::atomic<uint32_t> dropped_{0};
+    std::atomic<uint32_t> underruns_{0};
+    std::atomic<uint32_t> depth_{0};
+    std::atomic<uint32_t> target_depth_stat_{1};
+    std::atomic<uint32_t> jitter_ms_{0};
+
+    std::unique_ptr<AudioStreamPacket>& Slot(uint32_t sequence) {
+        return slots_[sequence & (AUDIO_JITTER_BUFFER_CAPACITY - 1)];
+    }
+    const std::unique_ptr<AudioStreamPacket>& Slot(uint32_t sequence) const {
+        return slots_[sequence & (AUDIO_JITTER_BUFFER_CAPACITY - 1)];
+    }
+    void UpdateJitter(uint32_t sequence, int64_t arrival_time_us);
+    void TakeSlot(uint32_t sequence, std::unique_ptr<AudioStreamPacket>& packet);
+};
+
+#endif // AUDIO_JITTER_BUFFER_H
@@ -0,0 +1,120 @@
+#include "audio_metrics.h"
+
+#include <esp_timer.h>
+#include <algorithm>
+
+#define AUDIO_METRICS_WINDOW_MS (AUDIO_METRICS_WINDOW_SECONDS * 1000)
+
+static const char* const kStageNames[kAudioStageCount] = {
+    "i2s_read", "afe_feed", "afe_fetch", "encode", "send", "receive", "decode", "resample", "i2s_write"
+};
+
+const char* AudioMetrics::GetStageName(AudioStage stage) {
+    return kStageNames[stage];
+}
+
+int AudioMetrics::GetBucket(uint32_t duration_us) {
+    if (duration_us < AUDIO_METRICS_MIN_BUCKET_US) {
+        return 0;
+    }
+    /* Two buckets per octave: the bit below the most significant one picks the half */
+    int msb = 31 - __builtin_clz(duration_us);
+    int octave = msb - __builtin_ctz(AUDIO_METRICS_MIN_BUCKET_US);
+    int half = (duration_us >> (msb - 1)) & 1;
+    return std::min(1 + octave * 2 + half, AUDIO_METRICS_BUCKETS - 1);
+}
+
+uint32_t AudioMetrics::GetBucketUpperBound(int bucket) {
+    if (bucket == 0) {
+        return AUDIO_METRICS_MIN_BUCKET_US;
+    }
+    uint32_t lower = AUDIO_METRICS_MIN_BUCKET_US << ((bucket - 1) / 2);
+    return lower + ((bucket - 1) % 2 + 1) * (lower / 2);
+}
+
+void AudioMetrics::ResetWindow(Window& window) {
+    window.count.store(0, std::memory_order_relaxed);
+    window.sum_us.store(0, std::memory_order_relaxed);
+    window.max_us.store(0, std::memory_order_relaxed);
+    for (auto& bucket : window.buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void AudioMetrics::RotateWindow(uint32_t now_ms) {
+    uint32_t start_ms = window_start_ms_.load(std::memory_order_relaxed);
+    uint32_t elapsed_ms = now_ms - start_ms;
+    if (elapsed_ms < AUDIO_METRICS_WINDOW_MS) {
+        return;
+    }
+    /* Only the caller that moves the window start rotates, the others keep recording into the current window */
+    if (!window_start_ms_.compare_exchange_strong(start_ms, now_ms, std::memory_order_relaxed)) {
+        return;
+    }
+    int next = current_window_.load(std::memory_order_relaxed) ^ 1;
+    for (auto& window : windows_[next]) {
+        ResetWindow(window);
+    }
+    if (elapsed_ms >= 2 * AUDIO_METRICS_WINDOW_MS) {
+        /* Nothing was recorded for a whole window, the current one is stale as well */
+        for (auto& window : windows_[next ^ 1]) {
+            ResetWindow(window);
+        }
+    }
+    current_window_.store(next, std::memory_order_relaxed);
+}
+
+void AudioMetrics::Record(AudioStage stage, int64_t start_us) {
+    int64_t now_us = esp_timer_get_time();
+    uint32_t duration_us = (uint32_t)std::clamp<int64_t>(now_us - start_us, 0, UINT32_MAX);
+    uint32_t now_ms = now_us / 1000;
+    if (now_ms - window_start_ms_.load(std::memory_order_relaxed) >= AUDIO_METRICS_WINDOW_MS) {
+        RotateWindow(now_ms);
+    }
+
+    auto& window = windows_[current_window_.load(std::memory_order_relaxed)][stage];
+    window.count.fetch_add(1, std::memory_order_relaxed);
+    window.sum_us.fetch_add(duration_us, std::memory_order_relaxed);
+    window.buckets[GetBucket(duration_us)].fetch_add(1, std::memory_order_relaxed);
+    uint32_t max_us = window.max_us.load(std::memory_order_relaxed);
+    while (duration_us > max_us && !window.max_us.compare_exchange_weak(max_us, duration_us, std::memory_order_relaxed)) {
+    }
+}
+
+AudioStageStatistics AudioMetrics::GetStageStatistics(AudioStage stage) {
+    RotateWindow(esp_timer_get_time() / 1000);
+
+    uint32_t buckets[AUDIO_METRICS_BUCKETS] = {0};
+    uint64_t sum_us = 0;
+    AudioStageStatistics stats;
+    for (auto& windows : windows_) {
+        auto& window = windows[stage];
+        stats.count += window.count.load(std::memory_order_relaxed);
+        sum_us += window.sum_us.load(std::memory_order_relaxed);
+        stats.max_us = std::max(stats.max_us, window.max_us.load(std::memory_order_relaxed));
+        for (int i = 0; i < AUDIO_METRICS_BUCKETS; i++) {
+            buckets[i] += window.buckets[i].load(std::memory_order_relaxed);
+        }
+    }
+    if (stats.count == 0) {
+        return stats;
+    }
+    stats.avg_us = sum_us / stats.count;
+
+    /* Report the upper bound of the bucket, but never more than the largest sample */
+    auto percentile = [&](int percent) -> uint32_t {
+        uint32_t target = ((uint64_t)stats.count * percent + 99) / 100;
+        uint32_t accumulated = 0;
+        for (int i = 0; i < AUDIO_METRICS_BUCKETS; i++) {
+            accumulated += buckets[i];
+            if (accumulated >= target) {
+                return std::min(GetBucketUpperBound(i), stats.max_us);
+            }
+        }
+        return stats.max_us;
+    };
+    stats.p50_us = percentile(50);
+    stats.p95_us = percentile(95);
+    stats.p99_us = percentile(99);
+    return stats;
+}
@@ -0,0 +1,75 @@
+#ifndef AUDIO_METRICS_H
+#define AUDIO_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Per-stage timing of the AudioService pipeline, cheap enough to stay enabled in the field.
+ *
+ * Every stage keeps a histogram with two buckets per octave (64 us to ~2 s), so the percentiles are
+ * within 25% of the real value. Record() only does a few relaxed atomic adds and may be called from
+ * any task.
+ *
+ * Samples go into the current window, and a new window starts every AUDIO_METRICS_WINDOW_SECONDS.
+ * The statistics cover the current and the previous window, so they always describe the last
+ * AUDIO_METRICS_WINDOW_SECONDS to 2 * AUDIO_METRICS_WINDOW_SECONDS of audio.
+ */
+
+#define AUDIO_METRICS_WINDOW_SECONDS 30
+#define AUDIO_METRICS_BUCKETS 32
+#define AUDIO_METRICS_MIN_BUCKET_US 64
+
+enum AudioStage {
+    kAudioStageI2sRead,     // Codec input, including the wait for the DMA buffer
+    kAudioStageAfeFeed,     // Feeding the wake word / audio processor
+    kAudioStageAfeFetch,    // From the last codec read until the audio processor outputs a frame
+    kAudioStageEncode,
+    kAudioStageSend,        // From the encoder output until the protocol has sent the packet
+    kAudioStageReceive,     // From the arrival of a packet until the decoder takes it (decode queue and jitter buffer)
+    kAudioStageDecode,
+    kAudioStageResample,    // Input and output sample rate conversion
+    kAudioStageI2sWrite,    // Codec output, including the wait for the DMA buffer
+    kAudioStageCount,
+};
+
+struct AudioStageStatistics {
+    uint32_t count = 0;
+    uint32_t avg_us = 0;
+    uint32_t max_us = 0;
+    uint32_t p50_us = 0;
+    uint32_t p95_us = 0;
+    uint32_t p99_us = 0;
+};
+
+class AudioMetrics {
+public:
+    AudioMetrics() = default;
+    AudioMetrics(const AudioMetrics&) = delete;
+    AudioMetrics& operator=(const AudioMetrics&) = delete;
+
+    /* Records the time from start_us (esp_timer_get_time) until now */
+    void Record(AudioStage stage, int64_t start_us);
+    AudioStageStatistics GetStageStatistics(AudioStage stage);
+    static const char* GetStageName(AudioStage stage);
+
+private:
+    struct Window {
+        std::atomic<uint32_t> count{0};
+        std::atomic<uint32_t> sum_us{0};
+        std::atomic<uint32_t> max_us{0};
+        std::atomic<uint32_t> buckets[AUDIO_METRICS_BUCKETS] = {};
+    };
+
+    Window windows_[2][kAudioStageCount];
+    std::atomic<int> current_window_{0};
+    std::atomic<uint32_t> window_start_ms_{0};
+
+    void RotateWindow(uint32_t now_ms);
+    static void ResetWindow(Window& window);
+    static int GetBucket(uint32_t duration_us);
+    static uint32_t GetBucketUpperBound(int bucket);
+};
+
+#endif // AUDIO_METRICS_H
@@ -1,6 +1,9 @@
 #include "audio_service.h"
+#include "audio_dsp.h"
 #include <esp_log.h>
+#include <cJSON.h>
 #include <cstring>
+#include <algorithm>
 
 #define RATE_CVT_CFG(_src_rate, _dest_rate, _channel)        \
     (esp_ae_rate_cvt_cfg_t)                                  \
@@ -57,6 +60,10 @@ AudioService::~AudioService() {
     if (output_resampler_ != nullptr) {
         esp_ae_rate_cvt_close(output_resampler_);
     }
+    if (audio_benchmark_timer_ != nullptr) {
+        esp_timer_stop(audio_benchmark_timer_);
+        esp_timer_delete(audio_benchmark_timer_);
+    }
 }
 
 void AudioService::Initialize(AudioCodec* codec) {
@@ -72,16 +79,10 @@ void AudioService::Initialize(AudioCodec* codec) {
         decoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
         decoder_frame_size_ = decoder_sample_rate_ / 1000 * OPUS_FRAME_DURATION_MS;
     }
-    esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG();
-    ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &opus_encoder_);
-    if (opus_encoder_ == nullptr) {
-        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
-    } else {
-        encoder_sample_rate_ = 16000;
-        encoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
-        esp_opus_enc_get_frame_size(opus_encoder_, &encoder_frame_size_, &encoder_outbuf_size_);
-        encoder_frame_size_ = encoder_frame_size_ / sizeof(int16_t);
-    }
+    encoder_params_.frame_duration_ms = OPUS_FRAME_DURATION_MS;
+    encoder_params_.bitrate = CONFIG_OPUS_BITRATE;
+    encoder_params_.complexity = CONFIG_OPUS_ENCODER_COMPLEXITY;
+    UpdateEncoder();
 
     if (codec->input_sample_rate() != 16000) {
         esp_ae_rate_cvt_cfg_t input_resampler_cfg = RATE_CVT_CFG(
@@ -99,6 +100,7 @@ void AudioService::Initialize(AudioCodec* codec) {
 #endif
 
     audio_processor_->OnOutput([this](std::vector<int16_t>&& data) {
+        audio_metrics_.Record(kAudioStageAfeFetch, last_input_time_us_);
         PushTaskToEncodeQueue(kAudioTaskTypeEncodeToSendQueue, std::move(data));
     });
 
@@ -120,11 +122,30 @@ void AudioService::Initialize(AudioCodec* codec) {
         .skip_unhandled_events = true,
     };
     esp_timer_create(&audio_power_timer_args, &audio_power_timer_);
+
+#if CONFIG_USE_AUDIO_BENCHMARK
+    audio_benchmark_ = std::make_unique<AudioBenchmark>();
+    esp_timer_create_args_t audio_benchmark_timer_args = {
+        .callback = [](void* arg) {
+            AudioService* audio_service = (AudioService*)arg;
+            audio_service->audio_benchmark_->PrintReport();
+            audio_service->PrintQueueStatistics();
+            audio_service->PrintPoolStatistics();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "audio_benchmark_timer",
+        .skip_unhandled_events = true,
+    };
+    esp_timer_create(&audio_benchmark_timer_args, &audio_benchmark_timer_);
+    esp_timer_start_periodic(audio_benchmark_timer_, CONFIG_AUDIO_BENCHMARK_REPORT_INTERVAL_SECONDS * 1000000LL);
+#endif
 }
 
 void AudioService::Start() {
     service_stopped_ = false;
-    xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING | AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING);
+    xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING | AS_EVENT_WAKE_WORD_RUNNING | AS_EVENT_AUDIO_PROCESSOR_RUNNING |
+        AS_EVENT_QUEUE_ALL);
 
     esp_timer_start_periodic(audio_power_timer_, 1000000);
 
@@ -164,6 +185,11 @@ void AudioService::Start() {
         audio_service->OpusCodecTask();
         vTaskDelete(NULL);
     }, "opus_codec", 2048 * 12, this, 2, &opus_codec_task_handle_);
+
+    /* The CPU usage window starts with the tasks */
+    std::lock_guard<std::mutex> lock(task_cpu_mutex_);
+    task_cpu_window_start_us_ = esp_timer_get_time();
+    std::fill(std::begin(task_cpu_window_start_), std::end(task_cpu_window_start_), 0);
 }
 
 void AudioService::Stop() {
@@ -173,12 +199,13 @@ void AudioService::Stop() {
         AS_EVENT_WAKE_WORD_RUNNING |
         AS_EVENT_AUDIO_PROCESSOR_RUNNING);
 
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    audio_encode_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    audio_encode_queue_.Clear();
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    jitter_buffer_reset_ = true;
+    ClearPrebuffer();
+    xEventGroupSetBits(event_group_, AS_EVENT_QUEUE_ALL);
 }
 
 bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples) {
@@ -190,10 +217,13 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
 
     if (codec_->input_sample_rate() != sample_rate) {
         data.resize(samples * codec_->input_sample_rate() / sample_rate * codec_->input_channels());
+        int64_t read_start_us = esp_timer_get_time();
         if (!codec_->InputData(data)) {
             return false;
         }
+        audio_metrics_.Record(kAudioStageI2sRead, read_start_us);
         if (input_resampler_ != nullptr) {
+            int64_t resample_start_us = esp_timer_get_time();
             std::lock_guard<std::mutex> lock(input_resampler_mutex_);
             uint32_t in_sample_num = data.size() / codec_->input_channels();
             uint32_t output_samples = 0;
@@ -204,16 +234,20 @@ bool AudioService::ReadAudioData(std::vector<int16_t>& data, int sample_rate, in
                                    (esp_ae_sample_t)resampled.data(), &actual_output);
             resampled.resize(actual_output * codec_->input_channels());
             data = std::move(resampled);
+            audio_metrics_.Record(kAudioStageResample, resample_start_us);
         }
     } else {
         data.resize(samples * codec_->input_channels());
+        int64_t read_start_us = esp_timer_get_time();
         if (!codec_->InputData(data)) {
             return false;
         }
+        audio_metrics_.Record(kAudioStageI2sRead, read_start_us);
     }
 
     /* Update the last input time */
     last_input_time_ = std::chrono::steady_clock::now();
+    last_input_time_us_ = esp_timer_get_time();
     debug_statistics_.input_count++;
 
 #if CONFIG_USE_AUDIO_DEBUGGER
@@ -244,21 +278,19 @@ void AudioService::AudioInputTask() {
 
         /* Used for audio testing in NetworkConfiguring mode by clicking the BOOT button */
         if (bits & AS_EVENT_AUDIO_TESTING_RUNNING) {
-            if (audio_testing_queue_.size() >= AUDIO_TESTING_MAX_DURATION_MS / OPUS_FRAME_DURATION_MS) {
+            int frame_duration_ms = GetEncoderParams().frame_duration_ms;
+            if (audio_testing_queue_.Size() >= AUDIO_TESTING_MAX_DURATION_MS / frame_duration_ms) {
                 ESP_LOGW(TAG, "Audio testing queue is full, stopping audio testing");
                 EnableAudioTesting(false);
                 continue;
             }
             std::vector<int16_t> data;
-            int samples = OPUS_FRAME_DURATION_MS * 16000 / 1000;
+            int samples = frame_duration_ms * 16000 / 1000;
             if (ReadAudioData(data, 16000, samples)) {
                 // If input channels is 2, we need to fetch the left channel data
                 if (codec_->input_channels() == 2) {
-                    auto mono_data = std::vector<int16_t>(data.size() / 2);
-                    for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                        mono_data[i] = data[j];
-                    }
-                    data = std::move(mono_data);
+                    AudioDspExtractChannel(data.data(), data.data(), data.size() / 2, 2);
+                    data.resize(data.size() / 2);
                 }
                 PushTaskToEncodeQueue(kAudioTaskTypeEncodeToTestingQueue, std::move(data));
                 continue;
@@ -271,7 +303,12 @@ void AudioService::AudioInputTask() {
             int samples = wake_word_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
+#if CONFIG_SEND_WAKE_WORD_DATA
+                    FeedWakeWordRing(data);
+#endif
+                    int64_t feed_start_us = esp_timer_get_time();
                     wake_word_->Feed(data);
+                    audio_metrics_.Record(kAudioStageAfeFeed, feed_start_us);
                     continue;
                 }
             }
@@ -279,11 +316,17 @@ void AudioService::AudioInputTask() {
 
         /* Feed the audio processor */
         if (bits & AS_EVENT_AUDIO_PROCESSOR_RUNNING) {
+            int frame_duration_ms = pending_processor_frame_duration_.exchange(0);
+            if (frame_duration_ms > 0) {
+                audio_processor_->SetFrameDuration(frame_duration_ms);
+            }
             std::vector<int16_t> data;
             int samples = audio_processor_->GetFeedSize();
             if (samples > 0) {
                 if (ReadAudioData(data, 16000, samples)) {
+                    int64_t feed_start_us = esp_timer_get_time();
                     audio_processor_->Feed(std::move(data));
+                    audio_metrics_.Record(kAudioStageAfeFeed, feed_start_us);
                     continue;
                 }
             }
@@ -298,161 +341,407 @@ void AudioService::AudioInputTask() {
 
 void AudioService::AudioOutputTask() {
     while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() { return !audio_playback_queue_.empty() || service_stopped_; });
+        std::unique_ptr<AudioTask> task;
+        bool starved = audio_playback_queue_.Empty();
+        while (!service_stopped_) {
+            bool discarded_any = false;
+            bool popped = audio_playback_queue_.Pop(task, [this, &discarded_any](std::unique_ptr<AudioTask>&& discarded) {
+                task_pool_.Release(std::move(discarded));
+                discarded_any = true;
+            });
+            // Signal every freed slot, a producer may have filled the ring since we last looked
+            if (popped || discarded_any) {
+                xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_NOT_FULL);
+            }
+            if (popped) {
+                break;
+            }
+            xEventGroupWaitBits(event_group_, AS_EVENT_PLAYBACK_NOT_EMPTY, pdTRUE, pdFALSE, portMAX_DELAY);
+            audio_output_wakeups_++;
+        }
         if (service_stopped_) {
             break;
         }
 
-        auto task = std::move(audio_playback_queue_.front());
-        audio_playback_queue_.pop_front();
-        audio_queue_cv_.notify_all();
-        lock.unlock();
-
         if (!codec_->output_enabled()) {
             esp_timer_stop(audio_power_timer_);
             esp_timer_start_periodic(audio_power_timer_, AUDIO_POWER_CHECK_INTERVAL_MS * 1000);
             codec_->EnableOutput(true);
         }
+        /* A gap inside a continuous stream means the decoder could not keep up */
+        if (audio_benchmark_ && starved) {
+            auto gap = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - last_output_time_).count();
+            if (gap < AUDIO_UNDERRUN_GAP_MS) {
+                audio_benchmark_->RecordUnderrun();
+            }
+        }
+        int64_t write_start_us = esp_timer_get_time();
         codec_->OutputData(task->pcm);
+        audio_metrics_.Record(kAudioStageI2sWrite, write_start_us);
+        /* Concealed frames carry no enqueue time, only a decoded packet ends the wait */
+        if (task->enqueue_time_us > 0) {
+            RecordResponseLatency();
+        }
 
         /* Update the last output time */
         last_output_time_ = std::chrono::steady_clock::now();
         debug_statistics_.playback_count++;
+        if (audio_benchmark_ && task->enqueue_time_us > 0) {
+            audio_benchmark_->RecordDownlinkLatency(decoder_duration_ms_, esp_timer_get_time() - task->enqueue_time_us);
+        }
 
 #if CONFIG_USE_SERVER_AEC
         /* Record the timestamp for server AEC */
         if (task->timestamp > 0) {
-            lock.lock();
-            timestamp_queue_.push_back(task->timestamp);
+            timestamp_queue_.Push(uint32_t(task->timestamp));
         }
 #endif
+        task_pool_.Release(std::move(task));
     }
 
     ESP_LOGW(TAG, "Audio output task stopped");
 }
 
 void AudioService::OpusCodecTask() {
-    while (true) {
-        std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-        audio_queue_cv_.wait(lock, [this]() {
-            return service_stopped_ ||
-                (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) ||
-                (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE);
-        });
-        if (service_stopped_) {
-            break;
-        }
+    bool woken_up = false;
+    while (!service_stopped_) {
+        bool busy = false;
 
-        /* Decode the audio from decode queue */
-        if (!audio_decode_queue_.empty() && audio_playback_queue_.size() < MAX_PLAYBACK_TASKS_IN_QUEUE) {
-            auto packet = std::move(audio_decode_queue_.front());
-            audio_decode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto task = std::make_unique<AudioTask>();
-            task->type = kAudioTaskTypeDecodeToPlaybackQueue;
-            task->timestamp = packet->timestamp;
-
-            SetDecodeSampleRate(packet->sample_rate, packet->frame_duration);
-            if (opus_decoder_ != nullptr) {
-                task->pcm.resize(decoder_frame_size_);
-                esp_audio_dec_in_raw_t raw = {
-                    .buffer = (uint8_t *)(packet->payload.data()),
-                    .len = (uint32_t)(packet->payload.size()),
-                    .consumed = 0,
-                    .frame_recover = ESP_AUDIO_DEC_RECOVERY_NONE,
-                };
-                esp_audio_dec_out_frame_t out_frame = {
-                    .buffer = (uint8_t *)(task->pcm.data()),
-                    .len = (uint32_t)(task->pcm.size() * sizeof(int16_t)),
-                    .decoded_size = 0,
-                };
-                esp_audio_dec_info_t dec_info = {};
-                std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
-                auto ret = esp_opus_dec_decode(opus_decoder_, &raw, &out_frame, &dec_info);
-                decoder_lock.unlock();
-                if (ret == ESP_AUDIO_ERR_OK) {
-                    task->pcm.resize(out_frame.decoded_size / sizeof(int16_t));
-                    if (decoder_sample_rate_ != codec_->output_sample_rate() && output_resampler_ != nullptr) {
-                        uint32_t target_size = 0;
-                        esp_ae_rate_cvt_get_max_out_sample_num(output_resampler_, task->pcm.size(), &target_size);
-                        std::vector<int16_t> resampled(target_size);
-                        uint32_t actual_output = target_size;
-                        esp_ae_rate_cvt_process(output_resampler_, (esp_ae_sample_t)task->pcm.data(), task->pcm.size(),
-                                                (esp_ae_sample_t)resampled.data(), &actual_output);
-                        resampled.resize(actual_output);
-                        task->pcm = std::move(resampled);
-                    }
-                    lock.lock();
-                    audio_playback_queue_.push_back(std::move(task));
-                    audio_queue_cv_.notify_all();
-                    debug_statistics_.decode_count++;
-                } else {
-                    ESP_LOGE(TAG, "Failed to decode audio after resize, error code: %d", ret);
-                    lock.lock();
+        /* Decode the audio from decode queue, through the jitter buffer */
+        if (jitter_buffer_reset_.exchange(false)) {
+            jitter_buffer_.Clear();
+        }
+        if (!audio_playback_queue_.Full()) {
+            std::unique_ptr<AudioStreamPacket> packet;
+            while (!jitter_buffer_.Full() && PopPacketToDecode(packet)) {
+                jitter_buffer_.Push(std::move(packet));
+            }
+            switch (jitter_buffer_.Pop(packet, esp_timer_get_time())) {
+            case kAudioJitterPacket:
+                if (packet->enqueue_time_us > 0) {
+                    audio_metrics_.Record(kAudioStageReceive, packet->enqueue_time_us);
                 }
-            } else {
-                ESP_LOGE(TAG, "Audio decoder is not configured");
-                lock.lock();
+                DecodePacket(*packet);
+                packet_pool_.Release(std::move(packet));
+                busy = true;
+                break;
+            case kAudioJitterLost:
+                DecodeLostFrame();
+                busy = true;
+                break;
+            default:
+                break;
             }
-            debug_statistics_.decode_count++;
         }
+
         /* Encode the audio to send queue */
-        if (!audio_encode_queue_.empty() && audio_send_queue_.size() < MAX_SEND_PACKETS_IN_QUEUE) {
-            auto task = std::move(audio_encode_queue_.front());
-            audio_encode_queue_.pop_front();
-            audio_queue_cv_.notify_all();
-            lock.unlock();
-
-            auto packet = std::make_unique<AudioStreamPacket>();
-            packet->frame_duration = OPUS_FRAME_DURATION_MS;
-            packet->sample_rate = 16000;
-            packet->timestamp = task->timestamp;
-
-            if (opus_encoder_ != nullptr && task->pcm.size() == encoder_frame_size_) {
-                std::vector<uint8_t> buf(encoder_outbuf_size_);
-                esp_audio_enc_in_frame_t in = {
-                    .buffer = (uint8_t *)(task->pcm.data()),
-                    .len = (uint32_t)(encoder_frame_size_ * sizeof(int16_t)),
-                };
-                esp_audio_enc_out_frame_t out = {
-                    .buffer = buf.data(),
-                    .len = (uint32_t)encoder_outbuf_size_,
-                    .encoded_bytes = 0,
-                };
-                auto ret = esp_opus_enc_process(opus_encoder_, &in, &out);
-                if (ret == ESP_AUDIO_ERR_OK) {
-                    packet->payload.assign(buf.data(), buf.data() + out.encoded_bytes);
-
-                    if (task->type == kAudioTaskTypeEncodeToSendQueue) {
-                        {
-                            std::lock_guard<std::mutex> lock2(audio_queue_mutex_);
-                            audio_send_queue_.push_back(std::move(packet));
-                        }
-                        if (callbacks_.on_send_queue_available) {
-                            callbacks_.on_send_queue_available();
-                        }
-                    } else if (task->type == kAudioTaskTypeEncodeToTestingQueue) {
-                        std::lock_guard<std::mutex> lock2(audio_queue_mutex_);
-                        audio_testing_queue_.push_back(std::move(packet));
-                    }
-                    debug_statistics_.encode_count++;
-                } else {
-                    ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
-                }
-            } else {
-                ESP_LOGE(TAG, "Failed to encode audio: encoder not configured or invalid frame size (got %u, expected %u)",
-                         task->pcm.size(), encoder_frame_size_);
+        if (!audio_send_queue_.Full()) {
+            std::unique_ptr<AudioTask> task;
+            bool discarded_any = false;
+            bool popped = audio_encode_queue_.Pop(task, [this, &discarded_any](std::unique_ptr<AudioTask>&& discarded) {
+                task_pool_.Release(std::move(discarded));
+                discarded_any = true;
+            });
+            if (popped || discarded_any) {
+                xEventGroupSetBits(event_group_, AS_EVENT_ENCODE_NOT_FULL);
+            }
+            if (popped) {
+                EncodeTask(*task);
+                task_pool_.Release(std::move(task));
+                busy = true;
             }
-            lock.lock();
         }
+
+        if (busy) {
+            woken_up = false;
+            continue;
+        }
+        if (woken_up) {
+            opus_codec_idle_wakeups_++;
+        }
+        /* Wake up when the jitter buffer is ready to start playing, even if no more packets arrive */
+        int64_t jitter_wait_us = jitter_buffer_.GetWaitTime(esp_timer_get_time());
+        TickType_t timeout = jitter_wait_us > 0 ? pdMS_TO_TICKS(jitter_wait_us / 1000) + 1 : portMAX_DELAY;
+        xEventGroupWaitBits(event_group_, AS_EVENT_ENCODE_NOT_EMPTY | AS_EVENT_DECODE_NOT_EMPTY |
+            AS_EVENT_SEND_NOT_FULL | AS_EVENT_PLAYBACK_NOT_FULL, pdTRUE, pdFALSE, timeout);
+        opus_codec_wakeups_++;
+        woken_up = true;
     }
 
     ESP_LOGW(TAG, "Opus codec task stopped");
 }
 
+bool AudioService::PopPacketToDecode(std::unique_ptr<AudioStreamPacket>& packet) {
+    bool discarded_any = false;
+    auto release = [this, &discarded_any](std::unique_ptr<AudioStreamPacket>&& discarded) {
+        packet_pool_.Release(std::move(discarded));
+        discarded_any = true;
+    };
+    bool popped = audio_decode_queue_.Pop(packet, release);
+    if (popped || discarded_any) {
+        xEventGroupSetBits(event_group_, AS_EVENT_DECODE_NOT_FULL);
+    }
+    if (popped) {
+        return true;
+    }
+
+    /* Play back the recorded audio once audio testing is stopped */
+    if (!(xEventGroupGetBits(event_group_) & AS_EVENT_AUDIO_TESTING_RUNNING)) {
+        return audio_testing_queue_.Pop(packet, release);
+    }
+    return false;
+}
+
+bool AudioService::DecodePacket(const AudioStreamPacket& packet, esp_audio_dec_recovery_t recovery) {
+    debug_statistics_.decode_count++;
+
+    SetDecodeSampleRate(packet.sample_rate, packet.frame_duration);
+    if (opus_decoder_ == nullptr) {
+        ESP_LOGE(TAG, "Audio decoder is not configured");
+        return false;
+    }
+
+    auto task = task_pool_.Acquire();
+    task->type = kAudioTaskTypeDecodeToPlaybackQueue;
+    task->timestamp = packet.timestamp;
+    task->enqueue_time_us = packet.enqueue_time_us;
+    if (recovery != ESP_AUDIO_DEC_RECOVERY_NONE) {
+        /* A concealed frame takes the place of a packet that never arrived */
+        task->timestamp = 0;
+        task->enqueue_time_us = 0;
+    }
+
+    /* Decode straight into the task unless the output has to be resampled */
+    bool resample = decoder_sample_rate_ != codec_->output_sample_rate() && output_resampler_ != nullptr;
+    auto& pcm = resample ? decode_buffer_ : task->pcm;
+    pcm.resize(decoder_frame_size_);
+    esp_audio_dec_in_raw_t raw = {
+        .buffer = (uint8_t *)(packet.opus_data()),
+        .len = (uint32_t)(packet.opus_size()),
+        .consumed = 0,
+        .frame_recover = recovery,
+    };
+    esp_audio_dec_out_frame_t out_frame = {
+        .buffer = (uint8_t *)(pcm.data()),
+        .len = (uint32_t)(pcm.size() * sizeof(int16_t)),
+        .decoded_size = 0,
+    };
+    esp_audio_dec_info_t dec_info = {};
+    int64_t decode_start_us = esp_timer_get_time();
+    std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
+    auto ret = esp_opus_dec_decode(opus_decoder_, &raw, &out_frame, &dec_info);
+    decoder_lock.unlock();
+    audio_metrics_.Record(kAudioStageDecode, decode_start_us);
+    if (ret != ESP_AUDIO_ERR_OK) {
+        ESP_LOGE(TAG, "Failed to decode audio after resize, error code: %d", ret);
+        task_pool_.Release(std::move(task));
+        return false;
+    }
+
+    pcm.resize(out_frame.decoded_size / sizeof(int16_t));
+    if (resample) {
+        int64_t resample_start_us = esp_timer_get_time();
+        uint32_t target_size = 0;
+        esp_ae_rate_cvt_get_max_out_sample_num(output_resampler_, pcm.size(), &target_size);
+        task->pcm.resize(target_size);
+        uint32_t actual_output = target_size;
+        esp_ae_rate_cvt_process(output_resampler_, (esp_ae_sample_t)pcm.data(), pcm.size(),
+                                (esp_ae_sample_t)task->pcm.data(), &actual_output);
+        task->pcm.resize(actual_output);
+        audio_metrics_.Record(kAudioStageResample, resample_start_us);
+    }
+
+    /* The opus codec task is the only producer, and it checked the queue is not full */
+    if (!audio_playback_queue_.Push(std::move(task))) {
+        ESP_LOGW(TAG, "Playback queue is full, dropping decoded audio");
+        task_pool_.Release(std::move(task));
+        return false;
+    }
+    xEventGroupSetBits(event_group_, AS_EVENT_PLAYBACK_NOT_EMPTY);
+    if (audio_benchmark_) {
+        audio_benchmark_->RecordQueueDepth(kAudioBenchmarkQueuePlayback, audio_playback_queue_.Size());
+    }
+    return true;
+}
+
+void AudioService::DecodeLostFrame() {
+    /* Opus FEC recovers the lost frame from the next packet if it has arrived, PLC extrapolates it otherwise */
+    auto next = jitter_buffer_.Peek();
+    if (next != nullptr) {
+        DecodePacket(*next, ESP_AUDIO_DEC_RECOVERY_FEC);
+    } else {
+        AudioStreamPacket packet;
+        packet.sample_rate = decoder_sample_rate_;
+        packet.frame_duration = decoder_duration_ms_;
+        DecodePacket(packet, ESP_AUDIO_DEC_RECOVERY_PLC);
+    }
+}
+
+void AudioService::EncodeTask(const AudioTask& task) {
+    if (encoder_params_changed_) {
+        /* A new session starts from the negotiated parameters */
+        adaptive_level_ = 0;
+        UpdateEncoder();
+    }
+    if (opus_encoder_ == nullptr || task.pcm.size() != encoder_frame_size_) {
+        ESP_LOGE(TAG, "Failed to encode audio: encoder not configured or invalid frame size (got %u, expected %u)",
+                 task.pcm.size(), encoder_frame_size_);
+        return;
+    }
+
+    auto packet = AcquirePacket();
+    packet->frame_duration = encoder_duration_ms_;
+    packet->sample_rate = 16000;
+    packet->timestamp = task.timestamp;
+
+    /* Encode straight into the payload, after the room reserved for the protocol header.
+     * A recycled packet already has the capacity */
+    packet->header_size = uplink_header_size_;
+    packet->payload.resize(packet->header_size + encoder_outbuf_size_);
+    esp_audio_enc_in_frame_t in = {
+        .buffer = (uint8_t *)(task.pcm.data()),
+        .len = (uint32_t)(encoder_frame_size_ * sizeof(int16_t)),
+    };
+    esp_audio_enc_out_frame_t out = {
+        .buffer = packet->opus_data(),
+        .len = (uint32_t)encoder_outbuf_size_,
+        .encoded_bytes = 0,
+    };
+    int64_t encode_start_us = esp_timer_get_time();
+    auto ret = esp_opus_enc_process(opus_encoder_, &in, &out);
+    audio_metrics_.Record(kAudioStageEncode, encode_start_us);
+    if (ret != ESP_AUDIO_ERR_OK) {
+        ESP_LOGE(TAG, "Failed to encode audio, error code: %d", ret);
+        packet_pool_.Release(std::move(packet));
+        return;
+    }
+    packet->payload.resize(packet->header_size + out.encoded_bytes);
+    debug_statistics_.encode_count++;
+
+    if (task.type == kAudioTaskTypeEncodeToSendQueue) {
+        /* The send stage starts here, see ReportPacketSent() */
+        packet->enqueue_time_us = esp_timer_get_time();
+        if (!audio_send_queue_.Push(std::move(packet))) {
+            ESP_LOGW(TAG, "Send queue is full, dropping encoded audio");
+            packet_pool_.Release(std::move(packet));
+            return;
+        }
+        if (audio_benchmark_) {
+            audio_benchmark_->RecordQueueDepth(kAudioBenchmarkQueueSend, audio_send_queue_.Size());
+            audio_benchmark_->RecordUplinkLatency(encoder_duration_ms_, esp_timer_get_time() - task.enqueue_time_us);
+        }
+        if (callbacks_.on_send_queue_available) {
+            callbacks_.on_send_queue_available();
+        }
+        CheckUplinkCongestion();
+    } else if (task.type == kAudioTaskTypeEncodeToWakeWordRing) {
+        PushPacketToWakeWordRing(std::move(packet));
+    } else if (task.type == kAudioTaskTypeEncodeToTestingQueue) {
+        if (!audio_testing_queue_.Push(std::move(packet))) {
+            ESP_LOGW(TAG, "Audio testing queue is full, dropping encoded audio");
+            packet_pool_.Release(std::move(packet));
+        }
+    }
+}
+
+void AudioService::UpdateEncoder() {
+    AudioEncoderParams params;
+    {
+        std::lock_guard<std::mutex> lock(encoder_params_mutex_);
+        params = encoder_params_;
+        encoder_params_changed_ = false;
+    }
+    if (adaptive_level_ > 0) {
+        int bitrate = params.bitrate > 0 ? params.bitrate : OPUS_ADAPTIVE_AUTO_BITRATE;
+        params.bitrate = std::max(bitrate >> adaptive_level_, OPUS_ADAPTIVE_MIN_BITRATE);
+        params.complexity >>= adaptive_level_;
+    }
+    if (opus_encoder_ != nullptr && params.frame_duration_ms == encoder_duration_ms_ &&
+        params.bitrate == encoder_bitrate_ && params.complexity == encoder_complexity_) {
+        return;
+    }
+
+    if (opus_encoder_ != nullptr) {
+        esp_opus_enc_close(opus_encoder_);
+        opus_encoder_ = nullptr;
+    }
+    esp_opus_enc_config_t opus_enc_cfg = AS_OPUS_ENC_CONFIG_WITH(params.frame_duration_ms,
+        params.bitrate > 0 ? params.bitrate : ESP_OPUS_BITRATE_AUTO, params.complexity);
+    auto ret = esp_opus_enc_open(&opus_enc_cfg, sizeof(esp_opus_enc_config_t), &opus_encoder_);
+    if (opus_encoder_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to create audio encoder, error code: %d", ret);
+        return;
+    }
+    encoder_sample_rate_ = 16000;
+    encoder_duration_ms_ = params.frame_duration_ms;
+    encoder_bitrate_ = params.bitrate;
+    encoder_complexity_ = params.complexity;
+    esp_opus_enc_get_frame_size(opus_encoder_, &encoder_frame_size_, &encoder_outbuf_size_);
+    encoder_frame_size_ = encoder_frame_size_ / sizeof(int16_t);
+    ESP_LOGI(TAG, "Opus encoder: frame duration %d ms, bitrate %d, complexity %d",
+        encoder_duration_ms_, encoder_bitrate_, encoder_complexity_);
+}
+
+void AudioService::CheckUplinkCongestion() {
+#if CONFIG_USE_ADAPTIVE_OPUS_BITRATE
+    auto now = esp_timer_get_time();
+    bool congested = (int)audio_send_queue_.Size() * encoder_duration_ms_ >= OPUS_ADAPTIVE_BACKLOG_MS;
+    if (send_failures_.exchange(0) > 0) {
+        congested = true;
+    }
+    if (congested) {
+        last_congestion_time_us_ = now;
+    }
+    if (now - last_adaptive_change_time_us_ < OPUS_ADAPTIVE_STEP_INTERVAL_MS * 1000LL) {
+        return;
+    }
+
+    int level = adaptive_level_;
+    if (congested) {
+        level = std::min(level + 1, OPUS_ADAPTIVE_MAX_LEVEL);
+    } else if (now - last_congestion_time_us_ >= OPUS_ADAPTIVE_RECOVER_MS * 1000LL) {
+        level = std::max(level - 1, 0);
+    }
+    if (level != adaptive_level_) {
+        ESP_LOGI(TAG, "Uplink %s, adaptive level %d -> %d", congested ? "congested" : "recovered", adaptive_level_, level);
+        adaptive_level_ = level;
+        last_adaptive_change_time_us_ = now;
+        UpdateEncoder();
+    }
+#endif
+}
+
+void AudioService::SetEncoderParams(int frame_duration_ms, int bitrate) {
+    if (frame_duration_ms != 20 && frame_duration_ms != 40 && frame_duration_ms != 60) {
+        ESP_LOGW(TAG, "Unsupported uplink frame duration %d ms, using %d ms", frame_duration_ms, OPUS_FRAME_DURATION_MS);
+        frame_duration_ms = OPUS_FRAME_DURATION_MS;
+    }
+    if (bitrate < 0) {
+        bitrate = 0;
+    }
+    {
+        std::lock_guard<std::mutex> lock(encoder_params_mutex_);
+        if (encoder_params_.frame_duration_ms == frame_duration_ms && encoder_params_.bitrate == bitrate) {
+            return;
+        }
+        encoder_params_.frame_duration_ms = frame_duration_ms;
+        encoder_params_.bitrate = bitrate;
+    }
+    ESP_LOGI(TAG, "Uplink frame duration %d ms, bitrate %d", frame_duration_ms, bitrate);
+
+    /* The audio input task applies it to the processor before its next feed, it owns the processor */
+    pending_processor_frame_duration_ = frame_duration_ms;
+    /* Frames already queued have the old size, the opus codec task drops them and reopens the encoder */
+    audio_encode_queue_.Clear();
+    encoder_params_changed_ = true;
+    xEventGroupSetBits(event_group_, AS_EVENT_ENCODE_NOT_EMPTY);
+}
+
+AudioEncoderParams AudioService::GetEncoderParams() {
+    std::lock_guard<std::mutex> lock(encoder_params_mutex_);
+    return encoder_params_;
+}
+
 void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
     if (decoder_sample_rate_ == sample_rate && decoder_duration_ms_ == frame_duration) {
         return;
@@ -490,68 +779,261 @@ void AudioService::SetDecodeSampleRate(int sample_rate, int frame_duration) {
 }
 
 void AudioService::PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm) {
-    auto task = std::make_unique<AudioTask>();
+    auto task = task_pool_.Acquire();
     task->type = type;
-    task->pcm = std::move(pcm);
-    /* Push the task to the encode queue */
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
+    /* Swap instead of move, so the producer gets the pooled buffer back and can reuse its capacity */
+    task->pcm.swap(pcm);
+    task->timestamp = 0;
+    task->enqueue_time_us = last_input_time_us_;
 
     /* If the task is to send queue, we need to set the timestamp */
-    if (type == kAudioTaskTypeEncodeToSendQueue && !timestamp_queue_.empty()) {
-        if (timestamp_queue_.size() <= MAX_TIMESTAMPS_IN_QUEUE) {
-            task->timestamp = timestamp_queue_.front();
-        } else {
-            ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamp_queue_.size());
+    if (type == kAudioTaskTypeEncodeToSendQueue) {
+        size_t timestamps = timestamp_queue_.Size();
+        uint32_t timestamp = 0;
+        if (timestamp_queue_.Pop(timestamp)) {
+            if (timestamps <= MAX_TIMESTAMPS_IN_QUEUE) {
+                task->timestamp = timestamp;
+            } else {
+                ESP_LOGW(TAG, "Timestamp queue (%u) is full, dropping timestamp", timestamps);
+            }
         }
-        timestamp_queue_.pop_front();
     }
 
-    audio_queue_cv_.wait(lock, [this]() { return audio_encode_queue_.size() < MAX_ENCODE_TASKS_IN_QUEUE; });
-    audio_encode_queue_.push_back(std::move(task));
-    audio_queue_cv_.notify_all();
+    /* Push the task to the encode queue, wait until the opus codec task makes room */
+    while (true) {
+        {
+            // The AFE output callback and the audio input task both produce, the ring takes one at a time
+            std::lock_guard<std::mutex> lock(encode_producer_mutex_);
+            if (audio_encode_queue_.Push(std::move(task))) {
+                break;
+            }
+        }
+        if (service_stopped_) {
+            task_pool_.Release(std::move(task));
+            return;
+        }
+        producer_waits_++;
+        xEventGroupWaitBits(event_group_, AS_EVENT_ENCODE_NOT_FULL, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+    xEventGroupSetBits(event_group_, AS_EVENT_ENCODE_NOT_EMPTY);
+    if (audio_benchmark_) {
+        audio_benchmark_->RecordQueueDepth(kAudioBenchmarkQueueEncode, audio_encode_queue_.Size());
+    }
 }
 
 bool AudioService::PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
-    std::unique_lock<std::mutex> lock(audio_queue_mutex_);
-    if (audio_decode_queue_.size() >= MAX_DECODE_PACKETS_IN_QUEUE) {
-        if (wait) {
-            audio_queue_cv_.wait(lock, [this]() { return audio_decode_queue_.size() < MAX_DECODE_PACKETS_IN_QUEUE; });
-        } else {
+    packet->enqueue_time_us = esp_timer_get_time();
+    return EnqueueDecodePacket(std::move(packet), wait);
+}
+
+bool AudioService::EnqueueDecodePacket(std::unique_ptr<AudioStreamPacket> packet, bool wait) {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(decode_producer_mutex_, std::try_to_lock);
+            if (!lock.owns_lock()) {
+                decode_producer_contention_++;
+                lock.lock();
+            }
+            if (audio_decode_queue_.Push(std::move(packet))) {
+                break;
+            }
+        }
+        if (!wait || service_stopped_) {
+            if (audio_benchmark_) {
+                audio_benchmark_->RecordDrop(kAudioBenchmarkQueueDecode);
+            }
+            packet_pool_.Release(std::move(packet));
             return false;
         }
+        producer_waits_++;
+        xEventGroupWaitBits(event_group_, AS_EVENT_DECODE_NOT_FULL, pdTRUE, pdFALSE, portMAX_DELAY);
+    }
+    xEventGroupSetBits(event_group_, AS_EVENT_DECODE_NOT_EMPTY);
+    if (audio_benchmark_) {
+        audio_benchmark_->RecordQueueDepth(kAudioBenchmarkQueueDecode, audio_decode_queue_.Size());
     }
-    audio_decode_queue_.push_back(std::move(packet));
-    audio_queue_cv_.notify_all();
     return true;
 }
 
-std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    if (audio_send_queue_.empty()) {
-        return nullptr;
+void AudioService::PushPacketToPrebuffer(std::unique_ptr<AudioStreamPacket> packet, uint32_t turn) {
+    /* Keep the arrival time, so the jitter buffer sees the real packet spacing after the flush */
+    packet->enqueue_time_us = esp_timer_get_time();
+    std::lock_guard<std::mutex> lock(prebuffer_mutex_);
+    if (turn == prebuffer_released_turn_) {
+        EnqueueDecodePacket(std::move(packet), false);
+        return;
+    }
+    if (prebuffer_.size() >= AUDIO_PREBUFFER_MAX_PACKETS) {
+        packet_pool_.Release(std::move(prebuffer_.front().packet));
+        prebuffer_.pop_front();
+        std::lock_guard<std::mutex> statistics_lock(response_statistics_mutex_);
+        response_statistics_.prebuffer_dropped++;
     }
-    auto packet = std::move(audio_send_queue_.front());
-    audio_send_queue_.pop_front();
-    audio_queue_cv_.notify_all();
+    prebuffer_.push_back({turn, std::move(packet)});
+}
+
+void AudioService::FlushPrebuffer(uint32_t turn) {
+    std::lock_guard<std::mutex> lock(prebuffer_mutex_);
+    prebuffer_released_turn_ = turn;
+    uint32_t flushed = 0;
+    uint32_t dropped = 0;
+    for (auto& item : prebuffer_) {
+        if (item.turn == turn) {
+            EnqueueDecodePacket(std::move(item.packet), false);
+            flushed++;
+        } else {
+            packet_pool_.Release(std::move(item.packet));
+            dropped++;
+        }
+    }
+    prebuffer_.clear();
+    if (flushed > 0 || dropped > 0) {
+        ESP_LOGI(TAG, "Prebuffer flushed for turn %lu: %lu packets, %lu stale dropped",
+            (unsigned long)turn, (unsigned long)flushed, (unsigned long)dropped);
+    }
+    std::lock_guard<std::mutex> statistics_lock(response_statistics_mutex_);
+    response_statistics_.prebuffered += flushed;
+    response_statistics_.prebuffer_dropped += dropped;
+}
+
+void AudioService::ClearPrebuffer() {
+    std::lock_guard<std::mutex> lock(prebuffer_mutex_);
+    prebuffer_released_turn_ = 0;
+    for (auto& item : prebuffer_) {
+        packet_pool_.Release(std::move(item.packet));
+    }
+    prebuffer_.clear();
+    response_start_time_us_ = 0;
+}
+
+void AudioService::MarkResponseStart() {
+    response_start_time_us_ = esp_timer_get_time();
+}
+
+void AudioService::RecordResponseLatency() {
+    int64_t start_time_us = response_start_time_us_.exchange(0);
+    if (start_time_us == 0) {
+        return;
+    }
+    uint32_t latency_ms = (esp_timer_get_time() - start_time_us) / 1000;
+    ESP_LOGI(TAG, "Response latency: %lu ms from stt to the first sample", (unsigned long)latency_ms);
+
+    std::lock_guard<std::mutex> lock(response_statistics_mutex_);
+    auto& stats = response_statistics_;
+    if (stats.responses == 0 || latency_ms < stats.min_latency_ms) {
+        stats.min_latency_ms = latency_ms;
+    }
+    if (latency_ms > stats.max_latency_ms) {
+        stats.max_latency_ms = latency_ms;
+    }
+    stats.responses++;
+    stats.last_latency_ms = latency_ms;
+    response_latency_sum_ms_ += latency_ms;
+    stats.avg_latency_ms = response_latency_sum_ms_ / stats.responses;
+}
+
+AudioResponseStatistics AudioService::GetResponseStatistics() {
+    std::lock_guard<std::mutex> lock(response_statistics_mutex_);
+    return response_statistics_;
+}
+
+std::unique_ptr<AudioStreamPacket> AudioService::AcquirePacket() {
+    auto packet = packet_pool_.Acquire();
+    /* A recycled packet still carries the sequence, timing and header room of its last use */
+    packet->sequence = 0;
+    packet->header_size = 0;
+    packet->enqueue_time_us = 0;
     return packet;
 }
 
-void AudioService::EncodeWakeWord() {
-    if (wake_word_) {
-        wake_word_->EncodeWakeWordData();
+void AudioService::ReportPacketSent(const AudioStreamPacket& packet) {
+    if (packet.enqueue_time_us > 0) {
+        audio_metrics_.Record(kAudioStageSend, packet.enqueue_time_us);
     }
 }
 
+std::unique_ptr<AudioStreamPacket> AudioService::PopPacketFromSendQueue() {
+    std::unique_ptr<AudioStreamPacket> packet;
+    bool discarded_any = false;
+    bool popped = audio_send_queue_.Pop(packet, [this, &discarded_any](std::unique_ptr<AudioStreamPacket>&& discarded) {
+        packet_pool_.Release(std::move(discarded));
+        discarded_any = true;
+    });
+    if (popped || discarded_any) {
+        xEventGroupSetBits(event_group_, AS_EVENT_SEND_NOT_FULL);
+    }
+    return packet;
+}
+
+void AudioService::CaptureWakeWordAudio() {
+    wake_word_ring_frozen_ = true;
+}
+
 const std::string& AudioService::GetLastWakeWord() const {
     return wake_word_->GetLastDetectedWakeWord();
 }
 
 std::unique_ptr<AudioStreamPacket> AudioService::PopWakeWordPacket() {
-    auto packet = std::make_unique<AudioStreamPacket>();
-    if (wake_word_->GetWakeWordOpus(packet->payload)) {
-        return packet;
+    std::lock_guard<std::mutex> lock(wake_word_ring_mutex_);
+    if (wake_word_ring_count_ == 0) {
+        return nullptr;
     }
-    return nullptr;
+    auto packet = std::move(wake_word_ring_[wake_word_ring_head_]);
+    wake_word_ring_head_ = (wake_word_ring_head_ + 1) % wake_word_ring_.size();
+    wake_word_ring_count_--;
+    wake_word_ring_duration_ms_ -= packet->frame_duration;
+    return packet;
+}
+
+void AudioService::FeedWakeWordRing(const std::vector<int16_t>& data) {
+    if (wake_word_ring_frozen_) {
+        wake_word_pcm_.clear();
+        return;
+    }
+
+    /* Only the first channel, the others are references or extra microphones */
+    int channels = codec_->input_channels();
+    size_t frames = data.size() / channels;
+    size_t offset = wake_word_pcm_.size();
+    wake_word_pcm_.resize(offset + frames);
+    AudioDspExtractChannel(data.data(), wake_word_pcm_.data() + offset, frames, channels);
+
+    size_t frame_samples = GetEncoderParams().frame_duration_ms * 16000 / 1000;
+    while (wake_word_pcm_.size() >= frame_samples) {
+        wake_word_frame_.assign(wake_word_pcm_.begin(), wake_word_pcm_.begin() + frame_samples);
+        wake_word_pcm_.erase(wake_word_pcm_.begin(), wake_word_pcm_.begin() + frame_samples);
+        PushTaskToEncodeQueue(kAudioTaskTypeEncodeToWakeWordRing, std::move(wake_word_frame_));
+    }
+}
+
+void AudioService::PushPacketToWakeWordRing(std::unique_ptr<AudioStreamPacket> packet) {
+    std::lock_guard<std::mutex> lock(wake_word_ring_mutex_);
+    if (wake_word_ring_.empty()) {
+        wake_word_ring_.resize(WAKE_WORD_RING_CAPACITY);
+    }
+    /* Drop the oldest frames beyond the ring duration */
+    while (wake_word_ring_count_ > 0 && (wake_word_ring_count_ == wake_word_ring_.size() ||
+        wake_word_ring_duration_ms_ + packet->frame_duration > WAKE_WORD_RING_DURATION_MS)) {
+        auto& oldest = wake_word_ring_[wake_word_ring_head_];
+        wake_word_ring_duration_ms_ -= oldest->frame_duration;
+        packet_pool_.Release(std::move(oldest));
+        wake_word_ring_head_ = (wake_word_ring_head_ + 1) % wake_word_ring_.size();
+        wake_word_ring_count_--;
+    }
+    wake_word_ring_duration_ms_ += packet->frame_duration;
+    wake_word_ring_[(wake_word_ring_head_ + wake_word_ring_count_) % wake_word_ring_.size()] = std::move(packet);
+    wake_word_ring_count_++;
+}
+
+void AudioService::ClearWakeWordRing() {
+    std::lock_guard<std::mutex> lock(wake_word_ring_mutex_);
+    while (wake_word_ring_count_ > 0) {
+        packet_pool_.Release(std::move(wake_word_ring_[wake_word_ring_head_]));
+        wake_word_ring_head_ = (wake_word_ring_head_ + 1) % wake_word_ring_.size();
+        wake_word_ring_count_--;
+    }
+    wake_word_ring_head_ = 0;
+    wake_word_ring_duration_ms_ = 0;
 }
 
 void AudioService::EnableWakeWordDetection(bool enable) {
@@ -576,6 +1058,11 @@ void AudioService::EnableWakeWordDetection(bool enable) {
                 esp_ae_rate_cvt_reset(input_resampler_);
             }
         }
+#if CONFIG_SEND_WAKE_WORD_DATA
+        /* Start over, the ring may still hold the audio of the last wake word */
+        ClearWakeWordRing();
+        wake_word_ring_frozen_ = false;
+#endif
         wake_word_->Start();
         xEventGroupSetBits(event_group_, AS_EVENT_WAKE_WORD_RUNNING);
     } else {
@@ -588,7 +1075,7 @@ void AudioService::EnableVoiceProcessing(bool enable) {
     ESP_LOGD(TAG, "%s voice processing", enable ? "Enabling" : "Disabling");
     if (enable) {
         if (!audio_processor_initialized_) {
-            audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+            audio_processor_->Initialize(codec_, GetEncoderParams().frame_duration_ms, models_list_);
             audio_processor_initialized_ = true;
         }
 
@@ -617,17 +1104,15 @@ void AudioService::EnableAudioTesting(bool enable) {
         xEventGroupSetBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
     } else {
         xEventGroupClearBits(event_group_, AS_EVENT_AUDIO_TESTING_RUNNING);
-        /* Copy audio_testing_queue_ to audio_decode_queue_ */
-        std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-        audio_decode_queue_ = std::move(audio_testing_queue_);
-        audio_queue_cv_.notify_all();
+        /* The opus codec task plays back audio_testing_queue_ once testing is stopped */
+        xEventGroupSetBits(event_group_, AS_EVENT_DECODE_NOT_EMPTY);
     }
 }
 
 void AudioService::EnableDeviceAec(bool enable) {
     ESP_LOGI(TAG, "%s device AEC", enable ? "Enabling" : "Disabling");
     if (!audio_processor_initialized_) {
-        audio_processor_->Initialize(codec_, OPUS_FRAME_DURATION_MS, models_list_);
+        audio_processor_->Initialize(codec_, GetEncoderParams().frame_duration_ms, models_list_);
         audio_processor_initialized_ = true;
     }
 
@@ -723,11 +1208,11 @@ void AudioService::PlaySound(const std::string_view& ogg) {
             }
 
             // Audio packet (Opus)
-            auto packet = std::make_unique<AudioStreamPacket>();
+            auto packet = AcquirePacket();
             packet->sample_rate = sample_rate;
             packet->frame_duration = 60;
-            packet->payload.resize(pkt_len);
-            std::memcpy(packet->payload.data(), pkt_ptr, pkt_len);
+            packet->timestamp = 0;
+            packet->payload.assign(pkt_ptr, pkt_ptr + pkt_len);
             PushPacketToDecodeQueue(std::move(packet), true);
         }
 
@@ -736,22 +1221,23 @@ void AudioService::PlaySound(const std::string_view& ogg) {
 }
 
 bool AudioService::IsIdle() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
-    return audio_encode_queue_.empty() && audio_decode_queue_.empty() && audio_playback_queue_.empty() && audio_testing_queue_.empty();
+    return audio_encode_queue_.Empty() && audio_decode_queue_.Empty() && jitter_buffer_.Empty() &&
+        audio_playback_queue_.Empty() && audio_testing_queue_.Empty();
 }
 
 void AudioService::ResetDecoder() {
-    std::lock_guard<std::mutex> lock(audio_queue_mutex_);
     std::unique_lock<std::mutex> decoder_lock(decoder_mutex_);
     if (opus_decoder_ != nullptr) {
         esp_opus_dec_reset(opus_decoder_);
     }
     decoder_lock.unlock();
-    timestamp_queue_.clear();
-    audio_decode_queue_.clear();
-    audio_playback_queue_.clear();
-    audio_testing_queue_.clear();
-    audio_queue_cv_.notify_all();
+    timestamp_queue_.Clear();
+    audio_decode_queue_.Clear();
+    audio_playback_queue_.Clear();
+    audio_testing_queue_.Clear();
+    jitter_buffer_reset_ = true;
+    /* Wake up the consumers so they release the discarded items */
+    xEventGroupSetBits(event_group_, AS_EVENT_DECODE_NOT_EMPTY | AS_EVENT_PLAYBACK_NOT_EMPTY);
 }
 
 void AudioService::CheckAndUpdateAudioPowerState() {
@@ -790,6 +1276,8 @@ void AudioService::SetModelsList(srmodel_list_t* models_list) {
 
     if (wake_word_) {
         wake_word_->OnWakeWordDetected([this](const std::string& wake_word) {
+            /* Keep the audio up to the detection */
+            wake_word_ring_frozen_ = true;
             if (callbacks_.on_wake_word_detected) {
                 callbacks_.on_wake_word_detected(wake_word);
             }
@@ -804,3 +1292,214 @@ bool AudioService::IsAfeWakeWord() {
     return false;
 #endif
 }
+
+AudioQueueStatistics AudioService::GetQueueStatistics() const {
+    auto counters = [](const auto& queue) {
+        AudioQueueCounters counters;
+        counters.pushes = queue.push_count();
+        counters.rejected = queue.rejected_count();
+        counters.high_water_mark = queue.high_water_mark();
+        return counters;
+    };
+
+    AudioQueueStatistics stats;
+    stats.encode = counters(audio_encode_queue_);
+    stats.decode = counters(audio_decode_queue_);
+    stats.send = counters(audio_send_queue_);
+    stats.playback = counters(audio_playback_queue_);
+    stats.opus_codec_wakeups = opus_codec_wakeups_.load();
+    stats.opus_codec_idle_wakeups = opus_codec_idle_wakeups_.load();
+    stats.audio_output_wakeups = audio_output_wakeups_.load();
+    stats.producer_waits = producer_waits_.load();
+    stats.decode_producer_contention = decode_producer_contention_.load();
+    return stats;
+}
+
+void AudioService::PrintQueueStatistics() {
+    auto stats = GetQueueStatistics();
+    auto now = esp_timer_get_time();
+    if (last_queue_statistics_time_us_ > 0 && now > last_queue_statistics_time_us_) {
+        float seconds = (now - last_queue_statistics_time_us_) / 1000000.0f;
+        auto& last = last_queue_statistics_;
+        ESP_LOGI(TAG, "Wakeups/s: opus_codec %.1f (idle %.1f), audio_output %.1f; producer waits %lu, decode producer contention %lu",
+            (stats.opus_codec_wakeups - last.opus_codec_wakeups) / seconds,
+            (stats.opus_codec_idle_wakeups - last.opus_codec_idle_wakeups) / seconds,
+            (stats.audio_output_wakeups - last.audio_output_wakeups) / seconds,
+            stats.producer_waits - last.producer_waits,
+            stats.decode_producer_contention - last.decode_producer_contention);
+    }
+
+    const std::pair<const char*, AudioQueueCounters*> queues[] = {
+        {"encode", &stats.encode}, {"decode", &stats.decode}, {"send", &stats.send}, {"playback", &stats.playback}
+    };
+    for (auto& [name, counters] : queues) {
+        ESP_LOGI(TAG, "Queue %-8s pushes %lu rejected %lu hwm %lu", name,
+            counters->pushes, counters->rejected, counters->high_water_mark);
+    }
+
+    auto jitter = jitter_buffer_.GetStatistics();
+    ESP_LOGI(TAG, "Jitter buffer depth %lu target %lu jitter %lums, received %lu late %lu concealed %lu skipped %lu dropped %lu underruns %lu",
+        jitter.depth, jitter.target_depth, jitter.jitter_ms, jitter.received, jitter.late, jitter.concealed,
+        jitter.skipped, jitter.dropped, jitter.underruns);
+
+    auto response = GetResponseStatistics();
+    if (response.responses > 0) {
+        ESP_LOGI(TAG, "Response latency last %lums min %lums avg %lums max %lums over %lu replies, prebuffered %lu dropped %lu",
+            response.last_latency_ms, response.min_latency_ms, response.avg_latency_ms, response.max_latency_ms,
+            response.responses, response.prebuffered, response.prebuffer_dropped);
+    }
+    last_queue_statistics_ = stats;
+    last_queue_statistics_time_us_ = now;
+}
+
+AudioPoolStatistics AudioService::GetPoolStatistics() {
+    AudioPoolStatistics stats;
+    stats.packets = packet_pool_.GetStatistics();
+    stats.tasks = task_pool_.GetStatistics();
+    return stats;
+}
+
+void AudioService::PrintPoolStatistics() {
+    auto stats = GetPoolStatistics();
+    const std::pair<const char*, AudioBufferPoolStatistics*> pools[] = {
+        {"packet", &stats.packets}, {"task", &stats.tasks}
+    };
+    for (auto& [name, pool] : pools) {
+        ESP_LOGI(TAG, "Pool %-6s capacity %lu free %lu in use %lu hwm %lu misses %lu overflows %lu", name,
+            pool->capacity, pool->free, pool->in_use, pool->high_water_mark, pool->misses, pool->overflows);
+    }
+}
+
+std::string AudioService::GetMetricsJson() {
+    /*
+        {
+            "window": 30,
+            "stages": {
+                "i2s_read": {"n": 1500, "avg": 29500, "p50": 32768, "p95": 32768, "p99": 36000, "max": 36000},
+                ...
+            },
+            "frames": {"input": 12000, "encode": 800, "decode": 950, "playback": 950},
+            "queues": {"encode": {"hwm": 2, "rejected": 0}, ...},
+            "pools": {"packet": {"hwm": 30, "misses": 0}, "task": {"hwm": 6, "misses": 0}},
+            "jitter": {"depth": 3, "target": 2, "jitter_ms": 12, "concealed": 1, "skipped": 0, "late": 0, "underruns": 1},
+            "uplink": {"frame_duration": 60, "bitrate": 0, "send_failures": 0},
+            "response": {"count": 3, "last_ms": 900, "avg_ms": 1100, "max_ms": 1500},
+            "cpu": {"audio_input": 12, "audio_output": 3, "opus_codec": 25}
+        }
+        Stage times are in microseconds, CPU usage in percent of one core.
+    */
+    cJSON* root = cJSON_CreateObject();
+    cJSON_AddNumberToObject(root, "window", AUDIO_METRICS_WINDOW_SECONDS);
+
+    cJSON* stages = cJSON_CreateObject();
+    for (int i = 0; i < kAudioStageCount; i++) {
+        auto stats = audio_metrics_.GetStageStatistics((AudioStage)i);
+        cJSON* stage = cJSON_CreateObject();
+        cJSON_AddNumberToObject(stage, "n", stats.count);
+        cJSON_AddNumberToObject(stage, "avg", stats.avg_us);
+        cJSON_AddNumberToObject(stage, "p50", stats.p50_us);
+        cJSON_AddNumberToObject(stage, "p95", stats.p95_us);
+        cJSON_AddNumberToObject(stage, "p99", stats.p99_us);
+        cJSON_AddNumberToObject(stage, "max", stats.max_us);
+        cJSON_AddItemToObject(stages, AudioMetrics::GetStageName((AudioStage)i), stage);
+    }
+    cJSON_AddItemToObject(root, "stages", stages);
+
+    cJSON* frames = cJSON_CreateObject();
+    cJSON_AddNumberToObject(frames, "input", debug_statistics_.input_count);
+    cJSON_AddNumberToObject(frames, "encode", debug_statistics_.encode_count);
+    cJSON_AddNumberToObject(frames, "decode", debug_statistics_.decode_count);
+    cJSON_AddNumberToObject(frames, "playback", debug_statistics_.playback_count);
+    cJSON_AddItemToObject(root, "frames", frames);
+
+    auto queue_stats = GetQueueStatistics();
+    const std::pair<const char*, AudioQueueCounters*> queues[] = {
+        {"encode", &queue_stats.encode}, {"decode", &queue_stats.decode}, {"send", &queue_stats.send}, {"playback", &queue_stats.playback}
+    };
+    cJSON* queues_json = cJSON_CreateObject();
+    for (auto& [name, counters] : queues) {
+        cJSON* queue = cJSON_CreateObject();
+        cJSON_AddNumberToObject(queue, "hwm", counters->high_water_mark);
+        cJSON_AddNumberToObject(queue, "rejected", counters->rejected);
+        cJSON_AddItemToObject(queues_json, name, queue);
+    }
+    cJSON_AddItemToObject(root, "queues", queues_json);
+
+    auto pool_stats = GetPoolStatistics();
+    const std::pair<const char*, AudioBufferPoolStatistics*> pools[] = {
+        {"packet", &pool_stats.packets}, {"task", &pool_stats.tasks}
+    };
+    cJSON* pools_json = cJSON_CreateObject();
+    for (auto& [name, pool] : pools) {
+        cJSON* pool_json = cJSON_CreateObject();
+        cJSON_AddNumberToObject(pool_json, "hwm", pool->high_water_mark);
+        cJSON_AddNumberToObject(pool_json, "misses", pool->misses);
+        cJSON_AddItemToObject(pools_json, name, pool_json);
+    }
+    cJSON_AddItemToObject(root, "pools", pools_json);
+
+    auto jitter_stats = jitter_buffer_.GetStatistics();
+    cJSON* jitter = cJSON_CreateObject();
+    cJSON_AddNumberToObject(jitter, "depth", jitter_stats.depth);
+    cJSON_AddNumberToObject(jitter, "target", jitter_stats.target_depth);
+    cJSON_AddNumberToObject(jitter, "jitter_ms", jitter_stats.jitter_ms);
+    cJSON_AddNumberToObject(jitter, "concealed", jitter_stats.concealed);
+    cJSON_AddNumberToObject(jitter, "skipped", jitter_stats.skipped);
+    cJSON_AddNumberToObject(jitter, "late", jitter_stats.late);
+    cJSON_AddNumberToObject(jitter, "underruns", jitter_stats.underruns);
+    cJSON_AddItemToObject(root, "jitter", jitter);
+
+    auto encoder_params = GetEncoderParams();
+    cJSON* uplink = cJSON_CreateObject();
+    cJSON_AddNumberToObject(uplink, "frame_duration", encoder_params.frame_duration_ms);
+    cJSON_AddNumberToObject(uplink, "bitrate", encoder_params.bitrate);
+    cJSON_AddNumberToObject(uplink, "send_failures", send_failures_.load());
+    cJSON_AddItemToObject(root, "uplink", uplink);
+
+    auto response_stats = GetResponseStatistics();
+    cJSON* response = cJSON_CreateObject();
+    cJSON_AddNumberToObject(response, "count", response_stats.responses);
+    cJSON_AddNumberToObject(response, "last_ms", response_stats.last_latency_ms);
+    cJSON_AddNumberToObject(response, "avg_ms", response_stats.avg_latency_ms);
+    cJSON_AddNumberToObject(response, "max_ms", response_stats.max_latency_ms);
+    cJSON_AddItemToObject(root, "response", response);
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    /* The tasks are gone once the service is stopped */
+    if (!service_stopped_) {
+        const std::pair<const char*, TaskHandle_t> tasks[] = {
+            {"audio_input", audio_input_task_handle_},
+            {"audio_output", audio_output_task_handle_},
+            {"opus_codec", opus_codec_task_handle_},
+        };
+        std::lock_guard<std::mutex> lock(task_cpu_mutex_);
+        int64_t now = esp_timer_get_time();
+        int64_t elapsed_us = now - task_cpu_window_start_us_;
+        bool new_window = elapsed_us >= AUDIO_METRICS_WINDOW_SECONDS * 1000000LL;
+        /* Not read for a while: the usage would cover an unbounded period, and the counters may have wrapped
+           more than once, so only a new window starts */
+        bool stale = elapsed_us > 2 * AUDIO_METRICS_WINDOW_SECONDS * 1000000LL;
+        cJSON* cpu = cJSON_CreateObject();
+        for (size_t i = 0; i < sizeof(tasks) / sizeof(tasks[0]); i++) {
+            /* The run time counter counts microseconds and may wrap, only the difference is used */
+            uint32_t run_time = ulTaskGetRunTimeCounter(tasks[i].second);
+            if (elapsed_us > 0 && !stale) {
+                cJSON_AddNumberToObject(cpu, tasks[i].first, (uint64_t)(run_time - task_cpu_window_start_[i]) * 100 / elapsed_us);
+            }
+            if (new_window) {
+                task_cpu_window_start_[i] = run_time;
+            }
+        }
+        if (new_window) {
+            task_cpu_window_start_us_ = now;
+        }
+        cJSON_AddItemToObject(root, "cpu", cpu);
+    }
+#endif
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
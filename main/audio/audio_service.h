@@ -2,10 +2,10 @@
 #define AUDIO_SERVICE_H
 
 #include <memory>
-#include <deque>
-#include <condition_variable>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <deque>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
@@ -21,6 +21,11 @@
 #include "audio_codec.h"
 #include "audio_processor.h"
 #include "processors/audio_debugger.h"
+#include "audio_benchmark.h"
+#include "spsc_ring_buffer.h"
+#include "audio_buffer_pool.h"
+#include "audio_jitter_buffer.h"
+#include "audio_metrics.h"
 #include "wake_word.h"
 #include "protocol.h"
 
@@ -28,29 +33,91 @@
 /*
  * There are two types of audio data flow:
  * 1. (MIC) -> [Processors] -> {Encode Queue} -> [Opus Encoder] -> {Send Queue} -> (Server)
- * 2. (Server) -> {Decode Queue} -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
+ * 2. (Server) -> {Decode Queue} -> [Jitter Buffer] -> [Opus Decoder] -> {Playback Queue} -> (Speaker)
  *
  * We use one task for MIC / Speaker / Processors, and one task for Opus Encoder / Opus Decoder.
  * 
  * Decode Queue and Send Queue are the main queues, because Opus packets are quite smaller than PCM packets.
- * 
+ *
+ * Every queue is a lock-free single-producer / single-consumer ring with its own "not empty" and "not full"
+ * event bits, so a push only wakes up the task that consumes that queue.
+ * The decode queue has several producers (network, PlaySound), they are serialized by decode_producer_mutex_.
+ * The encode queue is fed by the audio input task and the AFE output callback, serialized by encode_producer_mutex_.
+ *
+ * Packets and tasks come from fixed-capacity pools and are released back to them once consumed,
+ * so the buffers they carry are reused instead of being allocated for every frame.
+ *
+ * While listening for the wake word, the microphone audio is also encoded into a ring of the last
+ * WAKE_WORD_RING_DURATION_MS: (MIC) -> {Encode Queue} -> [Opus Encoder] -> {Wake Word Ring}
+ * The ring stops taking frames at the detection, and its packets are sent to the server as they are.
+ *
+ * With low latency playback, downlink packets that arrive before the speaking state wait in the pre-buffer
+ * (Server) -> {Pre-buffer} -> {Decode Queue}, instead of being dropped.
  */
 
-#define OPUS_FRAME_DURATION_MS 60
+// Default uplink frame duration, the session may negotiate another one (see SetEncoderParams)
+#define OPUS_FRAME_DURATION_MS CONFIG_OPUS_FRAME_DURATION_MS
+#define OPUS_MIN_FRAME_DURATION_MS 20
+#define AUDIO_QUEUE_DURATION_MS 2400
 #define MAX_ENCODE_TASKS_IN_QUEUE 2
 #define MAX_PLAYBACK_TASKS_IN_QUEUE 2
-#define MAX_DECODE_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
-#define MAX_SEND_PACKETS_IN_QUEUE (2400 / OPUS_FRAME_DURATION_MS)
+#define MAX_DECODE_PACKETS_IN_QUEUE (AUDIO_QUEUE_DURATION_MS / OPUS_FRAME_DURATION_MS)
+// Uplink queues are sized for the shortest frame duration that can be negotiated
+#define MAX_SEND_PACKETS_IN_QUEUE (AUDIO_QUEUE_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS)
+#if CONFIG_USE_LOW_LATENCY_PLAYBACK
+// Downlink packets kept while waiting for the speaking state, the flush must fit in the decode queue
+#define AUDIO_PREBUFFER_MAX_PACKETS (MAX_DECODE_PACKETS_IN_QUEUE / 2)
+#else
+#define AUDIO_PREBUFFER_MAX_PACKETS 0
+#endif
+// Audio before the wake word detection, encoded while listening for the wake word
+#define WAKE_WORD_RING_DURATION_MS 2000
+#if CONFIG_SEND_WAKE_WORD_DATA
+#define WAKE_WORD_RING_CAPACITY (WAKE_WORD_RING_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS)
+#define WAKE_WORD_RING_POOL_PACKETS (WAKE_WORD_RING_DURATION_MS / OPUS_FRAME_DURATION_MS)
+#else
+#define WAKE_WORD_RING_CAPACITY 0
+#define WAKE_WORD_RING_POOL_PACKETS 0
+#endif
 #define AUDIO_TESTING_MAX_DURATION_MS 10000
 #define MAX_TIMESTAMPS_IN_QUEUE 3
+#define TIMESTAMP_QUEUE_CAPACITY 16
+// Objects held outside the queues at the same time (being received / decoded / encoded / sent)
+#define AUDIO_POOL_IN_FLIGHT 4
+// Shorter frames fall back to the heap only when the send queue backs up
+#define AUDIO_PACKET_POOL_SIZE (MAX_DECODE_PACKETS_IN_QUEUE + AUDIO_JITTER_BUFFER_CAPACITY + AUDIO_PREBUFFER_MAX_PACKETS + WAKE_WORD_RING_POOL_PACKETS + \
+                                AUDIO_QUEUE_DURATION_MS / OPUS_FRAME_DURATION_MS + AUDIO_POOL_IN_FLIGHT)
+#define AUDIO_TASK_POOL_SIZE (MAX_ENCODE_TASKS_IN_QUEUE + MAX_PLAYBACK_TASKS_IN_QUEUE + AUDIO_POOL_IN_FLIGHT)
 
 #define AUDIO_POWER_TIMEOUT_MS 15000
 #define AUDIO_POWER_CHECK_INTERVAL_MS 1000
+#define AUDIO_UNDERRUN_GAP_MS 1000
+
+// Adaptive uplink bitrate: step down when this much audio is waiting to be sent, or sending failed
+#define OPUS_ADAPTIVE_BACKLOG_MS 600
+#define OPUS_ADAPTIVE_STEP_INTERVAL_MS 2000
+// Step back up after the link has been healthy for this long
+#define OPUS_ADAPTIVE_RECOVER_MS 10000
+// Every level halves the bitrate and the complexity
+#define OPUS_ADAPTIVE_MAX_LEVEL 3
+#define OPUS_ADAPTIVE_MIN_BITRATE 6000
+// Assumed bitrate of ESP_OPUS_BITRATE_AUTO, the starting point when no bitrate is configured
+#define OPUS_ADAPTIVE_AUTO_BITRATE 32000
 
 #define AS_EVENT_AUDIO_TESTING_RUNNING      (1 << 0)
 #define AS_EVENT_WAKE_WORD_RUNNING          (1 << 1)
 #define AS_EVENT_AUDIO_PROCESSOR_RUNNING    (1 << 2)
 #define AS_EVENT_PLAYBACK_NOT_EMPTY         (1 << 3)
+#define AS_EVENT_PLAYBACK_NOT_FULL          (1 << 4)
+#define AS_EVENT_ENCODE_NOT_EMPTY           (1 << 5)
+#define AS_EVENT_ENCODE_NOT_FULL            (1 << 6)
+#define AS_EVENT_DECODE_NOT_EMPTY           (1 << 7)
+#define AS_EVENT_DECODE_NOT_FULL            (1 << 8)
+#define AS_EVENT_SEND_NOT_FULL              (1 << 9)
+#define AS_EVENT_QUEUE_ALL                  (AS_EVENT_PLAYBACK_NOT_EMPTY | AS_EVENT_PLAYBACK_NOT_FULL | \
+                                             AS_EVENT_ENCODE_NOT_EMPTY | AS_EVENT_ENCODE_NOT_FULL | \
+                                             AS_EVENT_DECODE_NOT_EMPTY | AS_EVENT_DECODE_NOT_FULL | \
+                                             AS_EVENT_SEND_NOT_FULL)
 
 #define AS_OPUS_GET_FRAME_DRU_ENUM(duration_ms)                   \
     ((duration_ms) == 5 ? ESP_OPUS_ENC_FRAME_DURATION_5_MS :      \
@@ -62,19 +129,21 @@
      (duration_ms) == 100 ? ESP_OPUS_ENC_FRAME_DURATION_100_MS :  \
      (duration_ms) == 120 ? ESP_OPUS_ENC_FRAME_DURATION_120_MS : -1)
 
-#define AS_OPUS_ENC_CONFIG() {                                                                                    \
+#define AS_OPUS_ENC_CONFIG_WITH(_frame_duration_ms, _bitrate, _complexity) {                                      \
         .sample_rate        = ESP_AUDIO_SAMPLE_RATE_16K,                                                          \
         .channel            = ESP_AUDIO_MONO,                                                                     \
         .bits_per_sample    = ESP_AUDIO_BIT16,                                                                    \
-        .bitrate            = ESP_OPUS_BITRATE_AUTO,                                                              \
-        .frame_duration     = (esp_opus_enc_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(OPUS_FRAME_DURATION_MS),  \
+        .bitrate            = (int)(_bitrate),                                                                    \
+        .frame_duration     = (esp_opus_enc_frame_duration_t)AS_OPUS_GET_FRAME_DRU_ENUM(_frame_duration_ms),      \
         .application_mode   = ESP_OPUS_ENC_APPLICATION_AUDIO,                                                     \
-        .complexity         = 0,                                                                                  \
+        .complexity         = (int)(_complexity),                                                                 \
         .enable_fec         = false,                                                                              \
         .enable_dtx         = true,                                                                               \
         .enable_vbr         = true,                                                                               \
     }
 
+#define AS_OPUS_ENC_CONFIG() AS_OPUS_ENC_CONFIG_WITH(OPUS_FRAME_DURATION_MS, ESP_OPUS_BITRATE_AUTO, 0)
+
 struct AudioServiceCallbacks {
     std::function<void(void)> on_send_queue_available;
     std::function<void(const std::string&)> on_wake_word_detected;
@@ -86,6 +155,7 @@ struct AudioServiceCallbacks {
 enum AudioTaskType {
     kAudioTaskTypeEncodeToSendQueue,
     kAudioTaskTypeEncodeToTestingQueue,
+    kAudioTaskTypeEncodeToWakeWordRing,
     kAudioTaskTypeDecodeToPlaybackQueue,
 };
 
@@ -93,6 +163,13 @@ struct AudioTask {
     AudioTaskType type;
     std::vector<int16_t> pcm;
     uint32_t timestamp;
+    int64_t enqueue_time_us = 0;
+};
+
+struct AudioEncoderParams {
+    int frame_duration_ms = OPUS_FRAME_DURATION_MS;
+    int bitrate = 0;        // 0 for auto
+    int complexity = 0;
 };
 
 struct DebugStatistics {
@@ -102,6 +179,39 @@ struct DebugStatistics {
     uint32_t playback_count = 0;
 };
 
+struct AudioQueueCounters {
+    uint32_t pushes = 0;
+    uint32_t rejected = 0;      // Push attempts on a full queue
+    uint32_t high_water_mark = 0;
+};
+
+struct AudioQueueStatistics {
+    AudioQueueCounters encode;
+    AudioQueueCounters decode;
+    AudioQueueCounters send;
+    AudioQueueCounters playback;
+    uint32_t opus_codec_wakeups = 0;
+    uint32_t opus_codec_idle_wakeups = 0;    // Woken up without any work to do
+    uint32_t audio_output_wakeups = 0;
+    uint32_t producer_waits = 0;             // Producers blocked on a full queue
+    uint32_t decode_producer_contention = 0; // Decode producers that found the producer lock taken
+};
+
+struct AudioResponseStatistics {
+    uint32_t responses = 0;         // Replies that reached the speaker
+    uint32_t last_latency_ms = 0;   // From the stt message to the first PCM sample written to the codec
+    uint32_t min_latency_ms = 0;
+    uint32_t max_latency_ms = 0;
+    uint32_t avg_latency_ms = 0;
+    uint32_t prebuffered = 0;       // Packets played from the pre-buffer
+    uint32_t prebuffer_dropped = 0; // Packets of stale replies, or beyond the pre-buffer capacity
+};
+
+struct AudioPoolStatistics {
+    AudioBufferPoolStatistics packets;
+    AudioBufferPoolStatistics tasks;
+};
+
 class AudioService {
 public:
     AudioService();
@@ -110,7 +220,9 @@ public:
     void Initialize(AudioCodec* codec);
     void Start();
     void Stop();
-    void EncodeWakeWord();
+    // Stop adding to the wake word ring, so it ends with the wake word (detections do this on their own)
+    void CaptureWakeWordAudio();
+    // Never blocks, nullptr once the ring is empty
     std::unique_ptr<AudioStreamPacket> PopWakeWordPacket();
     const std::string& GetLastWakeWord() const;
     bool IsVoiceDetected() const { return voice_detected_; }
@@ -127,11 +239,40 @@ public:
     void SetCallbacks(AudioServiceCallbacks& callbacks);
 
     bool PushPacketToDecodeQueue(std::unique_ptr<AudioStreamPacket> packet, bool wait = false);
+    /*
+     * Low latency playback: downlink packets are tagged with the reply (turn) they belong to.
+     * Packets of the turn released by FlushPrebuffer() go straight to the decode queue, the others
+     * are held until their turn is released, or dropped when another turn is released.
+     */
+    void PushPacketToPrebuffer(std::unique_ptr<AudioStreamPacket> packet, uint32_t turn);
+    void FlushPrebuffer(uint32_t turn);
+    void ClearPrebuffer();
+    // Called when the stt message arrives, the reply latency is measured from here
+    void MarkResponseStart();
+    AudioResponseStatistics GetResponseStatistics();
     std::unique_ptr<AudioStreamPacket> PopPacketFromSendQueue();
+    void ReportSendFailure() { send_failures_++; }
+    // Called once the protocol has sent a packet from the send queue
+    void ReportPacketSent(const AudioStreamPacket& packet);
+    std::unique_ptr<AudioStreamPacket> AcquirePacket();
+    void ReleasePacket(std::unique_ptr<AudioStreamPacket> packet) { packet_pool_.Release(std::move(packet)); }
     void PlaySound(const std::string_view& sound);
     bool ReadAudioData(std::vector<int16_t>& data, int sample_rate, int samples);
     void ResetDecoder();
     void SetModelsList(srmodel_list_t* models_list);
+    // Uplink encoder parameters for the next frames, usually negotiated in the server hello
+    void SetEncoderParams(int frame_duration_ms, int bitrate);
+    // Room reserved in front of every encoded frame, so the protocol can write its header in place
+    void SetUplinkHeaderSize(size_t header_size) { uplink_header_size_ = header_size; }
+    AudioEncoderParams GetEncoderParams();
+    AudioQueueStatistics GetQueueStatistics() const;
+    void PrintQueueStatistics();
+    AudioJitterStatistics GetJitterStatistics() const { return jitter_buffer_.GetStatistics(); }
+    AudioPoolStatistics GetPoolStatistics();
+    void PrintPoolStatistics();
+    AudioStageStatistics GetStageStatistics(AudioStage stage) { return audio_metrics_.GetStageStatistics(stage); }
+    // Stage latencies, queues, pools and task CPU usage in one compact JSON object, for MCP and telemetry
+    std::string GetMetricsJson();
 
 private:
     AudioCodec* codec_ = nullptr;
@@ -139,6 +280,7 @@ private:
     std::unique_ptr<AudioProcessor> audio_processor_;
     std::unique_ptr<WakeWord> wake_word_;
     std::unique_ptr<AudioDebugger> audio_debugger_;
+    std::unique_ptr<AudioBenchmark> audio_benchmark_;
     void* opus_encoder_ = nullptr;
     void* opus_decoder_ = nullptr;
     std::mutex decoder_mutex_;
@@ -151,27 +293,83 @@ private:
     int encoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
     int encoder_frame_size_ = 0;
     int encoder_outbuf_size_ = 0;
+    int encoder_bitrate_ = 0;
+    int encoder_complexity_ = 0;
+    // Requested by SetEncoderParams() from any task, applied by the opus codec task before the next frame
+    std::mutex encoder_params_mutex_;
+    AudioEncoderParams encoder_params_;
+    std::atomic<bool> encoder_params_changed_{false};
+    // Frame duration for the audio processor, 0 once the audio input task has applied it
+    std::atomic<int> pending_processor_frame_duration_{0};
+    int adaptive_level_ = 0;
+    int64_t last_adaptive_change_time_us_ = 0;
+    int64_t last_congestion_time_us_ = 0;
+    std::atomic<uint32_t> send_failures_{0};
+    std::atomic<uint16_t> uplink_header_size_{0};
     int decoder_sample_rate_ = 0;
     int decoder_duration_ms_ = OPUS_FRAME_DURATION_MS;
     int decoder_frame_size_ = 0;
+    std::vector<int16_t> decode_buffer_;    // Decoder output before resampling, only used by the opus codec task
     DebugStatistics debug_statistics_;
     srmodel_list_t* models_list_ = nullptr;
 
     EventGroupHandle_t event_group_;
 
+    // Packets and tasks passed through the queues
+    AudioBufferPool<AudioStreamPacket> packet_pool_{AUDIO_PACKET_POOL_SIZE};
+    AudioBufferPool<AudioTask> task_pool_{AUDIO_TASK_POOL_SIZE};
+    // Only used by the opus codec task, other tasks request a reset through jitter_buffer_reset_
+    AudioJitterBuffer jitter_buffer_{packet_pool_};
+    std::atomic<bool> jitter_buffer_reset_{false};
+
     // Audio encode / decode
     TaskHandle_t audio_input_task_handle_ = nullptr;
     TaskHandle_t audio_output_task_handle_ = nullptr;
     TaskHandle_t opus_codec_task_handle_ = nullptr;
-    std::mutex audio_queue_mutex_;
-    std::condition_variable audio_queue_cv_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_send_queue_;
-    std::deque<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_encode_queue_;
-    std::deque<std::unique_ptr<AudioTask>> audio_playback_queue_;
+    SpscRingBuffer<std::unique_ptr<AudioStreamPacket>> audio_decode_queue_{MAX_DECODE_PACKETS_IN_QUEUE};
+    SpscRingBuffer<std::unique_ptr<AudioStreamPacket>> audio_send_queue_{MAX_SEND_PACKETS_IN_QUEUE};
+    SpscRingBuffer<std::unique_ptr<AudioStreamPacket>> audio_testing_queue_{AUDIO_TESTING_MAX_DURATION_MS / OPUS_MIN_FRAME_DURATION_MS + MAX_ENCODE_TASKS_IN_QUEUE};
+    SpscRingBuffer<std::unique_ptr<AudioTask>> audio_encode_queue_{MAX_ENCODE_TASKS_IN_QUEUE};
+    SpscRingBuffer<std::unique_ptr<AudioTask>> audio_playback_queue_{MAX_PLAYBACK_TASKS_IN_QUEUE};
+    std::mutex decode_producer_mutex_;
+    std::mutex encode_producer_mutex_;
+    // Wake word ring, filled by the opus codec task and drained by PopWakeWordPacket()
+    std::mutex wake_word_ring_mutex_;
+    std::vector<std::unique_ptr<AudioStreamPacket>> wake_word_ring_;
+    size_t wake_word_ring_head_ = 0;
+    size_t wake_word_ring_count_ = 0;
+    int wake_word_ring_duration_ms_ = 0;
+    std::atomic<bool> wake_word_ring_frozen_{false};
+    std::vector<int16_t> wake_word_pcm_;    // Mono samples short of a full frame, only used by the audio input task
+    std::vector<int16_t> wake_word_frame_;
+    // Low latency playback
+    struct PrebufferedPacket {
+        uint32_t turn;
+        std::unique_ptr<AudioStreamPacket> packet;
+    };
+    std::mutex prebuffer_mutex_;
+    std::deque<PrebufferedPacket> prebuffer_;
+    uint32_t prebuffer_released_turn_ = 0;
+    std::atomic<int64_t> response_start_time_us_{0};
+    std::mutex response_statistics_mutex_;
+    AudioResponseStatistics response_statistics_;
+    int64_t response_latency_sum_ms_ = 0;
     // For server AEC
-    std::deque<uint32_t> timestamp_queue_;
+    SpscRingBuffer<uint32_t> timestamp_queue_{TIMESTAMP_QUEUE_CAPACITY};
+
+    std::atomic<uint32_t> opus_codec_wakeups_{0};
+    std::atomic<uint32_t> opus_codec_idle_wakeups_{0};
+    std::atomic<uint32_t> audio_output_wakeups_{0};
+    std::atomic<uint32_t> producer_waits_{0};
+    std::atomic<uint32_t> decode_producer_contention_{0};
+    AudioQueueStatistics last_queue_statistics_;
+    int64_t last_queue_statistics_time_us_ = 0;
+    AudioMetrics audio_metrics_;
+    // Task run time at the start of the CPU usage window, moved forward every AUDIO_METRICS_WINDOW_SECONDS;
+    // a window older than twice that is restarted without reporting
+    std::mutex task_cpu_mutex_;
+    int64_t task_cpu_window_start_us_ = 0;
+    uint32_t task_cpu_window_start_[3] = {0};
 
     bool wake_word_initialized_ = false;
     bool audio_processor_initialized_ = false;
@@ -180,6 +378,8 @@ private:
     bool audio_input_need_warmup_ = false;
 
     esp_timer_handle_t audio_power_timer_ = nullptr;
+    esp_timer_handle_t audio_benchmark_timer_ = nullptr;
+    int64_t last_input_time_us_ = 0;
     std::chrono::steady_clock::time_point last_input_time_;
     std::chrono::steady_clock::time_point last_output_time_;
 
@@ -187,7 +387,18 @@ private:
     void AudioOutputTask();
     void OpusCodecTask();
     void PushTaskToEncodeQueue(AudioTaskType type, std::vector<int16_t>&& pcm);
+    bool PopPacketToDecode(std::unique_ptr<AudioStreamPacket>& packet);
+    bool EnqueueDecodePacket(std::unique_ptr<AudioStreamPacket> packet, bool wait);
+    void RecordResponseLatency();
+    void FeedWakeWordRing(const std::vector<int16_t>& data);
+    void PushPacketToWakeWordRing(std::unique_ptr<AudioStreamPacket> packet);
+    void ClearWakeWordRing();
+    bool DecodePacket(const AudioStreamPacket& packet, esp_audio_dec_recovery_t recovery = ESP_AUDIO_DEC_RECOVERY_NONE);
+    void DecodeLostFrame();
+    void EncodeTask(const AudioTask& task);
     void SetDecodeSampleRate(int sample_rate, int frame_duration);
+    void UpdateEncoder();
+    void CheckUplinkCongestion();
     void CheckAndUpdateAudioPowerState();
 };
 
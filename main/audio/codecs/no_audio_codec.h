@@ -6,10 +6,16 @@
 #include <driver/gpio.h>
 #include <driver/i2s_pdm.h>
 #include <mutex>
+#include <vector>
 
 class NoAudioCodec : public AudioCodec {
 protected:
     std::mutex data_if_mutex_;
+    // 32-bit I2S frames, kept between calls so the audio tasks do not allocate
+    std::vector<int32_t> write_buffer_;
+    std::vector<int32_t> read_buffer_;
+    int volume_factor_volume_ = -1;
+    int32_t volume_factor_ = 0;
 
     virtual int Write(const int16_t* data, int samples) override;
     virtual int Read(int16_t* dest, int samples) override;
@@ -0,0 +1,120 @@
+#ifndef SPSC_RING_BUFFER_H
+#define SPSC_RING_BUFFER_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/*
+ * Bounded, preallocated single-producer / single-consumer ring buffer.
+ *
+ * Push() may only be called from one task at a time, and Pop() from one task at a time.
+ * Clear() may be called from any task: it marks everything pushed so far as discarded,
+ * and the consumer drops the discarded items on its next Pop(). Until then they still
+ * occupy their slots, so the consumer should be woken up after Clear().
+ *
+ * The counters are free-running and the slot count is a power of two, so wrap-around is safe.
+ */
+template <typename T>
+class SpscRingBuffer {
+public:
+    explicit SpscRingBuffer(size_t capacity) : capacity_(capacity) {
+        size_t slots = 1;
+        while (slots < capacity) {
+            slots <<= 1;
+        }
+        slots_.resize(slots);
+        mask_ = slots - 1;
+    }
+
+    SpscRingBuffer(const SpscRingBuffer&) = delete;
+    SpscRingBuffer& operator=(const SpscRingBuffer&) = delete;
+
+    /* Producer side. The item is only moved from if the push succeeds. */
+    bool Push(T&& item) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        if (tail - head >= capacity_) {
+            rejected_count_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots_[tail & mask_] = std::move(item);
+        tail_.store(tail + 1, std::memory_order_release);
+        push_count_.fetch_add(1, std::memory_order_relaxed);
+
+        uint32_t size = Size();
+        if (size > high_water_mark_.load(std::memory_order_relaxed)) {
+            high_water_mark_.store(size, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    /* Consumer side. Returns false if there is nothing to pop. */
+    bool Pop(T& item) {
+        return Pop(item, [](T&&) {});
+    }
+
+    /* Same as Pop(), but the items discarded by Clear() are handed to on_discard instead of being destroyed */
+    template <typename F>
+    bool Pop(T& item, F&& on_discard) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t discard = discard_.load(std::memory_order_acquire);
+
+        // Drop the items discarded by Clear()
+        while (head != tail && (int32_t)(discard - head) > 0) {
+            on_discard(std::move(slots_[head & mask_]));
+            slots_[head & mask_] = T();
+            head++;
+        }
+        if (head == tail) {
+            head_.store(head, std::memory_order_release);
+            return false;
+        }
+        item = std::move(slots_[head & mask_]);
+        slots_[head & mask_] = T();
+        head_.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    void Clear() {
+        discard_.store(tail_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+    /* Number of items that will be returned by Pop() */
+    size_t Size() const {
+        uint32_t head = head_.load(std::memory_order_acquire);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        uint32_t discard = discard_.load(std::memory_order_acquire);
+        if ((int32_t)(discard - head) > 0) {
+            head = discard;
+        }
+        return (int32_t)(tail - head) > 0 ? tail - head : 0;
+    }
+
+    bool Empty() const { return Size() == 0; }
+
+    /* True if the next Push() fails, discarded items included */
+    bool Full() const {
+        return tail_.load(std::memory_order_acquire) - head_.load(std::memory_order_acquire) >= capacity_;
+    }
+
+    size_t capacity() const { return capacity_; }
+    uint32_t push_count() const { return push_count_.load(std::memory_order_relaxed); }
+    uint32_t rejected_count() const { return rejected_count_.load(std::memory_order_relaxed); }
+    uint32_t high_water_mark() const { return high_water_mark_.load(std::memory_order_relaxed); }
+
+private:
+    std::vector<T> slots_;
+    size_t capacity_;
+    uint32_t mask_;
+    std::atomic<uint32_t> head_{0};
+    std::atomic<uint32_t> tail_{0};
+    std::atomic<uint32_t> discard_{0};
+    std::atomic<uint32_t> push_count_{0};
+    std::atomic<uint32_t> rejected_count_{0};
+    std::atomic<uint32_t> high_water_mark_{0};
+};
+
+#endif // SPSC_RING_BUFFER_H
@@ -4,6 +4,7 @@
 #include "esp_log.h"
 #include "display.h"
 #include "ssid_manager.h"
+#include "audio_dsp.h"
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
@@ -42,11 +43,8 @@ namespace audio_wifi_config
             }
 
             if (input_channels == 2) { // 如果是双声道输入，转换为单声道
-                auto mono_data = std::vector<int16_t>(audio_data.size() / 2);
-                for (size_t i = 0, j = 0; i < mono_data.size(); ++i, j += 2) {
-                    mono_data[i] = audio_data[j];
-                }
-                audio_data = std::move(mono_data);
+                AudioDspExtractChannel(audio_data.data(), audio_data.data(), audio_data.size() / 2, 2);
+                audio_data.resize(audio_data.size() / 2);
             }
             
             // Downsample the audio data
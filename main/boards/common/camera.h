@@ -10,6 +10,10 @@ public:
     virtual bool SetHMirror(bool enabled) = 0;
     virtual bool SetVFlip(bool enabled) = 0;
     virtual std::string Explain(const std::string& question) = 0;
+
+    // Stream frames as JPEG to the url at most fps frames per second, false if not supported
+    virtual bool StartStreaming(const std::string& url, int fps, int downscale) { return false; }
+    virtual void StopStreaming() {}
 };
 
 #endif // CAMERA_H
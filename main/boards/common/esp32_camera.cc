@@ -5,8 +5,11 @@
 #include <unistd.h>
 #include <errno.h>
 #include <esp_heap_caps.h>
+#include <esp_timer.h>
 #include <cstdio>
 #include <cstring>
+#include <cstdlib>
+#include <algorithm>
 
 #include "esp_imgfx_color_convert.h"
 #include "esp_video_device.h"
@@ -54,6 +57,22 @@
 
 #define TAG "Esp32Camera"
 
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+#define CAMERA_EVENT_NEW_FRAME (1 << 0)
+#define CAMERA_EVENT_CAPTURE_STOPPED (1 << 1)
+#define CAMERA_EVENT_STREAM_STOPPED (1 << 2)
+
+#define CAMERA_STREAM_BOUNDARY "XIAOZHI_CAMERA_FRAME"
+#define CAMERA_STREAM_JPEG_QUALITY 60
+// 画面不变时也至少每隔这么久发送一帧，让服务器知道连接还活着
+#define CAMERA_STREAM_KEEPALIVE_MS 5000
+// 推流任务每一轮最多等待一个帧间隔和 1 秒取帧，超过这个时间还没退出就是卡在了网络上
+#define CAMERA_STREAM_STOP_TIMEOUT_MS 2500
+// 帧差用的亮度采样网格
+#define CAMERA_LUMA_GRID_WIDTH 16
+#define CAMERA_LUMA_GRID_HEIGHT 12
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+
 #if defined(CONFIG_CAMERA_SENSOR_SWAP_PIXEL_BYTE_ORDER) || defined(CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP)
 #warning \
     "CAMERA_SENSOR_SWAP_PIXEL_BYTE_ORDER or CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP is enabled, which may cause image corruption in YUV422 format!"
@@ -274,7 +293,12 @@ Esp32Camera::Esp32Camera(const esp_video_init_config_t& config) {
 
     // 申请缓冲并mmap
     struct v4l2_requestbuffers req = {};
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    // 环中保留 N 帧，另外至少一个缓冲区留给驱动继续采集
+    req.count = CONFIG_XIAOZHI_CAMERA_FRAME_RING_SIZE + 1;
+#else
     req.count = strcmp(video_device_name, ESP_VIDEO_MIPI_CSI_DEVICE_NAME) == 0 ? 2 : 1;
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
     req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory = V4L2_MEMORY_MMAP;
     if (ioctl(video_fd_, VIDIOC_REQBUFS, &req) != 0) {
@@ -351,20 +375,40 @@ Esp32Camera::Esp32Camera(const esp_video_init_config_t& config) {
             ESP_LOGI(TAG, "Camera init success, captured %d frames in %lums", capture_count,
                      (unsigned long)((xTaskGetTickCount() - start) * portTICK_PERIOD_MS));
             self->streaming_on_ = true;
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+            self->StartCaptureTask();
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
             vTaskDelete(NULL);
         },
         "CameraInitTask", 4096, this, 5, nullptr);
 #else
     ESP_LOGI(TAG, "Camera init success");
     streaming_on_ = true;
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    StartCaptureTask();
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
 #endif  // CONFIG_ESP_VIDEO_ENABLE_ISP_VIDEO_DEVICE
 }
 
 Esp32Camera::~Esp32Camera() {
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    StopStreaming();
+    bool capture_running = capture_running_.exchange(false);
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
     if (streaming_on_ && video_fd_ >= 0) {
         int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         ioctl(video_fd_, VIDIOC_STREAMOFF, &type);
     }
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    if (capture_running) {
+        // STREAMOFF 之后 DQBUF 返回失败，采集任务随即退出
+        xEventGroupWaitBits(event_group_, CAMERA_EVENT_CAPTURE_STOPPED, pdFALSE, pdFALSE, pdMS_TO_TICKS(1000));
+    }
+    if (event_group_ != nullptr) {
+        vEventGroupDelete(event_group_);
+        event_group_ = nullptr;
+    }
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
     for (auto& b : mmap_buffers_) {
         if (b.start && b.length) {
             munmap(b.start, b.length);
@@ -383,6 +427,127 @@ void Esp32Camera::SetExplainUrl(const std::string& url, const std::string& token
     explain_token_ = token;
 }
 
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+void Esp32Camera::StartCaptureTask() {
+    ring_size_ = std::min<size_t>(CONFIG_XIAOZHI_CAMERA_FRAME_RING_SIZE, mmap_buffers_.size() - 1);
+    if (ring_size_ == 0) {
+        // 只有一个缓冲区时环会占住它，驱动无法继续采集
+        ESP_LOGW(TAG, "Only %u video buffer, continuous capture disabled", (unsigned)mmap_buffers_.size());
+        return;
+    }
+    event_group_ = xEventGroupCreate();
+    xEventGroupSetBits(event_group_, CAMERA_EVENT_STREAM_STOPPED);
+    capture_running_ = true;
+    xTaskCreate(
+        [](void* arg) {
+            static_cast<Esp32Camera*>(arg)->CaptureTask();
+            vTaskDelete(NULL);
+        },
+        "camera_ring", 3072, this, 5, nullptr);
+    ESP_LOGI(TAG, "Continuous capture started, keeping the newest %u frames", (unsigned)ring_size_);
+}
+
+void Esp32Camera::CaptureTask() {
+    while (capture_running_) {
+        struct v4l2_buffer buf = {};
+        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        buf.memory = V4L2_MEMORY_MMAP;
+        if (ioctl(video_fd_, VIDIOC_DQBUF, &buf) != 0) {
+            if (capture_running_) {
+                ESP_LOGE(TAG, "VIDIOC_DQBUF failed");
+                vTaskDelay(pdMS_TO_TICKS(10));
+            }
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> lock(ring_mutex_);
+            ring_.push_back({buf, ++sequence_, 0});
+            TrimRing();
+        }
+        xEventGroupSetBits(event_group_, CAMERA_EVENT_NEW_FRAME);
+    }
+    xEventGroupSetBits(event_group_, CAMERA_EVENT_CAPTURE_STOPPED);
+}
+
+// 从最旧的帧开始，把超出环大小且没有被使用的帧还给驱动，调用时需持有 ring_mutex_
+void Esp32Camera::TrimRing() {
+    for (auto it = ring_.begin(); it != ring_.end() && ring_.size() > ring_size_;) {
+        if (it->pins > 0) {
+            ++it;
+            continue;
+        }
+        if (ioctl(video_fd_, VIDIOC_QBUF, &it->buf) != 0) {
+            ESP_LOGE(TAG, "VIDIOC_QBUF failed");
+        }
+        it = ring_.erase(it);
+    }
+}
+
+bool Esp32Camera::PinNewestFrame(struct v4l2_buffer& buf, uint32_t& sequence, TickType_t timeout) {
+    // 先清除事件再检查环，避免错过检查之后到达的帧
+    xEventGroupClearBits(event_group_, CAMERA_EVENT_NEW_FRAME);
+    for (int attempt = 0; attempt < 2; attempt++) {
+        {
+            std::lock_guard<std::mutex> lock(ring_mutex_);
+            if (!ring_.empty()) {
+                auto& frame = ring_.back();
+                frame.pins++;
+                buf = frame.buf;
+                sequence = frame.sequence;
+                return true;
+            }
+        }
+        if (attempt == 0) {
+            xEventGroupWaitBits(event_group_, CAMERA_EVENT_NEW_FRAME, pdFALSE, pdFALSE, timeout);
+        }
+    }
+    return false;
+}
+
+void Esp32Camera::UnpinFrame(const struct v4l2_buffer& buf) {
+    std::lock_guard<std::mutex> lock(ring_mutex_);
+    for (auto& frame : ring_) {
+        if (frame.buf.index == buf.index) {
+            frame.pins--;
+            break;
+        }
+    }
+    TrimRing();
+}
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+
+bool Esp32Camera::AcquireFrame(struct v4l2_buffer& buf) {
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    if (capture_running_) {
+        uint32_t sequence;
+        if (!PinNewestFrame(buf, sequence, pdMS_TO_TICKS(1000))) {
+            ESP_LOGE(TAG, "No frame captured in time");
+            return false;
+        }
+        return true;
+    }
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = V4L2_MEMORY_MMAP;
+    if (ioctl(video_fd_, VIDIOC_DQBUF, &buf) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_DQBUF failed");
+        return false;
+    }
+    return true;
+}
+
+void Esp32Camera::ReleaseFrame(struct v4l2_buffer& buf) {
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    if (capture_running_) {
+        UnpinFrame(buf);
+        return;
+    }
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
+        ESP_LOGE(TAG, "VIDIOC_QBUF failed");
+    }
+}
+
 bool Esp32Camera::Capture() {
     if (encoder_thread_.joinable()) {
         encoder_thread_.join();
@@ -392,12 +557,17 @@ bool Esp32Camera::Capture() {
         return false;
     }
 
-    for (int i = 0; i < 3; i++) {
+    // 驱动队列中的前两帧可能是很久以前采集的，丢弃后使用第三帧
+    int first_frame = 0;
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    if (capture_running_) {
+        // 采集任务一直在取帧，环中最新的一帧就是当前画面，不需要丢弃旧帧
+        first_frame = 2;
+    }
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    for (int i = first_frame; i < 3; i++) {
         struct v4l2_buffer buf = {};
-        buf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-        buf.memory = V4L2_MEMORY_MMAP;
-        if (ioctl(video_fd_, VIDIOC_DQBUF, &buf) != 0) {
-            ESP_LOGE(TAG, "VIDIOC_DQBUF failed");
+        if (!AcquireFrame(buf)) {
             return false;
         }
         if (i == 2) {
@@ -411,9 +581,7 @@ bool Esp32Camera::Capture() {
             frame_.data = (uint8_t*)heap_caps_malloc(frame_.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
             if (!frame_.data) {
                 ESP_LOGE(TAG, "alloc frame copy failed: need allocate %lu bytes", buf.bytesused);
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
+                ReleaseFrame(buf);
                 return false;
             }
 
@@ -483,9 +651,7 @@ bool Esp32Camera::Capture() {
                 }
                 default:
                     ESP_LOGE(TAG, "unsupported sensor format: 0x%08lx", sensor_format_);
-                    if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                        ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                    }
+                    ReleaseFrame(buf);
                     return false;
             }
 
@@ -495,9 +661,7 @@ bool Esp32Camera::Capture() {
                 (uint8_t*)heap_caps_aligned_alloc(64, frame_.len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
             if (rotate_dst == nullptr) {
                 ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
+                ReleaseFrame(buf);
                 return false;
             }
             uint8_t* rotate_src = (uint8_t*)frame_.data;
@@ -525,18 +689,14 @@ bool Esp32Camera::Capture() {
                     break;
                 default:
                     ESP_LOGE(TAG, "unsupported sensor format: 0x%08lx", sensor_format_);
-                    if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                        ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                    }
+                    ReleaseFrame(buf);
                     return false;
             }
             esp_imgfx_rotate_handle_t rotate_handle = nullptr;
             esp_imgfx_err_t imgfx_err = esp_imgfx_rotate_open(&rotate_cfg, &rotate_handle);
             if (imgfx_err != ESP_IMGFX_ERR_OK || rotate_handle == nullptr) {
                 ESP_LOGE(TAG, "esp_imgfx_rotate_create failed");
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
+                ReleaseFrame(buf);
                 return false;
             }
 
@@ -554,9 +714,7 @@ bool Esp32Camera::Capture() {
                 ESP_LOGE(TAG, "esp_imgfx_rotate_process failed");
                 heap_caps_free(rotate_dst);
                 rotate_dst = nullptr;
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
+                ReleaseFrame(buf);
                 esp_imgfx_rotate_close(rotate_handle);
                 rotate_handle = nullptr;
                 return false;
@@ -588,9 +746,7 @@ bool Esp32Camera::Capture() {
                                                             MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
                     if (rotate_src == nullptr) {
                         ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
-                        if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                            ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                        }
+                        ReleaseFrame(buf);
                         return false;
                     }
                     esp_imgfx_color_convert_cfg_t convert_cfg = {
@@ -605,9 +761,7 @@ bool Esp32Camera::Capture() {
                         ESP_LOGE(TAG, "esp_imgfx_color_convert_open failed");
                         heap_caps_free(rotate_src);
                         rotate_src = nullptr;
-                        if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                            ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                        }
+                        ReleaseFrame(buf);
                         return false;
                     }
                     esp_imgfx_data_t convert_input_data = {
@@ -625,9 +779,7 @@ bool Esp32Camera::Capture() {
                         rotate_src = nullptr;
                         esp_imgfx_color_convert_close(convert_handle);
                         convert_handle = nullptr;
-                        if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                            ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                        }
+                        ReleaseFrame(buf);
                         return false;
                     }
                     esp_imgfx_color_convert_close(convert_handle);
@@ -640,9 +792,7 @@ bool Esp32Camera::Capture() {
                 }
                 default:
                     ESP_LOGE(TAG, "unsupported sensor format for PPA rotation: 0x%08lx", sensor_format_);
-                    if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                        ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                    }
+                    ReleaseFrame(buf);
                     return false;
             }
 
@@ -650,9 +800,7 @@ bool Esp32Camera::Capture() {
                 frame_.width * frame_.height * 2, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT | MALLOC_CAP_CACHE_ALIGNED);
             if (rotate_dst == nullptr) {
                 ESP_LOGE(TAG, "Failed to allocate memory for rotate image");
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
+                ReleaseFrame(buf);
                 return false;
             }
 
@@ -666,9 +814,7 @@ bool Esp32Camera::Capture() {
                 ESP_LOGE(TAG, "ppa_register_client failed: %d", (int)err);
                 heap_caps_free(rotate_dst);
                 rotate_dst = nullptr;
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
+                ReleaseFrame(buf);
                 return false;
             }
 
@@ -705,9 +851,7 @@ bool Esp32Camera::Capture() {
                 heap_caps_free(rotate_dst);
                 rotate_dst = nullptr;
                 (void)ppa_unregister_client(ppa_client);
-                if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-                    ESP_LOGE(TAG, "Cleanup: VIDIOC_QBUF failed");
-                }
+                ReleaseFrame(buf);
                 return false;
             }
 
@@ -722,9 +866,7 @@ bool Esp32Camera::Capture() {
 #endif  // CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
         }
 
-        if (ioctl(video_fd_, VIDIOC_QBUF, &buf) != 0) {
-            ESP_LOGE(TAG, "VIDIOC_QBUF failed");
-        }
+        ReleaseFrame(buf);
     }
 
     // 显示预览图片
@@ -917,7 +1059,8 @@ std::string Esp32Camera::Explain(const std::string& question) {
             [](void* arg, size_t index, const void* data, size_t len) -> size_t {
                 auto jpeg_queue = static_cast<QueueHandle_t>(arg);
                 JpegChunk chunk = {.data = nullptr, .len = len};
-                if (index == 0 && data != nullptr && len > 0) {
+                // JPEG data arrives band by band while encoding, a null data marks the end
+                if (data != nullptr && len > 0) {
                     chunk.data = (uint8_t*)heap_caps_aligned_alloc(16, len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
                     if (chunk.data == nullptr) {
                         ESP_LOGE(TAG, "Failed to allocate %zu bytes for JPEG chunk", len);
@@ -1037,3 +1180,319 @@ std::string Esp32Camera::Explain(const std::string& question) {
              (int)frame_.len, (int)total_sent, (int)remain_stack_size, question.c_str(), result.c_str());
     return result;
 }
+
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+void Esp32Camera::GetSensorResolution(uint16_t& width, uint16_t& height) const {
+#ifdef CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
+    width = sensor_width_;
+    height = sensor_height_;
+#else
+    width = frame_.width;
+    height = frame_.height;
+#endif  // CONFIG_XIAOZHI_ENABLE_ROTATE_CAMERA_IMAGE
+}
+
+/**
+ * @brief 开始把摄像头画面以 JPEG 推送到指定 URL
+ *
+ * 推流任务直接从环中的 mmap 缓冲区编码，不拷贝整帧，通过一个持久的分块 POST 请求
+ * 以 multipart/x-mixed-replace 的形式发送，每个部分是一帧 JPEG。
+ * - fps 限制每秒最多发送的帧数
+ * - downscale 按整数倍隔行隔列抽取，降低分辨率和带宽
+ * - 画面没有明显变化的帧会被跳过（CONFIG_XIAOZHI_CAMERA_STREAM_DIFF_THRESHOLD）
+ *
+ * @note 推流的画面是传感器方向，不做旋转
+ */
+bool Esp32Camera::StartStreaming(const std::string& url, int fps, int downscale) {
+    if (!capture_running_) {
+        ESP_LOGE(TAG, "Continuous capture is not running");
+        return false;
+    }
+    switch (sensor_format_) {
+        case V4L2_PIX_FMT_YUV422P:
+        case V4L2_PIX_FMT_YUYV:
+        case V4L2_PIX_FMT_RGB565:
+        case V4L2_PIX_FMT_RGB565X:
+        case V4L2_PIX_FMT_RGB24:
+        case V4L2_PIX_FMT_GREY:
+            break;
+#ifdef CONFIG_XIAOZHI_CAMERA_ALLOW_JPEG_INPUT
+        case V4L2_PIX_FMT_JPEG:
+            // JPEG 帧原样发送，无法缩小
+            downscale = 1;
+            break;
+#endif  // CONFIG_XIAOZHI_CAMERA_ALLOW_JPEG_INPUT
+        default:
+            ESP_LOGE(TAG, "unsupported sensor format for streaming: 0x%08lx", sensor_format_);
+            return false;
+    }
+
+    StopStreaming();
+    if (!(xEventGroupGetBits(event_group_) & CAMERA_EVENT_STREAM_STOPPED)) {
+        ESP_LOGE(TAG, "The previous stream task has not exited");
+        return false;
+    }
+    stream_url_ = url;
+    stream_fps_ = std::clamp(fps, 1, 15);
+    stream_downscale_ = std::clamp(downscale, 1, 4);
+    stream_running_ = true;
+    xEventGroupClearBits(event_group_, CAMERA_EVENT_STREAM_STOPPED);
+    if (xTaskCreate(
+            [](void* arg) {
+                static_cast<Esp32Camera*>(arg)->StreamTask();
+                vTaskDelete(NULL);
+            },
+            "camera_stream", 8192, this, 2, nullptr) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the stream task");
+        stream_running_ = false;
+        return false;
+    }
+    return true;
+}
+
+void Esp32Camera::StopStreaming() {
+    if (!stream_running_.exchange(false)) {
+        return;
+    }
+    auto wait_stopped = [this]() {
+        return xEventGroupWaitBits(event_group_, CAMERA_EVENT_STREAM_STOPPED, pdFALSE, pdFALSE,
+                                   pdMS_TO_TICKS(CAMERA_STREAM_STOP_TIMEOUT_MS)) & CAMERA_EVENT_STREAM_STOPPED;
+    };
+    if (wait_stopped()) {
+        return;
+    }
+    // 推流任务阻塞在连接或发送上，关闭连接让它返回
+    ESP_LOGW(TAG, "Stream task is blocked, closing the connection");
+    {
+        std::lock_guard<std::mutex> lock(stream_mutex_);
+        if (stream_http_ != nullptr) {
+            stream_http_->Close();
+        }
+    }
+    if (!wait_stopped()) {
+        ESP_LOGE(TAG, "Stream task did not exit");
+    }
+}
+
+// 推流任务持有的连接，StopStreaming() 可能从其他任务关闭它
+void Esp32Camera::SetStreamHttp(std::unique_ptr<Http>& http, std::unique_ptr<Http> value) {
+    std::lock_guard<std::mutex> lock(stream_mutex_);
+    if (http) {
+        http->Close();
+    }
+    http = std::move(value);
+    stream_http_ = http.get();
+}
+
+void Esp32Camera::StreamTask() {
+    auto network = Board::GetInstance().GetNetwork();
+    std::unique_ptr<Http> http;
+    uint8_t reference[CAMERA_LUMA_GRID_WIDTH * CAMERA_LUMA_GRID_HEIGHT];
+    uint8_t samples[CAMERA_LUMA_GRID_WIDTH * CAMERA_LUMA_GRID_HEIGHT];
+    bool has_reference = false;
+    uint32_t last_sequence = 0;
+    int64_t last_sent_ms = 0;
+    uint32_t sent_count = 0;
+    uint32_t skipped_count = 0;
+
+    ESP_LOGI(TAG, "Streaming to %s at %d fps, downscale %d", stream_url_.c_str(), stream_fps_, stream_downscale_);
+    const TickType_t period = pdMS_TO_TICKS(1000 / stream_fps_);
+    TickType_t last_wake = xTaskGetTickCount();
+    while (stream_running_) {
+        vTaskDelayUntil(&last_wake, period);
+
+        if (!http) {
+            SetStreamHttp(http, network->CreateHttp(3));
+            http->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
+            http->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
+            if (!explain_token_.empty()) {
+                http->SetHeader("Authorization", "Bearer " + explain_token_);
+            }
+            http->SetHeader("Content-Type", "multipart/x-mixed-replace; boundary=" CAMERA_STREAM_BOUNDARY);
+            http->SetHeader("Transfer-Encoding", "chunked");
+            if (!http->Open("POST", stream_url_)) {
+                ESP_LOGW(TAG, "Failed to connect to the stream URL, retry in 1s");
+                SetStreamHttp(http, nullptr);
+                vTaskDelay(pdMS_TO_TICKS(1000));
+                last_wake = xTaskGetTickCount();
+                continue;
+            }
+            // 新连接的第一帧总是发送
+            has_reference = false;
+        }
+
+        struct v4l2_buffer buf;
+        uint32_t sequence;
+        if (!PinNewestFrame(buf, sequence, pdMS_TO_TICKS(1000))) {
+            continue;
+        }
+        if (sequence == last_sequence) {
+            UnpinFrame(buf);
+            continue;
+        }
+        last_sequence = sequence;
+        auto data = (const uint8_t*)mmap_buffers_[buf.index].start;
+        int64_t now_ms = esp_timer_get_time() / 1000;
+
+        // 帧差：与上一次发送的帧相比亮度几乎不变时跳过
+        bool sampled = CONFIG_XIAOZHI_CAMERA_STREAM_DIFF_THRESHOLD > 0 && SampleLuma(data, samples);
+        if (sampled && has_reference && now_ms - last_sent_ms < CAMERA_STREAM_KEEPALIVE_MS) {
+            int difference = 0;
+            for (size_t i = 0; i < sizeof(samples); i++) {
+                difference += abs(samples[i] - reference[i]);
+            }
+            if (difference < CONFIG_XIAOZHI_CAMERA_STREAM_DIFF_THRESHOLD * (int)sizeof(samples)) {
+                UnpinFrame(buf);
+                skipped_count++;
+                continue;
+            }
+        }
+
+        char part_header[128];
+        int header_len = snprintf(part_header, sizeof(part_header),
+            "--" CAMERA_STREAM_BOUNDARY "\r\nContent-Type: image/jpeg\r\nX-Frame-Sequence: %lu\r\nX-Timestamp: %lld\r\n\r\n",
+            (unsigned long)sequence, (long long)now_ms);
+        bool ok = http->Write(part_header, header_len) >= 0;
+        ok = ok && EncodeFrame(data, buf.bytesused, stream_downscale_,
+            [](void* arg, size_t index, const void* data, size_t len) -> size_t {
+                if (data == nullptr) {
+                    return 0;
+                }
+                return static_cast<Http*>(arg)->Write((const char*)data, len) >= 0 ? len : 0;
+            },
+            http.get());
+        UnpinFrame(buf);
+        ok = ok && http->Write("\r\n", 2) >= 0;
+        if (!ok) {
+            ESP_LOGW(TAG, "Failed to send frame %lu, reconnecting", (unsigned long)sequence);
+            SetStreamHttp(http, nullptr);
+            continue;
+        }
+
+        last_sent_ms = now_ms;
+        if (sampled) {
+            memcpy(reference, samples, sizeof(reference));
+            has_reference = true;
+        }
+        if (++sent_count % 100 == 0) {
+            ESP_LOGI(TAG, "Streamed %lu frames, skipped %lu unchanged", (unsigned long)sent_count,
+                     (unsigned long)skipped_count);
+        }
+    }
+
+    if (http) {
+        const char* footer = "--" CAMERA_STREAM_BOUNDARY "--\r\n";
+        http->Write(footer, strlen(footer));
+        http->Write("", 0);
+        ESP_LOGI(TAG, "Stream closed after %lu frames, status code: %d", (unsigned long)sent_count,
+                 http->GetStatusCode());
+        SetStreamHttp(http, nullptr);
+    }
+    xEventGroupSetBits(event_group_, CAMERA_EVENT_STREAM_STOPPED);
+}
+
+// 在网格上采样亮度的近似值，JPEG 帧返回 false
+bool Esp32Camera::SampleLuma(const uint8_t* data, uint8_t* samples) {
+    uint16_t width, height;
+    GetSensorResolution(width, height);
+    size_t bytes_per_pixel = sensor_format_ == V4L2_PIX_FMT_RGB24 ? 3 : (sensor_format_ == V4L2_PIX_FMT_GREY ? 1 : 2);
+    for (int gy = 0; gy < CAMERA_LUMA_GRID_HEIGHT; gy++) {
+        size_t y = (2 * gy + 1) * height / (2 * CAMERA_LUMA_GRID_HEIGHT);
+        for (int gx = 0; gx < CAMERA_LUMA_GRID_WIDTH; gx++) {
+            size_t x = (2 * gx + 1) * width / (2 * CAMERA_LUMA_GRID_WIDTH);
+            const uint8_t* p = data + (y * width + x) * bytes_per_pixel;
+            uint8_t luma;
+            switch (sensor_format_) {
+                case V4L2_PIX_FMT_YUV422P:
+                case V4L2_PIX_FMT_YUYV:
+#ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
+                    luma = p[1];
+#else
+                    luma = p[0];
+#endif  // CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
+                    break;
+                case V4L2_PIX_FMT_RGB565:
+                case V4L2_PIX_FMT_RGB565X: {
+                    bool big_endian = sensor_format_ == V4L2_PIX_FMT_RGB565X;
+#ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
+                    big_endian = !big_endian;
+#endif  // CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
+                    uint16_t pixel = big_endian ? (p[0] << 8) | p[1] : p[0] | (p[1] << 8);
+                    luma = (((pixel >> 11) << 3) + (((pixel >> 5) & 0x3F) << 3) + ((pixel & 0x1F) << 3)) / 4;
+                    break;
+                }
+                case V4L2_PIX_FMT_RGB24:
+                    luma = (p[0] + 2 * p[1] + p[2]) / 4;
+                    break;
+                case V4L2_PIX_FMT_GREY:
+                    luma = p[0];
+                    break;
+                default:
+                    return false;
+            }
+            samples[gy * CAMERA_LUMA_GRID_WIDTH + gx] = luma;
+        }
+    }
+    return true;
+}
+
+bool Esp32Camera::EncodeFrame(const uint8_t* data, size_t len, int downscale, jpg_out_cb cb, void* arg) {
+#ifdef CONFIG_XIAOZHI_CAMERA_ALLOW_JPEG_INPUT
+    if (sensor_format_ == V4L2_PIX_FMT_JPEG) {
+        return cb(arg, 0, data, len) == len;
+    }
+#endif  // CONFIG_XIAOZHI_CAMERA_ALLOW_JPEG_INPUT
+
+    // 这个格式是 422 YUYV，不是 planer
+    v4l2_pix_fmt_t format = sensor_format_ == V4L2_PIX_FMT_YUV422P ? V4L2_PIX_FMT_YUYV : sensor_format_;
+    uint16_t width, height;
+    GetSensorResolution(width, height);
+    size_t bytes_per_pixel = format == V4L2_PIX_FMT_RGB24 ? 3 : (format == V4L2_PIX_FMT_GREY ? 1 : 2);
+    size_t stride = width * bytes_per_pixel;
+    if (len < stride * height) {
+        ESP_LOGE(TAG, "Frame too short: %u bytes", (unsigned)len);
+        return false;
+    }
+
+    // YUYV 的两个像素共用色度，按宏像素（4 字节）抽取
+    size_t unit_pixels = format == V4L2_PIX_FMT_YUYV ? 2 : 1;
+    size_t unit_bytes = unit_pixels * bytes_per_pixel;
+    size_t units = width / unit_pixels / downscale;
+    uint16_t out_width = units * unit_pixels;
+    uint16_t out_height = height / downscale;
+
+    auto encoder = jpeg_band_encoder_open(out_width, out_height, format, CAMERA_STREAM_JPEG_QUALITY, cb, arg);
+    if (encoder == nullptr) {
+        return false;
+    }
+
+    bool copy_rows = downscale > 1;
+#ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
+    copy_rows = true;
+#endif  // CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
+    bool ok = true;
+    if (!copy_rows) {
+        ok = jpeg_band_encoder_write(encoder, data, height);
+    } else {
+        auto row = (uint8_t*)heap_caps_malloc(out_width * bytes_per_pixel, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        ok = row != nullptr;
+        for (uint16_t y = 0; ok && y < out_height; y++) {
+            const uint8_t* src = data + (size_t)y * downscale * stride;
+            for (size_t u = 0; u < units; u++) {
+                memcpy(row + u * unit_bytes, src + u * downscale * unit_bytes, unit_bytes);
+            }
+#ifdef CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
+            if (bytes_per_pixel == 2) {
+                auto row16 = (uint16_t*)row;
+                for (size_t i = 0; i < out_width; i++) {
+                    row16[i] = __builtin_bswap16(row16[i]);
+                }
+            }
+#endif  // CONFIG_XIAOZHI_ENABLE_CAMERA_ENDIANNESS_SWAP
+            ok = jpeg_band_encoder_write(encoder, row, 1);
+        }
+        heap_caps_free(row);
+    }
+    return jpeg_band_encoder_close(encoder) && ok;
+}
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
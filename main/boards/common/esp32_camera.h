@@ -6,9 +6,14 @@
 #include <thread>
 #include <memory>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/queue.h>
+#include <freertos/event_groups.h>
+#include <http.h>
 
 #include "camera.h"
 #include "jpg/image_to_jpeg.h"
@@ -41,6 +46,43 @@ private:
     std::string explain_token_;
     std::thread encoder_thread_;
 
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    // 连续采集：采集任务不断取帧，保留最新的 N 帧（仍在 mmap 缓冲区中，不拷贝），
+    // 被 Capture() 或推流任务使用（pin）的帧不会被还给驱动
+    struct RingFrame {
+        struct v4l2_buffer buf;
+        uint32_t sequence;
+        int pins;
+    };
+    std::deque<RingFrame> ring_;  // 旧帧在前
+    size_t ring_size_ = 0;
+    std::mutex ring_mutex_;
+    uint32_t sequence_ = 0;
+    EventGroupHandle_t event_group_ = nullptr;
+    std::atomic<bool> capture_running_ = false;
+
+    std::string stream_url_;
+    int stream_fps_ = 0;
+    int stream_downscale_ = 1;
+    std::atomic<bool> stream_running_ = false;
+    std::mutex stream_mutex_;
+    Http* stream_http_ = nullptr;  // 由 stream_mutex_ 保护
+
+    void StartCaptureTask();
+    void CaptureTask();
+    void TrimRing();
+    bool PinNewestFrame(struct v4l2_buffer& buf, uint32_t& sequence, TickType_t timeout);
+    void UnpinFrame(const struct v4l2_buffer& buf);
+    void GetSensorResolution(uint16_t& width, uint16_t& height) const;
+    void StreamTask();
+    void SetStreamHttp(std::unique_ptr<Http>& http, std::unique_ptr<Http> value);
+    bool SampleLuma(const uint8_t* data, uint8_t* samples);
+    bool EncodeFrame(const uint8_t* data, size_t len, int downscale, jpg_out_cb cb, void* arg);
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+
+    bool AcquireFrame(struct v4l2_buffer& buf);
+    void ReleaseFrame(struct v4l2_buffer& buf);
+
 public:
     Esp32Camera(const esp_video_init_config_t& config);
     ~Esp32Camera();
@@ -51,6 +93,10 @@ public:
     virtual bool SetHMirror(bool enabled) override;
     virtual bool SetVFlip(bool enabled) override;
     virtual std::string Explain(const std::string& question);
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    virtual bool StartStreaming(const std::string& url, int fps, int downscale) override;
+    virtual void StopStreaming() override;
+#endif  // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
 };
 
 #endif // ndef CONFIG_IDF_TARGET_ESP32
\ No newline at end of file
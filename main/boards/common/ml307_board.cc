@@ -3,6 +3,7 @@
 #include "application.h"
 #include "display.h"
 #include "assets/lang_config.h"
+#include "task_profiler.h"
 
 #include <esp_log.h>
 #include <esp_timer.h>
@@ -207,6 +208,11 @@ std::string Ml307Board::GetDeviceStatusJson() {
      *         "type": "cellular",
      *         "carrier": "CHINA MOBILE",
      *         "csq": 10
+     *     },
+     *     "system": {
+     *         "cpu": [20, 55],
+     *         "busiest_tasks": {"opus_codec": 30, "audio_input": 12},
+     *         "free_internal_heap": 51234
      *     }
      * }
      */
@@ -265,6 +271,11 @@ std::string Ml307Board::GetDeviceStatusJson() {
     }
     cJSON_AddItemToObject(root, "network", network);
 
+#if CONFIG_USE_TASK_PROFILER
+    // Core load and busiest tasks
+    cJSON_AddItemToObject(root, "system", TaskProfiler::GetInstance().GetStatusJson());
+#endif
+
     auto json_str = cJSON_PrintUnformatted(root);
     std::string json(json_str);
     cJSON_free(json_str);
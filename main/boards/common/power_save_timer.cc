@@ -99,6 +99,8 @@ void PowerSaveTimer::PowerSaveCheck() {
         }
     }
     if (seconds_to_shutdown_ != -1 && ticks_ >= seconds_to_shutdown_ && on_shutdown_request_) {
+        // The callback cuts the power or enters deep sleep, settings still waiting for their commit would be lost
+        Settings::Flush();
         on_shutdown_request_();
     }
 }
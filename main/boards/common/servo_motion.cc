@@ -0,0 +1,278 @@
+//--------------------------------------------------------------
+//-- ServoMotion
+//-- Timer driven playback of servo moves and oscillations
+//--------------------------------------------------------------
+#include "servo_motion.h"
+
+#include <algorithm>
+
+#define MOTION_EVENT_SEGMENT_DONE (1 << 0)
+#define MOTION_EVENT_CANCELLED (1 << 1)
+
+static int ToDegrees(int position) {
+    return position >= 0 ? (position + 8) / 16 : -((8 - position) / 16);
+}
+
+ServoMotion::ServoMotion(int count) : count_(std::min(count, SERVO_MOTION_MAX_SERVOS)) {
+    event_group_ = xEventGroupCreate();
+
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            static_cast<ServoMotion*>(arg)->Tick();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "servo_motion",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_));
+}
+
+ServoMotion::~ServoMotion() {
+    Stop();
+    esp_timer_delete(timer_);
+    vEventGroupDelete(event_group_);
+}
+
+void ServoMotion::Start() {
+    portENTER_CRITICAL(&lock_);
+    started_ = true;
+    bool pending = queued_ > 0;
+    portEXIT_CRITICAL(&lock_);
+    if (pending) {
+        StartTimer();
+    }
+}
+
+void ServoMotion::Stop() {
+    portENTER_CRITICAL(&lock_);
+    started_ = false;
+    portEXIT_CRITICAL(&lock_);
+    Cancel();
+    esp_timer_stop(timer_);
+    Resume();
+}
+
+void ServoMotion::StartTimer() {
+    // Fails harmlessly if the timer is running, it picks up the new segment on its next tick
+    esp_timer_start_periodic(timer_, SERVO_MOTION_TICK_MS * 1000);
+}
+
+void ServoMotion::StopTimer() {
+    esp_timer_stop(timer_);
+    // A segment committed while stopping found the timer still running and did not start it
+    portENTER_CRITICAL(&lock_);
+    bool pending = started_ && queued_ > 0;
+    portEXIT_CRITICAL(&lock_);
+    if (pending) {
+        StartTimer();
+    }
+}
+
+ServoMotion::Segment* ServoMotion::AcquireSegment() {
+    while (true) {
+        xEventGroupClearBits(event_group_, MOTION_EVENT_SEGMENT_DONE);
+        portENTER_CRITICAL(&lock_);
+        bool cancelled = cancelled_;
+        bool full = queued_ == SERVO_MOTION_QUEUE_LENGTH;
+        int tail = (head_ + queued_) % SERVO_MOTION_QUEUE_LENGTH;
+        portEXIT_CRITICAL(&lock_);
+
+        if (cancelled) {
+            return nullptr;
+        }
+        if (!full) {
+            // The timer does not touch the tail until the segment is committed
+            return &segments_[tail];
+        }
+        xEventGroupWaitBits(event_group_, MOTION_EVENT_SEGMENT_DONE | MOTION_EVENT_CANCELLED, pdFALSE,
+                            pdFALSE, portMAX_DELAY);
+    }
+}
+
+bool ServoMotion::CommitSegment() {
+    portENTER_CRITICAL(&lock_);
+    bool committed = !cancelled_;
+    if (committed) {
+        queued_++;
+    }
+    bool start = committed && started_;
+    portEXIT_CRITICAL(&lock_);
+    if (start) {
+        StartTimer();
+    }
+    return committed;
+}
+
+bool ServoMotion::QueueMove(const int* target, int duration_ms) {
+    Segment* segment = AcquireSegment();
+    if (segment == nullptr) {
+        return false;
+    }
+    segment->duration_ms = std::max(duration_ms, 0);
+    segment->period_ms = 0;
+    segment->blend_ms = 0;
+    for (int i = 0; i < count_; i++) {
+        segment->keyframes[i][0] = target[i] * 16;
+    }
+    return CommitSegment();
+}
+
+bool ServoMotion::QueueOscillation(int period_ms, int duration_ms) {
+    if (period_ms <= 0 || duration_ms <= 0) {
+        return !cancelled();
+    }
+    Segment* segment = AcquireSegment();
+    if (segment == nullptr) {
+        return false;
+    }
+    segment->duration_ms = duration_ms;
+    segment->period_ms = period_ms;
+    segment->blend_ms = std::min(SERVO_MOTION_BLEND_MS, period_ms / 2);
+    for (int i = 0; i < count_; i++) {
+        if (servos_[i]->IsAttached()) {
+            servos_[i]->GetKeyframes(segment->keyframes[i], SERVO_MOTION_KEYFRAMES);
+            segment->keyframes[i][SERVO_MOTION_KEYFRAMES] = segment->keyframes[i][0];
+        }
+    }
+    return CommitSegment();
+}
+
+bool ServoMotion::WaitIdle() {
+    while (true) {
+        // Cleared before looking at the queue, so a segment finishing in between is not missed
+        xEventGroupClearBits(event_group_, MOTION_EVENT_SEGMENT_DONE);
+        portENTER_CRITICAL(&lock_);
+        bool cancelled = cancelled_;
+        bool idle = queued_ == 0;
+        portEXIT_CRITICAL(&lock_);
+
+        if (cancelled) {
+            return false;
+        }
+        if (idle) {
+            return true;
+        }
+        xEventGroupWaitBits(event_group_, MOTION_EVENT_SEGMENT_DONE | MOTION_EVENT_CANCELLED, pdFALSE,
+                            pdFALSE, portMAX_DELAY);
+    }
+}
+
+bool ServoMotion::Wait(int ms) {
+    if (ms <= 0) {
+        return !cancelled();
+    }
+    EventBits_t bits = xEventGroupWaitBits(event_group_, MOTION_EVENT_CANCELLED, pdFALSE, pdFALSE,
+                                           pdMS_TO_TICKS(ms));
+    return !(bits & MOTION_EVENT_CANCELLED);
+}
+
+void ServoMotion::Cancel() {
+    portENTER_CRITICAL(&lock_);
+    cancelled_ = true;
+    queued_ = 0;
+    playing_ = false;
+    portEXIT_CRITICAL(&lock_);
+    xEventGroupSetBits(event_group_, MOTION_EVENT_CANCELLED | MOTION_EVENT_SEGMENT_DONE);
+}
+
+void ServoMotion::Resume() {
+    portENTER_CRITICAL(&lock_);
+    cancelled_ = false;
+    portEXIT_CRITICAL(&lock_);
+    xEventGroupClearBits(event_group_, MOTION_EVENT_CANCELLED);
+}
+
+bool ServoMotion::cancelled() {
+    return xEventGroupGetBits(event_group_) & MOTION_EVENT_CANCELLED;
+}
+
+int ServoMotion::Sample(const Segment& segment, int servo, int elapsed_ms) {
+    int from = segment.from[servo];
+    if (segment.period_ms == 0) {
+        int target = segment.keyframes[servo][0];
+        if (segment.duration_ms == 0) {
+            return target;
+        }
+        return from + (target - from) * elapsed_ms / segment.duration_ms;
+    }
+
+    const int16_t* keyframes = segment.keyframes[servo];
+    int phase = (elapsed_ms % segment.period_ms) * SERVO_MOTION_KEYFRAMES;
+    int index = phase / segment.period_ms;
+    int fraction = phase % segment.period_ms;
+    int position = keyframes[index] + (keyframes[index + 1] - keyframes[index]) * fraction / segment.period_ms;
+    if (elapsed_ms < segment.blend_ms) {
+        position = from + (position - from) * elapsed_ms / segment.blend_ms;
+    }
+    return position;
+}
+
+void ServoMotion::Tick() {
+    int positions[SERVO_MOTION_MAX_SERVOS];
+    bool attached[SERVO_MOTION_MAX_SERVOS];
+    for (int i = 0; i < count_; i++) {
+        attached[i] = servos_[i]->IsAttached();
+        positions[i] = servos_[i]->GetPosition() * 16;
+    }
+    int64_t now = esp_timer_get_time();
+    bool segment_done = false;
+
+    portENTER_CRITICAL(&lock_);
+    if (queued_ == 0) {
+        // Cancelled since the last tick
+        portEXIT_CRITICAL(&lock_);
+        StopTimer();
+        return;
+    }
+    Segment& segment = segments_[head_];
+    if (!playing_) {
+        // Nothing was playing, the segment starts now from where the servos are
+        playing_ = true;
+        start_time_ = now;
+        for (int i = 0; i < count_; i++) {
+            segment.from[i] = positions[i];
+        }
+    }
+
+    int elapsed_ms = (int)((now - start_time_) / 1000);
+    if (elapsed_ms >= segment.duration_ms) {
+        elapsed_ms = segment.duration_ms;
+        segment_done = true;
+    }
+    for (int i = 0; i < count_; i++) {
+        if (attached[i]) {
+            positions[i] = Sample(segment, i, elapsed_ms);
+        }
+    }
+
+    if (segment_done) {
+        head_ = (head_ + 1) % SERVO_MOTION_QUEUE_LENGTH;
+        queued_--;
+        if (queued_ > 0) {
+            // The next segment continues on the same clock from the last sample
+            start_time_ += (int64_t)segment.duration_ms * 1000;
+            Segment& next = segments_[head_];
+            for (int i = 0; i < count_; i++) {
+                next.from[i] = positions[i];
+            }
+        } else {
+            playing_ = false;
+        }
+    }
+    bool idle = queued_ == 0;
+    portEXIT_CRITICAL(&lock_);
+
+    for (int i = 0; i < count_; i++) {
+        if (attached[i]) {
+            servos_[i]->SetPosition(ToDegrees(positions[i]));
+        }
+    }
+
+    if (segment_done) {
+        if (idle) {
+            StopTimer();
+        }
+        xEventGroupSetBits(event_group_, MOTION_EVENT_SEGMENT_DONE);
+    }
+}
@@ -0,0 +1,109 @@
+//--------------------------------------------------------------
+//-- ServoMotion
+//-- Timer driven playback of servo moves and oscillations
+//--------------------------------------------------------------
+#ifndef __SERVO_MOTION_H__
+#define __SERVO_MOTION_H__
+
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/event_groups.h>
+#include <cstdint>
+
+#define SERVO_MOTION_MAX_SERVOS 8
+#define SERVO_MOTION_TICK_MS 10           // Servo update period
+#define SERVO_MOTION_KEYFRAMES 32         // Samples of one oscillation period
+#define SERVO_MOTION_QUEUE_LENGTH 2       // The next segment can be queued while one plays
+#define SERVO_MOTION_BLEND_MS 120         // Oscillations fade in from the current positions
+
+/*
+ * A servo ServoMotion can drive, positions in degrees
+ */
+class MotionServo {
+public:
+    virtual ~MotionServo() = default;
+
+    virtual bool IsAttached() const = 0;
+    virtual int GetPosition() = 0;
+    virtual void SetPosition(int position) = 0;
+    // Positions at count evenly spaced phases of one oscillation period, in 1/16 degree
+    virtual void GetKeyframes(int16_t* keyframes, int count) const = 0;
+};
+
+/*
+ * The motion is split into segments, a linear move to a target or an oscillation. The calling task
+ * only queues them: the trajectory of an oscillation is sampled once from the Oscillator parameters
+ * into a keyframe table, and a periodic esp_timer interpolates the tables with integer math and writes
+ * the servos. The samples follow the timer clock, so a late callback never shifts the rest of the
+ * trajectory, and the task queuing the motion sleeps instead of polling.
+ *
+ * A segment starts from the positions the servos have when it begins, so consecutive segments blend
+ * without jumps. Cancel() drops the queue, holds the servos where they are and makes every wait return
+ * false until Resume().
+ *
+ * The timer only runs between Start() and Stop() while segments are queued.
+ *
+ * The segments must be queued from a single task.
+ */
+class ServoMotion {
+public:
+    // servos is an array of count objects derived from MotionServo
+    template <typename T>
+    ServoMotion(T* servos, int count) : ServoMotion(count) {
+        for (int i = 0; i < count_; i++) {
+            servos_[i] = &servos[i];
+        }
+    }
+    ~ServoMotion();
+
+    void Start();
+    void Stop();
+
+    // Linear move of the attached servos to target (degrees)
+    bool QueueMove(const int* target, int duration_ms);
+    // Oscillation with the parameters currently set on the oscillators, starting at phase 0
+    bool QueueOscillation(int period_ms, int duration_ms);
+
+    // False if the motion was cancelled
+    bool WaitIdle();
+    bool Wait(int ms);
+
+    void Cancel();
+    void Resume();
+    bool cancelled();
+
+private:
+    struct Segment {
+        int duration_ms;
+        int period_ms;  // 0 for a move
+        int blend_ms;
+        int16_t from[SERVO_MOTION_MAX_SERVOS];
+        // 1/16 degree. A move only uses the first entry, as its target
+        int16_t keyframes[SERVO_MOTION_MAX_SERVOS][SERVO_MOTION_KEYFRAMES + 1];
+    };
+
+    MotionServo* servos_[SERVO_MOTION_MAX_SERVOS] = {};
+    int count_;
+    esp_timer_handle_t timer_ = nullptr;
+    EventGroupHandle_t event_group_ = nullptr;
+
+    // Guarded by lock_
+    portMUX_TYPE lock_ = portMUX_INITIALIZER_UNLOCKED;
+    Segment segments_[SERVO_MOTION_QUEUE_LENGTH];
+    int head_ = 0;
+    int queued_ = 0;
+    bool playing_ = false;
+    bool cancelled_ = false;
+    bool started_ = false;
+    int64_t start_time_ = 0;
+
+    explicit ServoMotion(int count);
+    void StartTimer();
+    void StopTimer();
+    Segment* AcquireSegment();
+    bool CommitSegment();
+    void Tick();
+    static int Sample(const Segment& segment, int servo, int elapsed_ms);
+};
+
+#endif  // __SERVO_MOTION_H__
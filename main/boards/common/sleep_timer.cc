@@ -114,6 +114,8 @@ void SleepTimer::CheckTimer() {
         }
     }
     if (seconds_to_deep_sleep_ != -1 && ticks_ >= seconds_to_deep_sleep_) {
+        // Deep sleep resets the chip, settings still waiting for their commit would be lost
+        Settings::Flush();
         if (on_enter_deep_sleep_mode_) {
             on_enter_deep_sleep_mode_();
         }
@@ -4,6 +4,7 @@
 #include "application.h"
 #include "system_info.h"
 #include "settings.h"
+#include "task_profiler.h"
 #include "assets/lang_config.h"
 
 #include <freertos/FreeRTOS.h>
@@ -351,6 +352,11 @@ std::string WifiBoard::GetDeviceStatusJson() {
         cJSON_AddItemToObject(root, "chip", chip);
     }
 
+#if CONFIG_USE_TASK_PROFILER
+    // Core load and busiest tasks
+    cJSON_AddItemToObject(root, "system", TaskProfiler::GetInstance().GetStatusJson());
+#endif
+
     auto str = cJSON_PrintUnformatted(root);
     std::string result(str);
     cJSON_free(str);
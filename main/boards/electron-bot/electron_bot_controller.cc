@@ -5,6 +5,7 @@
 #include <cJSON.h>
 #include <esp_log.h>
 
+#include <atomic>
 #include <cstring>
 
 #include "application.h"
@@ -23,6 +24,7 @@ struct ElectronBotActionParams {
     int speed;
     int direction;
     int amount;
+    uint32_t generation;
 };
 
 class ElectronBotController {
@@ -31,6 +33,8 @@ private:
     TaskHandle_t action_task_handle_ = nullptr;
     QueueHandle_t action_queue_;
     bool is_action_in_progress_ = false;
+    // 每次停止时递增，用于丢弃停止前已取出的动作
+    std::atomic<uint32_t> action_generation_{0};
 
     enum ActionType {
         // 手部动作 1-12
@@ -70,6 +74,12 @@ private:
 
         while (true) {
             if (xQueueReceive(controller->action_queue_, &params, pdMS_TO_TICKS(1000)) == pdTRUE) {
+                // 先恢复再检查代数：检查之后的停止请求会取消本次动作
+                controller->electron_bot_.ResumeMotion();
+                if (params.generation != controller->action_generation_) {
+                    ESP_LOGI(TAG, "丢弃已停止的动作: %d", params.action_type);
+                    continue;
+                }
                 ESP_LOGI(TAG, "执行动作: %d", params.action_type);
                 controller->is_action_in_progress_ = true;  // 开始执行动作
 
@@ -105,15 +115,15 @@ private:
         ESP_LOGI(TAG, "动作控制: 类型=%d, 步数=%d, 速度=%d, 方向=%d, 幅度=%d", action_type, steps,
                  speed, direction, amount);
 
-        ElectronBotActionParams params = {action_type, steps, speed, direction, amount};
+        ElectronBotActionParams params = {action_type, steps, speed, direction, amount, action_generation_};
         xQueueSend(action_queue_, &params, portMAX_DELAY);
         StartActionTaskIfNeeded();
     }
 
     void StartActionTaskIfNeeded() {
         if (action_task_handle_ == nullptr) {
-            xTaskCreate(ActionTask, "electron_bot_action", 1024 * 4, this, configMAX_PRIORITIES - 1,
-                        &action_task_handle_);
+            // 舵机时序由运动定时器保证，动作任务只负责排队，不必抢占音频和网络任务
+            xTaskCreate(ActionTask, "electron_bot_action", 1024 * 4, this, 2, &action_task_handle_);
         }
     }
 
@@ -249,9 +259,10 @@ public:
         // 系统工具
         mcp_server.AddTool("self.electron.stop", "立即停止", PropertyList(),
                            [this](const PropertyList& properties) -> ReturnValue {
-                               // 清空队列但保持任务常驻
+                               // 清空队列但保持任务常驻，并取消正在播放的动作
+                               action_generation_++;
                                xQueueReset(action_queue_);
-                               is_action_in_progress_ = false;
+                               electron_bot_.CancelMotion();
                                QueueAction(ACTION_HOME, 1, 1000, 0, 0);
                                return true;
                            });
@@ -5,7 +5,7 @@
 
 #include "oscillator.h"
 
-Otto::Otto() {
+Otto::Otto() : motion_(servo_, SERVO_COUNT) {
     is_otto_resting_ = false;
     for (int i = 0; i < SERVO_COUNT; i++) {
         servo_pins_[i] = -1;
@@ -43,9 +43,11 @@ void Otto::AttachServos() {
             servo_[i].Attach(servo_pins_[i]);
         }
     }
+    motion_.Start();
 }
 
 void Otto::DetachServos() {
+    motion_.Stop();
     for (int i = 0; i < SERVO_COUNT; i++) {
         if (servo_pins_[i] != -1) {
             servo_[i].Detach();
@@ -76,26 +78,17 @@ void Otto::SetTrims(int right_pitch, int right_roll, int left_pitch, int left_ro
 //-- BASIC MOTION FUNCTIONS -------------------------------------//
 ///////////////////////////////////////////////////////////////////
 void Otto::MoveServos(int time, int servo_target[]) {
+    if (motion_.cancelled()) {
+        return;
+    }
     if (GetRestState() == true) {
         SetRestState(false);
     }
 
-    final_time_ = millis() + time;
     if (time > 10) {
-        for (int i = 0; i < SERVO_COUNT; i++) {
-            if (servo_pins_[i] != -1) {
-                increment_[i] = (servo_target[i] - servo_[i].GetPosition()) / (time / 10.0);
-            }
-        }
-
-        for (int iteration = 1; millis() < final_time_; iteration++) {
-            partial_time_ = millis() + 10;
-            for (int i = 0; i < SERVO_COUNT; i++) {
-                if (servo_pins_[i] != -1) {
-                    servo_[i].SetPosition(servo_[i].GetPosition() + increment_[i]);
-                }
-            }
-            vTaskDelay(pdMS_TO_TICKS(10));
+        // 由运动定时器从当前位置插值到目标位置，本任务只需等待
+        if (!motion_.QueueMove(servo_target, time) || !motion_.WaitIdle()) {
+            return;
         }
     } else {
         for (int i = 0; i < SERVO_COUNT; i++) {
@@ -103,7 +96,9 @@ void Otto::MoveServos(int time, int servo_target[]) {
                 servo_[i].SetPosition(servo_target[i]);
             }
         }
-        vTaskDelay(pdMS_TO_TICKS(time));
+        if (!motion_.Wait(time)) {
+            return;
+        }
     }
 
     // final adjustment to the target.
@@ -123,13 +118,17 @@ void Otto::MoveServos(int time, int servo_target[]) {
                     servo_[i].SetPosition(servo_target[i]);
                 }
             }
-            vTaskDelay(pdMS_TO_TICKS(10));
+            if (!motion_.Wait(10)) {
+                return;
+            }
             adjustment_count++;
         }
     };
 }
 
 void Otto::MoveSingle(int position, int servo_number) {
+    if (motion_.cancelled())
+        return;
     if (position > 180)
         position = 90;
     if (position < 0)
@@ -146,6 +145,9 @@ void Otto::MoveSingle(int position, int servo_number) {
 
 void Otto::OscillateServos(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
                            double phase_diff[SERVO_COUNT], float cycle = 1) {
+    if (motion_.cancelled()) {
+        return;
+    }
     for (int i = 0; i < SERVO_COUNT; i++) {
         if (servo_pins_[i] != -1) {
             servo_[i].SetO(offset[i]);
@@ -155,18 +157,10 @@ void Otto::OscillateServos(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT],
         }
     }
 
-    double ref = millis();
-    double end_time = period * cycle + ref;
-
-    while (millis() < end_time) {
-        for (int i = 0; i < SERVO_COUNT; i++) {
-            if (servo_pins_[i] != -1) {
-                servo_[i].Refresh();
-            }
-        }
-        vTaskDelay(5);
+    // 轨迹在这里预先采样成关键帧表，由运动定时器播放
+    if (motion_.QueueOscillation(period, (int)(period * cycle))) {
+        motion_.WaitIdle();
     }
-    vTaskDelay(pdMS_TO_TICKS(10));
 }
 
 void Otto::Execute(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
@@ -175,16 +169,8 @@ void Otto::Execute(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int peri
         SetRestState(false);
     }
 
-    int cycles = (int)steps;
-
-    //-- Execute complete cycles
-    if (cycles >= 1)
-        for (int i = 0; i < cycles; i++)
-            OscillateServos(amplitude, offset, period, phase_diff);
-
-    //-- Execute the final not complete cycle
-    OscillateServos(amplitude, offset, period, phase_diff, (float)steps - cycles);
-    vTaskDelay(pdMS_TO_TICKS(10));
+    //-- The complete cycles and the final not complete one play as a single segment
+    OscillateServos(amplitude, offset, period, phase_diff, steps);
 }
 
 ///////////////////////////////////////////////////////////////////
@@ -193,10 +179,10 @@ void Otto::Execute(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int peri
 void Otto::Home(bool hands_down) {
     if (is_otto_resting_ == false) {  // Go to rest position only if necessary
         MoveServos(1000, servo_initial_);
-        is_otto_resting_ = true;
+        is_otto_resting_ = !motion_.cancelled();
     }
 
-    vTaskDelay(pdMS_TO_TICKS(1000));
+    motion_.Wait(1000);
 }
 
 bool Otto::GetRestState() {
@@ -262,7 +248,7 @@ void Otto::HandAction(int action, int times, int amount, int period) {
             for (int i = 0; i < times; i++) {
                 current_positions[LEFT_PITCH] = 150 + (i % 2 == 0 ? -30 : 30);
                 MoveServos(period / 10, current_positions);
-                vTaskDelay(pdMS_TO_TICKS(period / 10));
+                motion_.Wait(period / 10);
             }
             memcpy(current_positions, servo_initial_, sizeof(current_positions));
             MoveServos(period, current_positions);
@@ -274,7 +260,7 @@ void Otto::HandAction(int action, int times, int amount, int period) {
             for (int i = 0; i < times; i++) {
                 current_positions[RIGHT_PITCH] = 30 + (i % 2 == 0 ? 30 : -30);
                 MoveServos(period / 10, current_positions);
-                vTaskDelay(pdMS_TO_TICKS(period / 10));
+                motion_.Wait(period / 10);
             }
             memcpy(current_positions, servo_initial_, sizeof(current_positions));
             MoveServos(period, current_positions);
@@ -288,7 +274,7 @@ void Otto::HandAction(int action, int times, int amount, int period) {
                 current_positions[LEFT_PITCH] = 150 + (i % 2 == 0 ? -30 : 30);
                 current_positions[RIGHT_PITCH] = 30 + (i % 2 == 0 ? 30 : -30);
                 MoveServos(period / 10, current_positions);
-                vTaskDelay(pdMS_TO_TICKS(period / 10));
+                motion_.Wait(period / 10);
             }
             memcpy(current_positions, servo_initial_, sizeof(current_positions));
             MoveServos(period, current_positions);
@@ -383,7 +369,7 @@ void Otto::BodyAction(int action, int times, int amount, int period) {
 
     current_positions[BODY] = target_angle;
     MoveServos(period, current_positions);
-    vTaskDelay(pdMS_TO_TICKS(100));
+    motion_.Wait(100);
 }
 
 //---------------------------------------------------------
@@ -426,12 +412,12 @@ void Otto::HeadAction(int action, int times, int amount, int period) {
             // 先抬头
             current_positions[HEAD] = head_center + amount;
             MoveServos(period / 3, current_positions);
-            vTaskDelay(pdMS_TO_TICKS(period / 6));
+            motion_.Wait(period / 6);
 
             // 再低头
             current_positions[HEAD] = head_center - amount;
             MoveServos(period / 3, current_positions);
-            vTaskDelay(pdMS_TO_TICKS(period / 6));
+            motion_.Wait(period / 6);
 
             // 回到中心
             current_positions[HEAD] = head_center;
@@ -453,7 +439,7 @@ void Otto::HeadAction(int action, int times, int amount, int period) {
                 current_positions[HEAD] = head_center - amount;
                 MoveServos(period / 2, current_positions);
 
-                vTaskDelay(pdMS_TO_TICKS(50));  // 短暂停顿
+                motion_.Wait(50);  // 短暂停顿
             }
 
             // 回到中心
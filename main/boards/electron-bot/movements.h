@@ -7,6 +7,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "oscillator.h"
+#include "servo_motion.h"
 
 //-- Constants
 #define FORWARD 1
@@ -69,17 +70,19 @@ public:
     void HeadAction(int action, int times = 1, int amount = 10, int period = 500);
     // action: 1=抬头, 2=低头, 3=点头, 4=回中心, 5=连续点头
 
+    //-- 动作取消：停止当前动作，之后的动作函数立即返回，直到 ResumeMotion()
+    void CancelMotion() { motion_.Cancel(); }
+    void ResumeMotion() { motion_.Resume(); }
+    bool IsMotionCancelled() { return motion_.cancelled(); }
+
 private:
     Oscillator servo_[SERVO_COUNT];
+    ServoMotion motion_;
 
     int servo_pins_[SERVO_COUNT];
     int servo_trim_[SERVO_COUNT];
     int servo_initial_[SERVO_COUNT] = {180, 180, 0, 0, 90, 90};
 
-    unsigned long final_time_;
-    unsigned long partial_time_;
-    float increment_[SERVO_COUNT];
-
     bool is_otto_resting_;
 
     void Execute(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
@@ -120,6 +120,15 @@ void Oscillator::Refresh() {
     }
 }
 
+void Oscillator::GetKeyframes(int16_t* keyframes, int count) const {
+    for (int k = 0; k < count; k++) {
+        double pos = amplitude_ * std::sin(2 * M_PI * k / count + phase0_) + offset_;
+        if (rev_)
+            pos = -pos;
+        keyframes[k] = (int16_t)std::lround((pos + 90) * 16);
+    }
+}
+
 void Oscillator::Write(int position) {
     if (!is_attached_)
         return;
@@ -6,6 +6,7 @@
 #include <driver/gpio.h>
 #include "adc_battery_estimation.h"
 #include "power_controller.h"
+#include "settings.h"
 #include <driver/rtc_io.h>
 #include <esp_sleep.h>
 
@@ -164,6 +165,7 @@ public:
                 case PowerState::SHUTDOWN: {
 
                     ESP_LOGD(TAG, "关机");
+                    Settings::Flush();
                     
                 //取消 PWR_EN 使能
                     /* 防止关机后误唤醒 */
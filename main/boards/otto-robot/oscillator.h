@@ -13,6 +13,7 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "servo_motion.h"
 
 #define M_PI 3.14159265358979323846
 
@@ -27,7 +28,7 @@
 #define SERVO_TIMEBASE_RESOLUTION_HZ 1000000  // 1MHz, 1us per tick
 #define SERVO_TIMEBASE_PERIOD 20000           // 20000 ticks, 20ms
 
-class Oscillator {
+class Oscillator : public MotionServo {
 public:
     Oscillator(int trim = 0);
     ~Oscillator();
@@ -42,12 +43,14 @@ public:
     void SetLimiter(int diff_limit) { diff_limit_ = diff_limit; };
     void DisableLimiter() { diff_limit_ = 0; };
     int GetTrim() { return trim_; };
-    void SetPosition(int position);
+    void SetPosition(int position) override;
     void Stop() { stop_ = true; };
     void Play() { stop_ = false; };
     void Reset() { phase_ = 0; };
     void Refresh();
-    int GetPosition() { return pos_; }
+    int GetPosition() override { return pos_; }
+    bool IsAttached() const override { return is_attached_; }
+    void GetKeyframes(int16_t* keyframes, int count) const override;
 
 private:
     bool NextSample();
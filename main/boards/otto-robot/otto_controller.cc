@@ -5,6 +5,7 @@
 #include <cJSON.h>
 #include <esp_log.h>
 
+#include <atomic>
 #include <cstdlib> 
 #include <cstring>
 
@@ -27,6 +28,8 @@ private:
     QueueHandle_t action_queue_;
     bool has_hands_ = false;
     bool is_action_in_progress_ = false;
+    // 每次停止时递增，用于丢弃停止前已取出的动作
+    std::atomic<uint32_t> action_generation_{0};
 
     struct OttoActionParams {
         int action_type;
@@ -35,6 +38,7 @@ private:
         int direction;
         int amount;
         char servo_sequence_json[512];  // 用于存储舵机序列的JSON字符串
+        uint32_t generation;
     };
 
     enum ActionType {
@@ -75,6 +79,12 @@ private:
 
         while (true) {
             if (xQueueReceive(controller->action_queue_, &params, pdMS_TO_TICKS(1000)) == pdTRUE) {
+                // 先恢复再检查代数：检查之后的停止请求会取消本次动作
+                controller->otto_.ResumeMotion();
+                if (params.generation != controller->action_generation_) {
+                    ESP_LOGI(TAG, "丢弃已停止的动作: %d", params.action_type);
+                    continue;
+                }
                 ESP_LOGI(TAG, "执行动作: %d", params.action_type);
                 PowerManager::PauseBatteryUpdate();  // 动作开始时暂停电量更新
                 controller->is_action_in_progress_ = true;
@@ -106,7 +116,7 @@ private:
                             current_positions[LEFT_HAND] = 45;
                             current_positions[RIGHT_HAND] = 180 - 45;
                             
-                            for (int i = 0; i < array_size; i++) {
+                            for (int i = 0; i < array_size && !controller->otto_.IsMotionCancelled(); i++) {
                                 cJSON* action_item = cJSON_GetArrayItem(actions, i);
                                 if (cJSON_IsObject(action_item)) {
                                     // 检查是否为振荡器模式（短键名 "osc"）
@@ -265,7 +275,7 @@ private:
                                     // 动作后的延迟（最后一个动作后不延迟）
                                     if (delay_after > 0 && i < array_size - 1) {
                                         ESP_LOGI(TAG, "动作%d执行完成，延迟%d毫秒", i, delay_after);
-                                        vTaskDelay(pdMS_TO_TICKS(delay_after));
+                                        controller->otto_.Wait(delay_after);
                                     }
                                 }
                             }
@@ -277,7 +287,7 @@ private:
                                 if (queue_count > 0) {
                                     ESP_LOGI(TAG, "序列执行完成，延迟%d毫秒后执行下一个序列（队列中还有%d个序列）", 
                                              sequence_delay, queue_count);
-                                    vTaskDelay(pdMS_TO_TICKS(sequence_delay));
+                                    controller->otto_.Wait(sequence_delay);
                                 }
                             }
                             // 释放JSON内存
@@ -419,8 +429,8 @@ private:
 
     void StartActionTaskIfNeeded() {
         if (action_task_handle_ == nullptr) {
-            xTaskCreate(ActionTask, "otto_action", 1024 * 3, this, configMAX_PRIORITIES - 1,
-                        &action_task_handle_);
+            // 舵机时序由运动定时器保证，动作任务只负责排队，不必抢占音频和网络任务
+            xTaskCreate(ActionTask, "otto_action", 1024 * 3, this, 2, &action_task_handle_);
         }
     }
 
@@ -440,7 +450,7 @@ private:
         ESP_LOGI(TAG, "动作控制: 类型=%d, 步数=%d, 速度=%d, 方向=%d, 幅度=%d", action_type, steps,
                  speed, direction, amount);
 
-        OttoActionParams params = {action_type, steps, speed, direction, amount, ""};
+        OttoActionParams params = {action_type, steps, speed, direction, amount, "", action_generation_};
         xQueueSend(action_queue_, &params, portMAX_DELAY);
         StartActionTaskIfNeeded();
     }
@@ -465,7 +475,7 @@ private:
             return;
         }
         
-        OttoActionParams params = {ACTION_SERVO_SEQUENCE, 0, 0, 0, 0, ""};
+        OttoActionParams params = {ACTION_SERVO_SEQUENCE, 0, 0, 0, 0, "", action_generation_};
         // 复制JSON字符串到结构体中（限制长度）
         strncpy(params.servo_sequence_json, servo_sequence_json, sizeof(params.servo_sequence_json) - 1);
         params.servo_sequence_json[sizeof(params.servo_sequence_json) - 1] = '\0';
@@ -702,13 +712,10 @@ public:
 
         mcp_server.AddTool("self.otto.stop", "立即停止所有动作并复位", PropertyList(),
                            [this](const PropertyList& properties) -> ReturnValue {
-                               if (action_task_handle_ != nullptr) {
-                                   vTaskDelete(action_task_handle_);
-                                   action_task_handle_ = nullptr;
-                               }
-                               is_action_in_progress_ = false;
-                               PowerManager::ResumeBatteryUpdate();  // 停止动作时恢复电量更新
+                               // 动作任务保持常驻：取消正在播放的动作，并丢弃已排队的动作
+                               action_generation_++;
                                xQueueReset(action_queue_);
+                               otto_.CancelMotion();
 
                                QueueAction(ACTION_HOME, 1, 1000, 1, 0);
                                return true;
@@ -9,7 +9,7 @@ static const char* TAG = "OttoMovements";
 
 #define HAND_HOME_POSITION 45
 
-Otto::Otto() {
+Otto::Otto() : motion_(servo_, SERVO_COUNT) {
     is_otto_resting_ = false;
     has_hands_ = false;
     // 初始化所有舵机管脚为-1（未连接）
@@ -52,9 +52,11 @@ void Otto::AttachServos() {
             servo_[i].Attach(servo_pins_[i]);
         }
     }
+    motion_.Start();
 }
 
 void Otto::DetachServos() {
+    motion_.Stop();
     for (int i = 0; i < SERVO_COUNT; i++) {
         if (servo_pins_[i] != -1) {
             servo_[i].Detach();
@@ -88,26 +90,17 @@ void Otto::SetTrims(int left_leg, int right_leg, int left_foot, int right_foot,
 //-- BASIC MOTION FUNCTIONS -------------------------------------//
 ///////////////////////////////////////////////////////////////////
 void Otto::MoveServos(int time, int servo_target[]) {
+    if (motion_.cancelled()) {
+        return;
+    }
     if (GetRestState() == true) {
         SetRestState(false);
     }
 
-    final_time_ = millis() + time;
     if (time > 10) {
-        for (int i = 0; i < SERVO_COUNT; i++) {
-            if (servo_pins_[i] != -1) {
-                increment_[i] = (servo_target[i] - servo_[i].GetPosition()) / (time / 10.0);
-            }
-        }
-
-        for (int iteration = 1; millis() < final_time_; iteration++) {
-            partial_time_ = millis() + 10;
-            for (int i = 0; i < SERVO_COUNT; i++) {
-                if (servo_pins_[i] != -1) {
-                    servo_[i].SetPosition(servo_[i].GetPosition() + increment_[i]);
-                }
-            }
-            vTaskDelay(pdMS_TO_TICKS(10));
+        // 由运动定时器从当前位置插值到目标位置，本任务只需等待
+        if (!motion_.QueueMove(servo_target, time) || !motion_.WaitIdle()) {
+            return;
         }
     } else {
         for (int i = 0; i < SERVO_COUNT; i++) {
@@ -115,7 +108,9 @@ void Otto::MoveServos(int time, int servo_target[]) {
                 servo_[i].SetPosition(servo_target[i]);
             }
         }
-        vTaskDelay(pdMS_TO_TICKS(time));
+        if (!motion_.Wait(time)) {
+            return;
+        }
     }
 
     // final adjustment to the target.
@@ -135,13 +130,17 @@ void Otto::MoveServos(int time, int servo_target[]) {
                     servo_[i].SetPosition(servo_target[i]);
                 }
             }
-            vTaskDelay(pdMS_TO_TICKS(10));
+            if (!motion_.Wait(10)) {
+                return;
+            }
             adjustment_count++;
         }
     };
 }
 
 void Otto::MoveSingle(int position, int servo_number) {
+    if (motion_.cancelled())
+        return;
     if (position > 180)
         position = 90;
     if (position < 0)
@@ -158,6 +157,9 @@ void Otto::MoveSingle(int position, int servo_number) {
 
 void Otto::OscillateServos(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
                            double phase_diff[SERVO_COUNT], float cycle = 1) {
+    if (motion_.cancelled()) {
+        return;
+    }
     for (int i = 0; i < SERVO_COUNT; i++) {
         if (servo_pins_[i] != -1) {
             servo_[i].SetO(offset[i]);
@@ -167,18 +169,10 @@ void Otto::OscillateServos(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT],
         }
     }
 
-    double ref = millis();
-    double end_time = period * cycle + ref;
-
-    while (millis() < end_time) {
-        for (int i = 0; i < SERVO_COUNT; i++) {
-            if (servo_pins_[i] != -1) {
-                servo_[i].Refresh();
-            }
-        }
-        vTaskDelay(5);
+    // 轨迹在这里预先采样成关键帧表，由运动定时器播放
+    if (motion_.QueueOscillation(period, (int)(period * cycle))) {
+        motion_.WaitIdle();
     }
-    vTaskDelay(pdMS_TO_TICKS(10));
 }
 
 void Otto::Execute(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int period,
@@ -187,16 +181,8 @@ void Otto::Execute(int amplitude[SERVO_COUNT], int offset[SERVO_COUNT], int peri
         SetRestState(false);
     }
 
-    int cycles = (int)steps;
-
-    //-- Execute complete cycles
-    if (cycles >= 1)
-        for (int i = 0; i < cycles; i++)
-            OscillateServos(amplitude, offset, period, phase_diff);
-
-    //-- Execute the final not complete cycle
-    OscillateServos(amplitude, offset, period, phase_diff, (float)steps - cycles);
-    vTaskDelay(pdMS_TO_TICKS(10));
+    //-- The complete cycles and the final not complete one play as a single segment
+    OscillateServos(amplitude, offset, period, phase_diff, steps);
 }
 
 //---------------------------------------------------------
@@ -220,16 +206,7 @@ void Otto::Execute2(int amplitude[SERVO_COUNT], int center_angle[SERVO_COUNT], i
         offset[i] = center_angle[i] - 90;
     }
 
-    int cycles = (int)steps;
-
-    //-- Execute complete cycles
-    if (cycles >= 1)
-        for (int i = 0; i < cycles; i++)
-            OscillateServos(amplitude, offset, period, phase_diff);
-
-    //-- Execute the final not complete cycle
-    OscillateServos(amplitude, offset, period, phase_diff, (float)steps - cycles);
-    vTaskDelay(pdMS_TO_TICKS(10));
+    OscillateServos(amplitude, offset, period, phase_diff, steps);
 }
 
 ///////////////////////////////////////////////////////////////////
@@ -259,10 +236,10 @@ void Otto::Home(bool hands_down) {
         }
 
         MoveServos(700, homes);
-        is_otto_resting_ = true;
+        is_otto_resting_ = !motion_.cancelled();
     }
 
-    vTaskDelay(pdMS_TO_TICKS(200));
+    motion_.Wait(200);
 }
 
 bool Otto::GetRestState() {
@@ -400,7 +377,7 @@ void Otto::Bend(int steps, int period, int dir) {
     for (int i = 0; i < steps; i++) {
         MoveServos(T2 / 2, bend1);
         MoveServos(T2 / 2, bend2);
-        vTaskDelay(pdMS_TO_TICKS(period * 0.8));
+        motion_.Wait(period * 0.8);
         MoveServos(500, homes);
     }
 }
@@ -451,7 +428,7 @@ void Otto::ShakeLeg(int steps, int period, int dir) {
         MoveServos(500, homes);  // Return to home position
     }
 
-    vTaskDelay(pdMS_TO_TICKS(period));
+    motion_.Wait(period);
 }
 
 //---------------------------------------------------------
@@ -644,7 +621,7 @@ void Otto::WhirlwindLeg(float steps, int period, int amplitude) {
     MoveServos(100, target);
     target[RIGHT_FOOT] = 160;
     MoveServos(500, target);
-    vTaskDelay(pdMS_TO_TICKS(1000));
+    motion_.Wait(1000);
 
     int C[SERVO_COUNT] = {90, 90, 180, 160, 45, 20};
     int A[SERVO_COUNT] = {amplitude, 0, 0, 0, amplitude, 0};
@@ -785,7 +762,7 @@ void Otto::Fitness(float steps, int period, int amplitude) {
     MoveServos(100, target);
     target[LEFT_FOOT] = 20;
     MoveServos(400, target);
-    vTaskDelay(pdMS_TO_TICKS(2000));
+    motion_.Wait(2000);
 
     int C[SERVO_COUNT] = {90, 90, 20, 90, 160, 135};
     int A[SERVO_COUNT] = {0, 0, 0, 0, 0, amplitude};
@@ -909,38 +886,38 @@ void Otto::Showcase() {
 
     // 1. 往前走3步
     Walk(3, 1000, FORWARD, 50);
-    vTaskDelay(pdMS_TO_TICKS(500));
+    motion_.Wait(500);
 
     // 2. 挥挥手
     if (has_hands_) {
         HandWave(LEFT);
-        vTaskDelay(pdMS_TO_TICKS(500));
+        motion_.Wait(500);
     }
 
     // 3. 跳舞（使用广播体操）
     if (has_hands_) {
         RadioCalisthenics();
-        vTaskDelay(pdMS_TO_TICKS(500));
+        motion_.Wait(500);
     }
 
     // 4. 太空步
     Moonwalker(3, 900, 25, LEFT);
-    vTaskDelay(pdMS_TO_TICKS(500));
+    motion_.Wait(500);
 
     // 5. 摇摆
     Swing(3, 1000, 30);
-    vTaskDelay(pdMS_TO_TICKS(500));
+    motion_.Wait(500);
 
     // 6. 起飞
     if (has_hands_) {
         Takeoff(5, 300, 40);
-        vTaskDelay(pdMS_TO_TICKS(500));
+        motion_.Wait(500);
     }
 
     // 7. 健身
     if (has_hands_) {
         Fitness(5, 1000, 25);
-        vTaskDelay(pdMS_TO_TICKS(500));
+        motion_.Wait(500);
     }
 
     // 8. 往后走3步
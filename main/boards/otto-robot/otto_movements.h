@@ -7,6 +7,7 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "oscillator.h"
+#include "servo_motion.h"
 
 //-- Constants
 #define FORWARD 1
@@ -96,16 +97,20 @@ public:
     void EnableServoLimit(int speed_limit_degree_per_sec = SERVO_LIMIT_DEFAULT);
     void DisableServoLimit();
 
+    // -- 动作取消：停止当前动作，之后的动作函数立即返回，直到 ResumeMotion()
+    void CancelMotion() { motion_.Cancel(); }
+    void ResumeMotion() { motion_.Resume(); }
+    bool IsMotionCancelled() { return motion_.cancelled(); }
+    // 可被 CancelMotion() 打断的延时，被取消时返回 false
+    bool Wait(int ms) { return motion_.Wait(ms); }
+
 private:
     Oscillator servo_[SERVO_COUNT];
+    ServoMotion motion_;
 
     int servo_pins_[SERVO_COUNT];
     int servo_trim_[SERVO_COUNT];
 
-    unsigned long final_time_;
-    unsigned long partial_time_;
-    float increment_[SERVO_COUNT];
-
     bool is_otto_resting_;
     bool has_hands_;  // 是否有手部舵机
 
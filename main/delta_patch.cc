@@ -0,0 +1,269 @@
+#include "delta_patch.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+#include <algorithm>
+
+#define TAG "DeltaPatch"
+
+#define DELTA_OP_DIFF 0x01
+#define DELTA_OP_INSERT 0x02
+
+DeltaPatch::DeltaPatch(ReadCallback read_callback, WriteCallback write_callback)
+    : read_callback_(read_callback), write_callback_(write_callback) {
+    buffer_ = (uint8_t*)heap_caps_malloc(DELTA_PATCH_BUFFER_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    mbedtls_sha256_init(&sha256_);
+    mbedtls_sha256_starts(&sha256_, 0);
+}
+
+DeltaPatch::~DeltaPatch() {
+    mbedtls_sha256_free(&sha256_);
+    heap_caps_free(buffer_);
+}
+
+bool DeltaPatch::IsPatch(const uint8_t* data, size_t size) {
+    return size >= 4 && memcmp(data, DELTA_PATCH_MAGIC, 4) == 0;
+}
+
+bool DeltaPatch::HashSource(const ReadCallback& read_callback, size_t size, SourceDigest& digest) {
+    uint8_t* buffer = (uint8_t*)heap_caps_malloc(DELTA_PATCH_BUFFER_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (buffer == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the hash buffer");
+        return false;
+    }
+    mbedtls_sha256_context sha256;
+    mbedtls_sha256_init(&sha256);
+    mbedtls_sha256_starts(&sha256, 0);
+    bool success = true;
+    for (size_t offset = 0; offset < size && success; offset += DELTA_PATCH_BUFFER_SIZE) {
+        size_t n = std::min<size_t>(DELTA_PATCH_BUFFER_SIZE, size - offset);
+        success = read_callback(offset, buffer, n);
+        if (success) {
+            mbedtls_sha256_update(&sha256, buffer, n);
+        }
+    }
+    if (success) {
+        mbedtls_sha256_finish(&sha256, digest.sha256);
+        digest.size = size;
+    }
+    mbedtls_sha256_free(&sha256);
+    heap_caps_free(buffer);
+    return success;
+}
+
+void DeltaPatch::SetSourceDigest(const SourceDigest& digest) {
+    source_digest_ = digest;
+    has_source_digest_ = true;
+}
+
+bool DeltaPatch::Fail(const char* reason) {
+    ESP_LOGE(TAG, "%s (target offset %u)", reason, written_);
+    state_ = kStateFailed;
+    return false;
+}
+
+bool DeltaPatch::CheckHeader() {
+    if (buffer_ == nullptr) {
+        return Fail("Failed to allocate the patch buffer");
+    }
+    if (memcmp(header_.magic, DELTA_PATCH_MAGIC, 4) != 0 || header_.version != DELTA_PATCH_VERSION) {
+        return Fail("Unsupported patch format");
+    }
+    ESP_LOGI(TAG, "Patch from %lu to %lu bytes%s", header_.source_size, header_.target_size,
+        in_place() ? ", in place" : "");
+
+    // The patch only fits the image it was created from
+    if (!has_source_digest_ || source_digest_.size != header_.source_size) {
+        if (!HashSource(read_callback_, header_.source_size, source_digest_)) {
+            return Fail("Failed to read the source image");
+        }
+    }
+    if (memcmp(source_digest_.sha256, header_.source_sha256, sizeof(header_.source_sha256)) != 0) {
+        return Fail("The patch was not created for the running image");
+    }
+
+    if (on_header_ && !on_header_()) {
+        return Fail("Patch rejected");
+    }
+    return true;
+}
+
+bool DeltaPatch::ReadVarint(const uint8_t*& data, size_t& size) {
+    while (size > 0) {
+        uint8_t byte = *data++;
+        size--;
+        varint_ |= (uint32_t)(byte & 0x7F) << varint_shift_;
+        if (!(byte & 0x80)) {
+            varint_shift_ = 0;
+            return true;
+        }
+        varint_shift_ += 7;
+        if (varint_shift_ > 28) {
+            Fail("Malformed varint");
+            return false;
+        }
+    }
+    return false;
+}
+
+uint32_t DeltaPatch::TakeVarint() {
+    uint32_t value = varint_;
+    varint_ = 0;
+    return value;
+}
+
+bool DeltaPatch::Write(const uint8_t* data, size_t size) {
+    if (size > header_.target_size - written_) {
+        return Fail("The patch produces more than the target size");
+    }
+    mbedtls_sha256_update(&sha256_, data, size);
+    if (!write_callback_(data, size)) {
+        return Fail("Failed to write the target image");
+    }
+    written_ += size;
+    return true;
+}
+
+bool DeltaPatch::CopySource(size_t length) {
+    while (length > 0) {
+        size_t size = std::min<size_t>(length, DELTA_PATCH_BUFFER_SIZE);
+        if (!read_callback_(source_offset_, buffer_, size)) {
+            return Fail("Failed to read the source image");
+        }
+        if (!Write(buffer_, size)) {
+            return false;
+        }
+        source_offset_ += size;
+        length -= size;
+    }
+    return true;
+}
+
+bool DeltaPatch::Feed(const uint8_t* data, size_t size) {
+    while (size > 0) {
+        switch (state_) {
+        case kStateHeader: {
+            size_t n = std::min(size, sizeof(header_) - header_received_);
+            memcpy((uint8_t*)&header_ + header_received_, data, n);
+            header_received_ += n;
+            data += n;
+            size -= n;
+            if (header_received_ == sizeof(header_)) {
+                if (!CheckHeader()) {
+                    return false;
+                }
+                state_ = kStateOpcode;
+            }
+            break;
+        }
+        case kStateOpcode:
+            if (written_ == header_.target_size) {
+                return Fail("Trailing data after the last operation");
+            }
+            if (*data == DELTA_OP_DIFF) {
+                state_ = kStateDiffOffset;
+            } else if (*data == DELTA_OP_INSERT) {
+                state_ = kStateInsertLength;
+            } else {
+                return Fail("Unknown operation");
+            }
+            data++;
+            size--;
+            break;
+        case kStateDiffOffset:
+            if (ReadVarint(data, size)) {
+                source_offset_ = TakeVarint();
+                state_ = kStateDiffLength;
+            }
+            break;
+        case kStateDiffLength:
+            if (ReadVarint(data, size)) {
+                remaining_ = TakeVarint();
+                if (source_offset_ + remaining_ > header_.source_size) {
+                    return Fail("Operation reads past the source image");
+                }
+                state_ = remaining_ > 0 ? kStateDiffSame : kStateOpcode;
+            }
+            break;
+        case kStateDiffSame:
+            if (ReadVarint(data, size)) {
+                size_t same = TakeVarint();
+                if (same > remaining_) {
+                    return Fail("Record exceeds the operation");
+                }
+                if (!CopySource(same)) {
+                    return false;
+                }
+                remaining_ -= same;
+                state_ = kStateDiffCount;
+            }
+            break;
+        case kStateDiffCount:
+            if (ReadVarint(data, size)) {
+                count_ = TakeVarint();
+                if (count_ > remaining_) {
+                    return Fail("Record exceeds the operation");
+                }
+                state_ = count_ > 0 ? kStateDiffData : (remaining_ > 0 ? kStateDiffSame : kStateOpcode);
+            }
+            break;
+        case kStateDiffData: {
+            size_t n = std::min({size, count_, (size_t)DELTA_PATCH_BUFFER_SIZE});
+            if (!read_callback_(source_offset_, buffer_, n)) {
+                return Fail("Failed to read the source image");
+            }
+            for (size_t i = 0; i < n; i++) {
+                buffer_[i] += data[i];
+            }
+            if (!Write(buffer_, n)) {
+                return false;
+            }
+            source_offset_ += n;
+            data += n;
+            size -= n;
+            count_ -= n;
+            remaining_ -= n;
+            if (count_ == 0) {
+                state_ = remaining_ > 0 ? kStateDiffSame : kStateOpcode;
+            }
+            break;
+        }
+        case kStateInsertLength:
+            if (ReadVarint(data, size)) {
+                remaining_ = TakeVarint();
+                state_ = remaining_ > 0 ? kStateInsertData : kStateOpcode;
+            }
+            break;
+        case kStateInsertData: {
+            size_t n = std::min(size, remaining_);
+            if (!Write(data, n)) {
+                return false;
+            }
+            data += n;
+            size -= n;
+            remaining_ -= n;
+            if (remaining_ == 0) {
+                state_ = kStateOpcode;
+            }
+            break;
+        }
+        case kStateFailed:
+            return false;
+        }
+    }
+    return state_ != kStateFailed;
+}
+
+bool DeltaPatch::Finish() {
+    if (state_ != kStateOpcode || written_ != header_.target_size) {
+        return Fail("The patch is incomplete");
+    }
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha256_, digest);
+    if (memcmp(digest, header_.target_sha256, sizeof(digest)) != 0) {
+        return Fail("The SHA-256 of the rebuilt image does not match");
+    }
+    ESP_LOGI(TAG, "Rebuilt and verified %u bytes", written_);
+    return true;
+}
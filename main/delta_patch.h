@@ -0,0 +1,110 @@
+#ifndef DELTA_PATCH_H
+#define DELTA_PATCH_H
+
+#include <functional>
+#include <cstdint>
+#include <cstddef>
+
+#include <mbedtls/sha256.h>
+
+#define DELTA_PATCH_MAGIC "XZDP"
+#define DELTA_PATCH_VERSION 1
+#define DELTA_PATCH_FLAG_IN_PLACE 0x0001
+#define DELTA_PATCH_BUFFER_SIZE 4096
+// In-place patches assume the target is written back one flash sector of this size at a time
+#define DELTA_PATCH_SECTOR_SIZE 4096
+
+/*
+ * Rebuilds a new image from the running one and a patch created by scripts/delta_patch.py,
+ * which also documents the format.
+ *
+ * The patch is fed in pieces of any size as it is downloaded. The source image is read through
+ * a callback, and the target is passed to the write callback in order. Before any byte is written
+ * the SHA-256 of the source is checked (see SetSourceDigest()), and Finish() checks the SHA-256 of the whole target, so a
+ * patch for another version or a corrupted download is never installed.
+ */
+class DeltaPatch {
+public:
+    using ReadCallback = std::function<bool(size_t offset, uint8_t* data, size_t size)>;
+    using WriteCallback = std::function<bool(const uint8_t* data, size_t size)>;
+
+    // SHA-256 of the first size bytes of a source image
+    struct SourceDigest {
+        size_t size;
+        uint8_t sha256[32];
+    };
+
+    DeltaPatch(ReadCallback read_callback, WriteCallback write_callback);
+    ~DeltaPatch();
+    DeltaPatch(const DeltaPatch&) = delete;
+    DeltaPatch& operator=(const DeltaPatch&) = delete;
+
+    static bool IsPatch(const uint8_t* data, size_t size);
+    static bool HashSource(const ReadCallback& read_callback, size_t size, SourceDigest& digest);
+
+    // A source hashed before the download, so the header check does not stall the download reading the
+    // whole source. The source is hashed when the header arrives if its size is not digest.size
+    void SetSourceDigest(const SourceDigest& digest);
+
+    // Returns false if the patch is malformed, does not match the source or a write fails
+    bool Feed(const uint8_t* data, size_t size);
+    // True if the whole target is written and its hash matches
+    bool Finish();
+
+    // Valid once the header is received
+    size_t source_size() const { return header_.source_size; }
+    size_t target_size() const { return header_.target_size; }
+    bool in_place() const { return header_.flags & DELTA_PATCH_FLAG_IN_PLACE; }
+    // Called when the header has been received and the source verified, return false to reject the patch
+    void OnHeader(std::function<bool()> callback) { on_header_ = callback; }
+
+private:
+    struct __attribute__((packed)) Header {
+        char magic[4];
+        uint16_t version;
+        uint16_t flags;
+        uint32_t source_size;
+        uint32_t target_size;
+        uint8_t source_sha256[32];
+        uint8_t target_sha256[32];
+    };
+
+    enum State {
+        kStateHeader,
+        kStateOpcode,
+        kStateDiffOffset,
+        kStateDiffLength,
+        kStateDiffSame,
+        kStateDiffCount,
+        kStateDiffData,
+        kStateInsertLength,
+        kStateInsertData,
+        kStateFailed,
+    };
+
+    ReadCallback read_callback_;
+    WriteCallback write_callback_;
+    std::function<bool()> on_header_;
+    Header header_ = {};
+    size_t header_received_ = 0;
+    State state_ = kStateHeader;
+    uint32_t varint_ = 0;
+    int varint_shift_ = 0;
+    size_t source_offset_ = 0;      // Next source byte of the current DIFF
+    size_t remaining_ = 0;          // Bytes left in the current operation
+    size_t count_ = 0;              // Delta bytes left in the current DIFF record
+    size_t written_ = 0;
+    uint8_t* buffer_ = nullptr;
+    mbedtls_sha256_context sha256_;
+    SourceDigest source_digest_ = {};
+    bool has_source_digest_ = false;
+
+    bool CheckHeader();
+    bool ReadVarint(const uint8_t*& data, size_t& size);
+    uint32_t TakeVarint();
+    bool CopySource(size_t length);
+    bool Write(const uint8_t* data, size_t size);
+    bool Fail(const char* reason);
+};
+
+#endif // DELTA_PATCH_H
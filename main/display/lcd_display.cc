@@ -61,6 +61,52 @@ void LcdDisplay::InitializeLcdThemes() {
     theme_manager.RegisterTheme("dark", dark_theme);
 }
 
+DisplayPipelineConfig DisplayPipelineConfig::Spi() {
+    return {
+        .buffer_lines = 20,
+        .double_buffer = false,
+        .buffer_in_psram = false,
+        .trans_lines = 0,
+        .full_refresh = false,
+        .direct_mode = false,
+        .task_priority = 1,
+#if CONFIG_SOC_CPU_CORES_NUM > 1
+        .task_affinity = 1,
+#else
+        .task_affinity = -1,
+#endif
+        .timer_period_ms = 5,
+    };
+}
+
+DisplayPipelineConfig DisplayPipelineConfig::Rgb() {
+    return {
+        .buffer_lines = 20,
+        .double_buffer = true,
+        .buffer_in_psram = false,
+        .trans_lines = 0,
+        .full_refresh = true,
+        .direct_mode = true,
+        .task_priority = 1,
+        .task_affinity = -1,
+        .timer_period_ms = 50,
+    };
+}
+
+DisplayPipelineConfig DisplayPipelineConfig::Mipi() {
+    return {
+        .buffer_lines = 50,
+        .double_buffer = false,
+        .buffer_in_psram = false,
+        .trans_lines = 0,
+        .full_refresh = false,
+        .direct_mode = false,
+        .task_priority = 4,
+        .task_affinity = -1,
+        .timer_period_ms = 5,
+    };
+}
+
 LcdDisplay::LcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel, int width, int height)
     : panel_io_(panel_io), panel_(panel) {
     width_ = width;
@@ -88,9 +134,38 @@ LcdDisplay::LcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_
     esp_timer_create(&preview_timer_args, &preview_timer_);
 }
 
+void LcdDisplay::InitializeLvglPort(const DisplayPipelineConfig& pipeline) {
+    ESP_LOGI(TAG, "Display pipeline: %d lines x%d in %s, trans %d lines, full refresh %d, direct %d",
+        pipeline.buffer_lines, pipeline.double_buffer ? 2 : 1, pipeline.buffer_in_psram ? "PSRAM" : "internal RAM",
+        pipeline.trans_lines, pipeline.full_refresh, pipeline.direct_mode);
+
+    ESP_LOGI(TAG, "Initialize LVGL port");
+    lvgl_port_cfg_t port_cfg = ESP_LVGL_PORT_INIT_CONFIG();
+    port_cfg.task_priority = pipeline.task_priority;
+    port_cfg.task_affinity = pipeline.task_affinity;
+    port_cfg.timer_period_ms = pipeline.timer_period_ms;
+    lvgl_port_init(&port_cfg);
+}
+
 SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
-                           int width, int height, int offset_x, int offset_y, bool mirror_x, bool mirror_y, bool swap_xy)
+                           int width, int height, int offset_x, int offset_y, bool mirror_x, bool mirror_y, bool swap_xy,
+                           const DisplayPipelineConfig& board_pipeline)
     : LcdDisplay(panel_io, panel, width, height) {
+    // The pipeline profile in menuconfig overrides the one of the board, to compare them with the display benchmark
+    DisplayPipelineConfig pipeline = board_pipeline;
+#if CONFIG_DISPLAY_PIPELINE_LOW_MEMORY
+    pipeline.buffer_lines = 10;
+    pipeline.double_buffer = false;
+    pipeline.buffer_in_psram = false;
+#elif CONFIG_DISPLAY_PIPELINE_DOUBLE_BUFFER
+    pipeline.double_buffer = true;
+    pipeline.buffer_in_psram = false;
+#elif CONFIG_DISPLAY_PIPELINE_PSRAM_BUFFER
+    pipeline.buffer_lines = height_ / 4;
+    pipeline.double_buffer = true;
+    pipeline.buffer_in_psram = true;
+    pipeline.trans_lines = 20;
+#endif
 
     // draw white
     std::vector<uint16_t> buffer(width_, 0xFFFF);
@@ -124,22 +199,16 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
     }
 #endif
 
-    ESP_LOGI(TAG, "Initialize LVGL port");
-    lvgl_port_cfg_t port_cfg = ESP_LVGL_PORT_INIT_CONFIG();
-    port_cfg.task_priority = 1;
-#if CONFIG_SOC_CPU_CORES_NUM > 1
-    port_cfg.task_affinity = 1;
-#endif
-    lvgl_port_init(&port_cfg);
+    InitializeLvglPort(pipeline);
 
     ESP_LOGI(TAG, "Adding LCD display");
     const lvgl_port_display_cfg_t display_cfg = {
         .io_handle = panel_io_,
         .panel_handle = panel_,
         .control_handle = nullptr,
-        .buffer_size = static_cast<uint32_t>(width_ * 20),
-        .double_buffer = false,
-        .trans_size = 0,
+        .buffer_size = static_cast<uint32_t>(width_ * pipeline.buffer_lines),
+        .double_buffer = pipeline.double_buffer,
+        .trans_size = static_cast<uint32_t>(pipeline.buffer_in_psram ? width_ * pipeline.trans_lines : 0),
         .hres = static_cast<uint32_t>(width_),
         .vres = static_cast<uint32_t>(height_),
         .monochrome = false,
@@ -150,12 +219,12 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
         },
         .color_format = LV_COLOR_FORMAT_RGB565,
         .flags = {
-            .buff_dma = 1,
-            .buff_spiram = 0,
+            .buff_dma = !pipeline.buffer_in_psram,
+            .buff_spiram = pipeline.buffer_in_psram,
             .sw_rotate = 0,
             .swap_bytes = 1,
-            .full_refresh = 0,
-            .direct_mode = 0,
+            .full_refresh = pipeline.full_refresh,
+            .direct_mode = pipeline.direct_mode,
         },
     };
 
@@ -176,7 +245,8 @@ SpiLcdDisplay::SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
 // RGB LCD implementation
 RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                            int width, int height, int offset_x, int offset_y,
-                           bool mirror_x, bool mirror_y, bool swap_xy)
+                           bool mirror_x, bool mirror_y, bool swap_xy,
+                           const DisplayPipelineConfig& pipeline)
     : LcdDisplay(panel_io, panel, width, height) {
 
     // draw white
@@ -188,18 +258,14 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
     ESP_LOGI(TAG, "Initialize LVGL library");
     lv_init();
 
-    ESP_LOGI(TAG, "Initialize LVGL port");
-    lvgl_port_cfg_t port_cfg = ESP_LVGL_PORT_INIT_CONFIG();
-    port_cfg.task_priority = 1;
-    port_cfg.timer_period_ms = 50;
-    lvgl_port_init(&port_cfg);
+    InitializeLvglPort(pipeline);
 
     ESP_LOGI(TAG, "Adding LCD display");
     const lvgl_port_display_cfg_t display_cfg = {
         .io_handle = panel_io_,
         .panel_handle = panel_,
-        .buffer_size = static_cast<uint32_t>(width_ * 20),
-        .double_buffer = true,
+        .buffer_size = static_cast<uint32_t>(width_ * pipeline.buffer_lines),
+        .double_buffer = pipeline.double_buffer,
         .hres = static_cast<uint32_t>(width_),
         .vres = static_cast<uint32_t>(height_),
         .rotation = {
@@ -208,10 +274,11 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
             .mirror_y = mirror_y,
         },
         .flags = {
-            .buff_dma = 1,
+            .buff_dma = !pipeline.buffer_in_psram,
+            .buff_spiram = pipeline.buffer_in_psram,
             .swap_bytes = 0,
-            .full_refresh = 1,
-            .direct_mode = 1,
+            .full_refresh = pipeline.full_refresh,
+            .direct_mode = pipeline.direct_mode,
         },
     };
 
@@ -237,23 +304,22 @@ RgbLcdDisplay::RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_h
 
 MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                             int width, int height,  int offset_x, int offset_y,
-                            bool mirror_x, bool mirror_y, bool swap_xy)
+                            bool mirror_x, bool mirror_y, bool swap_xy,
+                            const DisplayPipelineConfig& pipeline)
     : LcdDisplay(panel_io, panel, width, height) {
 
     ESP_LOGI(TAG, "Initialize LVGL library");
     lv_init();
 
-    ESP_LOGI(TAG, "Initialize LVGL port");
-    lvgl_port_cfg_t port_cfg = ESP_LVGL_PORT_INIT_CONFIG();
-    lvgl_port_init(&port_cfg);
+    InitializeLvglPort(pipeline);
 
     ESP_LOGI(TAG, "Adding LCD display");
     const lvgl_port_display_cfg_t disp_cfg = {
         .io_handle = panel_io,
         .panel_handle = panel,
         .control_handle = nullptr,
-        .buffer_size = static_cast<uint32_t>(width_ * 50),
-        .double_buffer = false,
+        .buffer_size = static_cast<uint32_t>(width_ * pipeline.buffer_lines),
+        .double_buffer = pipeline.double_buffer,
         .hres = static_cast<uint32_t>(width_),
         .vres = static_cast<uint32_t>(height_),
         .monochrome = false,
@@ -264,9 +330,11 @@ MipiLcdDisplay::MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel
             .mirror_y = mirror_y,
         },
         .flags = {
-            .buff_dma = true,
-            .buff_spiram =false,
+            .buff_dma = !pipeline.buffer_in_psram,
+            .buff_spiram = pipeline.buffer_in_psram,
             .sw_rotate = true,
+            .full_refresh = pipeline.full_refresh,
+            .direct_mode = pipeline.direct_mode,
         },
     };
 
@@ -358,6 +426,7 @@ void LcdDisplay::Unlock() {
 #if CONFIG_USE_WECHAT_MESSAGE_STYLE
 void LcdDisplay::SetupUI() {
     DisplayLockGuard lock(this);
+    MonitorRendering();
 
     auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
     auto text_font = lvgl_theme->text_font()->font();
@@ -499,192 +568,165 @@ void LcdDisplay::SetupUI() {
 #else
 #define  MAX_MESSAGES 20
 #endif
-void LcdDisplay::SetChatMessage(const char* role, const char* content) {
-    DisplayLockGuard lock(this);
-    if (content_ == nullptr) {
-        return;
-    }
-    
-    // Check if message count exceeds limit
-    uint32_t child_count = lv_obj_get_child_cnt(content_);
-    if (child_count >= MAX_MESSAGES) {
-        // Delete the oldest message (first child object)
+LcdDisplay::ChatBubble& LcdDisplay::AcquireChatBubble() {
+    size_t index = next_chat_bubble_;
+    next_chat_bubble_ = (next_chat_bubble_ + 1) % MAX_MESSAGES;
+    last_chat_bubble_ = index;
+
+    if (index < chat_bubbles_.size()) {
+        // Recycle the oldest message, dropping the images shown before it
+        ChatBubble& chat_bubble = chat_bubbles_[index];
         lv_obj_t* first_child = lv_obj_get_child(content_, 0);
-        lv_obj_t* last_child = lv_obj_get_child(content_, child_count - 1);
-        if (first_child != nullptr) {
-            lv_obj_del(first_child);
-        }
-        // Scroll to the last message immediately
-        if (last_child != nullptr) {
-            lv_obj_scroll_to_view_recursive(last_child, LV_ANIM_OFF);
-        }
-    }
-    
-    // Collapse system messages (if it's a system message, check if the last message is also a system message)
-    if (strcmp(role, "system") == 0) {
-        if (child_count > 0) {
-            // Get the last message container
-            lv_obj_t* last_container = lv_obj_get_child(content_, child_count - 1);
-            if (last_container != nullptr && lv_obj_get_child_cnt(last_container) > 0) {
-                // Get the bubble inside the container
-                lv_obj_t* last_bubble = lv_obj_get_child(last_container, 0);
-                if (last_bubble != nullptr) {
-                    // Check if bubble type is system message
-                    void* bubble_type_ptr = lv_obj_get_user_data(last_bubble);
-                    if (bubble_type_ptr != nullptr && strcmp((const char*)bubble_type_ptr, "system") == 0) {
-                        // If the last message is also a system message, delete it
-                        lv_obj_del(last_container);
-                    }
-                }
+        while (first_child != nullptr && first_child != chat_bubble.row) {
+            void* bubble_type_ptr = lv_obj_get_user_data(first_child);
+            if (bubble_type_ptr == nullptr || strcmp((const char*)bubble_type_ptr, "image") != 0) {
+                break;
             }
+            lv_obj_del(first_child);
+            first_child = lv_obj_get_child(content_, 0);
         }
-    } else {
-        // Hide the centered AI logo
-        lv_obj_add_flag(emoji_label_, LV_OBJ_FLAG_HIDDEN);
+        lv_obj_move_to_index(chat_bubble.row, -1);
+        lv_obj_remove_flag(chat_bubble.row, LV_OBJ_FLAG_HIDDEN);
+        return chat_bubble;
     }
 
-    // Avoid empty message boxes
-    if(strlen(content) == 0) {
+    auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
+    ChatBubble chat_bubble;
+
+    // Full-width transparent row, so the bubble can be aligned left, right or center
+    chat_bubble.row = lv_obj_create(content_);
+    lv_obj_set_width(chat_bubble.row, LV_HOR_RES);
+    lv_obj_set_height(chat_bubble.row, LV_SIZE_CONTENT);
+    lv_obj_set_style_bg_opa(chat_bubble.row, LV_OPA_TRANSP, 0);
+    lv_obj_set_style_border_width(chat_bubble.row, 0, 0);
+    lv_obj_set_style_pad_all(chat_bubble.row, 0, 0);
+    lv_obj_set_scrollbar_mode(chat_bubble.row, LV_SCROLLBAR_MODE_OFF);
+    lv_obj_remove_flag(chat_bubble.row, LV_OBJ_FLAG_SCROLLABLE);
+
+    chat_bubble.bubble = lv_obj_create(chat_bubble.row);
+    lv_obj_set_style_radius(chat_bubble.bubble, 8, 0);
+    lv_obj_set_scrollbar_mode(chat_bubble.bubble, LV_SCROLLBAR_MODE_OFF);
+    lv_obj_set_style_border_width(chat_bubble.bubble, 0, 0);
+    lv_obj_set_style_pad_all(chat_bubble.bubble, lvgl_theme->spacing(4), 0);
+    lv_obj_set_style_bg_opa(chat_bubble.bubble, LV_OPA_70, 0);
+    lv_obj_set_size(chat_bubble.bubble, LV_SIZE_CONTENT, LV_SIZE_CONTENT);
+    lv_obj_set_style_flex_grow(chat_bubble.bubble, 0, 0);
+
+    chat_bubble.label = lv_label_create(chat_bubble.bubble);
+    lv_label_set_long_mode(chat_bubble.label, LV_LABEL_LONG_WRAP);
+    lv_label_set_text(chat_bubble.label, "");
+
+    chat_bubbles_.push_back(chat_bubble);
+    return chat_bubbles_.back();
+}
+
+void LcdDisplay::SetChatBubbleRole(ChatBubble& chat_bubble, const char* role) {
+    // Restyling a recycled bubble is only needed when the role changes
+    if (chat_bubble.role != nullptr && strcmp(chat_bubble.role, role) == 0) {
         return;
     }
+    chat_bubble.role = role;
+
+    auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
+    // Set custom attribute to mark bubble type
+    lv_obj_set_user_data(chat_bubble.bubble, (void*)role);
+
+    if (strcmp(role, "user") == 0) {
+        // User messages are right-aligned with green background
+        lv_obj_set_style_bg_color(chat_bubble.bubble, lvgl_theme->user_bubble_color(), 0);
+        lv_obj_set_style_text_color(chat_bubble.label, lvgl_theme->text_color(), 0);
+        lv_obj_align(chat_bubble.bubble, LV_ALIGN_RIGHT_MID, -25, 0);
+    } else if (strcmp(role, "system") == 0) {
+        // System messages are center-aligned with light gray background
+        lv_obj_set_style_bg_color(chat_bubble.bubble, lvgl_theme->system_bubble_color(), 0);
+        lv_obj_set_style_text_color(chat_bubble.label, lvgl_theme->system_text_color(), 0);
+        lv_obj_align(chat_bubble.bubble, LV_ALIGN_CENTER, 0, 0);
+    } else {
+        // Assistant messages are left-aligned
+        lv_obj_set_style_bg_color(chat_bubble.bubble, lvgl_theme->assistant_bubble_color(), 0);
+        lv_obj_set_style_text_color(chat_bubble.label, lvgl_theme->text_color(), 0);
+        lv_obj_align(chat_bubble.bubble, LV_ALIGN_LEFT_MID, 0, 0);
+    }
+}
 
+void LcdDisplay::SetChatBubbleText(ChatBubble& chat_bubble, const char* content) {
     auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
     auto text_font = lvgl_theme->text_font()->font();
 
-    // Create a message bubble
-    lv_obj_t* msg_bubble = lv_obj_create(content_);
-    lv_obj_set_style_radius(msg_bubble, 8, 0);
-    lv_obj_set_scrollbar_mode(msg_bubble, LV_SCROLLBAR_MODE_OFF);
-    lv_obj_set_style_border_width(msg_bubble, 0, 0);
-    lv_obj_set_style_pad_all(msg_bubble, lvgl_theme->spacing(4), 0);
+    // Unpack the glyphs of the new sentence now rather than during the next refresh
+    lvgl_theme->text_font()->Prewarm(content);
 
-    // Create the message text
-    lv_obj_t* msg_text = lv_label_create(msg_bubble);
-    lv_label_set_text(msg_text, content);
-    
-    // Calculate actual text width
+    // Size the label to the text, up to 85% of the screen width
     lv_coord_t text_width = lv_txt_get_width(content, strlen(content), text_font, 0);
+    lv_coord_t max_width = LV_HOR_RES * 85 / 100 - 16;
+    lv_coord_t min_width = 20;
+    lv_obj_set_width(chat_bubble.label, std::clamp(text_width, min_width, max_width));
+
+    // Streamed text that extends the current one is appended in place
+    const char* text = lv_label_get_text(chat_bubble.label);
+    size_t length = strlen(text);
+    if (length > 0 && strncmp(content, text, length) == 0) {
+        if (content[length] != '\0') {
+            lv_label_ins_text(chat_bubble.label, LV_LABEL_POS_LAST, content + length);
+        }
+    } else {
+        lv_label_set_text(chat_bubble.label, content);
+    }
+}
 
-    // Calculate bubble width
-    lv_coord_t max_width = LV_HOR_RES * 85 / 100 - 16;  // 85% of screen width
-    lv_coord_t min_width = 20;  
-    lv_coord_t bubble_width;
-    
-    // Ensure text width is not less than minimum width
-    if (text_width < min_width) {
-        text_width = min_width;
+void LcdDisplay::SetChatMessage(const char* role, const char* content) {
+    DisplayLockGuard lock(this);
+    if (content_ == nullptr) {
+        return;
     }
 
-    // If text width is less than max width, use text width
-    if (text_width < max_width) {
-        bubble_width = text_width; 
+    // Bubble types are static strings, they are kept as the user data of the bubbles
+    if (strcmp(role, "user") == 0) {
+        role = "user";
+    } else if (strcmp(role, "system") == 0) {
+        role = "system";
     } else {
-        bubble_width = max_width;
+        role = "assistant";
     }
-    
-    // Set message text width
-    lv_obj_set_width(msg_text, bubble_width);  // Subtract padding
-    lv_label_set_long_mode(msg_text, LV_LABEL_LONG_WRAP);
 
-    // Set bubble width
-    lv_obj_set_width(msg_bubble, bubble_width);
-    lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
+    if (strcmp(role, "system") != 0) {
+        // Hide the centered AI logo
+        lv_obj_add_flag(emoji_label_, LV_OBJ_FLAG_HIDDEN);
+    }
 
-    // Set alignment and style based on message role
-    if (strcmp(role, "user") == 0) {
-        // User messages are right-aligned with green background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->user_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"user");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "assistant") == 0) {
-        // Assistant messages are left-aligned with white background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->assistant_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"assistant");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
-    } else if (strcmp(role, "system") == 0) {
-        // System messages are center-aligned with light gray background
-        lv_obj_set_style_bg_color(msg_bubble, lvgl_theme->system_bubble_color(), 0);
-        lv_obj_set_style_bg_opa(msg_bubble, LV_OPA_70, 0);
-        // Set text color for contrast
-        lv_obj_set_style_text_color(msg_text, lvgl_theme->system_text_color(), 0);
-        
-        // Set custom attribute to mark bubble type
-        lv_obj_set_user_data(msg_bubble, (void*)"system");
-        
-        // Set appropriate width for content
-        lv_obj_set_width(msg_bubble, LV_SIZE_CONTENT);
-        lv_obj_set_height(msg_bubble, LV_SIZE_CONTENT);
-        
-        // Don't grow
-        lv_obj_set_style_flex_grow(msg_bubble, 0, 0);
+    // Update the newest message in place if it has the same role: system messages replace each other,
+    // and streamed text that extends the newest message is appended to it. Only the bubble is redrawn.
+    ChatBubble* last_bubble = last_chat_bubble_ >= 0 ? &chat_bubbles_[last_chat_bubble_] : nullptr;
+    bool same_role = last_bubble != nullptr && strcmp(last_bubble->role, role) == 0;
+    if (same_role) {
+        if (strcmp(role, "system") == 0 && content[0] == '\0') {
+            // Collapse the system message, its bubble is reused by the next message
+            lv_obj_add_flag(last_bubble->row, LV_OBJ_FLAG_HIDDEN);
+            next_chat_bubble_ = last_chat_bubble_;
+            last_chat_bubble_ = -1;
+            return;
+        }
+        const char* text = lv_label_get_text(last_bubble->label);
+        if (strcmp(role, "system") == 0 || strncmp(content, text, strlen(text)) == 0) {
+            SetChatBubbleText(*last_bubble, content);
+            lv_obj_scroll_to_view_recursive(last_bubble->row, LV_ANIM_OFF);
+            return;
+        }
     }
-    
-    // Create a full-width container for user messages to ensure right alignment
-    if (strcmp(role, "user") == 0) {
-        // Create a full-width container
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        // Make container transparent and borderless
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        // Move the message bubble into this container
-        lv_obj_set_parent(msg_bubble, container);
-        
-        // Right align the bubble in the container
-        lv_obj_align(msg_bubble, LV_ALIGN_RIGHT_MID, -25, 0);
-        
-        // Auto-scroll to this container
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else if (strcmp(role, "system") == 0) {
-        // Create full-width container for system messages to ensure center alignment
-        lv_obj_t* container = lv_obj_create(content_);
-        lv_obj_set_width(container, LV_HOR_RES);
-        lv_obj_set_height(container, LV_SIZE_CONTENT);
-        
-        lv_obj_set_style_bg_opa(container, LV_OPA_TRANSP, 0);
-        lv_obj_set_style_border_width(container, 0, 0);
-        lv_obj_set_style_pad_all(container, 0, 0);
-        
-        lv_obj_set_parent(msg_bubble, container);
-        lv_obj_align(msg_bubble, LV_ALIGN_CENTER, 0, 0);
-        lv_obj_scroll_to_view_recursive(container, LV_ANIM_ON);
-    } else {
-        // For assistant messages
-        // Left align assistant messages
-        lv_obj_align(msg_bubble, LV_ALIGN_LEFT_MID, 0, 0);
 
-        // Auto-scroll to the message bubble
-        lv_obj_scroll_to_view_recursive(msg_bubble, LV_ANIM_ON);
+    // Avoid empty message boxes
+    if (content[0] == '\0') {
+        return;
     }
-    
+
+    // Only animate the scroll when the speaker changes, a burst of sentences jumps to the newest one
+    ChatBubble& chat_bubble = AcquireChatBubble();
+    SetChatBubbleRole(chat_bubble, role);
+    SetChatBubbleText(chat_bubble, content);
+    lv_obj_scroll_to_view_recursive(chat_bubble.row, same_role ? LV_ANIM_OFF : LV_ANIM_ON);
+
     // Store reference to the latest message label
-    chat_message_label_ = msg_text;
+    chat_message_label_ = chat_bubble.label;
 }
 
 void LcdDisplay::SetPreviewImage(std::unique_ptr<LvglImage> image) {
@@ -696,7 +738,10 @@ void LcdDisplay::SetPreviewImage(std::unique_ptr<LvglImage> image) {
     if (image == nullptr) {
         return;
     }
-    
+
+    // Messages after the image get a new bubble
+    last_chat_bubble_ = -1;
+
     auto lvgl_theme = static_cast<LvglTheme*>(current_theme_);
     // Create a message bubble for image preview
     lv_obj_t* img_bubble = lv_obj_create(content_);
@@ -773,6 +818,7 @@ void LcdDisplay::SetPreviewImage(std::unique_ptr<LvglImage> image) {
 #else
 void LcdDisplay::SetupUI() {
     DisplayLockGuard lock(this);
+    MonitorRendering();
     LvglTheme* lvgl_theme = static_cast<LvglTheme*>(current_theme_);
     auto text_font = lvgl_theme->text_font()->font();
     auto icon_font = lvgl_theme->icon_font()->font();
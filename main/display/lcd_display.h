@@ -10,9 +10,27 @@
 
 #include <atomic>
 #include <memory>
+#include <vector>
 
 #define PREVIEW_IMAGE_DURATION_MS 5000
 
+// How LVGL draws and flushes to the panel. Boards start from the preset of their interface and tune it.
+struct DisplayPipelineConfig {
+    int buffer_lines;           // Height of each draw buffer
+    bool double_buffer;         // Draw into one buffer while the DMA flushes the other
+    bool buffer_in_psram;       // Draw buffers in PSRAM, flushed through an internal DMA buffer of trans_lines
+    int trans_lines;
+    bool full_refresh;          // Redraw the whole screen on every change
+    bool direct_mode;           // Draw directly into the panel frame buffer
+    int task_priority;          // LVGL task
+    int task_affinity;          // -1 for any core
+    int timer_period_ms;        // LVGL timer handler period
+
+    static DisplayPipelineConfig Spi();
+    static DisplayPipelineConfig Rgb();
+    static DisplayPipelineConfig Mipi();
+};
+
 
 class LcdDisplay : public LvglDisplay {
 protected:
@@ -36,8 +54,23 @@ protected:
     std::unique_ptr<LvglImage> preview_image_cached_ = nullptr;
     bool hide_subtitle_ = false;  // Control whether to hide chat messages/subtitles
 
+    // Chat messages reuse a fixed pool of bubbles, oldest first
+    struct ChatBubble {
+        lv_obj_t* row = nullptr;    // Full-width transparent container, aligns the bubble
+        lv_obj_t* bubble = nullptr;
+        lv_obj_t* label = nullptr;
+        const char* role = nullptr;
+    };
+    std::vector<ChatBubble> chat_bubbles_;
+    size_t next_chat_bubble_ = 0;
+    int last_chat_bubble_ = -1;  // Newest message, -1 if there is none or an image came after it
+
     void InitializeLcdThemes();
+    void InitializeLvglPort(const DisplayPipelineConfig& pipeline);
     void SetupUI();
+    ChatBubble& AcquireChatBubble();
+    void SetChatBubbleRole(ChatBubble& chat_bubble, const char* role);
+    void SetChatBubbleText(ChatBubble& chat_bubble, const char* content);
     virtual bool Lock(int timeout_ms = 0) override;
     virtual void Unlock() override;
 
@@ -63,7 +96,8 @@ class SpiLcdDisplay : public LcdDisplay {
 public:
     SpiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                   int width, int height, int offset_x, int offset_y,
-                  bool mirror_x, bool mirror_y, bool swap_xy);
+                  bool mirror_x, bool mirror_y, bool swap_xy,
+                  const DisplayPipelineConfig& pipeline = DisplayPipelineConfig::Spi());
 };
 
 // RGB LCD display
@@ -71,7 +105,8 @@ class RgbLcdDisplay : public LcdDisplay {
 public:
     RgbLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                   int width, int height, int offset_x, int offset_y,
-                  bool mirror_x, bool mirror_y, bool swap_xy);
+                  bool mirror_x, bool mirror_y, bool swap_xy,
+                  const DisplayPipelineConfig& pipeline = DisplayPipelineConfig::Rgb());
 };
 
 // MIPI LCD display
@@ -79,7 +114,8 @@ class MipiLcdDisplay : public LcdDisplay {
 public:
     MipiLcdDisplay(esp_lcd_panel_io_handle_t panel_io, esp_lcd_panel_handle_t panel,
                    int width, int height, int offset_x, int offset_y,
-                   bool mirror_x, bool mirror_y, bool swap_xy);
+                   bool mirror_x, bool mirror_y, bool swap_xy,
+                   const DisplayPipelineConfig& pipeline = DisplayPipelineConfig::Mipi());
 };
 
 #endif // LCD_DISPLAY_H
@@ -0,0 +1,81 @@
+#include "display_benchmark.h"
+#include "lvgl_theme.h"
+#include "assets/lang_config.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#define TAG "DisplayBenchmark"
+
+// Task created by esp_lvgl_port
+#define LVGL_TASK_NAME "taskLVGL"
+
+static const char* const kChatMessages[] = {
+    "What is the weather like today?",
+    "It is sunny today, around twenty degrees, a good day for a walk in the park.",
+    "Tell me a short story.",
+    "Once upon a time, a little robot learned to sing. Every morning it woke the whole town with a new song.",
+};
+
+void DisplayBenchmark::RunPhase(const char* name, std::function<void(int step)> step) {
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    TaskHandle_t lvgl_task = xTaskGetHandle(LVGL_TASK_NAME);
+    uint32_t run_time_start = lvgl_task != nullptr ? ulTaskGetRunTimeCounter(lvgl_task) : 0;
+#endif
+    display_->GetRenderStatistics(true);
+    int64_t start_time = esp_timer_get_time();
+    for (int i = 0; esp_timer_get_time() - start_time < DISPLAY_BENCHMARK_PHASE_MS * 1000LL; i++) {
+        if (step) {
+            step(i);
+        }
+        vTaskDelay(pdMS_TO_TICKS(DISPLAY_BENCHMARK_STEP_MS));
+    }
+    auto stats = display_->GetRenderStatistics(true);
+    int64_t elapsed_us = esp_timer_get_time() - start_time;
+
+    int cpu = -1;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    if (lvgl_task != nullptr) {
+        // The run time counter counts microseconds and may wrap, only the difference is used
+        cpu = (uint32_t)(ulTaskGetRunTimeCounter(lvgl_task) - run_time_start) * 100 / elapsed_us;
+    }
+#endif
+
+    uint32_t frames = stats.frames > 0 ? stats.frames : 1;
+    ESP_LOGI(TAG, "%s: %.1f FPS, frame avg %lu us max %lu us, flush %lu us wait %lu us per frame, %lu KB/s, LVGL CPU %d%%",
+        name, stats.frames * 1000000.0f / elapsed_us,
+        (uint32_t)(stats.frame_time_us / frames), stats.max_frame_time_us,
+        (uint32_t)(stats.flush_time_us / frames), (uint32_t)(stats.flush_wait_time_us / frames),
+        (uint32_t)(stats.flush_bytes * 1000000 / elapsed_us / 1024), cpu);
+}
+
+void DisplayBenchmark::Run() {
+    ESP_LOGI(TAG, "Running display benchmark, %d ms per part", DISPLAY_BENCHMARK_PHASE_MS);
+    const int message_count = sizeof(kChatMessages) / sizeof(kChatMessages[0]);
+
+    RunPhase("chat_scroll", [this, message_count](int step) {
+        display_->SetChatMessage(step % 2 == 0 ? "user" : "assistant", kChatMessages[step % message_count]);
+    });
+    auto theme = static_cast<LvglTheme*>(display_->GetTheme());
+    auto text_font = theme != nullptr ? dynamic_cast<LvglCBinFont*>(theme->text_font().get()) : nullptr;
+    if (text_font != nullptr) {
+        text_font->LogCacheStats();
+    }
+
+    display_->SetChatMessage("system", "");
+    display_->SetEmotion("happy");
+    RunPhase("gif_emotion", nullptr);
+
+    RunPhase("status_bar", [this](int step) {
+        display_->SetStatus(step % 2 == 0 ? Lang::Strings::LISTENING : Lang::Strings::SPEAKING);
+        if (step % 10 == 0) {
+            display_->ShowNotification(Lang::Strings::CONNECTING, DISPLAY_BENCHMARK_STEP_MS * 5);
+        }
+        display_->UpdateStatusBar(true);
+    });
+
+    display_->SetEmotion("neutral");
+    display_->SetStatus(Lang::Strings::INITIALIZING);
+}
@@ -0,0 +1,33 @@
+#ifndef DISPLAY_BENCHMARK_H
+#define DISPLAY_BENCHMARK_H
+
+#include "lvgl_display.h"
+
+#include <functional>
+
+/*
+ * Renders a standard scene on an LvglDisplay and logs the FPS, frame time, flush time, bytes flushed
+ * and the CPU load of the LVGL task for each part of it:
+ *   chat_scroll  a new chat message every step
+ *   gif_emotion  an animated emotion without other updates
+ *   status_bar   status text, notification and status bar icons every step
+ *
+ * Run() blocks the caller for DISPLAY_BENCHMARK_PHASE_MS per part, so the results of different pipeline
+ * profiles and panels can be compared directly.
+ */
+
+#define DISPLAY_BENCHMARK_PHASE_MS 5000
+#define DISPLAY_BENCHMARK_STEP_MS 100
+
+class DisplayBenchmark {
+public:
+    explicit DisplayBenchmark(LvglDisplay* display) : display_(display) {}
+    void Run();
+
+private:
+    LvglDisplay* display_;
+
+    void RunPhase(const char* name, std::function<void(int step)> step);
+};
+
+#endif // DISPLAY_BENCHMARK_H
@@ -0,0 +1,91 @@
+#include "gif_frame_cache.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+#include <algorithm>
+
+#define TAG "GifFrameCache"
+
+// Bytes of the GIF hashed to tell apart different files loaded at the same address
+#define GIF_FRAME_CACHE_CHECKSUM_BYTES 256
+
+GifFrames::GifFrames(uint16_t width, uint16_t height) : width_(width), height_(height) {
+}
+
+GifFrames::~GifFrames() {
+    for (auto buffer : buffers_) {
+        heap_caps_free(buffer);
+    }
+}
+
+bool GifFrames::AddFrame(const uint8_t* canvas, uint32_t delay_ms) {
+    size_t pixels = (size_t)width_ * height_;
+    auto buffer = (uint8_t*)heap_caps_malloc(frame_size(), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (buffer == nullptr) {
+        ESP_LOGW(TAG, "Failed to allocate a %ux%u frame", width_, height_);
+        return false;
+    }
+
+    /* RGB565A8: the RGB565 plane is followed by the alpha plane. Canvas pixels are B, G, R, A */
+    auto rgb = (uint16_t*)buffer;
+    auto alpha = buffer + pixels * 2;
+    for (size_t i = 0; i < pixels; i++) {
+        const uint8_t* pixel = &canvas[i * 4];
+        rgb[i] = ((pixel[2] & 0xF8) << 8) | ((pixel[1] & 0xFC) << 3) | (pixel[0] >> 3);
+        alpha[i] = pixel[3];
+    }
+
+    if (!buffers_.empty() && memcmp(buffers_.back(), buffer, frame_size()) == 0) {
+        heap_caps_free(buffer);
+        frames_.push_back({buffers_.back(), delay_ms});
+        return true;
+    }
+    if (memory_size() + frame_size() > GifFrameCache::GetInstance().max_size()) {
+        heap_caps_free(buffer);
+        return false;
+    }
+    buffers_.push_back(buffer);
+    frames_.push_back({buffer, delay_ms});
+    return true;
+}
+
+uint32_t GifFrameCache::GetChecksum(const lv_img_dsc_t* src) {
+    /* FNV-1a */
+    uint32_t hash = 2166136261u;
+    size_t length = std::min<size_t>(src->data_size, GIF_FRAME_CACHE_CHECKSUM_BYTES);
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ src->data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+size_t GifFrameCache::max_size() const {
+    return CONFIG_GIF_FRAME_CACHE_SIZE_KB * 1024;
+}
+
+std::shared_ptr<const GifFrames> GifFrameCache::Find(const lv_img_dsc_t* src) {
+    uint32_t checksum = GetChecksum(src);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+        if (it->data == src->data && it->data_size == src->data_size && it->checksum == checksum) {
+            entries_.splice(entries_.begin(), entries_, it);
+            return entries_.front().frames;
+        }
+    }
+    return nullptr;
+}
+
+void GifFrameCache::Insert(const lv_img_dsc_t* src, std::shared_ptr<const GifFrames> frames) {
+    size_t size = frames->memory_size();
+    if (size > max_size() || Find(src) != nullptr) {
+        return;
+    }
+    while (!entries_.empty() && size_ + size > max_size()) {
+        size_ -= entries_.back().frames->memory_size();
+        entries_.pop_back();
+    }
+    entries_.push_front({src->data, src->data_size, GetChecksum(src), frames});
+    size_ += size;
+    ESP_LOGI(TAG, "Cached %ux%u GIF, %u frames in %u KB, cache %u / %u KB", frames->width(), frames->height(),
+        (unsigned)frames->frames().size(), (unsigned)(size / 1024), (unsigned)(size_ / 1024), (unsigned)(max_size() / 1024));
+}
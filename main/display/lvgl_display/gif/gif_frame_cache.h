@@ -0,0 +1,95 @@
+#pragma once
+
+#include <lvgl.h>
+#include <list>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+/**
+ * Decoded GIF frames kept in PSRAM, so an animation is decoded only once and then replayed
+ *
+ * LvglGif records the frames it renders during the first pass of an animation, converted to RGB565A8,
+ * and publishes them here once the pass is complete. Later LvglGif instances of the same GIF replay the
+ * frames without opening the decoder. A frame equal to the previous one shares its buffer.
+ *
+ * Animations are evicted least recently used first once the cache exceeds CONFIG_GIF_FRAME_CACHE_SIZE_KB.
+ * Evicted frames stay valid until the last LvglGif replaying them is gone.
+ *
+ * Only used from the LVGL task.
+ */
+class GifFrames {
+public:
+    struct Frame {
+        const uint8_t* data;
+        uint32_t delay_ms;
+    };
+
+    GifFrames(uint16_t width, uint16_t height);
+    ~GifFrames();
+    GifFrames(const GifFrames&) = delete;
+    GifFrames& operator=(const GifFrames&) = delete;
+
+    /**
+     * Convert an ARGB8888 canvas and append it, false if it does not fit in the cache or PSRAM
+     */
+    bool AddFrame(const uint8_t* canvas, uint32_t delay_ms);
+
+    uint16_t width() const { return width_; }
+    uint16_t height() const { return height_; }
+    size_t frame_size() const { return (size_t)width_ * height_ * 3; }
+    size_t memory_size() const { return buffers_.size() * frame_size(); }
+    const std::vector<Frame>& frames() const { return frames_; }
+
+    /**
+     * Loop count of the GIF as gifdec keeps it: -1 plays once, 0 loops forever, N plays N times
+     */
+    int32_t loop_count() const { return loop_count_; }
+    void set_loop_count(int32_t loop_count) { loop_count_ = loop_count; }
+
+private:
+    uint16_t width_;
+    uint16_t height_;
+    int32_t loop_count_ = -1;
+    std::vector<uint8_t*> buffers_;
+    std::vector<Frame> frames_;
+};
+
+class GifFrameCache {
+public:
+    static GifFrameCache& GetInstance() {
+        static GifFrameCache instance;
+        return instance;
+    }
+
+    GifFrameCache(const GifFrameCache&) = delete;
+    GifFrameCache& operator=(const GifFrameCache&) = delete;
+
+    /**
+     * Frames of the GIF in the image descriptor, nullptr if it has not been cached yet
+     */
+    std::shared_ptr<const GifFrames> Find(const lv_img_dsc_t* src);
+    void Insert(const lv_img_dsc_t* src, std::shared_ptr<const GifFrames> frames);
+
+    /**
+     * Largest animation that can be cached
+     */
+    size_t max_size() const;
+
+private:
+    GifFrameCache() = default;
+
+    struct Entry {
+        const void* data;
+        uint32_t data_size;
+        uint32_t checksum;
+        std::shared_ptr<const GifFrames> frames;
+    };
+
+    // Most recently used first
+    std::list<Entry> entries_;
+    size_t size_ = 0;
+
+    static uint32_t GetChecksum(const lv_img_dsc_t* src);
+};
@@ -36,6 +36,31 @@ static void f_gif_close(gd_GIF * gif);
 
 #if LV_USE_DRAW_SW_ASM == LV_DRAW_SW_ASM_HELIUM
     #include "gifdec_mve.h"
+    #define GIFDEC_LUT_SIZE 0
+#else
+/* Palette expanded to canvas pixels, allocated after the canvas */
+#define GIFDEC_LUT_SIZE (0x100 * sizeof(uint32_t))
+
+/* Canvas pixels are B, G, R, A in memory, i.e. one little-endian 32-bit word per pixel */
+static inline uint32_t
+canvas_pixel(const uint8_t * color, uint8_t opa)
+{
+    return ((uint32_t) opa << 24) | ((uint32_t) color[0] << 16) | ((uint32_t) color[1] << 8) | color[2];
+}
+
+static void
+fill_rect(uint8_t * dst, uint16_t w, uint16_t h, uint32_t stride, const uint8_t * color, uint8_t opa)
+{
+    /* The canvas follows the gd_GIF structure, so its rows are 32-bit aligned */
+    uint32_t pixel = canvas_pixel(color, opa);
+    uint32_t * row = (uint32_t *) dst;
+    for(int j = 0; j < h; j++) {
+        for(int k = 0; k < w; k++) {
+            row[k] = pixel;
+        }
+        row += stride;
+    }
+}
 #endif
 
 static uint16_t
@@ -117,17 +142,17 @@ static gd_GIF * gif_open(gd_GIF * gif_base)
         goto fail;
     }
 #if LV_GIF_CACHE_DECODE_DATA
-    if(0 == (INT_MAX - sizeof(gd_GIF) - LZW_CACHE_SIZE) / width / height / 5){
+    if(0 == (INT_MAX - sizeof(gd_GIF) - GIFDEC_LUT_SIZE - LZW_CACHE_SIZE) / width / height / 5){
         ESP_LOGW(TAG, "Image dimensions are too large");
         goto fail;
     } 
-    gif = lv_malloc(sizeof(gd_GIF) + 5 * width * height + LZW_CACHE_SIZE);
+    gif = lv_malloc(sizeof(gd_GIF) + 5 * width * height + GIFDEC_LUT_SIZE + LZW_CACHE_SIZE);
 #else
-    if(0 == (INT_MAX - sizeof(gd_GIF)) / width / height / 5){
+    if(0 == (INT_MAX - sizeof(gd_GIF) - GIFDEC_LUT_SIZE) / width / height / 5){
         ESP_LOGW(TAG, "Image dimensions are too large");
         goto fail;
     } 
-    gif = lv_malloc(sizeof(gd_GIF) + 5 * width * height);
+    gif = lv_malloc(sizeof(gd_GIF) + 5 * width * height + GIFDEC_LUT_SIZE);
 #endif
     if(!gif) goto fail;
     memcpy(gif, gif_base, sizeof(gd_GIF));
@@ -140,7 +165,8 @@ static gd_GIF * gif_open(gd_GIF * gif_base)
     gif->palette = &gif->gct;
     gif->bgindex = bgidx;
     gif->canvas = (uint8_t *) &gif[1];
-    gif->frame = &gif->canvas[4 * width * height];
+    gif->lut = (uint32_t *) &gif->canvas[4 * width * height];
+    gif->frame = &gif->canvas[4 * width * height + GIFDEC_LUT_SIZE];
     if(gif->bgindex) {
         memset(gif->frame, gif->bgindex, gif->width * gif->height);
     }
@@ -152,12 +178,8 @@ static gd_GIF * gif_open(gd_GIF * gif_base)
 #ifdef GIFDEC_FILL_BG
     GIFDEC_FILL_BG(gif->canvas, gif->width * gif->height, 1, gif->width * gif->height, bgcolor, 0x00);
 #else
-    for(int i = 0; i < gif->width * gif->height; i++) {
-        gif->canvas[i * 4 + 0] = *(bgcolor + 2);
-        gif->canvas[i * 4 + 1] = *(bgcolor + 1);
-        gif->canvas[i * 4 + 2] = *(bgcolor + 0);
-        gif->canvas[i * 4 + 3] = 0x00;  // 初始化为透明，让第一帧根据自己的透明度设置来渲染
-    }
+    // 初始化为透明，让第一帧根据自己的透明度设置来渲染
+    fill_rect(gif->canvas, gif->width, gif->height, gif->width, bgcolor, 0x00);
 #endif
     gif->anim_start = f_gif_seek(gif, 0, LV_FS_SEEK_CUR);
     gif->loop_count = -1;
@@ -666,21 +688,24 @@ render_frame_rect(gd_GIF * gif, uint8_t * buffer)
                         &gif->frame[i], gif->palette->colors,
                         gif->gce.transparency ? gif->gce.tindex : 0x100);
 #else
-    int j, k;
-    uint8_t index, * color;
-
-    for(j = 0; j < gif->fh; j++) {
-        for(k = 0; k < gif->fw; k++) {
-            index = gif->frame[(gif->fy + j) * gif->width + gif->fx + k];
-            color = &gif->palette->colors[index * 3];
-            if(!gif->gce.transparency || index != gif->gce.tindex) {
-                buffer[(i + k) * 4 + 0] = *(color + 2);
-                buffer[(i + k) * 4 + 1] = *(color + 1);
-                buffer[(i + k) * 4 + 2] = *(color + 0);
-                buffer[(i + k) * 4 + 3] = 0xFF;
+    /* Expand the palette once, so every pixel is a single table load and 32-bit store */
+    uint32_t * lut = gif->lut;
+    for(int n = 0; n < 0x100; n++) {
+        lut[n] = canvas_pixel(&gif->palette->colors[n * 3], 0xFF);
+    }
+
+    int tindex = gif->gce.transparency ? gif->gce.tindex : 0x100;
+    const uint8_t * src = &gif->frame[i];
+    uint32_t * dst = (uint32_t *) buffer + i;
+    for(int j = 0; j < gif->fh; j++) {
+        for(int k = 0; k < gif->fw; k++) {
+            uint8_t index = src[k];
+            if(index != tindex) {
+                dst[k] = lut[index];
             }
         }
-        i += gif->width;
+        src += gif->width;
+        dst += gif->width;
     }
 #endif
 }
@@ -701,16 +726,7 @@ dispose(gd_GIF * gif)
 #ifdef GIFDEC_FILL_BG
             GIFDEC_FILL_BG(&(gif->canvas[i * 4]), gif->fw, gif->fh, gif->width, bgcolor, opa);
 #else
-            int j, k;
-            for(j = 0; j < gif->fh; j++) {
-                for(k = 0; k < gif->fw; k++) {
-                    gif->canvas[(i + k) * 4 + 0] = *(bgcolor + 2);
-                    gif->canvas[(i + k) * 4 + 1] = *(bgcolor + 1);
-                    gif->canvas[(i + k) * 4 + 2] = *(bgcolor + 0);
-                    gif->canvas[(i + k) * 4 + 3] = opa;
-                }
-                i += gif->width;
-            }
+            fill_rect(&gif->canvas[i * 4], gif->fw, gif->fh, gif->width, bgcolor, opa);
 #endif
             break;
         case 3: /* Restore to previous, i.e., don't update canvas.*/
@@ -46,6 +46,7 @@ typedef struct _gd_GIF {
     uint16_t fx, fy, fw, fh;
     uint8_t bgindex;
     uint8_t * canvas, * frame;
+    uint32_t * lut;
 #if LV_GIF_CACHE_DECODE_DATA
     uint8_t *lzw_cache;
 #endif
@@ -11,6 +11,17 @@ LvglGif::LvglGif(const lv_img_dsc_t* img_dsc)
         return;
     }
 
+#if CONFIG_USE_GIF_FRAME_CACHE
+    src_dsc_ = *img_dsc;
+    auto frames = GifFrameCache::GetInstance().Find(img_dsc);
+    if (frames) {
+        UseCachedFrames(frames, frames->loop_count());
+        loaded_ = true;
+        ESP_LOGD(TAG, "GIF replayed from cache: %dx%d", frames->width(), frames->height());
+        return;
+    }
+#endif
+
     gif_ = gd_open_gif_data(img_dsc->data);
     if (!gif_) {
         ESP_LOGE(TAG, "Failed to open GIF from image descriptor");
@@ -33,6 +44,9 @@ LvglGif::LvglGif(const lv_img_dsc_t* img_dsc)
         gd_render_frame(gif_, gif_->canvas);
     }
 
+#if CONFIG_USE_GIF_FRAME_CACHE
+    recording_ = std::make_shared<GifFrames>(gif_->width, gif_->height);
+#endif
     loaded_ = true;
     ESP_LOGD(TAG, "GIF loaded from image descriptor: %dx%d", gif_->width, gif_->height);
 }
@@ -52,7 +66,7 @@ const lv_img_dsc_t* LvglGif::image_dsc() const {
 
 // Animation control methods
 void LvglGif::Start() {
-    if (!loaded_ || !gif_) {
+    if (!loaded_) {
         ESP_LOGW(TAG, "GIF not loaded, cannot start");
         return;
     }
@@ -71,7 +85,15 @@ void LvglGif::Start() {
         lv_timer_reset(timer_);
         
         // Render first frame
+#if CONFIG_USE_GIF_FRAME_CACHE
+        if (cached_frames_) {
+            ShowCachedFrame(0);
+        } else {
+            NextFrame();
+        }
+#else
         NextFrame();
+#endif
         
         ESP_LOGD(TAG, "GIF animation started");
     }
@@ -86,7 +108,7 @@ void LvglGif::Pause() {
 }
 
 void LvglGif::Resume() {
-    if (!loaded_ || !gif_) {
+    if (!loaded_) {
         ESP_LOGW(TAG, "GIF not loaded, cannot resume");
         return;
     }
@@ -104,8 +126,23 @@ void LvglGif::Stop() {
         lv_timer_pause(timer_);
     }
 
+#if CONFIG_USE_GIF_FRAME_CACHE
+    if (cached_frames_) {
+        cached_loop_count_ = cached_frames_->loop_count();
+        ShowCachedFrame(0);
+        ESP_LOGD(TAG, "GIF animation stopped and rewound");
+        return;
+    }
+#endif
     if (gif_) {
         gd_rewind(gif_);
+#if CONFIG_USE_GIF_FRAME_CACHE
+        /* The recording has to start over with the first frame */
+        if (recording_) {
+            recording_ = std::make_shared<GifFrames>(gif_->width, gif_->height);
+            recorded_position_ = 0;
+        }
+#endif
         NextFrame();
         ESP_LOGD(TAG, "GIF animation stopped and rewound");
     }
@@ -120,32 +157,45 @@ bool LvglGif::IsLoaded() const {
 }
 
 int32_t LvglGif::GetLoopCount() const {
-    if (!loaded_ || !gif_) {
+    if (!loaded_) {
         return -1;
     }
+#if CONFIG_USE_GIF_FRAME_CACHE
+    if (!gif_) {
+        return cached_loop_count_;
+    }
+#endif
     return gif_->loop_count;
 }
 
 void LvglGif::SetLoopCount(int32_t count) {
-    if (!loaded_ || !gif_) {
+    if (!loaded_) {
         ESP_LOGW(TAG, "GIF not loaded, cannot set loop count");
         return;
     }
+#if CONFIG_USE_GIF_FRAME_CACHE
+    if (!gif_) {
+        cached_loop_count_ = count;
+        return;
+    }
+    /* The cache keeps the loop count of the GIF itself, which this one no longer plays */
+    recording_.reset();
+#endif
     gif_->loop_count = count;
 }
 
 uint16_t LvglGif::width() const {
-    if (!loaded_ || !gif_) {
+    if (!loaded_) {
         return 0;
     }
-    return gif_->width;
+    return img_dsc_.header.w;
 }
 
 uint16_t LvglGif::height() const {
-    if (!loaded_ || !gif_) {
+    if (!loaded_) {
         return 0;
     }
-    return gif_->height;
+    return img_dsc_.header.h;
 }
 
 void LvglGif::SetFrameCallback(std::function<void()> callback) {
@@ -153,9 +203,15 @@ void LvglGif::SetFrameCallback(std::function<void()> callback) {
 }
 
 void LvglGif::NextFrame() {
-    if (!loaded_ || !gif_ || !playing_) {
+    if (!loaded_ || !playing_) {
         return;
     }
+#if CONFIG_USE_GIF_FRAME_CACHE
+    if (cached_frames_) {
+        NextCachedFrame();
+        return;
+    }
+#endif
 
     // Check if enough time has passed for the next frame
     uint32_t elapsed = lv_tick_elaps(last_call_);
@@ -179,6 +235,13 @@ void LvglGif::NextFrame() {
     // Render current frame
     if (gif_->canvas) {
         gd_render_frame(gif_, gif_->canvas);
+
+#if CONFIG_USE_GIF_FRAME_CACHE
+        RecordFrame(has_next);
+        if (cached_frames_) {
+            return;
+        }
+#endif
         
         // Call frame callback if set
         if (frame_callback_) {
@@ -187,6 +250,103 @@ void LvglGif::NextFrame() {
     }
 }
 
+#if CONFIG_USE_GIF_FRAME_CACHE
+void LvglGif::RecordFrame(int has_next) {
+    if (!recording_) {
+        return;
+    }
+    if (has_next < 0) {
+        recording_.reset();
+        return;
+    }
+
+    /* The decoder seeks back to the start of the animation when it loops, so a frame read from an earlier
+     * position than the previous one starts the second pass */
+    bool wrapped = has_next > 0 && !recording_->frames().empty() && gif_->f_rw_p <= recorded_position_;
+    if (has_next > 0 && !wrapped) {
+        if (recording_->frames().empty()) {
+            /* Read from the NETSCAPE extension in front of the first frame */
+            recording_->set_loop_count(gif_->loop_count);
+        }
+        recorded_position_ = gif_->f_rw_p;
+        if (!recording_->AddFrame(gif_->canvas, gif_->gce.delay * 10)) {
+            ESP_LOGD(TAG, "GIF does not fit in the frame cache, decoding every frame");
+            recording_.reset();
+        }
+        return;
+    }
+    if (recording_->frames().empty()) {
+        recording_.reset();
+        return;
+    }
+
+    /* The first pass is complete: replay it from now on, the decoder is not needed anymore.
+     * gd_get_frame() has already counted the pass that starts now */
+    std::shared_ptr<const GifFrames> frames = std::move(recording_);
+    GifFrameCache::GetInstance().Insert(&src_dsc_, frames);
+    UseCachedFrames(frames, gif_->loop_count);
+    /* Without a loop the animation has ended on its last frame */
+    ShowCachedFrame(wrapped ? 0 : frames->frames().size() - 1);
+}
+
+void LvglGif::UseCachedFrames(std::shared_ptr<const GifFrames> frames, int32_t loop_count) {
+    if (gif_) {
+        gd_close_gif(gif_);
+        gif_ = nullptr;
+    }
+    cached_frames_ = frames;
+    cached_loop_count_ = loop_count;
+
+    memset(&img_dsc_, 0, sizeof(img_dsc_));
+    img_dsc_.header.magic = LV_IMAGE_HEADER_MAGIC;
+    img_dsc_.header.cf = LV_COLOR_FORMAT_RGB565A8;
+    img_dsc_.header.w = frames->width();
+    img_dsc_.header.h = frames->height();
+    img_dsc_.header.stride = frames->width() * 2;
+    img_dsc_.data_size = frames->frame_size();
+    cached_index_ = 0;
+    img_dsc_.data = frames->frames()[0].data;
+}
+
+void LvglGif::ShowCachedFrame(size_t index) {
+    cached_index_ = index;
+    img_dsc_.data = cached_frames_->frames()[index].data;
+    if (frame_callback_) {
+        frame_callback_();
+    }
+}
+
+void LvglGif::NextCachedFrame() {
+    auto& frames = cached_frames_->frames();
+    uint32_t elapsed = lv_tick_elaps(last_call_);
+    if (elapsed < frames[cached_index_].delay_ms) {
+        return;
+    }
+    last_call_ = lv_tick_get();
+
+    size_t next = cached_index_ + 1;
+    if (next >= frames.size()) {
+        /* Same loop count handling as gd_get_frame() */
+        if (cached_loop_count_ == 1 || cached_loop_count_ < 0) {
+            playing_ = false;
+            if (timer_) {
+                lv_timer_pause(timer_);
+            }
+            ESP_LOGD(TAG, "GIF animation completed");
+            return;
+        } else if (cached_loop_count_ > 1) {
+            cached_loop_count_--;
+        }
+        next = 0;
+    }
+    if (frames[next].data != frames[cached_index_].data) {
+        ShowCachedFrame(next);
+    } else {
+        cached_index_ = next;
+    }
+}
+#endif
+
 void LvglGif::Cleanup() {
     // Stop and delete timer
     if (timer_) {
@@ -1,7 +1,11 @@
 #pragma once
 
+#include "sdkconfig.h"
 #include "../lvgl_image.h"
 #include "gifdec.h"
+#if CONFIG_USE_GIF_FRAME_CACHE
+#include "gif_frame_cache.h"
+#endif
 #include <lvgl.h>
 #include <memory>
 #include <functional>
@@ -9,6 +13,9 @@
 /**
  * C++ implementation of LVGL GIF widget
  * Provides GIF animation functionality using gifdec library
+ *
+ * With CONFIG_USE_GIF_FRAME_CACHE the frames of the first pass are recorded into the GifFrameCache,
+ * after that the animation is replayed from the cache and the decoder is closed.
  */
 class LvglGif {
 public:
@@ -70,11 +77,25 @@ public:
     void SetFrameCallback(std::function<void()> callback);
 
 private:
-    // GIF decoder instance
+    // GIF decoder instance, nullptr while replaying cached frames
     gd_GIF* gif_;
     
     // LVGL image descriptor
     lv_img_dsc_t img_dsc_;
+
+#if CONFIG_USE_GIF_FRAME_CACHE
+    // Source GIF, the key of the frame cache
+    lv_img_dsc_t src_dsc_;
+
+    // Cached frames being replayed
+    std::shared_ptr<const GifFrames> cached_frames_;
+    size_t cached_index_ = 0;
+    int32_t cached_loop_count_ = -1;
+
+    // Frames recorded during the first pass, and the read position of the last one
+    std::shared_ptr<GifFrames> recording_;
+    uint32_t recorded_position_ = 0;
+#endif
     
     // Animation timer
     lv_timer_t* timer_;
@@ -93,6 +114,20 @@ private:
      * Update to next frame
      */
     void NextFrame();
+
+#if CONFIG_USE_GIF_FRAME_CACHE
+    /**
+     * Replay the cached frames from now on, with loop_count passes left
+     */
+    void UseCachedFrames(std::shared_ptr<const GifFrames> frames, int32_t loop_count);
+    void ShowCachedFrame(size_t index);
+    void NextCachedFrame();
+
+    /**
+     * Add the rendered frame to the recording, has_next is the result of gd_get_frame()
+     */
+    void RecordFrame(int has_next);
+#endif
     
     /**
      * Cleanup resources
@@ -4,6 +4,7 @@
 #include <stddef.h>
 #include <string.h>
 #include <utility>
+#include <algorithm>
 
 #include "esp_jpeg_common.h"
 #include "esp_jpeg_enc.h"
@@ -424,6 +425,228 @@ static bool encode_with_esp_new_jpeg(const uint8_t* src, size_t src_len, uint16_
     return true;
 }
 
+struct jpeg_band_encoder {
+    uint16_t width;
+    uint16_t height;
+    int src_bpp;                // 输入每像素字节数
+    int band_rows;              // 编码器每个块的行数
+    int buffered_rows;
+    int encoded_rows;
+    bool failed;
+    uint8_t* band;              // 待转换的输入行，无需转换时为 NULL，直接写入 block
+    uint8_t* block;             // 编码器输入，16 字节对齐
+    int block_size;
+    uint8_t* out;
+    int out_size;
+    size_t out_index;
+    jpeg_enc_handle_t enc;
+    esp_imgfx_color_convert_handle_t convert;
+    jpg_out_cb cb;
+    void* arg;
+};
+
+static void jpeg_band_encoder_free(jpeg_band_encoder* encoder) {
+    if (encoder->enc) {
+        jpeg_enc_close(encoder->enc);
+    }
+    if (encoder->convert) {
+        esp_imgfx_color_convert_close(encoder->convert);
+    }
+    if (encoder->block) {
+        jpeg_free_align(encoder->block);
+    }
+    free(encoder->band);
+    free(encoder->out);
+    free(encoder);
+}
+
+jpeg_band_encoder_handle_t jpeg_band_encoder_open(uint16_t width, uint16_t height, v4l2_pix_fmt_t format,
+                                                  uint8_t quality, jpg_out_cb cb, void* arg) {
+    jpeg_pixel_format_t enc_src_type = JPEG_PIXEL_FORMAT_YCbYCr;
+    esp_imgfx_pixel_fmt_t in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB888;
+    bool needs_convert = true;
+    int src_bpp = 2;
+    switch (format) {
+        case V4L2_PIX_FMT_GREY:
+            enc_src_type = JPEG_PIXEL_FORMAT_GRAY;
+            needs_convert = false;
+            src_bpp = 1;
+            break;
+        case V4L2_PIX_FMT_YUYV:
+            needs_convert = false;
+            break;
+        case V4L2_PIX_FMT_RGB565:
+            in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB565_LE;
+            break;
+        case V4L2_PIX_FMT_RGB565X:
+            in_pixel_fmt = ESP_IMGFX_PIXEL_FMT_RGB565_BE;
+            break;
+        case V4L2_PIX_FMT_RGB24:
+            src_bpp = 3;
+            break;
+        default:
+            ESP_LOGE(TAG, "band encoder: unsupported format: 0x%08lx", format);
+            return nullptr;
+    }
+    if (quality < 1)
+        quality = 1;
+    if (quality > 100)
+        quality = 100;
+
+    auto encoder = (jpeg_band_encoder*)calloc(1, sizeof(jpeg_band_encoder));
+    if (!encoder)
+        return nullptr;
+    encoder->width = width;
+    encoder->height = height;
+    encoder->src_bpp = src_bpp;
+    encoder->cb = cb;
+    encoder->arg = arg;
+
+    jpeg_enc_config_t cfg = DEFAULT_JPEG_ENC_CONFIG();
+    cfg.width = width;
+    cfg.height = height;
+    cfg.src_type = enc_src_type;
+    cfg.subsampling = (enc_src_type == JPEG_PIXEL_FORMAT_GRAY) ? JPEG_SUBSAMPLE_GRAY : JPEG_SUBSAMPLE_420;
+    cfg.quality = quality;
+    cfg.rotate = JPEG_ROTATE_0D;
+    cfg.task_enable = false;
+    jpeg_error_t ret = jpeg_enc_open(&cfg, &encoder->enc);
+    if (ret != JPEG_ERR_OK) {
+        ESP_LOGE(TAG, "jpeg_enc_open failed: %d", (int)ret);
+        encoder->enc = NULL;
+        jpeg_band_encoder_free(encoder);
+        return nullptr;
+    }
+
+    // 块大小是编码器的最小处理单位，4:2:0 为16行，灰度为8行
+    int enc_bpp = (enc_src_type == JPEG_PIXEL_FORMAT_GRAY) ? 1 : 2;
+    encoder->block_size = jpeg_enc_get_block_size(encoder->enc);
+    encoder->band_rows = encoder->block_size / ((int)width * enc_bpp);
+    if (encoder->band_rows <= 0 || encoder->band_rows * (int)width * enc_bpp != encoder->block_size) {
+        ESP_LOGE(TAG, "unexpected block size %d for width %u", encoder->block_size, width);
+        jpeg_band_encoder_free(encoder);
+        return nullptr;
+    }
+
+    // 一个块的压缩数据（加上第一个块的JPEG头部）不会超过块输入大小的两倍
+    encoder->out_size = encoder->block_size * 2 + 1024;
+    encoder->block = (uint8_t*)jpeg_calloc_align(encoder->block_size, 16);
+    encoder->out = (uint8_t*)malloc_psram(encoder->out_size);
+    if (needs_convert) {
+        encoder->band = (uint8_t*)malloc_psram((size_t)width * encoder->band_rows * src_bpp);
+    }
+    if (!encoder->block || !encoder->out || (needs_convert && !encoder->band)) {
+        ESP_LOGE(TAG, "band encoder: alloc buffers failed");
+        jpeg_band_encoder_free(encoder);
+        return nullptr;
+    }
+
+    if (needs_convert) {
+        esp_imgfx_color_convert_cfg_t convert_cfg = {
+            .in_res = {.width = static_cast<int16_t>(width),
+                        .height = static_cast<int16_t>(encoder->band_rows)},
+            .in_pixel_fmt = in_pixel_fmt,
+            .out_pixel_fmt = ESP_IMGFX_PIXEL_FMT_YUYV,
+            .color_space_std = ESP_IMGFX_COLOR_SPACE_STD_BT601,
+        };
+        if (esp_imgfx_color_convert_open(&convert_cfg, &encoder->convert) != ESP_IMGFX_ERR_OK || encoder->convert == nullptr) {
+            ESP_LOGE(TAG, "esp_imgfx_color_convert_open failed");
+            encoder->convert = nullptr;
+            jpeg_band_encoder_free(encoder);
+            return nullptr;
+        }
+    }
+    return encoder;
+}
+
+static bool jpeg_band_encoder_encode(jpeg_band_encoder* encoder) {
+    size_t row_bytes = (size_t)encoder->width * encoder->src_bpp;
+    uint8_t* rows = encoder->band ? encoder->band : encoder->block;
+    // 最后一个块不足时重复最后一行补齐，多出的行不会出现在图像中
+    for (int y = encoder->buffered_rows; y < encoder->band_rows; y++) {
+        memcpy(rows + y * row_bytes, rows + (encoder->buffered_rows - 1) * row_bytes, row_bytes);
+    }
+
+    if (encoder->convert) {
+        esp_imgfx_data_t convert_input_data = {
+            .data = encoder->band,
+            .data_len = static_cast<uint32_t>(row_bytes * encoder->band_rows),
+        };
+        esp_imgfx_data_t convert_output_data = {
+            .data = encoder->block,
+            .data_len = static_cast<uint32_t>(encoder->block_size),
+        };
+        if (esp_imgfx_color_convert_process(encoder->convert, &convert_input_data, &convert_output_data) != ESP_IMGFX_ERR_OK) {
+            ESP_LOGE(TAG, "esp_imgfx_color_convert_process failed");
+            return false;
+        }
+    }
+
+    int out_len = 0;
+    jpeg_error_t ret = jpeg_enc_process_with_block(encoder->enc, encoder->block, encoder->block_size,
+                                                   encoder->out, encoder->out_size, &out_len);
+    if (ret < JPEG_ERR_OK) {
+        ESP_LOGE(TAG, "jpeg_enc_process_with_block failed: %d", (int)ret);
+        return false;
+    }
+    encoder->encoded_rows += encoder->buffered_rows;
+    encoder->buffered_rows = 0;
+
+    if (out_len > 0) {
+        if (encoder->cb(encoder->arg, encoder->out_index, encoder->out, (size_t)out_len) < (size_t)out_len) {
+            ESP_LOGW(TAG, "band encoder: output aborted at %u bytes", encoder->out_index);
+            return false;
+        }
+        encoder->out_index += out_len;
+    }
+    return true;
+}
+
+bool jpeg_band_encoder_write(jpeg_band_encoder_handle_t encoder, const uint8_t* rows, uint16_t row_count) {
+    if (encoder->failed) {
+        return false;
+    }
+    if (encoder->encoded_rows + encoder->buffered_rows + row_count > encoder->height) {
+        ESP_LOGE(TAG, "band encoder: more rows than the image height %u", encoder->height);
+        encoder->failed = true;
+        return false;
+    }
+
+    size_t row_bytes = (size_t)encoder->width * encoder->src_bpp;
+    while (row_count > 0) {
+        int n = std::min<int>(row_count, encoder->band_rows - encoder->buffered_rows);
+        uint8_t* dst = (encoder->band ? encoder->band : encoder->block) + encoder->buffered_rows * row_bytes;
+        memcpy(dst, rows, n * row_bytes);
+        rows += n * row_bytes;
+        row_count -= n;
+        encoder->buffered_rows += n;
+        if (encoder->buffered_rows == encoder->band_rows && !jpeg_band_encoder_encode(encoder)) {
+            encoder->failed = true;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool jpeg_band_encoder_close(jpeg_band_encoder_handle_t encoder) {
+    if (!encoder) {
+        return false;
+    }
+    bool ok = !encoder->failed;
+    if (ok && encoder->buffered_rows > 0) {
+        ok = jpeg_band_encoder_encode(encoder);
+    }
+    if (ok && encoder->encoded_rows != encoder->height) {
+        ESP_LOGE(TAG, "band encoder: only %d of %u rows written", encoder->encoded_rows, encoder->height);
+        ok = false;
+    }
+    if (ok) {
+        encoder->cb(encoder->arg, encoder->out_index, NULL, 0);  // 结束信号
+    }
+    jpeg_band_encoder_free(encoder);
+    return ok;
+}
+
 bool image_to_jpeg(uint8_t* src, size_t src_len, uint16_t width, uint16_t height, v4l2_pix_fmt_t format,
                    uint8_t quality, uint8_t** out, size_t* out_len) {
 #ifdef CONFIG_XIAOZHI_CAMERA_ALLOW_JPEG_INPUT
@@ -463,5 +686,11 @@ bool image_to_jpeg_cb(uint8_t* src, size_t src_len, uint16_t width, uint16_t hei
     }
     // Fallback to esp_new_jpeg
 #endif
+    // 逐带编码并输出，无需整帧的格式转换拷贝和整张JPEG的输出缓冲区
+    jpeg_band_encoder_handle_t encoder = jpeg_band_encoder_open(width, height, format, quality, cb, arg);
+    if (encoder) {
+        bool ok = jpeg_band_encoder_write(encoder, src, height);
+        return jpeg_band_encoder_close(encoder) && ok;
+    }
     return encode_with_esp_new_jpeg(src, src_len, width, height, format, quality, NULL, NULL, cb, arg);
 }
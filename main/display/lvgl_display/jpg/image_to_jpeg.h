@@ -63,6 +63,37 @@ bool image_to_jpeg(uint8_t *src, size_t src_len, uint16_t width, uint16_t height
 bool image_to_jpeg_cb(uint8_t *src, size_t src_len, uint16_t width, uint16_t height, 
                       v4l2_pix_fmt_t format, uint8_t quality, jpg_out_cb cb, void *arg);
 
+/**
+ * @brief 分带（band）流式JPEG编码器
+ *
+ * 图像按行分批写入，每凑满编码器的一个块（4:2:0 为16行）就立即编码并通过回调输出，
+ * 内存占用只有几个块的大小，不需要整帧的输入拷贝和整张JPEG的输出缓冲区：
+ * - 使用 esp_new_jpeg 的分块编码接口，ESP32-S3 上使用其 SIMD 优化的 DCT/颜色转换
+ * - 回调的 index 为数据在JPEG中的偏移，结束时以 data 为 NULL 调用一次
+ * - 回调返回值小于 len 时中止编码（例如上传失败）
+ * - 支持 RGB565、RGB565X、RGB24、YUYV 和 GREY 输入
+ */
+typedef struct jpeg_band_encoder *jpeg_band_encoder_handle_t;
+
+jpeg_band_encoder_handle_t jpeg_band_encoder_open(uint16_t width, uint16_t height, v4l2_pix_fmt_t format,
+                                                  uint8_t quality, jpg_out_cb cb, void *arg);
+
+/**
+ * @brief 写入连续的若干行，行数任意，按编码器块的大小缓存并编码
+ *
+ * @param rows      行数据，每行 width 个像素，紧密排列
+ * @param row_count 行数
+ * @return true 成功, false 编码或输出失败
+ */
+bool jpeg_band_encoder_write(jpeg_band_encoder_handle_t encoder, const uint8_t *rows, uint16_t row_count);
+
+/**
+ * @brief 编码剩余的行并释放编码器
+ *
+ * @return true 所有行都已写入且编码成功
+ */
+bool jpeg_band_encoder_close(jpeg_band_encoder_handle_t encoder);
+
 #ifdef __cplusplus
 }
 #endif
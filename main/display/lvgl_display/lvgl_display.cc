@@ -15,6 +15,8 @@
 
 #define TAG "Display"
 
+#define RENDER_STATISTICS_REPORT_INTERVAL_US (10 * 1000 * 1000)
+
 LvglDisplay::LvglDisplay() {
     // Notification timer
     esp_timer_create_args_t notification_timer_args = {
@@ -216,43 +218,180 @@ void LvglDisplay::SetPowerSaveMode(bool on) {
 }
 
 bool LvglDisplay::SnapshotToJpeg(std::string& jpeg_data, int quality) {
+    jpeg_data.clear();
+    return SnapshotToJpeg([&jpeg_data](const void* data, size_t size) -> bool {
+        jpeg_data.append(static_cast<const char*>(data), size);
+        return true;
+    }, quality);
+}
+
 #if CONFIG_LV_USE_SNAPSHOT
-    DisplayLockGuard lock(this);
+static size_t WriteJpegOutput(void* arg, size_t index, const void* data, size_t len) {
+    auto write = static_cast<std::function<bool(const void*, size_t)>*>(arg);
+    if (data == nullptr || len == 0) {
+        return len;
+    }
+    return (*write)(data, len) ? len : 0;
+}
+#endif
 
-    lv_obj_t* screen = lv_screen_active();
-    lv_draw_buf_t* draw_buffer = lv_snapshot_take(screen, LV_COLOR_FORMAT_RGB565);
-    if (draw_buffer == nullptr) {
-        ESP_LOGE(TAG, "Failed to take snapshot, draw_buffer is nullptr");
+bool LvglDisplay::SnapshotToJpeg(std::function<bool(const void* data, size_t size)> write, int quality) {
+#if CONFIG_LV_USE_SNAPSHOT
+    DisplayLockGuard lock(this);
+    if (display_ == nullptr) {
         return false;
     }
 
-    // swap bytes
-    uint16_t* data = (uint16_t*)draw_buffer->data;
-    size_t pixel_count = draw_buffer->data_size / 2;
-    for (size_t i = 0; i < pixel_count; i++) {
-        data[i] = __builtin_bswap16(data[i]);
+    if (lv_display_get_color_format(display_) != LV_COLOR_FORMAT_RGB565) {
+        // Other formats are rendered to a full RGB565 copy of the screen first
+        lv_draw_buf_t* draw_buffer = lv_snapshot_take(lv_screen_active(), LV_COLOR_FORMAT_RGB565);
+        if (draw_buffer == nullptr) {
+            ESP_LOGE(TAG, "Failed to take snapshot, draw_buffer is nullptr");
+            return false;
+        }
+        bool ret = image_to_jpeg_cb((uint8_t*)draw_buffer->data, draw_buffer->data_size, draw_buffer->header.w, draw_buffer->header.h,
+            V4L2_PIX_FMT_RGB565, quality, WriteJpegOutput, &write);
+        if (!ret) {
+            ESP_LOGE(TAG, "Failed to convert image to JPEG");
+        }
+        lv_draw_buf_destroy(draw_buffer);
+        return ret;
     }
 
-    // Clear output string and use callback version to avoid pre-allocating large memory blocks
-    jpeg_data.clear();
+    // Redraw the whole screen and encode every area when it is flushed, straight from the draw buffer,
+    // so only a few encoder blocks are held in memory instead of a full frame and a full JPEG
+    struct Snapshot {
+        jpeg_band_encoder_handle_t encoder;
+        int32_t width;
+        int32_t next_row;
+        bool failed;
+    } snapshot = {};
+    snapshot.width = lv_display_get_horizontal_resolution(display_);
+    int32_t height = lv_display_get_vertical_resolution(display_);
+    snapshot.encoder = jpeg_band_encoder_open(snapshot.width, height, V4L2_PIX_FMT_RGB565, quality, WriteJpegOutput, &write);
+    if (snapshot.encoder == nullptr) {
+        ESP_LOGE(TAG, "Failed to open the JPEG encoder");
+        return false;
+    }
 
-    // Use callback-based JPEG encoder to further save memory
-    bool ret = image_to_jpeg_cb((uint8_t*)draw_buffer->data, draw_buffer->data_size, draw_buffer->header.w, draw_buffer->header.h, V4L2_PIX_FMT_RGB565, quality,
-        [](void *arg, size_t index, const void *data, size_t len) -> size_t {
-        std::string* output = static_cast<std::string*>(arg);
-        if (data && len > 0) {
-            output->append(static_cast<const char*>(data), len);
+    auto flush_cb = [](lv_event_t* e) {
+        auto snapshot = static_cast<Snapshot*>(lv_event_get_user_data(e));
+        auto area = static_cast<const lv_area_t*>(lv_event_get_param(e));
+        auto display = static_cast<lv_display_t*>(lv_event_get_target(e));
+        lv_draw_buf_t* buffer = lv_display_get_buf_active(display);
+        int32_t width = lv_area_get_width(area);
+        int32_t rows = lv_area_get_height(area);
+        if (snapshot->failed) {
+            return;
         }
-        return len;
-    }, &jpeg_data);
+        if (buffer == nullptr || area->x1 != 0 || width != snapshot->width || area->y1 != snapshot->next_row) {
+            ESP_LOGE(TAG, "Unexpected flush area (%ld, %ld) %ldx%ld", area->x1, area->y1, width, rows);
+            snapshot->failed = true;
+            return;
+        }
+
+        // In partial mode the buffer holds only the area, otherwise the whole screen
+        const uint8_t* data = buffer->data;
+        uint32_t stride = buffer->header.stride;
+        if (buffer->header.w != width || buffer->header.h != rows) {
+            data += area->y1 * stride;
+        }
+        if (stride == (uint32_t)width * 2) {
+            snapshot->failed = !jpeg_band_encoder_write(snapshot->encoder, data, rows);
+        } else {
+            for (int32_t y = 0; y < rows && !snapshot->failed; y++) {
+                snapshot->failed = !jpeg_band_encoder_write(snapshot->encoder, data + y * stride, 1);
+            }
+        }
+        snapshot->next_row += rows;
+    };
+
+    lv_display_add_event_cb(display_, flush_cb, LV_EVENT_FLUSH_START, &snapshot);
+    lv_obj_invalidate(lv_screen_active());
+    lv_refr_now(display_);
+    lv_display_remove_event_cb_with_user_data(display_, flush_cb, &snapshot);
+
+    bool ret = jpeg_band_encoder_close(snapshot.encoder) && !snapshot.failed;
     if (!ret) {
-        ESP_LOGE(TAG, "Failed to convert image to JPEG");
+        ESP_LOGE(TAG, "Failed to encode the snapshot");
     }
-
-    lv_draw_buf_destroy(draw_buffer);
     return ret;
 #else
     ESP_LOGE(TAG, "LV_USE_SNAPSHOT is not enabled");
     return false;
 #endif
 }
+
+void LvglDisplay::MonitorRendering() {
+    DisplayLockGuard lock(this);
+    if (display_ == nullptr) {
+        return;
+    }
+
+    lv_display_add_event_cb(display_, [](lv_event_t* e) {
+        auto display = static_cast<LvglDisplay*>(lv_event_get_user_data(e));
+        display->frame_start_time_us_ = esp_timer_get_time();
+        display->frame_flush_bytes_ = 0;
+    }, LV_EVENT_REFR_START, this);
+
+    lv_display_add_event_cb(display_, [](lv_event_t* e) {
+        auto display = static_cast<LvglDisplay*>(lv_event_get_user_data(e));
+        auto area = static_cast<const lv_area_t*>(lv_event_get_param(e));
+        auto color_format = lv_display_get_color_format(display->display_);
+        display->frame_flush_bytes_ += lv_area_get_size(area) * lv_color_format_get_size(color_format);
+        display->render_statistics_.flushes++;
+        display->flush_start_time_us_ = esp_timer_get_time();
+    }, LV_EVENT_FLUSH_START, this);
+
+    lv_display_add_event_cb(display_, [](lv_event_t* e) {
+        auto display = static_cast<LvglDisplay*>(lv_event_get_user_data(e));
+        display->render_statistics_.flush_time_us += esp_timer_get_time() - display->flush_start_time_us_;
+    }, LV_EVENT_FLUSH_FINISH, this);
+
+    lv_display_add_event_cb(display_, [](lv_event_t* e) {
+        auto display = static_cast<LvglDisplay*>(lv_event_get_user_data(e));
+        display->flush_start_time_us_ = esp_timer_get_time();
+    }, LV_EVENT_FLUSH_WAIT_START, this);
+
+    lv_display_add_event_cb(display_, [](lv_event_t* e) {
+        auto display = static_cast<LvglDisplay*>(lv_event_get_user_data(e));
+        display->render_statistics_.flush_wait_time_us += esp_timer_get_time() - display->flush_start_time_us_;
+    }, LV_EVENT_FLUSH_WAIT_FINISH, this);
+
+    lv_display_add_event_cb(display_, [](lv_event_t* e) {
+        auto display = static_cast<LvglDisplay*>(lv_event_get_user_data(e));
+        // Refreshes without invalidated areas do not touch the panel
+        if (display->frame_flush_bytes_ == 0) {
+            return;
+        }
+        int64_t now = esp_timer_get_time();
+        uint32_t frame_time_us = now - display->frame_start_time_us_;
+        auto& stats = display->render_statistics_;
+        stats.frames++;
+        stats.flush_bytes += display->frame_flush_bytes_;
+        stats.frame_time_us += frame_time_us;
+        if (frame_time_us > stats.max_frame_time_us) {
+            stats.max_frame_time_us = frame_time_us;
+        }
+        display->frame_flush_bytes_ = 0;
+
+#if CONFIG_USE_DISPLAY_RENDER_STATISTICS
+        if (now - display->last_render_report_time_us_ >= RENDER_STATISTICS_REPORT_INTERVAL_US) {
+            display->last_render_report_time_us_ = now;
+            ESP_LOGI(TAG, "Render: %lu frames, avg %lu us, max %lu us, %lu flushes, %llu KB",
+                stats.frames, (uint32_t)(stats.frame_time_us / stats.frames), stats.max_frame_time_us,
+                stats.flushes, stats.flush_bytes / 1024);
+            stats = RenderStatistics();
+        }
+#endif
+    }, LV_EVENT_REFR_READY, this);
+}
+
+RenderStatistics LvglDisplay::GetRenderStatistics(bool reset) {
+    DisplayLockGuard lock(this);
+    RenderStatistics stats = render_statistics_;
+    if (reset) {
+        render_statistics_ = RenderStatistics();
+    }
+    return stats;
+}
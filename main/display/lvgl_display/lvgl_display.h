@@ -11,6 +11,18 @@
 
 #include <string>
 #include <chrono>
+#include <functional>
+
+// Counted for the refreshes that flushed at least one area
+struct RenderStatistics {
+    uint32_t frames = 0;
+    uint32_t flushes = 0;
+    uint64_t flush_bytes = 0;
+    uint64_t frame_time_us = 0;
+    uint32_t max_frame_time_us = 0;
+    uint64_t flush_time_us = 0;         // Spent in the flush callback
+    uint64_t flush_wait_time_us = 0;    // Spent waiting for the previous flush to finish
+};
 
 class LvglDisplay : public Display {
 public:
@@ -23,7 +35,13 @@ public:
     virtual void SetPreviewImage(std::unique_ptr<LvglImage> image);
     virtual void UpdateStatusBar(bool update_all = false);
     virtual void SetPowerSaveMode(bool on);
-    virtual bool SnapshotToJpeg(std::string& jpeg_data, int quality = 80);
+    bool SnapshotToJpeg(std::string& jpeg_data, int quality = 80);
+    // Encode the screen band by band while it is rendered, passing the JPEG to write as it is produced.
+    // write is called with the display locked, it should only copy the data and not do any I/O
+    virtual bool SnapshotToJpeg(std::function<bool(const void* data, size_t size)> write, int quality = 80);
+
+    // Render statistics since the last reset
+    RenderStatistics GetRenderStatistics(bool reset = false);
 
 protected:
     esp_pm_lock_handle_t pm_lock_ = nullptr;
@@ -44,6 +62,15 @@ protected:
     std::chrono::system_clock::time_point last_status_update_time_;
     esp_timer_handle_t notification_timer_ = nullptr;
 
+    RenderStatistics render_statistics_;
+    int64_t frame_start_time_us_ = 0;
+    int64_t flush_start_time_us_ = 0;
+    uint32_t frame_flush_bytes_ = 0;
+    int64_t last_render_report_time_us_ = 0;
+
+    // Count frame time and flushed bytes of display_, call once display_ is created
+    void MonitorRendering();
+
     friend class DisplayLockGuard;
     virtual bool Lock(int timeout_ms = 0) = 0;
     virtual void Unlock() = 0;
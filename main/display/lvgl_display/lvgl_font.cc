@@ -1,13 +1,136 @@
 #include "lvgl_font.h"
 #include <cbin_font.h>
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+#include <cstring>
+
+#define TAG "LvglFont"
+
+// Bookkeeping of a cached glyph: the list and map nodes
+#define GLYPH_CACHE_ENTRY_OVERHEAD 48
 
 
 LvglCBinFont::LvglCBinFont(void* data) {
     font_ = cbin_font_create(static_cast<uint8_t*>(data));
+#if CONFIG_FONT_GLYPH_CACHE_SIZE_KB > 0
+    if (font_ != nullptr) {
+        source_font_ = font_;
+        cached_font_.font = *source_font_;
+        cached_font_.font.get_glyph_bitmap = GetGlyphBitmap;
+        cached_font_.owner = this;
+        font_ = &cached_font_.font;
+    }
+#endif
 }
 
 LvglCBinFont::~LvglCBinFont() {
-    if (font_ != nullptr) {
+    for (auto& glyph : glyphs_) {
+        heap_caps_free(glyph.bitmap);
+    }
+    if (source_font_ != nullptr) {
+        cbin_font_delete(source_font_);
+    } else if (font_ != nullptr) {
         cbin_font_delete(font_);
     }
-}
\ No newline at end of file
+}
+
+const void* LvglCBinFont::GetGlyphBitmap(lv_font_glyph_dsc_t* g_dsc, lv_draw_buf_t* draw_buf) {
+    // The glyph descriptor resolves to the font LVGL was given, which is the first member of CachedFont
+    auto cached_font = reinterpret_cast<const CachedFont*>(g_dsc->resolved_font);
+    return cached_font->owner->Lookup(g_dsc, draw_buf);
+}
+
+bool LvglCBinFont::Cacheable(const lv_font_glyph_dsc_t* g_dsc) const {
+    // Only the bitmaps unpacked to A8 are cached, raw bitmaps are read straight from the font data
+    return !g_dsc->req_raw_bitmap && g_dsc->format >= LV_FONT_GLYPH_FORMAT_A1 &&
+        g_dsc->format <= LV_FONT_GLYPH_FORMAT_A8 && g_dsc->gid.index != 0;
+}
+
+const void* LvglCBinFont::Lookup(lv_font_glyph_dsc_t* g_dsc, lv_draw_buf_t* draw_buf) {
+    if (draw_buf == nullptr || !Cacheable(g_dsc)) {
+        return source_font_->get_glyph_bitmap(g_dsc, draw_buf);
+    }
+
+    uint32_t size = draw_buf->header.stride * g_dsc->box_h;
+    auto it = glyph_map_.find(g_dsc->gid.index);
+    if (it != glyph_map_.end() && it->second->stride == draw_buf->header.stride && it->second->size <= draw_buf->data_size) {
+        glyphs_.splice(glyphs_.begin(), glyphs_, it->second);
+        memcpy(draw_buf->data, it->second->bitmap, it->second->size);
+        lv_draw_buf_flush_cache(draw_buf, nullptr);
+        hits_++;
+        return draw_buf;
+    }
+
+    misses_++;
+    auto bitmap = source_font_->get_glyph_bitmap(g_dsc, draw_buf);
+    if (bitmap == draw_buf && size <= draw_buf->data_size) {
+        Insert(g_dsc->gid.index, draw_buf, size);
+    }
+    return bitmap;
+}
+
+void LvglCBinFont::Insert(uint32_t index, const lv_draw_buf_t* draw_buf, uint32_t size) {
+    const size_t max_size = CONFIG_FONT_GLYPH_CACHE_SIZE_KB * 1024;
+    size_t entry_size = size + GLYPH_CACHE_ENTRY_OVERHEAD;
+    if (entry_size > max_size) {
+        return;
+    }
+
+    auto it = glyph_map_.find(index);
+    if (it != glyph_map_.end()) {
+        // Drawn with another stride, keep the newest one
+        cache_size_ -= it->second->size + GLYPH_CACHE_ENTRY_OVERHEAD;
+        heap_caps_free(it->second->bitmap);
+        glyphs_.erase(it->second);
+        glyph_map_.erase(it);
+    }
+    while (!glyphs_.empty() && cache_size_ + entry_size > max_size) {
+        auto& glyph = glyphs_.back();
+        cache_size_ -= glyph.size + GLYPH_CACHE_ENTRY_OVERHEAD;
+        heap_caps_free(glyph.bitmap);
+        glyph_map_.erase(glyph.index);
+        glyphs_.pop_back();
+    }
+
+    auto bitmap = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (bitmap == nullptr) {
+        return;
+    }
+    memcpy(bitmap, draw_buf->data, size);
+    glyphs_.push_front({index, draw_buf->header.stride, size, bitmap});
+    glyph_map_[index] = glyphs_.begin();
+    cache_size_ += entry_size;
+}
+
+void LvglCBinFont::Prewarm(const char* text) {
+    if (source_font_ == nullptr || text == nullptr) {
+        return;
+    }
+
+    uint32_t offset = 0;
+    uint32_t letter = lv_text_encoded_next(text, &offset);
+    while (letter != 0) {
+        uint32_t letter_next = lv_text_encoded_next(text, &offset);
+        lv_font_glyph_dsc_t g_dsc = {};
+        if (lv_font_get_glyph_dsc(font_, &g_dsc, letter, letter_next) && g_dsc.resolved_font == font_ &&
+            Cacheable(&g_dsc) && glyph_map_.find(g_dsc.gid.index) == glyph_map_.end()) {
+            // Unpack the glyph the way the label renderer does, into a draw buffer of the glyph size
+            lv_draw_buf_t* draw_buf = lv_draw_buf_create(g_dsc.box_w, g_dsc.box_h, LV_COLOR_FORMAT_A8, LV_STRIDE_AUTO);
+            if (draw_buf == nullptr) {
+                return;
+            }
+            if (source_font_->get_glyph_bitmap(&g_dsc, draw_buf) == draw_buf) {
+                Insert(g_dsc.gid.index, draw_buf, draw_buf->header.stride * g_dsc.box_h);
+            }
+            lv_draw_buf_destroy(draw_buf);
+        }
+        letter = letter_next;
+    }
+}
+
+void LvglCBinFont::LogCacheStats() const {
+    uint32_t lookups = hits_ + misses_;
+    ESP_LOGI(TAG, "Glyph cache: %u glyphs in %u / %u KB, hit rate %lu%% (%lu hits, %lu misses)",
+        (unsigned)glyphs_.size(), (unsigned)(cache_size_ / 1024), (unsigned)CONFIG_FONT_GLYPH_CACHE_SIZE_KB,
+        lookups > 0 ? hits_ * 100 / lookups : 0, hits_, misses_);
+}
@@ -1,12 +1,18 @@
 #pragma once
 
 #include <lvgl.h>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+#include <cstddef>
 
 
 class LvglFont {
 public:
     virtual const lv_font_t* font() const = 0;
     virtual ~LvglFont() = default;
+    // Prepare the glyphs of a text that is about to be shown
+    virtual void Prewarm(const char* text) {}
 };
 
 // Built-in font
@@ -20,12 +26,53 @@ private:
 };
 
 
+/**
+ * Font loaded from the assets partition
+ *
+ * The glyph bitmaps are read from flash-mapped data and unpacked to A8 every time a glyph is drawn.
+ * With CONFIG_FONT_GLYPH_CACHE_SIZE_KB the unpacked bitmaps are kept in internal RAM, least recently
+ * used glyphs are evicted first, and Prewarm() unpacks the glyphs of a text before it is rendered.
+ *
+ * Only used from the LVGL task.
+ */
 class LvglCBinFont : public LvglFont {
 public:
     LvglCBinFont(void* data);
     virtual ~LvglCBinFont();
     virtual const lv_font_t* font() const override { return font_; }
+    virtual void Prewarm(const char* text) override;
+
+    uint32_t hits() const { return hits_; }
+    uint32_t misses() const { return misses_; }
+    size_t cache_size() const { return cache_size_; }
+    void LogCacheStats() const;
 
 private:
+    // The font handed to LVGL when the cache is enabled, a copy of the loaded font with its own bitmap callback
+    struct CachedFont {
+        lv_font_t font;
+        LvglCBinFont* owner;
+    };
+
+    struct Glyph {
+        uint32_t index;
+        uint32_t stride;
+        uint32_t size;
+        uint8_t* bitmap;
+    };
+
     lv_font_t* font_;
+    lv_font_t* source_font_ = nullptr;
+    CachedFont cached_font_ = {};
+    // Most recently used first
+    std::list<Glyph> glyphs_;
+    std::unordered_map<uint32_t, std::list<Glyph>::iterator> glyph_map_;
+    size_t cache_size_ = 0;
+    uint32_t hits_ = 0;
+    uint32_t misses_ = 0;
+
+    static const void* GetGlyphBitmap(lv_font_glyph_dsc_t* g_dsc, lv_draw_buf_t* draw_buf);
+    const void* Lookup(lv_font_glyph_dsc_t* g_dsc, lv_draw_buf_t* draw_buf);
+    void Insert(uint32_t index, const lv_draw_buf_t* draw_buf, uint32_t size);
+    bool Cacheable(const lv_font_glyph_dsc_t* g_dsc) const;
 };
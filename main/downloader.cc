@@ -0,0 +1,264 @@
+#include "downloader.h"
+#include "board.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_heap_caps.h>
+#include <algorithm>
+#include <cstdio>
+
+#define TAG "Downloader"
+
+// A strong ETag, or else the Last-Modified date, identifies the version of the file for If-Range
+static std::string GetValidator(Http& http) {
+    std::string etag = http.GetResponseHeader("ETag");
+    if (!etag.empty() && etag.compare(0, 2, "W/") != 0) {
+        return etag;
+    }
+    return http.GetResponseHeader("Last-Modified");
+}
+
+Downloader::Downloader() : chunk_size_(CONFIG_DOWNLOAD_CHUNK_SIZE) {
+    for (auto& buffer : buffers_) {
+        buffer = (uint8_t*)heap_caps_malloc(chunk_size_, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (buffer == nullptr) {
+            buffer = (uint8_t*)heap_caps_malloc(chunk_size_, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        }
+    }
+    free_chunks_ = xQueueCreate(DOWNLOAD_CHUNKS, sizeof(Chunk));
+    // One more for the chunk that stops the writer task
+    full_chunks_ = xQueueCreate(DOWNLOAD_CHUNKS + 1, sizeof(Chunk));
+    writer_done_ = xSemaphoreCreateBinary();
+}
+
+Downloader::~Downloader() {
+    for (auto buffer : buffers_) {
+        heap_caps_free(buffer);
+    }
+    vQueueDelete(free_chunks_);
+    vQueueDelete(full_chunks_);
+    vSemaphoreDelete(writer_done_);
+}
+
+bool Downloader::Download(const std::string& url, WriteCallback write_callback, ProgressCallback progress_callback) {
+    for (auto buffer : buffers_) {
+        if (buffer == nullptr) {
+            ESP_LOGE(TAG, "Failed to allocate %u bytes for the download buffers", chunk_size_);
+            return false;
+        }
+    }
+
+    write_callback_ = write_callback;
+    write_failed_ = false;
+    content_length_ = 0;
+    xQueueReset(free_chunks_);
+    xQueueReset(full_chunks_);
+    for (auto buffer : buffers_) {
+        Chunk chunk = {buffer, 0, 0};
+        xQueueSend(free_chunks_, &chunk, 0);
+    }
+
+    if (xTaskCreate([](void* arg) {
+        auto downloader = (Downloader*)arg;
+        downloader->WriterTask();
+        vTaskDelete(NULL);
+    }, "download_writer", 4096, this, uxTaskPriorityGet(NULL), nullptr) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the writer task");
+        return false;
+    }
+
+    bool success = Receive(url, progress_callback);
+
+    // Let the writer finish the queued chunks, then stop it
+    Chunk stop = {nullptr, 0, 0};
+    xQueueSend(full_chunks_, &stop, portMAX_DELAY);
+    xSemaphoreTake(writer_done_, portMAX_DELAY);
+    write_callback_ = nullptr;
+    return success && !write_failed_;
+}
+
+void Downloader::WriterTask() {
+    Chunk chunk;
+    while (xQueueReceive(full_chunks_, &chunk, portMAX_DELAY) == pdTRUE) {
+        if (chunk.size == 0) {
+            break;
+        }
+        // After a failure the chunks are only returned, until the receiver notices it
+        if (!write_failed_ && !write_callback_(chunk.offset, chunk.data, chunk.size)) {
+            write_failed_ = true;
+        }
+        xQueueSend(free_chunks_, &chunk, portMAX_DELAY);
+    }
+    xSemaphoreGive(writer_done_);
+}
+
+bool Downloader::Restart(Chunk& chunk) {
+    if (!restart_callback_) {
+        ESP_LOGE(TAG, "The file changed on the server, the download cannot start over");
+        return false;
+    }
+    // The partly filled chunk is dropped, then all chunks are taken so the writer is idle
+    if (chunk.data != nullptr) {
+        xQueueSend(free_chunks_, &chunk, portMAX_DELAY);
+        chunk.data = nullptr;
+    }
+    Chunk chunks[DOWNLOAD_CHUNKS];
+    for (auto& idle : chunks) {
+        xQueueReceive(free_chunks_, &idle, portMAX_DELAY);
+    }
+    for (auto& idle : chunks) {
+        xQueueSend(free_chunks_, &idle, portMAX_DELAY);
+    }
+    if (write_failed_) {
+        return false;
+    }
+    ESP_LOGW(TAG, "The file changed on the server, starting over");
+    return restart_callback_();
+}
+
+bool Downloader::Receive(const std::string& url, ProgressCallback& progress_callback) {
+    auto network = Board::GetInstance().GetNetwork();
+    size_t received = 0;
+    size_t recent_received = 0;
+    int retries = 0;
+    auto last_calc_time = esp_timer_get_time();
+    Chunk chunk = {nullptr, 0, 0};
+    std::string validator;
+
+    while (true) {
+        if (retries > 0) {
+            if (retries > DOWNLOAD_MAX_RETRIES) {
+                ESP_LOGE(TAG, "Download failed at %u/%u after %d retries", received, content_length_, DOWNLOAD_MAX_RETRIES);
+                return false;
+            }
+            ESP_LOGW(TAG, "Download interrupted at %u/%u, retrying (%d/%d)", received, content_length_, retries, DOWNLOAD_MAX_RETRIES);
+            vTaskDelay(pdMS_TO_TICKS(1000 * retries));
+        }
+
+        auto http = network->CreateHttp(0);
+        if (received > 0) {
+            http->SetHeader("Range", "bytes=" + std::to_string(received) + "-");
+            // The server sends the whole file instead of the range if it has changed
+            if (!validator.empty()) {
+                http->SetHeader("If-Range", validator);
+            }
+        }
+        if (!http->Open("GET", url)) {
+            ESP_LOGE(TAG, "Failed to open HTTP connection");
+            retries++;
+            continue;
+        }
+
+        int status_code = http->GetStatusCode();
+        size_t skip = 0;
+        if (received == 0) {
+            if (status_code != 200) {
+                ESP_LOGE(TAG, "Failed to download, status code: %d", status_code);
+                return false;
+            }
+            content_length_ = http->GetBodyLength();
+            if (content_length_ == 0) {
+                ESP_LOGE(TAG, "Failed to get content length");
+                return false;
+            }
+            validator = GetValidator(*http);
+        } else if (status_code == 200) {
+            if (GetValidator(*http) == validator && http->GetBodyLength() == content_length_) {
+                // The server ignored the range, skip what has been received already
+                skip = received;
+            } else {
+                // The whole new file, received from the start
+                if (!Restart(chunk)) {
+                    http->Close();
+                    return false;
+                }
+                received = 0;
+                content_length_ = http->GetBodyLength();
+                validator = GetValidator(*http);
+                if (content_length_ == 0) {
+                    ESP_LOGE(TAG, "Failed to get content length");
+                    http->Close();
+                    return false;
+                }
+            }
+        } else if (status_code == 206) {
+            // bytes first-last/total, the total may be *
+            unsigned long first = 0, last = 0, total = 0;
+            int fields = sscanf(http->GetResponseHeader("Content-Range").c_str(), "bytes %lu-%lu/%lu", &first, &last, &total);
+            if (fields < 2 || first != received || (fields == 3 && total != content_length_)) {
+                ESP_LOGW(TAG, "Resumed at %u but got the range %lu-%lu/%lu", received, first, last, total);
+                http->Close();
+                if (!Restart(chunk)) {
+                    return false;
+                }
+                received = 0;
+                validator.clear();
+                retries++;
+                continue;
+            }
+        } else {
+            ESP_LOGE(TAG, "Failed to resume download, status code: %d", status_code);
+            http->Close();
+            retries++;
+            continue;
+        }
+
+        size_t attempt_start = received;
+        bool interrupted = false;
+        while (received < content_length_) {
+            if (write_failed_) {
+                http->Close();
+                return false;
+            }
+            if (chunk.data == nullptr) {
+                xQueueReceive(free_chunks_, &chunk, portMAX_DELAY);
+                chunk.offset = received;
+                chunk.size = 0;
+            }
+
+            // Skipped data is read into the free part of the chunk and dropped
+            size_t length = std::min(chunk_size_ - chunk.size, content_length_ - received);
+            if (skip > 0) {
+                length = std::min(length, skip);
+            }
+            int ret = http->Read((char*)chunk.data + chunk.size, length);
+            if (ret <= 0) {
+                if (ret < 0) {
+                    ESP_LOGW(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
+                }
+                interrupted = true;
+                break;
+            }
+            if (skip > 0) {
+                skip -= ret;
+                continue;
+            }
+
+            chunk.size += ret;
+            received += ret;
+            recent_received += ret;
+            if (chunk.size == chunk_size_ || received == content_length_) {
+                xQueueSend(full_chunks_, &chunk, portMAX_DELAY);
+                chunk.data = nullptr;
+            }
+
+            // Calculate speed and progress every second
+            if (esp_timer_get_time() - last_calc_time >= 1000000 || received == content_length_) {
+                size_t progress = received * 100 / content_length_;
+                ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %u B/s", progress, received, content_length_, recent_received);
+                if (progress_callback) {
+                    progress_callback(progress, recent_received);
+                }
+                last_calc_time = esp_timer_get_time();
+                recent_received = 0;
+            }
+        }
+        http->Close();
+
+        if (!interrupted) {
+            return true;
+        }
+        // Only failures without any progress in between count towards the limit
+        retries = received > attempt_start ? 1 : retries + 1;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef DOWNLOADER_H
+#define DOWNLOADER_H
+
+#include <functional>
+#include <string>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#define DOWNLOAD_CHUNKS 2
+#define DOWNLOAD_MAX_RETRIES 5
+
+/*
+ * Streams an HTTP download into a write callback, shared by the assets and firmware downloads.
+ *
+ * The calling task receives into one chunk while a writer task erases and writes the other, so the network
+ * and the flash no longer wait for each other. Chunks are CONFIG_DOWNLOAD_CHUNK_SIZE bytes, in PSRAM when
+ * available. A dropped connection is reopened with a Range request from the last received byte, up to
+ * DOWNLOAD_MAX_RETRIES times in a row.
+ *
+ * The Range request is pinned to the file received so far with If-Range, using its strong ETag or its
+ * Last-Modified date, and the returned Content-Range must start at the requested byte. If the file has
+ * changed on the server, the download starts over from offset 0 when the restart callback allows it.
+ * Otherwise the download fails.
+ */
+class Downloader {
+public:
+    // Called from the writer task with consecutive data, return false to abort the download
+    using WriteCallback = std::function<bool(size_t offset, const uint8_t* data, size_t size)>;
+    using ProgressCallback = std::function<void(int progress, size_t speed)>;
+    // Called once the writer is idle, return true to receive the file again from offset 0
+    using RestartCallback = std::function<bool()>;
+
+    Downloader();
+    ~Downloader();
+    Downloader(const Downloader&) = delete;
+    Downloader& operator=(const Downloader&) = delete;
+
+    // Blocks until the whole file is written, or the download or a write fails
+    bool Download(const std::string& url, WriteCallback write_callback, ProgressCallback progress_callback = nullptr);
+
+    // Without it a file that changed on the server fails the download
+    void OnRestart(RestartCallback callback) { restart_callback_ = callback; }
+
+    // Total size of the file, valid once the first write is called
+    size_t content_length() const { return content_length_; }
+    size_t chunk_size() const { return chunk_size_; }
+
+private:
+    struct Chunk {
+        uint8_t* data;
+        size_t offset;
+        size_t size;    // 0 stops the writer task
+    };
+
+    size_t chunk_size_;
+    size_t content_length_ = 0;
+    uint8_t* buffers_[DOWNLOAD_CHUNKS] = {};
+    QueueHandle_t free_chunks_ = nullptr;
+    QueueHandle_t full_chunks_ = nullptr;
+    SemaphoreHandle_t writer_done_ = nullptr;
+    WriteCallback write_callback_;
+    RestartCallback restart_callback_;
+    std::atomic<bool> write_failed_ = false;
+
+    void WriterTask();
+    bool Receive(const std::string& url, ProgressCallback& progress_callback);
+    bool Restart(Chunk& chunk);
+};
+
+#endif // DOWNLOADER_H
@@ -2,6 +2,7 @@
 #include "application.h"
 #include "device_state.h"
 #include <esp_log.h>
+#include <algorithm>
 
 #define TAG "GpioLed"
 
@@ -14,7 +15,8 @@
 #define UPGRADING_BRIGHTNESS 25
 #define ACTIVATING_BRIGHTNESS 35
 
-#define BLINK_INFINITE -1
+// Crossfade between the brightness of two device states
+#define STATE_CROSSFADE_MS 150
 
 // GPIO_LED
 #define LEDC_LS_TIMER          LEDC_TIMER_1
@@ -61,72 +63,36 @@ GpioLed::GpioLed(gpio_num_t gpio, int output_invert, ledc_timer_t timer_num, led
     // Set LED Controller with previously prepared configuration
     ledc_channel_config(&ledc_channel_);
 
-    // Initialize fade service.
-    ledc_fade_func_install(0);
-
-    // When the callback registered by ledc_cb_degister is called, run led ->OnFadeEnd()
-    ledc_cbs_t ledc_callbacks = {
-        .fade_cb = FadeCallback
-    };
-    ledc_cb_register(ledc_channel_.speed_mode, ledc_channel_.channel, &ledc_callbacks, this);
-
-    esp_timer_create_args_t blink_timer_args = {
-        .callback = [](void *arg) {
-            auto led = static_cast<GpioLed*>(arg);
-            led->OnBlinkTimer();
-        },
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "Blink Timer",
-        .skip_unhandled_events = false,
-    };
-    ESP_ERROR_CHECK(esp_timer_create(&blink_timer_args, &blink_timer_));
-
-    xTaskCreate(EventTask, "LedEvent", 2048, this, 
-            tskIDLE_PRIORITY + 2, &event_task_handle_);
+    // The animations use the red channel as the brightness
+    animator_ = new LedAnimator(1, [this](const StripColor* colors, int count) {
+        ledc_set_duty(ledc_channel_.speed_mode, ledc_channel_.channel, colors[0].red * LEDC_DUTY / 255);
+        ledc_update_duty(ledc_channel_.speed_mode, ledc_channel_.channel);
+    });
 
     ledc_initialized_ = true;
 }
 
 GpioLed::~GpioLed() {
-    esp_timer_stop(blink_timer_);
-    if (ledc_initialized_) {
-        ledc_fade_stop(ledc_channel_.speed_mode, ledc_channel_.channel);
-        ledc_fade_func_uninstall();
-    }
+    delete animator_;
 }
 
 
 void GpioLed::SetBrightness(uint8_t brightness) {
-    if (brightness == 100) {
-        duty_ = LEDC_DUTY;
-    } else {
-        duty_ = brightness * LEDC_DUTY / 100;
-    }
+    level_ = std::min<int>(brightness, 100) * 255 / 100;
 }
 
 void GpioLed::TurnOn() {
     if (!ledc_initialized_) {
         return;
     }
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    esp_timer_stop(blink_timer_);
-    ledc_fade_stop(ledc_channel_.speed_mode, ledc_channel_.channel);
-    ledc_set_duty(ledc_channel_.speed_mode, ledc_channel_.channel, duty_);
-    ledc_update_duty(ledc_channel_.speed_mode, ledc_channel_.channel);
+    animator_->Play(LedAnimation::Solid({ level_, 0, 0 }), STATE_CROSSFADE_MS);
 }
 
 void GpioLed::TurnOff() {
     if (!ledc_initialized_) {
         return;
     }
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    esp_timer_stop(blink_timer_);
-    ledc_fade_stop(ledc_channel_.speed_mode, ledc_channel_.channel);
-    ledc_set_duty(ledc_channel_.speed_mode, ledc_channel_.channel, 0);
-    ledc_update_duty(ledc_channel_.speed_mode, ledc_channel_.channel);
+    animator_->Play(LedAnimation::Solid(StripColor()), STATE_CROSSFADE_MS);
 }
 
 void GpioLed::BlinkOnce() {
@@ -134,74 +100,19 @@ void GpioLed::BlinkOnce() {
 }
 
 void GpioLed::Blink(int times, int interval_ms) {
-    StartBlinkTask(times, interval_ms);
+    animator_->Play(LedAnimation::Blink({ level_, 0, 0 }, interval_ms, times));
 }
 
 void GpioLed::StartContinuousBlink(int interval_ms) {
-    StartBlinkTask(BLINK_INFINITE, interval_ms);
-}
-
-void GpioLed::StartBlinkTask(int times, int interval_ms) {
-    if (!ledc_initialized_) {
-        return;
-    }
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    esp_timer_stop(blink_timer_);
-    ledc_fade_stop(ledc_channel_.speed_mode, ledc_channel_.channel);
-
-    blink_counter_ = times * 2;
-    blink_interval_ms_ = interval_ms;
-    esp_timer_start_periodic(blink_timer_, interval_ms * 1000);
-}
-
-void GpioLed::OnBlinkTimer() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    blink_counter_--;
-    if (blink_counter_ & 1) {
-        ledc_set_duty(ledc_channel_.speed_mode, ledc_channel_.channel, duty_);
-    } else {
-        ledc_set_duty(ledc_channel_.speed_mode, ledc_channel_.channel, 0);
-
-        if (blink_counter_ == 0) {
-            esp_timer_stop(blink_timer_);
-        }
-    }
-    ledc_update_duty(ledc_channel_.speed_mode, ledc_channel_.channel);
+    animator_->Play(LedAnimation::Blink({ level_, 0, 0 }, interval_ms));
 }
 
+// Fades between off and full brightness, LEDC_FADE_TIME each way
 void GpioLed::StartFadeTask() {
     if (!ledc_initialized_) {
         return;
     }
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    esp_timer_stop(blink_timer_);
-    ledc_fade_stop(ledc_channel_.speed_mode, ledc_channel_.channel);
-    fade_up_ = true;
-    ledc_set_fade_with_time(ledc_channel_.speed_mode,
-                            ledc_channel_.channel, LEDC_DUTY, LEDC_FADE_TIME);
-    ledc_fade_start(ledc_channel_.speed_mode,
-                    ledc_channel_.channel, LEDC_FADE_NO_WAIT);
-}
-
-void GpioLed::OnFadeEnd() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    fade_up_ = !fade_up_;
-    ledc_set_fade_with_time(ledc_channel_.speed_mode,
-                            ledc_channel_.channel, fade_up_ ? LEDC_DUTY : 0, LEDC_FADE_TIME);
-    ledc_fade_start(ledc_channel_.speed_mode,
-                    ledc_channel_.channel, LEDC_FADE_NO_WAIT);
-}
-
-bool IRAM_ATTR GpioLed::FadeCallback(const ledc_cb_param_t *param, void *user_arg) {
-    if (param->event == LEDC_FADE_END_EVT) {
-        auto led = static_cast<GpioLed*>(user_arg);
-        BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-        xTaskNotifyFromISR(led->event_task_handle_, 0x01, eSetValueWithOverwrite,
-                           &xHigherPriorityTaskWoken);
-    }
-    return true;
+    animator_->Play(LedAnimation::Breathe(StripColor(), { 255, 0, 0 }, LEDC_FADE_TIME), STATE_CROSSFADE_MS);
 }
 
 void GpioLed::OnStateChanged() {
@@ -252,12 +163,3 @@ void GpioLed::OnStateChanged() {
             return;
     }
 }
-
-void GpioLed::EventTask(void* arg) {
-    GpioLed* led = static_cast<GpioLed*>(arg);
-
-    while (1) {
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
-        led->OnFadeEnd();
-    }
-}
\ No newline at end of file
@@ -0,0 +1,219 @@
+#include "led_animator.h"
+#include <esp_log.h>
+#include <soc/soc_caps.h>
+#include <algorithm>
+#include <cstdlib>
+
+#define TAG "LedAnimator"
+
+LedAnimation::LedAnimation(int pixels, int frame_ms, bool loop)
+    : pixels_(std::max(pixels, 1)), frame_ms_(std::max(frame_ms, 1)), loop_(loop) {
+}
+
+StripColor* LedAnimation::AddFrame() {
+    frames_.resize((frame_count_ + 1) * pixels_);
+    return &frames_[frame_count_++ * pixels_];
+}
+
+uint32_t LedAnimation::GetFingerprint() const {
+    // FNV-1a over the timing and all frames
+    uint32_t hash = 2166136261u;
+    auto add = [&hash](uint32_t value) {
+        hash = (hash ^ value) * 16777619u;
+    };
+    add(pixels_);
+    add(frame_ms_);
+    add(loop_);
+    add(frame_count_);
+    for (auto& color : frames_) {
+        add(color.red | (color.green << 8) | (color.blue << 16));
+    }
+    return hash;
+}
+
+std::unique_ptr<LedAnimation> LedAnimation::Solid(StripColor color) {
+    auto animation = std::make_unique<LedAnimation>(1, LED_ANIMATION_TICK_MS, false);
+    *animation->AddFrame() = color;
+    return animation;
+}
+
+std::unique_ptr<LedAnimation> LedAnimation::Still(const std::vector<StripColor>& colors) {
+    auto animation = std::make_unique<LedAnimation>(colors.size(), LED_ANIMATION_TICK_MS, false);
+    std::copy(colors.begin(), colors.end(), animation->AddFrame());
+    return animation;
+}
+
+std::unique_ptr<LedAnimation> LedAnimation::Blink(StripColor color, int interval_ms, int times) {
+    auto animation = std::make_unique<LedAnimation>(1, interval_ms, times < 0);
+    for (int i = 0; i < std::max(times, 1); i++) {
+        *animation->AddFrame() = color;
+        *animation->AddFrame() = StripColor();
+    }
+    return animation;
+}
+
+std::unique_ptr<LedAnimation> LedAnimation::Breathe(StripColor low, StripColor high, int ramp_ms) {
+    int steps = std::max(1, ramp_ms / LED_ANIMATION_TICK_MS);
+    auto animation = std::make_unique<LedAnimation>(1, LED_ANIMATION_TICK_MS, true);
+    auto blend = [](uint8_t from, uint8_t to, int step, int steps) {
+        return (uint8_t)(from + (to - from) * step / steps);
+    };
+    // Up including high, then down excluding low, so the loop has no doubled frames
+    for (int i = 0; i < 2 * steps; i++) {
+        int step = i <= steps ? i : 2 * steps - i;
+        auto frame = animation->AddFrame();
+        frame->red = blend(low.red, high.red, step, steps);
+        frame->green = blend(low.green, high.green, step, steps);
+        frame->blue = blend(low.blue, high.blue, step, steps);
+    }
+    return animation;
+}
+
+std::unique_ptr<LedAnimation> LedAnimation::Scroll(int pixels, StripColor low, StripColor high, int length, int interval_ms) {
+    auto animation = std::make_unique<LedAnimation>(pixels, interval_ms, true);
+    for (int offset = 0; offset < pixels; offset++) {
+        auto frame = animation->AddFrame();
+        std::fill(frame, frame + pixels, low);
+        for (int j = 0; j < length; j++) {
+            frame[(offset + j) % pixels] = high;
+        }
+    }
+    return animation;
+}
+
+LedAnimator::LedAnimator(int pixels, Writer writer) : pixels_(pixels), writer_(writer) {
+    fade_from_.resize(pixels_);
+    output_.resize(pixels_);
+    written_.resize(pixels_);
+
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void *arg) {
+            static_cast<LedAnimator*>(arg)->OnTimer();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "led_animator",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_));
+}
+
+LedAnimator::~LedAnimator() {
+    esp_timer_stop(timer_);
+    esp_timer_delete(timer_);
+    delete pending_.exchange(nullptr);
+    delete current_;
+}
+
+led_strip_handle_t LedAnimator::CreateWs2812Strip(gpio_num_t gpio, int max_leds) {
+    led_strip_config_t strip_config = {};
+    strip_config.strip_gpio_num = gpio;
+    strip_config.max_leds = max_leds;
+    strip_config.color_component_format = LED_STRIP_COLOR_COMPONENT_FMT_GRB;
+    strip_config.led_model = LED_MODEL_WS2812;
+
+    led_strip_rmt_config_t rmt_config = {};
+    rmt_config.resolution_hz = 10 * 1000 * 1000; // 10MHz
+#if SOC_RMT_SUPPORT_DMA
+    // Without DMA the RMT memory is refilled from an interrupt, and a late refill shows up as flicker
+    if (max_leds > 1) {
+        rmt_config.flags.with_dma = true;
+        rmt_config.mem_block_symbols = 1024;
+    }
+#endif
+
+    led_strip_handle_t led_strip = nullptr;
+    esp_err_t err = led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip);
+#if SOC_RMT_SUPPORT_DMA
+    if (err != ESP_OK && rmt_config.flags.with_dma) {
+        // The DMA channels may all be taken, e.g. by the camera
+        ESP_LOGW(TAG, "No DMA for the LED strip: %s", esp_err_to_name(err));
+        rmt_config.flags.with_dma = false;
+        rmt_config.mem_block_symbols = 0;
+        err = led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip);
+    }
+#endif
+    ESP_ERROR_CHECK(err);
+    led_strip_clear(led_strip);
+    return led_strip;
+}
+
+void LedAnimator::Play(std::unique_ptr<LedAnimation> animation, int crossfade_ms) {
+    // Something that does not change over time is not restarted, it would only cost a refresh
+    uint32_t fingerprint = animation->GetFingerprint();
+    if (fingerprint_.exchange(fingerprint) == fingerprint && (animation->loop() || animation->frame_count() == 1)) {
+        return;
+    }
+
+    animation->crossfade_ms_ = crossfade_ms;
+    delete pending_.exchange(animation.release());
+    StartTimer();
+}
+
+void LedAnimator::StartTimer() {
+    // Tick now. A tick armed for a later frame is moved forward, one about to fire picks up the animation anyway
+    if (esp_timer_start_once(timer_, 0) != ESP_OK) {
+        esp_timer_restart(timer_, 0);
+    }
+}
+
+void LedAnimator::OnTimer() {
+    int64_t now = esp_timer_get_time();
+    LedAnimation* next = pending_.exchange(nullptr);
+    if (next != nullptr) {
+        delete current_;
+        current_ = next;
+        start_time_ = now;
+        frame_index_ = -1;
+        crossfade_ms_ = next->crossfade_ms_;
+        fade_from_ = written_;
+    }
+    if (current_ == nullptr || current_->frame_count_ == 0) {
+        return;
+    }
+
+    int elapsed_ms = (int)((now - start_time_) / 1000);
+    int frame_number = elapsed_ms / current_->frame_ms_;
+    int index = frame_number;
+    // Once the last frame of a finite animation is drawn nothing changes anymore
+    bool finished = !current_->loop_ && index >= current_->frame_count_ - 1;
+    if (index >= current_->frame_count_) {
+        index = current_->loop_ ? index % current_->frame_count_ : current_->frame_count_ - 1;
+    }
+
+    if (crossfade_ms_ > 0 && elapsed_ms >= crossfade_ms_) {
+        // Draw the last step of the crossfade
+        crossfade_ms_ = 0;
+        frame_index_ = -1;
+    }
+
+    if (index != frame_index_ || crossfade_ms_ > 0) {
+        frame_index_ = index;
+        const StripColor* frame = current_->GetFrame(index);
+        int stride = current_->pixels_ == 1 ? 0 : 1;
+        int weight = crossfade_ms_ > 0 ? elapsed_ms * 256 / crossfade_ms_ : 256;
+        for (int i = 0; i < pixels_; i++) {
+            const StripColor& to = frame[std::min(i * stride, current_->pixels_ - 1)];
+            if (weight >= 256) {
+                output_[i] = to;
+            } else {
+                const StripColor& from = fade_from_[i];
+                output_[i].red = from.red + (to.red - from.red) * weight / 256;
+                output_[i].green = from.green + (to.green - from.green) * weight / 256;
+                output_[i].blue = from.blue + (to.blue - from.blue) * weight / 256;
+            }
+        }
+        if (output_ != written_) {
+            writer_(output_.data(), pixels_);
+            written_.swap(output_);
+        }
+    }
+
+    if (crossfade_ms_ > 0) {
+        esp_timer_start_once(timer_, LED_ANIMATION_TICK_MS * 1000);
+    } else if (!finished) {
+        // Fails harmlessly if Play() has armed the timer meanwhile
+        int64_t next_frame = start_time_ + (int64_t)(frame_number + 1) * current_->frame_ms_ * 1000;
+        esp_timer_start_once(timer_, std::max<int64_t>(next_frame - now, 0));
+    }
+}
@@ -0,0 +1,103 @@
+#ifndef _LED_ANIMATOR_H_
+#define _LED_ANIMATOR_H_
+
+#include <driver/gpio.h>
+#include <led_strip.h>
+#include <esp_timer.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+// The animator wakes up this often during a crossfade, otherwise only when the next frame is due
+#define LED_ANIMATION_TICK_MS 20
+
+struct StripColor {
+    uint8_t red = 0, green = 0, blue = 0;
+
+    bool operator==(const StripColor& other) const {
+        return red == other.red && green == other.green && blue == other.blue;
+    }
+    bool operator!=(const StripColor& other) const { return !(*this == other); }
+};
+
+/*
+ * An LED effect computed in advance: frames of colors shown for frame_ms each.
+ * An animation with one pixel per frame shows the same color on every LED.
+ */
+class LedAnimation {
+public:
+    LedAnimation(int pixels, int frame_ms, bool loop);
+
+    StripColor* AddFrame();
+    const StripColor* GetFrame(int index) const { return &frames_[index * pixels_]; }
+    int pixels() const { return pixels_; }
+    int frame_count() const { return frame_count_; }
+    int frame_ms() const { return frame_ms_; }
+    bool loop() const { return loop_; }
+    uint32_t GetFingerprint() const;
+
+    static std::unique_ptr<LedAnimation> Solid(StripColor color);
+    static std::unique_ptr<LedAnimation> Still(const std::vector<StripColor>& colors);
+    // On and off for interval_ms each, times = -1 blinks until something else is played
+    static std::unique_ptr<LedAnimation> Blink(StripColor color, int interval_ms, int times = -1);
+    // From low to high in ramp_ms and back, until something else is played
+    static std::unique_ptr<LedAnimation> Breathe(StripColor low, StripColor high, int ramp_ms);
+    // length LEDs of high moving over low by one LED every interval_ms
+    static std::unique_ptr<LedAnimation> Scroll(int pixels, StripColor low, StripColor high, int length, int interval_ms);
+
+private:
+    friend class LedAnimator;
+
+    int pixels_;
+    int frame_ms_;
+    bool loop_;
+    int frame_count_ = 0;
+    int crossfade_ms_ = 0;
+    std::vector<StripColor> frames_;
+};
+
+/*
+ * Plays LedAnimations on any kind of LED through a writer callback.
+ *
+ * Play() hands the animation to the timer task with an atomic swap, so neither side takes a lock.
+ * The timer task blends from the colors on the LEDs into the new animation over the crossfade time,
+ * calls the writer only when the colors change, and stops once a finite animation has ended.
+ * The timer is one shot and armed for the next frame, so a slow blink wakes the CPU twice a second.
+ * Playing the animation that is already playing does not restart it.
+ */
+class LedAnimator {
+public:
+    // Writes the colors of all pixels to the LEDs, called from the esp_timer task
+    using Writer = std::function<void(const StripColor* colors, int count)>;
+
+    LedAnimator(int pixels, Writer writer);
+    ~LedAnimator();
+
+    void Play(std::unique_ptr<LedAnimation> animation, int crossfade_ms = 0);
+
+    // A WS2812 strip on RMT, with DMA where the RMT supports it so refreshes do not depend on interrupt latency
+    static led_strip_handle_t CreateWs2812Strip(gpio_num_t gpio, int max_leds);
+
+private:
+    const int pixels_;
+    Writer writer_;
+    esp_timer_handle_t timer_ = nullptr;
+    std::atomic<LedAnimation*> pending_{nullptr};
+    std::atomic<uint32_t> fingerprint_{0};
+
+    // Only used by the timer task
+    LedAnimation* current_ = nullptr;
+    int64_t start_time_ = 0;
+    int frame_index_ = -1;
+    int crossfade_ms_ = 0;
+    std::vector<StripColor> fade_from_;
+    std::vector<StripColor> output_;
+    std::vector<StripColor> written_;
+
+    void StartTimer();
+    void OnTimer();
+};
+
+#endif // _LED_ANIMATOR_H_
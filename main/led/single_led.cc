@@ -8,40 +8,22 @@
 #define HIGH_BRIGHTNESS 16
 #define LOW_BRIGHTNESS 2
 
-#define BLINK_INFINITE -1
-
+// Crossfade between the colors of two device states
+#define STATE_CROSSFADE_MS 150
 
 SingleLed::SingleLed(gpio_num_t gpio) {
     // If the gpio is not connected, you should use NoLed class
     assert(gpio != GPIO_NUM_NC);
 
-    led_strip_config_t strip_config = {};
-    strip_config.strip_gpio_num = gpio;
-    strip_config.max_leds = 1;
-    strip_config.color_component_format = LED_STRIP_COLOR_COMPONENT_FMT_GRB;
-    strip_config.led_model = LED_MODEL_WS2812;
-
-    led_strip_rmt_config_t rmt_config = {};
-    rmt_config.resolution_hz = 10 * 1000 * 1000; // 10MHz
-
-    ESP_ERROR_CHECK(led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip_));
-    led_strip_clear(led_strip_);
-
-    esp_timer_create_args_t blink_timer_args = {
-        .callback = [](void *arg) {
-            auto led = static_cast<SingleLed*>(arg);
-            led->OnBlinkTimer();
-        },
-        .arg = this,
-        .dispatch_method = ESP_TIMER_TASK,
-        .name = "blink_timer",
-        .skip_unhandled_events = false,
-    };
-    ESP_ERROR_CHECK(esp_timer_create(&blink_timer_args, &blink_timer_));
+    led_strip_ = LedAnimator::CreateWs2812Strip(gpio, 1);
+    animator_ = new LedAnimator(1, [this](const StripColor* colors, int count) {
+        led_strip_set_pixel(led_strip_, 0, colors[0].red, colors[0].green, colors[0].blue);
+        led_strip_refresh(led_strip_);
+    });
 }
 
 SingleLed::~SingleLed() {
-    esp_timer_stop(blink_timer_);
+    delete animator_;
     if (led_strip_ != nullptr) {
         led_strip_del(led_strip_);
     }
@@ -49,30 +31,15 @@ SingleLed::~SingleLed() {
 
 
 void SingleLed::SetColor(uint8_t r, uint8_t g, uint8_t b) {
-    r_ = r;
-    g_ = g;
-    b_ = b;
+    color_ = { r, g, b };
 }
 
 void SingleLed::TurnOn() {
-    if (led_strip_ == nullptr) {
-        return;
-    }
-    
-    std::lock_guard<std::mutex> lock(mutex_);
-    esp_timer_stop(blink_timer_);
-    led_strip_set_pixel(led_strip_, 0, r_, g_, b_);
-    led_strip_refresh(led_strip_);
+    animator_->Play(LedAnimation::Solid(color_), STATE_CROSSFADE_MS);
 }
 
 void SingleLed::TurnOff() {
-    if (led_strip_ == nullptr) {
-        return;
-    }
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    esp_timer_stop(blink_timer_);
-    led_strip_clear(led_strip_);
+    animator_->Play(LedAnimation::Solid(StripColor()), STATE_CROSSFADE_MS);
 }
 
 void SingleLed::BlinkOnce() {
@@ -80,39 +47,11 @@ void SingleLed::BlinkOnce() {
 }
 
 void SingleLed::Blink(int times, int interval_ms) {
-    StartBlinkTask(times, interval_ms);
+    animator_->Play(LedAnimation::Blink(color_, interval_ms, times));
 }
 
 void SingleLed::StartContinuousBlink(int interval_ms) {
-    StartBlinkTask(BLINK_INFINITE, interval_ms);
-}
-
-void SingleLed::StartBlinkTask(int times, int interval_ms) {
-    if (led_strip_ == nullptr) {
-        return;
-    }
-
-    std::lock_guard<std::mutex> lock(mutex_);
-    esp_timer_stop(blink_timer_);
-    
-    blink_counter_ = times * 2;
-    blink_interval_ms_ = interval_ms;
-    esp_timer_start_periodic(blink_timer_, interval_ms * 1000);
-}
-
-void SingleLed::OnBlinkTimer() {
-    std::lock_guard<std::mutex> lock(mutex_);
-    blink_counter_--;
-    if (blink_counter_ & 1) {
-        led_strip_set_pixel(led_strip_, 0, r_, g_, b_);
-        led_strip_refresh(led_strip_);
-    } else {
-        led_strip_clear(led_strip_);
-
-        if (blink_counter_ == 0) {
-            esp_timer_stop(blink_timer_);
-        }
-    }
+    animator_->Play(LedAnimation::Blink(color_, interval_ms));
 }
 
 
@@ -2,11 +2,9 @@
 #define _SINGLE_LED_H_
 
 #include "led.h"
+#include "led_animator.h"
 #include <driver/gpio.h>
 #include <led_strip.h>
-#include <esp_timer.h>
-#include <atomic>
-#include <mutex>
 
 class SingleLed : public Led {
 public:
@@ -16,16 +14,9 @@ public:
     void OnStateChanged() override;
 
 private:
-    std::mutex mutex_;
-    TaskHandle_t blink_task_ = nullptr;
     led_strip_handle_t led_strip_ = nullptr;
-    uint8_t r_ = 0, g_ = 0, b_ = 0;
-    int blink_counter_ = 0;
-    int blink_interval_ms_ = 0;
-    esp_timer_handle_t blink_timer_ = nullptr;
-
-    void StartBlinkTask(int times, int interval_ms);
-    void OnBlinkTimer();
+    LedAnimator* animator_ = nullptr;
+    StripColor color_;
 
     void BlinkOnce();
     void Blink(int times, int interval_ms);
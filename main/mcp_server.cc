@@ -15,11 +15,15 @@
 #include "oled_display.h"
 #include "board.h"
 #include "settings.h"
+#include "task_profiler.h"
 #include "lvgl_theme.h"
 #include "lvgl_display.h"
 
 #define TAG "MCP"
 
+// A screen snapshot is encoded into memory before it is uploaded, larger JPEGs fail the tool
+#define SNAPSHOT_MAX_JPEG_SIZE (256 * 1024)
+
 McpServer::McpServer() {
 }
 
@@ -135,6 +139,25 @@ void McpServer::AddUserOnlyTools() {
             return board.GetSystemInfoJson();
         });
 
+    AddUserOnlyTool("self.get_audio_metrics",
+        "Get the audio pipeline metrics: p50/p95/p99 latency of every stage (microseconds), queue and pool high water marks, "
+        "jitter buffer and reply latency statistics, and the CPU usage of the audio tasks (percent)",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            auto& app = Application::GetInstance();
+            return app.GetAudioService().GetMetricsJson();
+        });
+
+#if CONFIG_USE_TASK_PROFILER
+    AddUserOnlyTool("self.get_task_profile",
+        "Get the CPU usage of every task (percent of one core, last interval, average and peak of the last minute), "
+        "the load of each core, the lowest free stack of every task and the free heap of internal RAM, PSRAM and DMA memory (bytes)",
+        PropertyList(),
+        [](const PropertyList& properties) -> ReturnValue {
+            return TaskProfiler::GetInstance().GetProfileJson();
+        });
+#endif
+
     AddUserOnlyTool("self.reboot", "Reboot the system",
         PropertyList(),
         [this](const PropertyList& properties) -> ReturnValue {
@@ -196,12 +219,21 @@ void McpServer::AddUserOnlyTools() {
                 auto url = properties["url"].value<std::string>();
                 auto quality = properties["quality"].value<int>();
 
-                std::string jpeg_data;
-                if (!display->SnapshotToJpeg(jpeg_data, quality)) {
+                // JPEG数据，边渲染边编码，显示锁只在编码时持有，上传在释放锁之后
+                std::string jpeg;
+                bool success = display->SnapshotToJpeg([&jpeg](const void* data, size_t size) -> bool {
+                    if (jpeg.size() + size > SNAPSHOT_MAX_JPEG_SIZE) {
+                        ESP_LOGE(TAG, "Snapshot is larger than %d bytes", SNAPSHOT_MAX_JPEG_SIZE);
+                        return false;
+                    }
+                    jpeg.append(static_cast<const char*>(data), size);
+                    return true;
+                }, quality);
+                if (!success) {
                     throw std::runtime_error("Failed to snapshot screen");
                 }
 
-                ESP_LOGI(TAG, "Upload snapshot %u bytes to %s", jpeg_data.size(), url.c_str());
+                ESP_LOGI(TAG, "Upload snapshot (%u bytes) to %s", jpeg.size(), url.c_str());
                 
                 // 构造multipart/form-data请求体
                 std::string boundary = "----ESP32_SCREEN_SNAPSHOT_BOUNDARY";
@@ -222,7 +254,7 @@ void McpServer::AddUserOnlyTools() {
                 }
 
                 // JPEG数据
-                http->Write((const char*)jpeg_data.data(), jpeg_data.size());
+                http->Write(jpeg.data(), jpeg.size());
 
                 {
                     // multipart尾部
@@ -284,6 +316,36 @@ void McpServer::AddUserOnlyTools() {
     }
 #endif // HAVE_LVGL
 
+#ifdef CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+    auto camera = Board::GetInstance().GetCamera();
+    if (camera) {
+        AddUserOnlyTool("self.camera.start_streaming",
+            "Stream the camera as JPEG frames (multipart/x-mixed-replace) to the url, at most `fps` frames per second. "
+            "`downscale` divides the width and height. Unchanged frames are skipped.",
+            PropertyList({
+                Property("url", kPropertyTypeString),
+                Property("fps", kPropertyTypeInteger, 2, 1, 15),
+                Property("downscale", kPropertyTypeInteger, 1, 1, 4)
+            }),
+            [camera](const PropertyList& properties) -> ReturnValue {
+                auto url = properties["url"].value<std::string>();
+                int fps = properties["fps"].value<int>();
+                int downscale = properties["downscale"].value<int>();
+                if (!camera->StartStreaming(url, fps, downscale)) {
+                    throw std::runtime_error("Failed to start streaming");
+                }
+                return true;
+            });
+
+        AddUserOnlyTool("self.camera.stop_streaming", "Stop streaming the camera",
+            PropertyList(),
+            [camera](const PropertyList& properties) -> ReturnValue {
+                camera->StopStreaming();
+                return true;
+            });
+    }
+#endif // CONFIG_XIAOZHI_CAMERA_CONTINUOUS_CAPTURE
+
     // Assets download url
     auto& assets = Assets::GetInstance();
     if (assets.partition_valid()) {
@@ -2,12 +2,15 @@
 #include "system_info.h"
 #include "settings.h"
 #include "assets/lang_config.h"
+#include "downloader.h"
+#include "delta_patch.h"
 
 #include <cJSON.h>
 #include <esp_log.h>
 #include <esp_partition.h>
 #include <esp_ota_ops.h>
 #include <esp_app_format.h>
+#include <esp_image_format.h>
 #include <esp_efuse.h>
 #include <esp_efuse_table.h>
 #ifdef SOC_HMAC_SUPPORTED
@@ -18,6 +21,7 @@
 #include <vector>
 #include <sstream>
 #include <algorithm>
+#include <memory>
 
 #define TAG "Ota"
 
@@ -218,6 +222,17 @@ esp_err_t Ota::CheckVersion() {
         if (cJSON_IsString(url)) {
             firmware_url_ = url->valuestring;
         }
+        // A delta patch is only usable if it was created from the running version
+        firmware_patch_url_.clear();
+        cJSON *patch = cJSON_GetObjectItem(firmware, "patch");
+        if (cJSON_IsObject(patch)) {
+            cJSON *from = cJSON_GetObjectItem(patch, "from");
+            cJSON *patch_url = cJSON_GetObjectItem(patch, "url");
+            if (cJSON_IsString(from) && cJSON_IsString(patch_url) && current_version_ == from->valuestring) {
+                firmware_patch_url_ = patch_url->valuestring;
+                ESP_LOGI(TAG, "Delta patch available from %s", from->valuestring);
+            }
+        }
 
         if (cJSON_IsString(version) && cJSON_IsString(url)) {
             // Check if the version is newer, for example, 0.1.0 is newer than 0.0.1
@@ -262,6 +277,35 @@ void Ota::MarkCurrentVersionValid() {
 }
 
 bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progress, size_t speed)> callback) {
+    return Install(firmware_url, nullptr, callback);
+}
+
+bool Ota::Upgrade(const std::string& firmware_url, const std::string& patch_url, std::function<void(int progress, size_t speed)> callback) {
+    if (!patch_url.empty()) {
+        // Hash the running image now, the patch header is checked against it while the download is running
+        auto running_partition = esp_ota_get_running_partition();
+        esp_partition_pos_t position = {
+            .offset = running_partition->address,
+            .size = running_partition->size,
+        };
+        esp_image_metadata_t metadata = {};
+        DeltaPatch::SourceDigest source = {};
+        bool hashed = esp_image_get_metadata(&position, &metadata) == ESP_OK &&
+            DeltaPatch::HashSource([running_partition](size_t offset, uint8_t* data, size_t size) -> bool {
+                return esp_partition_read(running_partition, offset, data, size) == ESP_OK;
+            }, metadata.image_len, source);
+        if (!hashed) {
+            ESP_LOGW(TAG, "Failed to hash the running image, the patch will do it");
+        }
+        if (Install(patch_url, hashed ? &source : nullptr, callback)) {
+            return true;
+        }
+        ESP_LOGW(TAG, "Delta upgrade failed, downloading the full firmware");
+    }
+    return Install(firmware_url, nullptr, callback);
+}
+
+bool Ota::Install(const std::string& firmware_url, const DeltaPatch::SourceDigest* source, std::function<void(int progress, size_t speed)> callback) {
     ESP_LOGI(TAG, "Upgrading firmware from %s", firmware_url.c_str());
     esp_ota_handle_t update_handle = 0;
     auto update_partition = esp_ota_get_next_update_partition(NULL);
@@ -274,78 +318,86 @@ bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progre
     bool image_header_checked = false;
     std::string image_header;
 
-    auto network = Board::GetInstance().GetNetwork();
-    auto http = network->CreateHttp(0);
-    if (!http->Open("GET", firmware_url)) {
-        ESP_LOGE(TAG, "Failed to open HTTP connection");
-        return false;
-    }
+    auto write_image = [&](const uint8_t* data, size_t size) -> bool {
+        esp_err_t err;
+        if (!image_header_checked) {
+            image_header.append((const char*)data, size);
+            if (image_header.size() < sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
+                return true;
+            }
+            esp_app_desc_t new_app_info;
+            memcpy(&new_app_info, image_header.data() + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
 
-    if (http->GetStatusCode() != 200) {
-        ESP_LOGE(TAG, "Failed to get firmware, status code: %d", http->GetStatusCode());
-        return false;
-    }
+            auto current_version = esp_app_get_description()->version;
+            ESP_LOGI(TAG, "Current version: %s, New version: %s", current_version, new_app_info.version);
 
-    size_t content_length = http->GetBodyLength();
-    if (content_length == 0) {
-        ESP_LOGE(TAG, "Failed to get content length");
-        return false;
-    }
+            if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle)) {
+                esp_ota_abort(update_handle);
+                ESP_LOGE(TAG, "Failed to begin OTA");
+                return false;
+            }
 
-    char buffer[512];
-    size_t total_read = 0, recent_read = 0;
-    auto last_calc_time = esp_timer_get_time();
-    while (true) {
-        int ret = http->Read(buffer, sizeof(buffer));
-        if (ret < 0) {
-            ESP_LOGE(TAG, "Failed to read HTTP data: %s", esp_err_to_name(ret));
+            image_header_checked = true;
+            err = esp_ota_write(update_handle, image_header.data(), image_header.size());
+            std::string().swap(image_header);
+        } else {
+            err = esp_ota_write(update_handle, data, size);
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
             return false;
         }
+        return true;
+    };
 
-        // Calculate speed and progress every second
-        recent_read += ret;
-        total_read += ret;
-        if (esp_timer_get_time() - last_calc_time >= 1000000 || ret == 0) {
-            size_t progress = total_read * 100 / content_length;
-            ESP_LOGI(TAG, "Progress: %u%% (%u/%u), Speed: %uB/s", progress, total_read, content_length, recent_read);
-            if (callback) {
-                callback(progress, recent_read);
-            }
-            last_calc_time = esp_timer_get_time();
-            recent_read = 0;
-        }
+    // A delta patch is applied to the running image while it is downloaded
+    std::unique_ptr<DeltaPatch> patch;
+    auto running_partition = esp_ota_get_running_partition();
 
-        if (ret == 0) {
-            break;
+    Downloader downloader;
+    // The running image is left as it is, so a firmware that changed on the server can be written again
+    downloader.OnRestart([&]() -> bool {
+        if (image_header_checked) {
+            esp_ota_abort(update_handle);
+            image_header_checked = false;
         }
-
-        if (!image_header_checked) {
-            image_header.append(buffer, ret);
-            if (image_header.size() >= sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t)) {
-                esp_app_desc_t new_app_info;
-                memcpy(&new_app_info, image_header.data() + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t), sizeof(esp_app_desc_t));
-                
-                auto current_version = esp_app_get_description()->version;
-                ESP_LOGI(TAG, "Current version: %s, New version: %s", current_version, new_app_info.version);
-
-                if (esp_ota_begin(update_partition, OTA_WITH_SEQUENTIAL_WRITES, &update_handle)) {
-                    esp_ota_abort(update_handle);
-                    ESP_LOGE(TAG, "Failed to begin OTA");
+        std::string().swap(image_header);
+        patch.reset();
+        return true;
+    });
+    bool success = downloader.Download(firmware_url, [&](size_t offset, const uint8_t* data, size_t size) -> bool {
+        if (offset == 0 && DeltaPatch::IsPatch(data, size)) {
+            patch = std::make_unique<DeltaPatch>([running_partition](size_t offset, uint8_t* data, size_t size) -> bool {
+                return esp_partition_read(running_partition, offset, data, size) == ESP_OK;
+            }, write_image);
+            if (source != nullptr) {
+                patch->SetSourceDigest(*source);
+            }
+            patch->OnHeader([&patch, update_partition]() -> bool {
+                if (patch->target_size() > update_partition->size) {
+                    ESP_LOGE(TAG, "Patched image (%u) is larger than the update partition", patch->target_size());
                     return false;
                 }
-
-                image_header_checked = true;
-                std::string().swap(image_header);
-            }
+                return true;
+            });
         }
-        auto err = esp_ota_write(update_handle, buffer, ret);
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "Failed to write OTA data: %s", esp_err_to_name(err));
+        if (patch) {
+            return patch->Feed(data, size);
+        }
+        return write_image(data, size);
+    }, callback);
+
+    // Nothing is installed unless the rebuilt image has the expected hash
+    if (success && patch && !patch->Finish()) {
+        success = false;
+    }
+
+    if (!success) {
+        if (image_header_checked) {
             esp_ota_abort(update_handle);
-            return false;
         }
+        return false;
     }
-    http->Close();
 
     esp_err_t err = esp_ota_end(update_handle);
     if (err != ESP_OK) {
@@ -368,7 +420,7 @@ bool Ota::Upgrade(const std::string& firmware_url, std::function<void(int progre
 }
 
 bool Ota::StartUpgrade(std::function<void(int progress, size_t speed)> callback) {
-    return Upgrade(firmware_url_, callback);
+    return Upgrade(firmware_url_, firmware_patch_url_, callback);
 }
 
 
@@ -6,6 +6,7 @@
 
 #include <esp_err.h>
 #include "board.h"
+#include "delta_patch.h"
 
 class Ota {
 public:
@@ -22,11 +23,15 @@ public:
     bool HasServerTime() { return has_server_time_; }
     bool StartUpgrade(std::function<void(int progress, size_t speed)> callback);
     static bool Upgrade(const std::string& firmware_url, std::function<void(int progress, size_t speed)> callback);
+    // Tries the delta patch first if there is one, and falls back to the full image
+    static bool Upgrade(const std::string& firmware_url, const std::string& patch_url, std::function<void(int progress, size_t speed)> callback);
     void MarkCurrentVersionValid();
 
     const std::string& GetFirmwareVersion() const { return firmware_version_; }
     const std::string& GetCurrentVersion() const { return current_version_; }
     const std::string& GetFirmwareUrl() const { return firmware_url_; }
+    // Empty unless the server offers a delta patch from the running version
+    const std::string& GetFirmwarePatchUrl() const { return firmware_patch_url_; }
     const std::string& GetActivationMessage() const { return activation_message_; }
     const std::string& GetActivationCode() const { return activation_code_; }
     std::string GetCheckVersionUrl();
@@ -44,6 +49,7 @@ private:
     std::string current_version_;
     std::string firmware_version_;
     std::string firmware_url_;
+    std::string firmware_patch_url_;
     std::string activation_challenge_;
     std::string serial_number_;
     int activation_timeout_ms_ = 30000;
@@ -53,6 +59,7 @@ private:
     bool IsNewVersionAvailable(const std::string& currentVersion, const std::string& newVersion);
     std::string GetActivationPayload();
     std::unique_ptr<Http> SetupHttp();
+    static bool Install(const std::string& url, const DeltaPatch::SourceDigest* source, std::function<void(int progress, size_t speed)> callback);
 };
 
 #endif // _OTA_H
@@ -8,10 +8,67 @@ void Protocol::OnIncomingJson(std::function<void(const cJSON* root)> callback) {
     on_incoming_json_ = callback;
 }
 
+void Protocol::OnIncomingMessage(std::function<bool(const ServerMessage& message)> callback) {
+    on_incoming_message_ = callback;
+}
+
 void Protocol::OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback) {
     on_incoming_audio_ = callback;
 }
 
+void Protocol::SetAudioPacketAllocator(std::function<std::unique_ptr<AudioStreamPacket>()> allocator,
+    std::function<void(std::unique_ptr<AudioStreamPacket> packet)> releaser) {
+    audio_packet_allocator_ = allocator;
+    audio_packet_releaser_ = releaser;
+}
+
+std::unique_ptr<AudioStreamPacket> Protocol::AllocateAudioPacket() {
+    if (audio_packet_allocator_) {
+        return audio_packet_allocator_();
+    }
+    return std::make_unique<AudioStreamPacket>();
+}
+
+void Protocol::ReleaseAudioPacket(std::unique_ptr<AudioStreamPacket> packet) {
+    if (audio_packet_releaser_) {
+        audio_packet_releaser_(std::move(packet));
+    }
+}
+
+void Protocol::SetUplinkAudioParams(int frame_duration, int bitrate) {
+    client_frame_duration_ = frame_duration;
+    client_bitrate_ = bitrate;
+}
+
+void Protocol::AddUplinkAudioParams(cJSON* audio_params) {
+    cJSON_AddNumberToObject(audio_params, "frame_duration", client_frame_duration_);
+    if (client_bitrate_ > 0) {
+        cJSON_AddNumberToObject(audio_params, "bitrate", client_bitrate_);
+    }
+    // Uplink frame durations the server may choose from
+    int frame_durations[] = {20, 40, 60};
+    cJSON_AddItemToObject(audio_params, "frame_durations", cJSON_CreateIntArray(frame_durations, 3));
+
+    // Until the server replies, the proposal is what we send
+    uplink_frame_duration_ = client_frame_duration_;
+    uplink_bitrate_ = client_bitrate_;
+}
+
+void Protocol::ParseUplinkAudioParams(const cJSON* audio_params) {
+    auto frame_duration = cJSON_GetObjectItem(audio_params, "uplink_frame_duration");
+    if (cJSON_IsNumber(frame_duration)) {
+        if (frame_duration->valueint == 20 || frame_duration->valueint == 40 || frame_duration->valueint == 60) {
+            uplink_frame_duration_ = frame_duration->valueint;
+        } else {
+            ESP_LOGW(TAG, "Unsupported uplink frame duration: %d", frame_duration->valueint);
+        }
+    }
+    auto bitrate = cJSON_GetObjectItem(audio_params, "uplink_bitrate");
+    if (cJSON_IsNumber(bitrate) && bitrate->valueint >= 0) {
+        uplink_bitrate_ = bitrate->valueint;
+    }
+}
+
 void Protocol::OnAudioChannelOpened(std::function<void()> callback) {
     on_audio_channel_opened_ = callback;
 }
@@ -78,6 +135,12 @@ void Protocol::SendMcpMessage(const std::string& payload) {
     SendText(message);
 }
 
+void Protocol::SendTelemetry(const std::string& category, const std::string& payload) {
+    std::string message = "{\"session_id\":\"" + session_id_ + "\",\"type\":\"telemetry\",\"category\":\"" + category +
+        "\",\"payload\":" + payload + "}";
+    SendText(message);
+}
+
 bool Protocol::IsTimeout() const {
     const int kTimeoutSeconds = 120;
     auto now = std::chrono::steady_clock::now();
@@ -6,12 +6,24 @@
 #include <functional>
 #include <chrono>
 #include <vector>
+#include <memory>
+
+#include "server_message.h"
 
 struct AudioStreamPacket {
     int sample_rate = 0;
     int frame_duration = 0;
     uint32_t timestamp = 0;
+    uint32_t sequence = 0;  // 0 if the transport has no sequence numbers
+    // Uplink packets may reserve room for the protocol header in front of the Opus data,
+    // so the protocol can send the payload as one buffer without copying it
+    uint16_t header_size = 0;
     std::vector<uint8_t> payload;
+    int64_t enqueue_time_us = 0;  // Time the packet entered the audio pipeline, used for latency statistics
+
+    uint8_t* opus_data() { return payload.data() + header_size; }
+    const uint8_t* opus_data() const { return payload.data() + header_size; }
+    size_t opus_size() const { return payload.size() - header_size; }
 };
 
 struct BinaryProtocol2 {
@@ -54,9 +66,24 @@ public:
     inline const std::string& session_id() const {
         return session_id_;
     }
+    inline int uplink_frame_duration() const {
+        return uplink_frame_duration_;
+    }
+    inline int uplink_bitrate() const {
+        return uplink_bitrate_;
+    }
+
+    // Uplink audio parameters proposed in the hello message, the server hello may override them
+    void SetUplinkAudioParams(int frame_duration, int bitrate);
 
     void OnIncomingAudio(std::function<void(std::unique_ptr<AudioStreamPacket> packet)> callback);
+    // Incoming packets are taken from the allocator (e.g. a pool), so their payload buffers can be reused.
+    // Packets the protocol drops after allocating them are handed back to the releaser
+    void SetAudioPacketAllocator(std::function<std::unique_ptr<AudioStreamPacket>()> allocator,
+        std::function<void(std::unique_ptr<AudioStreamPacket> packet)> releaser);
     void OnIncomingJson(std::function<void(const cJSON* root)> callback);
+    // Tokenized messages of the fixed schema, return false to have the message parsed and passed to OnIncomingJson
+    void OnIncomingMessage(std::function<bool(const ServerMessage& message)> callback);
     void OnAudioChannelOpened(std::function<void()> callback);
     void OnAudioChannelClosed(std::function<void()> callback);
     void OnNetworkError(std::function<void(const std::string& message)> callback);
@@ -67,16 +94,26 @@ public:
     virtual bool OpenAudioChannel() = 0;
     virtual void CloseAudioChannel() = 0;
     virtual bool IsAudioChannelOpened() const = 0;
-    virtual bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) = 0;
+    // Start setting up the next session in the background, so OpenAudioChannel() only has to claim it
+    virtual void PrewarmAudioChannel() {}
+    // The protocol may write its header into the bytes reserved in front of the Opus data
+    virtual bool SendAudio(AudioStreamPacket& packet) = 0;
+    // Header bytes uplink packets should reserve, 0 if the protocol cannot send them in place
+    virtual size_t audio_header_size() const { return 0; }
     virtual void SendWakeWordDetected(const std::string& wake_word);
     virtual void SendStartListening(ListeningMode mode);
     virtual void SendStopListening();
     virtual void SendAbortSpeaking(AbortReason reason);
     virtual void SendMcpMessage(const std::string& message);
+    // Periodic device metrics, the payload is a JSON object
+    virtual void SendTelemetry(const std::string& category, const std::string& payload);
 
 protected:
     std::function<void(const cJSON* root)> on_incoming_json_;
+    std::function<bool(const ServerMessage& message)> on_incoming_message_;
     std::function<void(std::unique_ptr<AudioStreamPacket> packet)> on_incoming_audio_;
+    std::function<std::unique_ptr<AudioStreamPacket>()> audio_packet_allocator_;
+    std::function<void(std::unique_ptr<AudioStreamPacket> packet)> audio_packet_releaser_;
     std::function<void()> on_audio_channel_opened_;
     std::function<void()> on_audio_channel_closed_;
     std::function<void(const std::string& message)> on_network_error_;
@@ -85,11 +122,19 @@ protected:
 
     int server_sample_rate_ = 24000;
     int server_frame_duration_ = 60;
+    int client_frame_duration_ = 60;
+    int client_bitrate_ = 0;
+    int uplink_frame_duration_ = 60;
+    int uplink_bitrate_ = 0;
     bool error_occurred_ = false;
     std::string session_id_;
     std::chrono::time_point<std::chrono::steady_clock> last_incoming_time_;
 
     virtual bool SendText(const std::string& text) = 0;
+    std::unique_ptr<AudioStreamPacket> AllocateAudioPacket();
+    void ReleaseAudioPacket(std::unique_ptr<AudioStreamPacket> packet);
+    void AddUplinkAudioParams(cJSON* audio_params);
+    void ParseUplinkAudioParams(const cJSON* audio_params);
     virtual void SetError(const std::string& message);
     virtual bool IsTimeout() const;
 };
@@ -0,0 +1,252 @@
+#include "server_message.h"
+
+#include <cstring>
+
+static const struct {
+    const char* name;
+    ServerMessageType type;
+} kServerMessageTypes[] = {
+    {"hello", kServerMessageHello},
+    {"goodbye", kServerMessageGoodbye},
+    {"tts", kServerMessageTts},
+    {"stt", kServerMessageStt},
+    {"llm", kServerMessageLlm},
+    {"mcp", kServerMessageMcp},
+    {"system", kServerMessageSystem},
+    {"alert", kServerMessageAlert},
+    {"custom", kServerMessageCustom},
+};
+
+static const struct {
+    const char* name;
+    JsonSlice ServerMessage::*field;
+} kServerMessageFields[] = {
+    {"type", &ServerMessage::type_name},
+    {"state", &ServerMessage::state},
+    {"text", &ServerMessage::text},
+    {"emotion", &ServerMessage::emotion},
+    {"command", &ServerMessage::command},
+    {"status", &ServerMessage::status},
+    {"message", &ServerMessage::message},
+    {"session_id", &ServerMessage::session_id},
+};
+
+bool JsonSlice::Equals(const char* text) const {
+    return data != nullptr && !escaped && strlen(text) == length && memcmp(data, text, length) == 0;
+}
+
+static int HexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool ReadHex4(const char* p, const char* end, uint32_t& value) {
+    if (end - p < 4) {
+        return false;
+    }
+    value = 0;
+    for (int i = 0; i < 4; i++) {
+        int digit = HexValue(p[i]);
+        if (digit < 0) {
+            return false;
+        }
+        value = (value << 4) | digit;
+    }
+    return true;
+}
+
+static size_t EncodeUtf8(uint32_t code, char* out) {
+    if (code < 0x80) {
+        out[0] = code;
+        return 1;
+    } else if (code < 0x800) {
+        out[0] = 0xC0 | (code >> 6);
+        out[1] = 0x80 | (code & 0x3F);
+        return 2;
+    } else if (code < 0x10000) {
+        out[0] = 0xE0 | (code >> 12);
+        out[1] = 0x80 | ((code >> 6) & 0x3F);
+        out[2] = 0x80 | (code & 0x3F);
+        return 3;
+    }
+    out[0] = 0xF0 | (code >> 18);
+    out[1] = 0x80 | ((code >> 12) & 0x3F);
+    out[2] = 0x80 | ((code >> 6) & 0x3F);
+    out[3] = 0x80 | (code & 0x3F);
+    return 4;
+}
+
+size_t JsonSlice::CopyTo(char* out) const {
+    if (!escaped) {
+        memcpy(out, data, length);
+        out[length] = '\0';
+        return length;
+    }
+
+    // An escape sequence is never shorter than what it stands for, so the result fits in length bytes
+    const char* p = data;
+    const char* end = data + length;
+    char* q = out;
+    while (p < end) {
+        if (*p != '\\' || p + 1 >= end) {
+            *q++ = *p++;
+            continue;
+        }
+        char c = p[1];
+        p += 2;
+        switch (c) {
+        case 'b': *q++ = '\b'; break;
+        case 'f': *q++ = '\f'; break;
+        case 'n': *q++ = '\n'; break;
+        case 'r': *q++ = '\r'; break;
+        case 't': *q++ = '\t'; break;
+        case 'u': {
+            uint32_t code;
+            if (!ReadHex4(p, end, code)) {
+                break;
+            }
+            p += 4;
+            // Characters outside the BMP are escaped as a surrogate pair
+            uint32_t low;
+            if (code >= 0xD800 && code <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                ReadHex4(p + 2, end, low) && low >= 0xDC00 && low <= 0xDFFF) {
+                code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                p += 6;
+            }
+            q += EncodeUtf8(code, q);
+            break;
+        }
+        default:
+            // \" \\ \/
+            *q++ = c;
+            break;
+        }
+    }
+    *q = '\0';
+    return q - out;
+}
+
+std::string JsonSlice::ToString() const {
+    if (data == nullptr) {
+        return std::string();
+    }
+    std::string result(length, '\0');
+    result.resize(CopyTo(result.data()));
+    return result;
+}
+
+static const char* SkipSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    return p;
+}
+
+// p points at the opening quote, returns the position after the closing quote or nullptr
+static const char* ParseString(const char* p, const char* end, JsonSlice& slice) {
+    slice.data = ++p;
+    slice.escaped = false;
+    while (p < end) {
+        if (*p == '\\') {
+            slice.escaped = true;
+            p += 2;
+        } else if (*p == '"') {
+            slice.length = p - slice.data;
+            return p + 1;
+        } else {
+            p++;
+        }
+    }
+    slice.data = nullptr;
+    return nullptr;
+}
+
+// p points at '{' or '[', returns the position after the matching bracket or nullptr
+static const char* SkipContainer(const char* p, const char* end) {
+    int depth = 0;
+    while (p < end) {
+        if (*p == '"') {
+            JsonSlice ignored;
+            p = ParseString(p, end, ignored);
+            if (p == nullptr) {
+                return nullptr;
+            }
+            continue;
+        }
+        if (*p == '{' || *p == '[') {
+            depth++;
+        } else if (*p == '}' || *p == ']') {
+            if (--depth == 0) {
+                return p + 1;
+            }
+        }
+        p++;
+    }
+    return nullptr;
+}
+
+bool ServerMessage::Parse(const char* data, size_t length) {
+    const char* end = data + length;
+    const char* p = SkipSpace(data, end);
+    if (p >= end || *p != '{') {
+        return false;
+    }
+    p = SkipSpace(p + 1, end);
+    while (p < end && *p != '}') {
+        JsonSlice key;
+        if (*p != '"' || (p = ParseString(p, end, key)) == nullptr) {
+            return false;
+        }
+        p = SkipSpace(p, end);
+        if (p >= end || *p != ':') {
+            return false;
+        }
+        p = SkipSpace(p + 1, end);
+        if (p >= end) {
+            return false;
+        }
+
+        if (*p == '"') {
+            JsonSlice value;
+            if ((p = ParseString(p, end, value)) == nullptr) {
+                return false;
+            }
+            for (const auto& field : kServerMessageFields) {
+                if (key.Equals(field.name)) {
+                    this->*field.field = value;
+                    break;
+                }
+            }
+        } else if (*p == '{' || *p == '[') {
+            if ((p = SkipContainer(p, end)) == nullptr) {
+                return false;
+            }
+        } else {
+            // Number, true, false or null
+            while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+                p++;
+            }
+        }
+
+        p = SkipSpace(p, end);
+        if (p < end && *p == ',') {
+            p = SkipSpace(p + 1, end);
+        } else if (p >= end || *p != '}') {
+            return false;
+        }
+    }
+    if (p >= end || !type_name.present()) {
+        return false;
+    }
+
+    type = kServerMessageUnknown;
+    for (const auto& entry : kServerMessageTypes) {
+        if (type_name.Equals(entry.name)) {
+            type = entry.type;
+            break;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,56 @@
+#ifndef SERVER_MESSAGE_H
+#define SERVER_MESSAGE_H
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+enum ServerMessageType {
+    kServerMessageUnknown,
+    kServerMessageHello,
+    kServerMessageGoodbye,
+    kServerMessageTts,
+    kServerMessageStt,
+    kServerMessageLlm,
+    kServerMessageMcp,
+    kServerMessageSystem,
+    kServerMessageAlert,
+    kServerMessageCustom,
+    kServerMessageTypeCount
+};
+
+// A string value inside the received message, still JSON escaped
+struct JsonSlice {
+    const char* data = nullptr;
+    size_t length = 0;
+    bool escaped = false;
+
+    bool present() const { return data != nullptr; }
+    bool Equals(const char* text) const;
+    // Unescape into out, which needs length + 1 bytes, returns the length written
+    size_t CopyTo(char* out) const;
+    std::string ToString() const;
+};
+
+/*
+ * Server messages with a fixed, flat schema (tts, stt, llm, system, alert) are tokenized in place:
+ * the top level string fields are recorded as slices of the received buffer, nested objects are skipped,
+ * and nothing is allocated. Messages with nested payloads (hello, mcp, custom) are still parsed with cJSON.
+ */
+class ServerMessage {
+public:
+    // False if the data is not a JSON object with a string type
+    bool Parse(const char* data, size_t length);
+
+    ServerMessageType type = kServerMessageUnknown;
+    JsonSlice type_name;
+    JsonSlice state;
+    JsonSlice text;
+    JsonSlice emotion;
+    JsonSlice command;
+    JsonSlice status;
+    JsonSlice message;
+    JsonSlice session_id;
+};
+
+#endif // SERVER_MESSAGE_H
@@ -5,18 +5,25 @@
 #include "settings.h"
 
 #include <cstring>
+#include <algorithm>
 #include <cJSON.h>
 #include <esp_log.h>
 #include <arpa/inet.h>
+#include <netdb.h>
+#include <esp_timer.h>
+#include <freertos/task.h>
 #include "assets/lang_config.h"
 
 #define TAG "WS"
 
 WebsocketProtocol::WebsocketProtocol() {
     event_group_handle_ = xEventGroupCreate();
+    xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_PREWARM_IDLE_EVENT);
 }
 
 WebsocketProtocol::~WebsocketProtocol() {
+    // The pre-warm task uses this object until it ends
+    xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_PREWARM_IDLE_EVENT, pdFALSE, pdTRUE, portMAX_DELAY);
     vEventGroupDelete(event_group_handle_);
 }
 
@@ -25,44 +32,70 @@ bool WebsocketProtocol::Start() {
     return true;
 }
 
-bool WebsocketProtocol::SendAudio(std::unique_ptr<AudioStreamPacket> packet) {
-    if (websocket_ == nullptr || !websocket_->IsConnected()) {
-        return false;
+std::shared_ptr<WebSocket> WebsocketProtocol::GetWebSocket() const {
+    std::lock_guard<std::mutex> lock(websocket_mutex_);
+    return websocket_;
+}
+
+void WebsocketProtocol::SetWebSocket(std::shared_ptr<WebSocket> websocket) {
+    std::unique_lock<std::mutex> lock(websocket_mutex_);
+    websocket_.swap(websocket);
+    lock.unlock();
+    // The old connection, if no sender holds it, is closed outside the lock
+}
+
+size_t WebsocketProtocol::audio_header_size() const {
+    if (version_ == 2) {
+        return sizeof(BinaryProtocol2);
+    } else if (version_ == 3) {
+        return sizeof(BinaryProtocol3);
     }
+    return 0;
+}
 
+void WebsocketProtocol::WriteAudioHeader(uint8_t* header, const AudioStreamPacket& packet) {
     if (version_ == 2) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol2) + packet->payload.size());
-        auto bp2 = (BinaryProtocol2*)serialized.data();
+        auto bp2 = (BinaryProtocol2*)header;
         bp2->version = htons(version_);
         bp2->type = 0;
         bp2->reserved = 0;
-        bp2->timestamp = htonl(packet->timestamp);
-        bp2->payload_size = htonl(packet->payload.size());
-        memcpy(bp2->payload, packet->payload.data(), packet->payload.size());
-
-        return websocket_->Send(serialized.data(), serialized.size(), true);
+        bp2->timestamp = htonl(packet.timestamp);
+        bp2->payload_size = htonl(packet.opus_size());
     } else if (version_ == 3) {
-        std::string serialized;
-        serialized.resize(sizeof(BinaryProtocol3) + packet->payload.size());
-        auto bp3 = (BinaryProtocol3*)serialized.data();
+        auto bp3 = (BinaryProtocol3*)header;
         bp3->type = 0;
         bp3->reserved = 0;
-        bp3->payload_size = htons(packet->payload.size());
-        memcpy(bp3->payload, packet->payload.data(), packet->payload.size());
+        bp3->payload_size = htons(packet.opus_size());
+    }
+}
+
+bool WebsocketProtocol::SendAudio(AudioStreamPacket& packet) {
+    auto websocket = GetWebSocket();
+    if (websocket == nullptr || !websocket->IsConnected()) {
+        return false;
+    }
 
-        return websocket_->Send(serialized.data(), serialized.size(), true);
-    } else {
-        return websocket_->Send(packet->payload.data(), packet->payload.size(), true);
+    size_t header_size = audio_header_size();
+    if (packet.header_size == header_size) {
+        // The header goes into the reserved bytes, the frame is sent straight from the payload
+        WriteAudioHeader(packet.payload.data(), packet);
+        return websocket->Send(packet.payload.data(), packet.payload.size(), true);
     }
+
+    // Encoded before the protocol version was known (e.g. the wake word)
+    send_buffer_.resize(header_size + packet.opus_size());
+    WriteAudioHeader(send_buffer_.data(), packet);
+    memcpy(send_buffer_.data() + header_size, packet.opus_data(), packet.opus_size());
+    return websocket->Send(send_buffer_.data(), send_buffer_.size(), true);
 }
 
 bool WebsocketProtocol::SendText(const std::string& text) {
-    if (websocket_ == nullptr || !websocket_->IsConnected()) {
+    auto websocket = GetWebSocket();
+    if (websocket == nullptr || !websocket->IsConnected()) {
         return false;
     }
 
-    if (!websocket_->Send(text)) {
+    if (!websocket->Send(text)) {
         ESP_LOGE(TAG, "Failed to send text: %s", text.c_str());
         SetError(Lang::Strings::SERVER_ERROR);
         return false;
@@ -72,14 +105,30 @@ bool WebsocketProtocol::SendText(const std::string& text) {
 }
 
 bool WebsocketProtocol::IsAudioChannelOpened() const {
-    return websocket_ != nullptr && websocket_->IsConnected() && !error_occurred_ && !IsTimeout();
+    auto websocket = GetWebSocket();
+    return websocket != nullptr && websocket->IsConnected() && session_opened_ && !error_occurred_ && !IsTimeout();
 }
 
 void WebsocketProtocol::CloseAudioChannel() {
-    websocket_.reset();
+    std::lock_guard<std::mutex> lock(session_mutex_);
+#if CONFIG_USE_WEBSOCKET_KEEP_WARM
+    // Keep the connection for the next session, only the session ends
+    auto websocket = GetWebSocket();
+    if (websocket != nullptr && websocket->IsConnected() && !error_occurred_) {
+        session_opened_ = false;
+        session_ready_ = false;
+        if (on_audio_channel_closed_ != nullptr) {
+            on_audio_channel_closed_();
+        }
+        return;
+    }
+#endif
+    SetWebSocket(nullptr);
+    session_opened_ = false;
+    session_ready_ = false;
 }
 
-bool WebsocketProtocol::OpenAudioChannel() {
+bool WebsocketProtocol::Connect(bool report_error) {
     Settings settings("websocket", false);
     std::string url = settings.GetString("url");
     std::string token = settings.GetString("token");
@@ -88,11 +137,17 @@ bool WebsocketProtocol::OpenAudioChannel() {
         version_ = version;
     }
 
+    session_opened_ = false;
+    session_ready_ = false;
     error_occurred_ = false;
+    connect_timings_ = {};
+    ResolveHost(url);
 
+    // The new connection is only published once it is up
+    SetWebSocket(nullptr);
     auto network = Board::GetInstance().GetNetwork();
-    websocket_ = network->CreateWebSocket(1);
-    if (websocket_ == nullptr) {
+    std::shared_ptr<WebSocket> websocket = network->CreateWebSocket(1);
+    if (websocket == nullptr) {
         ESP_LOGE(TAG, "Failed to create websocket");
         return false;
     }
@@ -102,85 +157,148 @@ bool WebsocketProtocol::OpenAudioChannel() {
         if (token.find(" ") == std::string::npos) {
             token = "Bearer " + token;
         }
-        websocket_->SetHeader("Authorization", token.c_str());
+        websocket->SetHeader("Authorization", token.c_str());
     }
-    websocket_->SetHeader("Protocol-Version", std::to_string(version_).c_str());
-    websocket_->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
-    websocket_->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
+    websocket->SetHeader("Protocol-Version", std::to_string(version_).c_str());
+    websocket->SetHeader("Device-Id", SystemInfo::GetMacAddress().c_str());
+    websocket->SetHeader("Client-Id", Board::GetInstance().GetUuid().c_str());
 
-    websocket_->OnData([this](const char* data, size_t len, bool binary) {
+    websocket->OnData([this](const char* data, size_t len, bool binary) {
         if (binary) {
-            if (on_incoming_audio_ != nullptr) {
+            // Audio of a finished session may still arrive on a kept connection
+            if (on_incoming_audio_ != nullptr && session_opened_) {
+                // The header fields are unaligned, and the receive buffer is not ours to byte-swap in place
+                auto bytes = (const uint8_t*)data;
+                auto payload = bytes;
+                size_t payload_size = len;
+                uint32_t timestamp = 0;
                 if (version_ == 2) {
-                    BinaryProtocol2* bp2 = (BinaryProtocol2*)data;
-                    bp2->version = ntohs(bp2->version);
-                    bp2->type = ntohs(bp2->type);
-                    bp2->timestamp = ntohl(bp2->timestamp);
-                    bp2->payload_size = ntohl(bp2->payload_size);
-                    auto payload = (uint8_t*)bp2->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = bp2->timestamp,
-                        .payload = std::vector<uint8_t>(payload, payload + bp2->payload_size)
-                    }));
+                    BinaryProtocol2 bp2;
+                    if (len < sizeof(bp2)) {
+                        ESP_LOGE(TAG, "Invalid audio packet size: %u", (unsigned)len);
+                        return;
+                    }
+                    memcpy(&bp2, bytes, sizeof(bp2));
+                    timestamp = ntohl(bp2.timestamp);
+                    payload = bytes + sizeof(bp2);
+                    payload_size = std::min<size_t>(ntohl(bp2.payload_size), len - sizeof(bp2));
                 } else if (version_ == 3) {
-                    BinaryProtocol3* bp3 = (BinaryProtocol3*)data;
-                    bp3->type = bp3->type;
-                    bp3->payload_size = ntohs(bp3->payload_size);
-                    auto payload = (uint8_t*)bp3->payload;
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>(payload, payload + bp3->payload_size)
-                    }));
-                } else {
-                    on_incoming_audio_(std::make_unique<AudioStreamPacket>(AudioStreamPacket{
-                        .sample_rate = server_sample_rate_,
-                        .frame_duration = server_frame_duration_,
-                        .timestamp = 0,
-                        .payload = std::vector<uint8_t>((uint8_t*)data, (uint8_t*)data + len)
-                    }));
+                    BinaryProtocol3 bp3;
+                    if (len < sizeof(bp3)) {
+                        ESP_LOGE(TAG, "Invalid audio packet size: %u", (unsigned)len);
+                        return;
+                    }
+                    memcpy(&bp3, bytes, sizeof(bp3));
+                    payload = bytes + sizeof(bp3);
+                    payload_size = std::min<size_t>(ntohs(bp3.payload_size), len - sizeof(bp3));
                 }
+
+                auto packet = AllocateAudioPacket();
+                packet->sample_rate = server_sample_rate_;
+                packet->frame_duration = server_frame_duration_;
+                packet->timestamp = timestamp;
+                packet->payload.assign(payload, payload + payload_size);
+                on_incoming_audio_(std::move(packet));
             }
         } else {
-            // Parse JSON data
-            auto root = cJSON_Parse(data);
-            auto type = cJSON_GetObjectItem(root, "type");
-            if (cJSON_IsString(type)) {
-                if (strcmp(type->valuestring, "hello") == 0) {
-                    ParseServerHello(root);
-                } else {
-                    if (on_incoming_json_ != nullptr) {
-                        on_incoming_json_(root);
+            // Between sessions on a kept connection there is no server session to listen to,
+            // a pre-warmed one may already talk (e.g. MCP initialize)
+            bool in_session = session_opened_ || session_ready_;
+            ServerMessage message;
+            bool handled = false;
+            if (message.Parse(data, len) && message.type != kServerMessageHello) {
+                handled = !in_session || (on_incoming_message_ != nullptr && on_incoming_message_(message));
+            }
+            if (!handled) {
+                // Parse JSON data
+                auto root = cJSON_Parse(data);
+                auto type = cJSON_GetObjectItem(root, "type");
+                if (cJSON_IsString(type)) {
+                    if (strcmp(type->valuestring, "hello") == 0) {
+                        ParseServerHello(root);
+                    } else if (in_session) {
+                        if (on_incoming_json_ != nullptr) {
+                            on_incoming_json_(root);
+                        }
                     }
+                } else {
+                    ESP_LOGE(TAG, "Missing message type, data: %s", data);
                 }
-            } else {
-                ESP_LOGE(TAG, "Missing message type, data: %s", data);
+                cJSON_Delete(root);
             }
-            cJSON_Delete(root);
         }
         last_incoming_time_ = std::chrono::steady_clock::now();
     });
 
-    websocket_->OnDisconnected([this]() {
+    websocket->OnDisconnected([this]() {
         ESP_LOGI(TAG, "Websocket disconnected");
+        session_ready_ = false;
+        // A kept connection closed by the server between sessions, nobody is waiting on it
+        if (!session_opened_) {
+            return;
+        }
+        session_opened_ = false;
         if (on_audio_channel_closed_ != nullptr) {
             on_audio_channel_closed_();
         }
     });
 
     ESP_LOGI(TAG, "Connecting to websocket server: %s with version: %d", url.c_str(), version_);
-    if (!websocket_->Connect(url.c_str())) {
-        ESP_LOGE(TAG, "Failed to connect to websocket server, code=%d", websocket_->GetLastError());
-        SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+    auto start_time = esp_timer_get_time();
+    if (!websocket->Connect(url.c_str())) {
+        ESP_LOGE(TAG, "Failed to connect to websocket server, code=%d", websocket->GetLastError());
+        if (report_error) {
+            SetError(Lang::Strings::SERVER_NOT_CONNECTED);
+        }
         return false;
     }
+    connect_timings_.connect_ms = (esp_timer_get_time() - start_time) / 1000;
+    SetWebSocket(websocket);
+    return true;
+}
+
+void WebsocketProtocol::ResolveHost(const std::string& url) {
+    // Resolving ahead of Connect() times the DNS lookup on its own, and leaves the answer in the lwIP cache.
+    // 4G modules resolve names inside the module.
+    if (Board::GetInstance().GetBoardType() != "wifi") {
+        return;
+    }
+    auto host_start = url.find("://");
+    host_start = host_start == std::string::npos ? 0 : host_start + 3;
+    auto host_end = url.find_first_of(":/", host_start);
+    std::string host = url.substr(host_start, host_end == std::string::npos ? std::string::npos : host_end - host_start);
+    if (host.empty()) {
+        return;
+    }
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo* result = nullptr;
+    auto start_time = esp_timer_get_time();
+    int ret = getaddrinfo(host.c_str(), nullptr, &hints, &result);
+    connect_timings_.dns_ms = (esp_timer_get_time() - start_time) / 1000;
+    if (ret != 0 || result == nullptr) {
+        ESP_LOGW(TAG, "Failed to resolve %s, ret=%d", host.c_str(), ret);
+    }
+    if (result != nullptr) {
+        freeaddrinfo(result);
+    }
+}
+
+bool WebsocketProtocol::SendHello(bool report_error) {
+    session_ready_ = false;
+    xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
+    auto start_time = esp_timer_get_time();
 
     // Send hello message to describe the client
     auto message = GetHelloMessage();
-    if (!SendText(message)) {
+    auto websocket = GetWebSocket();
+    if (websocket == nullptr || !websocket->Send(message)) {
+        ESP_LOGE(TAG, "Failed to send hello");
+        if (report_error) {
+            SetError(Lang::Strings::SERVER_ERROR);
+        }
         return false;
     }
 
@@ -188,9 +306,96 @@ bool WebsocketProtocol::OpenAudioChannel() {
     EventBits_t bits = xEventGroupWaitBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT, pdTRUE, pdFALSE, pdMS_TO_TICKS(10000));
     if (!(bits & WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT)) {
         ESP_LOGE(TAG, "Failed to receive server hello");
-        SetError(Lang::Strings::SERVER_TIMEOUT);
+        if (report_error) {
+            SetError(Lang::Strings::SERVER_TIMEOUT);
+        }
         return false;
     }
+    connect_timings_.hello_ms = (esp_timer_get_time() - start_time) / 1000;
+    session_ready_ = true;
+    return true;
+}
+
+void WebsocketProtocol::PrewarmAudioChannel() {
+#if CONFIG_USE_WEBSOCKET_KEEP_WARM
+    // Connecting takes seconds, the caller only starts it
+    if (session_opened_ || session_ready_ || esp_timer_get_time() < prewarm_not_before_us_) {
+        return;
+    }
+    if (!(xEventGroupClearBits(event_group_handle_, WEBSOCKET_PROTOCOL_PREWARM_IDLE_EVENT) & WEBSOCKET_PROTOCOL_PREWARM_IDLE_EVENT)) {
+        // Already running
+        return;
+    }
+    if (xTaskCreate([](void* arg) {
+        auto protocol = static_cast<WebsocketProtocol*>(arg);
+        protocol->PrewarmTask();
+        xEventGroupSetBits(protocol->event_group_handle_, WEBSOCKET_PROTOCOL_PREWARM_IDLE_EVENT);
+        vTaskDelete(NULL);
+    }, "ws_prewarm", 4096 * 2, this, 2, nullptr) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create the pre-warm task");
+        xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_PREWARM_IDLE_EVENT);
+    }
+#endif
+}
+
+void WebsocketProtocol::PrewarmTask() {
+    // OpenAudioChannel() called meanwhile waits here, and claims the session once it is ready
+    std::lock_guard<std::mutex> lock(session_mutex_);
+    if (session_opened_ || session_ready_) {
+        return;
+    }
+    auto start_time = esp_timer_get_time();
+    auto websocket = GetWebSocket();
+    bool reused = websocket != nullptr && websocket->IsConnected() && !error_occurred_;
+    websocket.reset();
+    bool ok = reused || Connect(false);
+    if (ok && !SendHello(false)) {
+        // The next OpenAudioChannel() starts over with a new connection; a sender still holding this one
+        // keeps it alive until it is done
+        SetWebSocket(nullptr);
+        ok = false;
+    }
+    if (!ok) {
+        // Do not hammer an unreachable server every time the device goes idle
+        prewarm_backoff_ms_ = std::min(std::max(prewarm_backoff_ms_ * 2, WEBSOCKET_PREWARM_BACKOFF_MIN_MS), WEBSOCKET_PREWARM_BACKOFF_MAX_MS);
+        prewarm_not_before_us_ = esp_timer_get_time() + prewarm_backoff_ms_ * 1000LL;
+        ESP_LOGW(TAG, "Pre-warm failed, next attempt in %d s at the earliest", prewarm_backoff_ms_ / 1000);
+        return;
+    }
+    prewarm_backoff_ms_ = 0;
+    connect_timings_.reused = reused;
+    connect_timings_.prewarmed = true;
+    ESP_LOGI(TAG, "Session pre-warmed in %ld ms (dns %d ms, connect %d ms, hello %d ms%s)",
+        (long)((esp_timer_get_time() - start_time) / 1000), connect_timings_.dns_ms, connect_timings_.connect_ms,
+        connect_timings_.hello_ms, reused ? ", connection reused" : "");
+}
+
+bool WebsocketProtocol::OpenAudioChannel() {
+    std::unique_lock<std::mutex> lock(session_mutex_);
+    auto start_time = esp_timer_get_time();
+    auto websocket = GetWebSocket();
+    bool warm = websocket != nullptr && websocket->IsConnected() && !error_occurred_;
+    websocket.reset();
+    if (!(warm && session_ready_)) {
+        if (!warm && !Connect(true)) {
+            return false;
+        }
+        if (!SendHello(true)) {
+            return false;
+        }
+        connect_timings_.reused = warm;
+        connect_timings_.prewarmed = false;
+    }
+
+    // The server hello of a pre-warmed session may be old, the timeout counts from now
+    last_incoming_time_ = std::chrono::steady_clock::now();
+    session_ready_ = false;
+    session_opened_ = true;
+    connect_timings_.open_ms = (esp_timer_get_time() - start_time) / 1000;
+    ESP_LOGI(TAG, "Audio channel opened in %d ms (dns %d ms, connect %d ms, hello %d ms%s%s)",
+        connect_timings_.open_ms, connect_timings_.dns_ms, connect_timings_.connect_ms, connect_timings_.hello_ms,
+        connect_timings_.reused ? ", connection reused" : "", connect_timings_.prewarmed ? ", pre-warmed" : "");
+    lock.unlock();
 
     if (on_audio_channel_opened_ != nullptr) {
         on_audio_channel_opened_();
@@ -215,7 +420,7 @@ std::string WebsocketProtocol::GetHelloMessage() {
     cJSON_AddStringToObject(audio_params, "format", "opus");
     cJSON_AddNumberToObject(audio_params, "sample_rate", 16000);
     cJSON_AddNumberToObject(audio_params, "channels", 1);
-    cJSON_AddNumberToObject(audio_params, "frame_duration", OPUS_FRAME_DURATION_MS);
+    AddUplinkAudioParams(audio_params);
     cJSON_AddItemToObject(root, "audio_params", audio_params);
     auto json_str = cJSON_PrintUnformatted(root);
     std::string message(json_str);
@@ -247,6 +452,7 @@ void WebsocketProtocol::ParseServerHello(const cJSON* root) {
         if (cJSON_IsNumber(frame_duration)) {
             server_frame_duration_ = frame_duration->valueint;
         }
+        ParseUplinkAudioParams(audio_params);
     }
 
     xEventGroupSetBits(event_group_handle_, WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT);
@@ -5,10 +5,29 @@
 #include "protocol.h"
 
 #include <web_socket.h>
+#include <vector>
+#include <atomic>
+#include <mutex>
 #include <freertos/FreeRTOS.h>
 #include <freertos/event_groups.h>
 
 #define WEBSOCKET_PROTOCOL_SERVER_HELLO_EVENT (1 << 0)
+// Set while no pre-warm task is running
+#define WEBSOCKET_PROTOCOL_PREWARM_IDLE_EVENT (1 << 1)
+
+// After a failed pre-warm the next one waits this long, doubled on every failure up to the maximum
+#define WEBSOCKET_PREWARM_BACKOFF_MIN_MS 5000
+#define WEBSOCKET_PREWARM_BACKOFF_MAX_MS (5 * 60 * 1000)
+
+// Timings of the last session setup in milliseconds, -1 if the step was skipped
+struct WebsocketConnectTimings {
+    int dns_ms = -1;        // Host lookup, Wi-Fi boards only
+    int connect_ms = -1;    // TCP + TLS + WebSocket upgrade, done together by WebSocket::Connect()
+    int hello_ms = -1;      // Client hello sent until the server hello arrived
+    int open_ms = -1;       // Time spent in OpenAudioChannel()
+    bool reused = false;    // The connection was kept from an earlier session
+    bool prewarmed = false; // The session was set up before OpenAudioChannel() was called
+};
 
 class WebsocketProtocol : public Protocol {
 public:
@@ -16,15 +35,40 @@ public:
     ~WebsocketProtocol();
 
     bool Start() override;
-    bool SendAudio(std::unique_ptr<AudioStreamPacket> packet) override;
+    bool SendAudio(AudioStreamPacket& packet) override;
+    size_t audio_header_size() const override;
     bool OpenAudioChannel() override;
     void CloseAudioChannel() override;
     bool IsAudioChannelOpened() const override;
+    void PrewarmAudioChannel() override;
+    const WebsocketConnectTimings& connect_timings() const { return connect_timings_; }
 
 private:
     EventGroupHandle_t event_group_handle_;
-    std::unique_ptr<WebSocket> websocket_;
+    // Replaced by the pre-warm task while other tasks send, so it is only copied out under websocket_mutex_,
+    // and a connection dropped meanwhile lives on until the last sender lets go of it
+    std::shared_ptr<WebSocket> websocket_;
+    mutable std::mutex websocket_mutex_;
     int version_ = 1;
+    // For packets without a reserved header, reused so it keeps its capacity
+    std::vector<uint8_t> send_buffer_;
+    // A session is opened by the application; a ready one got its server hello but is not opened yet
+    std::atomic<bool> session_opened_{false};
+    std::atomic<bool> session_ready_{false};
+    WebsocketConnectTimings connect_timings_;
+    // Held while a session is set up or torn down, by the pre-warm task or the application
+    std::mutex session_mutex_;
+    int prewarm_backoff_ms_ = 0;
+    int64_t prewarm_not_before_us_ = 0;
+
+    std::shared_ptr<WebSocket> GetWebSocket() const;
+    void SetWebSocket(std::shared_ptr<WebSocket> websocket);
+    void PrewarmTask();
+    bool Connect(bool report_error);
+    void ResolveHost(const std::string& url);
+    bool SendHello(bool report_error);
+
+    void WriteAudioHeader(uint8_t* header, const AudioStreamPacket& packet);
 
     void ParseServerHello(const cJSON* root);
     bool SendText(const std::string& text) override;
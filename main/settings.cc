@@ -1,108 +1,358 @@
 #include "settings.h"
 
 #include <esp_log.h>
+#include <esp_system.h>
+#include <esp_timer.h>
 #include <nvs_flash.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+#include <map>
+#include <mutex>
+#include <vector>
 
 #define TAG "Settings"
 
-Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
-    nvs_open(ns.c_str(), read_write_ ? NVS_READWRITE : NVS_READONLY, &nvs_handle_);
-}
+namespace {
+
+enum class ValueType {
+    kString,
+    kInt,
+    kBool,
+    kErased,    // Erased in RAM, still to be erased in flash
+};
+
+struct Value {
+    ValueType type = ValueType::kErased;
+    int32_t number = 0;
+    std::string text;
+    bool dirty = false;
+};
 
-Settings::~Settings() {
-    if (nvs_handle_ != 0) {
-        if (read_write_ && dirty_) {
-            ESP_ERROR_CHECK(nvs_commit(nvs_handle_));
+struct Namespace {
+    std::map<std::string, Value> values;
+    bool erase_all = false;
+    bool dirty = false;
+};
+
+/*
+ * The RAM copy of the namespaces, shared by all Settings objects
+ */
+class SettingsStore {
+public:
+    static SettingsStore& GetInstance() {
+        static SettingsStore instance;
+        return instance;
+    }
+
+    SettingsStore(const SettingsStore&) = delete;
+    SettingsStore& operator=(const SettingsStore&) = delete;
+
+    bool Get(const std::string& ns, const std::string& key, ValueType type, Value& value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto& values = Load(ns).values;
+        auto it = values.find(key);
+        if (it == values.end() || it->second.type != type) {
+            return false;
         }
-        nvs_close(nvs_handle_);
+        value = it->second;
+        return true;
     }
-}
 
-std::string Settings::GetString(const std::string& key, const std::string& default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
+    void Set(const std::string& ns, const std::string& key, ValueType type, int32_t number, const std::string& text) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& space = Load(ns);
+            auto it = space.values.find(key);
+            if (it == space.values.end()) {
+                if (type == ValueType::kErased) {
+                    return;
+                }
+                it = space.values.emplace(key, Value()).first;
+            } else if (it->second.type == type && it->second.number == number && it->second.text == text) {
+                // Unchanged values cost no flash write
+                return;
+            }
+            auto& value = it->second;
+            value.type = type;
+            value.number = number;
+            value.text = text;
+            value.dirty = true;
+            space.dirty = true;
+        }
+        Changed(ns, key);
     }
 
-    size_t length = 0;
-    if (nvs_get_str(nvs_handle_, key.c_str(), nullptr, &length) != ESP_OK) {
-        return default_value;
+    void EraseAll(const std::string& ns) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& space = Load(ns);
+            space.values.clear();
+            space.erase_all = true;
+            space.dirty = true;
+        }
+        Changed(ns, "");
     }
 
-    std::string value;
-    value.resize(length);
-    ESP_ERROR_CHECK(nvs_get_str(nvs_handle_, key.c_str(), value.data(), &length));
-    while (!value.empty() && value.back() == '\0') {
-        value.pop_back();
+    void OnChange(const std::string& ns, Settings::ChangeCallback callback) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        callbacks_.emplace_back(ns, callback);
+    }
+
+    void Flush() {
+        // Only one flush writes at a time, so the commits of a namespace stay in order
+        std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+        std::vector<std::pair<std::string, Namespace>> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& [name, space] : namespaces_) {
+                if (!space.dirty) {
+                    continue;
+                }
+                Namespace changes;
+                changes.erase_all = space.erase_all;
+                for (auto it = space.values.begin(); it != space.values.end();) {
+                    if (it->second.dirty) {
+                        changes.values.emplace(it->first, it->second);
+                        it->second.dirty = false;
+                    }
+                    if (it->second.type == ValueType::kErased) {
+                        it = space.values.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+                space.erase_all = false;
+                space.dirty = false;
+                pending.emplace_back(name, std::move(changes));
+            }
+        }
+
+        for (auto& [name, changes] : pending) {
+            Write(name, changes);
+        }
+    }
+
+    // Wake up the commit task, which waits for the changes to settle
+    void ScheduleCommit() {
+        std::call_once(commit_task_once_, [this]() {
+            xTaskCreate([](void* arg) {
+                static_cast<SettingsStore*>(arg)->CommitTask();
+            }, "settings", 4096, this, 1, &commit_task_);
+        });
+        if (commit_task_ != nullptr) {
+            xTaskNotifyGive(commit_task_);
+        }
+    }
+
+private:
+    std::mutex mutex_;
+    std::mutex flush_mutex_;
+    std::map<std::string, Namespace> namespaces_;
+    std::vector<std::pair<std::string, Settings::ChangeCallback>> callbacks_;
+    std::once_flag commit_task_once_;
+    TaskHandle_t commit_task_ = nullptr;
+
+    SettingsStore() {
+        esp_register_shutdown_handler([]() {
+            SettingsStore::GetInstance().Flush();
+        });
+    }
+
+    // Must be called with mutex_ held
+    Namespace& Load(const std::string& ns) {
+        auto it = namespaces_.find(ns);
+        if (it != namespaces_.end()) {
+            return it->second;
+        }
+
+        auto& space = namespaces_[ns];
+        nvs_handle_t handle;
+        if (nvs_open(ns.c_str(), NVS_READONLY, &handle) != ESP_OK) {
+            // The namespace does not exist yet
+            return space;
+        }
+
+        nvs_iterator_t entry = nullptr;
+        esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, ns.c_str(), NVS_TYPE_ANY, &entry);
+        while (err == ESP_OK) {
+            nvs_entry_info_t info;
+            nvs_entry_info(entry, &info);
+            Value value;
+            if (info.type == NVS_TYPE_STR) {
+                size_t length = 0;
+                if (nvs_get_str(handle, info.key, nullptr, &length) == ESP_OK) {
+                    value.type = ValueType::kString;
+                    value.text.resize(length);
+                    nvs_get_str(handle, info.key, value.text.data(), &length);
+                    while (!value.text.empty() && value.text.back() == '\0') {
+                        value.text.pop_back();
+                    }
+                    space.values.emplace(info.key, std::move(value));
+                }
+            } else if (info.type == NVS_TYPE_I32) {
+                if (nvs_get_i32(handle, info.key, &value.number) == ESP_OK) {
+                    value.type = ValueType::kInt;
+                    space.values.emplace(info.key, std::move(value));
+                }
+            } else if (info.type == NVS_TYPE_U8) {
+                uint8_t number;
+                if (nvs_get_u8(handle, info.key, &number) == ESP_OK) {
+                    value.type = ValueType::kBool;
+                    value.number = number != 0;
+                    space.values.emplace(info.key, std::move(value));
+                }
+            }
+            err = nvs_entry_next(&entry);
+        }
+        nvs_release_iterator(entry);
+        nvs_close(handle);
+        ESP_LOGD(TAG, "Loaded %u values of %s", (unsigned)space.values.size(), ns.c_str());
+        return space;
+    }
+
+    void Changed(const std::string& ns, const std::string& key) {
+        std::vector<Settings::ChangeCallback> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& [name, callback] : callbacks_) {
+                if (name == ns) {
+                    callbacks.push_back(callback);
+                }
+            }
+        }
+        for (auto& callback : callbacks) {
+            callback(key);
+        }
+        ScheduleCommit();
     }
-    return value;
+
+    void Write(const std::string& ns, const Namespace& changes) {
+        nvs_handle_t handle;
+        esp_err_t err = nvs_open(ns.c_str(), NVS_READWRITE, &handle);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to open %s for writing: %s", ns.c_str(), esp_err_to_name(err));
+            return;
+        }
+
+        if (changes.erase_all) {
+            err = nvs_erase_all(handle);
+        }
+        for (auto it = changes.values.begin(); err == ESP_OK && it != changes.values.end(); ++it) {
+            const char* key = it->first.c_str();
+            const Value& value = it->second;
+            switch (value.type) {
+            case ValueType::kString:
+                err = nvs_set_str(handle, key, value.text.c_str());
+                break;
+            case ValueType::kInt:
+                err = nvs_set_i32(handle, key, value.number);
+                break;
+            case ValueType::kBool:
+                err = nvs_set_u8(handle, key, value.number ? 1 : 0);
+                break;
+            case ValueType::kErased:
+                err = nvs_erase_key(handle, key);
+                if (err == ESP_ERR_NVS_NOT_FOUND) {
+                    err = ESP_OK;
+                }
+                break;
+            }
+        }
+        if (err == ESP_OK) {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to write %s: %s", ns.c_str(), esp_err_to_name(err));
+        } else {
+            ESP_LOGI(TAG, "Committed %u changes of %s", (unsigned)changes.values.size(), ns.c_str());
+        }
+    }
+
+    void CommitTask() {
+        while (true) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            int64_t first_change = esp_timer_get_time();
+            while (esp_timer_get_time() - first_change < SETTINGS_COMMIT_MAX_DELAY_MS * 1000LL &&
+                   ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SETTINGS_COMMIT_DELAY_MS)) > 0) {
+            }
+            Flush();
+        }
+    }
+};
+
+} // namespace
+
+Settings::Settings(const std::string& ns, bool read_write) : ns_(ns), read_write_(read_write) {
 }
 
-void Settings::SetString(const std::string& key, const std::string& value) {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_str(nvs_handle_, key.c_str(), value.c_str()));
-        dirty_ = true;
-    } else {
+bool Settings::CheckWritable() {
+    if (!read_write_) {
         ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
     }
+    return read_write_;
 }
 
-int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
-    if (nvs_handle_ == 0) {
+std::string Settings::GetString(const std::string& key, const std::string& default_value) {
+    Value value;
+    if (!SettingsStore::GetInstance().Get(ns_, key, ValueType::kString, value)) {
         return default_value;
     }
+    return value.text;
+}
+
+void Settings::SetString(const std::string& key, const std::string& value) {
+    if (CheckWritable()) {
+        SettingsStore::GetInstance().Set(ns_, key, ValueType::kString, 0, value);
+    }
+}
 
-    int32_t value;
-    if (nvs_get_i32(nvs_handle_, key.c_str(), &value) != ESP_OK) {
+int32_t Settings::GetInt(const std::string& key, int32_t default_value) {
+    Value value;
+    if (!SettingsStore::GetInstance().Get(ns_, key, ValueType::kInt, value)) {
         return default_value;
     }
-    return value;
+    return value.number;
 }
 
 void Settings::SetInt(const std::string& key, int32_t value) {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_i32(nvs_handle_, key.c_str(), value));
-        dirty_ = true;
-    } else {
-        ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+    if (CheckWritable()) {
+        SettingsStore::GetInstance().Set(ns_, key, ValueType::kInt, value, "");
     }
 }
 
 bool Settings::GetBool(const std::string& key, bool default_value) {
-    if (nvs_handle_ == 0) {
-        return default_value;
-    }
-
-    uint8_t value;
-    if (nvs_get_u8(nvs_handle_, key.c_str(), &value) != ESP_OK) {
+    Value value;
+    if (!SettingsStore::GetInstance().Get(ns_, key, ValueType::kBool, value)) {
         return default_value;
     }
-    return value != 0;
+    return value.number != 0;
 }
 
 void Settings::SetBool(const std::string& key, bool value) {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_set_u8(nvs_handle_, key.c_str(), value ? 1 : 0));
-        dirty_ = true;
-    } else {
-        ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+    if (CheckWritable()) {
+        SettingsStore::GetInstance().Set(ns_, key, ValueType::kBool, value ? 1 : 0, "");
     }
 }
 
 void Settings::EraseKey(const std::string& key) {
-    if (read_write_) {
-        auto ret = nvs_erase_key(nvs_handle_, key.c_str());
-        if (ret != ESP_ERR_NVS_NOT_FOUND) {
-            ESP_ERROR_CHECK(ret);
-        }
-    } else {
-        ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+    if (CheckWritable()) {
+        SettingsStore::GetInstance().Set(ns_, key, ValueType::kErased, 0, "");
     }
 }
 
 void Settings::EraseAll() {
-    if (read_write_) {
-        ESP_ERROR_CHECK(nvs_erase_all(nvs_handle_));
-    } else {
-        ESP_LOGW(TAG, "Namespace %s is not open for writing", ns_.c_str());
+    if (CheckWritable()) {
+        SettingsStore::GetInstance().EraseAll(ns_);
     }
 }
+
+void Settings::OnChange(const std::string& ns, ChangeCallback callback) {
+    SettingsStore::GetInstance().OnChange(ns, callback);
+}
+
+void Settings::Flush() {
+    SettingsStore::GetInstance().Flush();
+}
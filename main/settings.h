@@ -2,12 +2,30 @@
 #define SETTINGS_H
 
 #include <string>
+#include <functional>
 #include <nvs_flash.h>
 
+// A change is written to flash once no other change has been made for this long
+#define SETTINGS_COMMIT_DELAY_MS 2000
+// Upper bound of the delay while changes keep coming
+#define SETTINGS_COMMIT_MAX_DELAY_MS 10000
+
+/*
+ * Typed access to an NVS namespace.
+ *
+ * Every namespace is read from NVS once, the first time it is used, and later reads are served
+ * from RAM. Changes update RAM immediately and are written to flash in the background, coalesced
+ * into one commit per namespace after SETTINGS_COMMIT_DELAY_MS. Pending changes are also written
+ * by Flush() and before esp_restart(). Deep sleep and cutting the power skip the shutdown handlers,
+ * so those paths call Flush() first (PowerSaveTimer and SleepTimer do it before their callbacks).
+ */
 class Settings {
 public:
+    // Called after a value of the namespace changes, in the task that changed it. The key is empty after EraseAll()
+    using ChangeCallback = std::function<void(const std::string& key)>;
+
     Settings(const std::string& ns, bool read_write = false);
-    ~Settings();
+    ~Settings() = default;
 
     std::string GetString(const std::string& key, const std::string& default_value = "");
     void SetString(const std::string& key, const std::string& value);
@@ -18,11 +36,15 @@ public:
     void EraseKey(const std::string& key);
     void EraseAll();
 
+    static void OnChange(const std::string& ns, ChangeCallback callback);
+    // Write all pending changes now
+    static void Flush();
+
 private:
     std::string ns_;
-    nvs_handle_t nvs_handle_ = 0;
     bool read_write_ = false;
-    bool dirty_ = false;
+
+    bool CheckWritable();
 };
 
 #endif
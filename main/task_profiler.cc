@@ -0,0 +1,323 @@
+#include "task_profiler.h"
+
+#include <esp_log.h>
+#include <esp_heap_caps.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#define TAG "TaskProfiler"
+
+// Tasks listed in the device status
+#define TASK_PROFILER_STATUS_TASKS 3
+
+TaskProfiler::~TaskProfiler() {
+    Stop();
+    free(ring_);
+    free(status_);
+}
+
+void TaskProfiler::Start() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (timer_ != nullptr) {
+        return;
+    }
+
+    // Several KB that are only read when asked for, PSRAM is good enough
+    ring_ = (Snapshot*)heap_caps_calloc(TASK_PROFILER_RING_SIZE, sizeof(Snapshot), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (ring_ == nullptr) {
+        ring_ = (Snapshot*)calloc(TASK_PROFILER_RING_SIZE, sizeof(Snapshot));
+    }
+    status_ = (TaskStatus_t*)malloc(sizeof(TaskStatus_t) * TASK_PROFILER_MAX_TASKS);
+    if (ring_ == nullptr || status_ == nullptr) {
+        ESP_LOGE(TAG, "Failed to allocate the snapshot ring");
+        free(ring_);
+        free(status_);
+        ring_ = nullptr;
+        status_ = nullptr;
+        return;
+    }
+    newest_ = -1;
+    count_ = 0;
+
+    esp_timer_create_args_t timer_args = {
+        .callback = [](void* arg) {
+            static_cast<TaskProfiler*>(arg)->Sample();
+        },
+        .arg = this,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "task_profiler",
+        .skip_unhandled_events = true,
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(timer_, CONFIG_TASK_PROFILER_INTERVAL_SECONDS * 1000000LL));
+    ESP_LOGI(TAG, "Sampling every %d s", CONFIG_TASK_PROFILER_INTERVAL_SECONDS);
+}
+
+void TaskProfiler::Stop() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (timer_ == nullptr) {
+        return;
+    }
+    esp_timer_stop(timer_);
+    esp_timer_delete(timer_);
+    timer_ = nullptr;
+}
+
+void TaskProfiler::Sample() {
+    // Walking the tasks suspends the scheduler, so it is done once per interval and not per request
+    configRUN_TIME_COUNTER_TYPE total_run_time = 0;
+    UBaseType_t task_count = uxTaskGetSystemState(status_, TASK_PROFILER_MAX_TASKS, &total_run_time);
+    if (task_count == 0) {
+        // More tasks than TASK_PROFILER_MAX_TASKS
+        ESP_LOGW(TAG, "Too many tasks to sample: %u", (unsigned)uxTaskGetNumberOfTasks());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    newest_ = (newest_ + 1) % TASK_PROFILER_RING_SIZE;
+    count_ = std::min(count_ + 1, TASK_PROFILER_RING_SIZE);
+    Snapshot& snapshot = ring_[newest_];
+    snapshot.time_us = esp_timer_get_time();
+    snapshot.total_run_time = (uint32_t)total_run_time;
+    snapshot.free_internal = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    snapshot.free_spiram = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
+    snapshot.free_dma = heap_caps_get_free_size(MALLOC_CAP_DMA);
+    snapshot.largest_internal = heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL);
+    snapshot.task_count = task_count;
+    for (int i = 0; i < (int)task_count; i++) {
+        auto& status = status_[i];
+        snapshot.tasks[i].handle = status.xHandle;
+        snapshot.tasks[i].run_time = (uint32_t)status.ulRunTimeCounter;
+        // The stack is counted in bytes on ESP-IDF
+        snapshot.tasks[i].stack_free = status.usStackHighWaterMark;
+
+        auto& info = infos_[i];
+        strncpy(info.name, status.pcTaskName, sizeof(info.name) - 1);
+        info.name[sizeof(info.name) - 1] = '\0';
+        BaseType_t core = xTaskGetCoreID(status.xHandle);
+        info.core = core == tskNO_AFFINITY ? -1 : (int)core;
+        info.priority = status.uxCurrentPriority;
+    }
+}
+
+// Age 0 is the newest snapshot
+const TaskProfiler::Snapshot& TaskProfiler::GetSnapshot(int age) const {
+    return ring_[(newest_ - age + TASK_PROFILER_RING_SIZE) % TASK_PROFILER_RING_SIZE];
+}
+
+int TaskProfiler::GetCpu(const Snapshot& from, const Snapshot& to, TaskHandle_t handle) const {
+    // The counters count microseconds and wrap, only differences are used
+    uint32_t elapsed = to.total_run_time - from.total_run_time;
+    if (elapsed == 0) {
+        return -1;
+    }
+    const TaskSample* start = nullptr;
+    const TaskSample* end = nullptr;
+    for (int i = 0; i < from.task_count && start == nullptr; i++) {
+        if (from.tasks[i].handle == handle) {
+            start = &from.tasks[i];
+        }
+    }
+    for (int i = 0; i < to.task_count && end == nullptr; i++) {
+        if (to.tasks[i].handle == handle) {
+            end = &to.tasks[i];
+        }
+    }
+    if (start == nullptr || end == nullptr) {
+        return -1;
+    }
+    uint32_t run_time = end->run_time - start->run_time;
+    if (run_time > elapsed) {
+        // The handle was reused by a new task
+        return -1;
+    }
+    return (int)((uint64_t)run_time * 100 / elapsed);
+}
+
+// The idle tasks are the spare time of the cores, not a load
+bool TaskProfiler::IsIdleTask(TaskHandle_t handle) const {
+    for (int core = 0; core < CONFIG_FREERTOS_NUMBER_OF_CORES; core++) {
+        if (xTaskGetIdleTaskHandleForCore(core) == handle) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int TaskProfiler::GetCoreLoad(int core, int& avg, int& peak) const {
+    TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(core);
+    const Snapshot& newest = GetSnapshot(0);
+    int idle_avg = GetCpu(GetSnapshot(count_ - 1), newest, idle);
+    avg = idle_avg < 0 ? -1 : 100 - idle_avg;
+    peak = -1;
+    for (int age = 0; age < count_ - 1; age++) {
+        int idle_cpu = GetCpu(GetSnapshot(age + 1), GetSnapshot(age), idle);
+        if (idle_cpu >= 0) {
+            peak = std::max(peak, 100 - idle_cpu);
+        }
+    }
+    int idle_cpu = GetCpu(GetSnapshot(1), newest, idle);
+    return idle_cpu < 0 ? -1 : 100 - idle_cpu;
+}
+
+// Fills usages_ with the tasks of the newest snapshot sorted by their average CPU usage, must be called with mutex_ held
+int TaskProfiler::UpdateTaskUsage() {
+    const Snapshot& newest = GetSnapshot(0);
+    for (int i = 0; i < newest.task_count; i++) {
+        TaskHandle_t handle = newest.tasks[i].handle;
+        auto& usage = usages_[i];
+        usage.index = i;
+        usage.cpu = GetCpu(GetSnapshot(1), newest, handle);
+        usage.peak = usage.cpu;
+        usage.stack_free = newest.tasks[i].stack_free;
+        // The average starts with the oldest snapshot that has the task
+        usage.avg = -1;
+        for (int age = count_ - 1; age > 0 && usage.avg < 0; age--) {
+            usage.avg = GetCpu(GetSnapshot(age), newest, handle);
+        }
+        for (int age = 1; age < count_; age++) {
+            const Snapshot& snapshot = GetSnapshot(age);
+            if (age + 1 < count_) {
+                usage.peak = std::max(usage.peak, GetCpu(GetSnapshot(age + 1), snapshot, handle));
+            }
+            for (int j = 0; j < snapshot.task_count; j++) {
+                if (snapshot.tasks[j].handle == handle) {
+                    usage.stack_free = std::min(usage.stack_free, snapshot.tasks[j].stack_free);
+                    break;
+                }
+            }
+        }
+    }
+    std::sort(usages_, usages_ + newest.task_count, [](const TaskUsage& a, const TaskUsage& b) {
+        return a.avg > b.avg;
+    });
+    return newest.task_count;
+}
+
+std::string TaskProfiler::GetProfileJson() {
+    /*
+        {
+            "interval_s": 5,
+            "window_s": 55,
+            "cores": [{"load": 35, "avg": 20, "peak": 80}, {"load": 60, "avg": 55, "peak": 97}],
+            "heap": {
+                "internal": {"free": 51234, "min": 40123, "largest": 30720},
+                "spiram": {"free": 4012345, "min": 3900000},
+                "dma": {"free": 41234, "min": 35000}
+            },
+            "tasks": [
+                {"name": "opus_codec", "core": 1, "priority": 2, "cpu": 45, "avg": 30, "peak": 70, "stack_free": 1840},
+                ...
+            ]
+        }
+        CPU usage is in percent of one core, the core of a task is -1 if it may run on any core.
+        "cpu" covers the last interval, "avg" and "peak" the whole window.
+        "stack_free" and the heap "min" are the lowest values seen in the window, in bytes.
+    */
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (count_ < 2) {
+        return "{\"error\":\"Not enough samples yet\"}";
+    }
+
+    auto root = cJSON_CreateObject();
+    const Snapshot& newest = GetSnapshot(0);
+    const Snapshot& oldest = GetSnapshot(count_ - 1);
+    cJSON_AddNumberToObject(root, "interval_s", CONFIG_TASK_PROFILER_INTERVAL_SECONDS);
+    cJSON_AddNumberToObject(root, "window_s", (newest.time_us - oldest.time_us) / 1000000);
+
+    auto cores = cJSON_CreateArray();
+    for (int core = 0; core < CONFIG_FREERTOS_NUMBER_OF_CORES; core++) {
+        int avg, peak;
+        int load = GetCoreLoad(core, avg, peak);
+        auto item = cJSON_CreateObject();
+        cJSON_AddNumberToObject(item, "load", load);
+        cJSON_AddNumberToObject(item, "avg", avg);
+        cJSON_AddNumberToObject(item, "peak", peak);
+        cJSON_AddItemToArray(cores, item);
+    }
+    cJSON_AddItemToObject(root, "cores", cores);
+
+    size_t min_internal = newest.free_internal, min_spiram = newest.free_spiram, min_dma = newest.free_dma;
+    for (int age = 1; age < count_; age++) {
+        const Snapshot& snapshot = GetSnapshot(age);
+        min_internal = std::min(min_internal, snapshot.free_internal);
+        min_spiram = std::min(min_spiram, snapshot.free_spiram);
+        min_dma = std::min(min_dma, snapshot.free_dma);
+    }
+    auto heap = cJSON_CreateObject();
+    auto internal = cJSON_CreateObject();
+    cJSON_AddNumberToObject(internal, "free", newest.free_internal);
+    cJSON_AddNumberToObject(internal, "min", min_internal);
+    cJSON_AddNumberToObject(internal, "largest", newest.largest_internal);
+    cJSON_AddItemToObject(heap, "internal", internal);
+    if (newest.free_spiram > 0) {
+        auto spiram = cJSON_CreateObject();
+        cJSON_AddNumberToObject(spiram, "free", newest.free_spiram);
+        cJSON_AddNumberToObject(spiram, "min", min_spiram);
+        cJSON_AddItemToObject(heap, "spiram", spiram);
+    }
+    auto dma = cJSON_CreateObject();
+    cJSON_AddNumberToObject(dma, "free", newest.free_dma);
+    cJSON_AddNumberToObject(dma, "min", min_dma);
+    cJSON_AddItemToObject(heap, "dma", dma);
+    cJSON_AddItemToObject(root, "heap", heap);
+
+    int task_count = UpdateTaskUsage();
+    auto tasks = cJSON_CreateArray();
+    for (int i = 0; i < task_count; i++) {
+        auto& usage = usages_[i];
+        auto& info = infos_[usage.index];
+        auto task = cJSON_CreateObject();
+        cJSON_AddStringToObject(task, "name", info.name);
+        cJSON_AddNumberToObject(task, "core", info.core);
+        cJSON_AddNumberToObject(task, "priority", info.priority);
+        cJSON_AddNumberToObject(task, "cpu", usage.cpu);
+        cJSON_AddNumberToObject(task, "avg", usage.avg);
+        cJSON_AddNumberToObject(task, "peak", usage.peak);
+        cJSON_AddNumberToObject(task, "stack_free", usage.stack_free);
+        cJSON_AddItemToArray(tasks, task);
+    }
+    cJSON_AddItemToObject(root, "tasks", tasks);
+
+    auto json_str = cJSON_PrintUnformatted(root);
+    std::string json(json_str);
+    cJSON_free(json_str);
+    cJSON_Delete(root);
+    return json;
+}
+
+cJSON* TaskProfiler::GetStatusJson() {
+    /*
+        {"cpu": [20, 55], "busiest_tasks": {"opus_codec": 30, "audio_input": 12, "LVGL": 8}, "free_internal_heap": 51234}
+    */
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto system = cJSON_CreateObject();
+    if (count_ < 2) {
+        return system;
+    }
+
+    auto cpu = cJSON_CreateArray();
+    for (int core = 0; core < CONFIG_FREERTOS_NUMBER_OF_CORES; core++) {
+        int avg, peak;
+        GetCoreLoad(core, avg, peak);
+        cJSON_AddItemToArray(cpu, cJSON_CreateNumber(avg));
+    }
+    cJSON_AddItemToObject(system, "cpu", cpu);
+
+    int task_count = UpdateTaskUsage();
+    auto busiest = cJSON_CreateObject();
+    const Snapshot& newest = GetSnapshot(0);
+    for (int i = 0, listed = 0; i < task_count && listed < TASK_PROFILER_STATUS_TASKS; i++) {
+        auto& usage = usages_[i];
+        if (usage.avg <= 0 || IsIdleTask(newest.tasks[usage.index].handle)) {
+            continue;
+        }
+        cJSON_AddNumberToObject(busiest, infos_[usage.index].name, usage.avg);
+        listed++;
+    }
+    cJSON_AddItemToObject(system, "busiest_tasks", busiest);
+    cJSON_AddNumberToObject(system, "free_internal_heap", newest.free_internal);
+    return system;
+}
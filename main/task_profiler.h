@@ -0,0 +1,96 @@
+#ifndef _TASK_PROFILER_H_
+#define _TASK_PROFILER_H_
+
+#include <mutex>
+#include <string>
+
+#include <cJSON.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Snapshots kept in the ring, the statistics cover (TASK_PROFILER_RING_SIZE - 1) intervals
+#define TASK_PROFILER_RING_SIZE 12
+// Tasks beyond this are left out of a snapshot
+#define TASK_PROFILER_MAX_TASKS 40
+
+/*
+ * Background sampling of the FreeRTOS run-time counters, stack high water marks and heap.
+ *
+ * An esp_timer takes a snapshot every CONFIG_TASK_PROFILER_INTERVAL_SECONDS into a ring, so reading
+ * the statistics never blocks. CPU usage is in percent of one core: a task pinned to a core is
+ * compared with that core, a task without affinity may have run on any core. The load of a core is
+ * what its idle task did not use.
+ */
+class TaskProfiler {
+public:
+    static TaskProfiler& GetInstance() {
+        static TaskProfiler instance;
+        return instance;
+    }
+
+    TaskProfiler(const TaskProfiler&) = delete;
+    TaskProfiler& operator=(const TaskProfiler&) = delete;
+
+    void Start();
+    void Stop();
+
+    // Every task with its current, average and peak CPU usage over the ring, plus heap and core load
+    std::string GetProfileJson();
+    // Core load, the busiest tasks and free internal heap, for the device status
+    cJSON* GetStatusJson();
+
+private:
+    struct TaskSample {
+        TaskHandle_t handle;
+        uint32_t run_time;
+        uint32_t stack_free;
+    };
+
+    struct Snapshot {
+        int64_t time_us;
+        uint32_t total_run_time;
+        size_t free_internal;
+        size_t free_spiram;
+        size_t free_dma;
+        size_t largest_internal;
+        int task_count;
+        TaskSample tasks[TASK_PROFILER_MAX_TASKS];
+    };
+
+    struct TaskInfo {
+        char name[configMAX_TASK_NAME_LEN];
+        int core;
+        int priority;
+    };
+
+    struct TaskUsage {
+        int index;      // In the newest snapshot
+        int cpu;
+        int avg;
+        int peak;
+        uint32_t stack_free;
+    };
+
+    std::mutex mutex_;
+    esp_timer_handle_t timer_ = nullptr;
+    Snapshot* ring_ = nullptr;
+    int newest_ = -1;
+    int count_ = 0;
+    // Names of the tasks in the newest snapshot, in the same order
+    TaskInfo infos_[TASK_PROFILER_MAX_TASKS];
+    TaskUsage usages_[TASK_PROFILER_MAX_TASKS];
+    TaskStatus_t* status_ = nullptr;
+
+    TaskProfiler() = default;
+    ~TaskProfiler();
+
+    void Sample();
+    const Snapshot& GetSnapshot(int age) const;
+    int GetCpu(const Snapshot& from, const Snapshot& to, TaskHandle_t handle) const;
+    bool IsIdleTask(TaskHandle_t handle) const;
+    int GetCoreLoad(int core, int& avg, int& peak) const;
+    int UpdateTaskUsage();
+};
+
+#endif // _TASK_PROFILER_H_
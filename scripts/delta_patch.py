@@ -0,0 +1,342 @@
+#!/usr/bin/env python3
+"""Create and apply delta patches for firmware and assets partitions.
+
+The device downloads a patch instead of the full image and rebuilds the new image
+from the one it is running (main/delta_patch.cc). Usage:
+
+    # Firmware: patch from the released xiaozhi.bin of the running version
+    python scripts/delta_patch.py create v1.8.0/xiaozhi.bin build/xiaozhi.bin xiaozhi-1.8.0-1.8.1.patch
+
+    # Assets: the partition is patched in place, sector by sector
+    python scripts/delta_patch.py create --in-place old/assets.bin build/generated_assets.bin assets.patch
+
+    # Rebuild the target from a patch, the same way the device does
+    python scripts/delta_patch.py apply old/assets.bin assets.patch assets.bin
+
+Every patch is applied again after it is created and compared with the target, so a
+patch that is written to disk is known to be good.
+
+The OTA server offers a firmware patch next to the full image, and the device only uses
+it when "from" is the version it is running. If the patch fails, the full image is used:
+
+    "firmware": {
+        "version": "1.8.1",
+        "url": "https://example.com/xiaozhi-1.8.1.bin",
+        "patch": {"from": "1.8.0", "url": "https://example.com/xiaozhi-1.8.0-1.8.1.patch"}
+    }
+
+An assets patch is used like a full assets file, with self.assets.set_download_url.
+
+Patch format, all integers little endian:
+
+    header (80 bytes)
+        char     magic[4]          "XZDP"
+        uint16   version           1
+        uint16   flags             bit 0: safe to apply in place
+        uint32   source_size
+        uint32   target_size
+        uint8    source_sha256[32]
+        uint8    target_sha256[32]
+    operations, until target_size bytes are produced
+        0x01 DIFF    varint source_offset, varint length, then records until
+                     length bytes are produced:
+                         varint same, varint count, uint8 delta[count]
+                     "same" bytes are copied from the source, then "count" bytes
+                     are source bytes plus delta (modulo 256)
+        0x02 INSERT  varint length, uint8 data[length]
+
+An in-place patch never reads a source sector after the device has rewritten it.
+The device buffers one sector of the target and only erases and writes it when it
+differs from the flash, so the generator knows which sectors get rewritten.
+"""
+
+import sys
+import struct
+import hashlib
+import argparse
+from pathlib import Path
+
+MAGIC = b"XZDP"
+VERSION = 1
+FLAG_IN_PLACE = 0x0001
+HEADER_FORMAT = "<4sHHII32s32s"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+
+OP_DIFF = 0x01
+OP_INSERT = 0x02
+
+SECTOR_SIZE = 4096
+BLOCK_SIZE = 32             # Length of the blocks indexed in the source
+INDEX_STRIDE = 16           # Source blocks are indexed at this stride
+MAX_CANDIDATES = 8          # Source offsets kept per block
+MIN_MATCH = 48              # Shorter exact matches are cheaper as INSERT data
+EXTEND_GIVE_UP = 64         # Stop the approximate extension this far below the best score
+
+
+def write_varint(out: bytearray, value: int) -> None:
+    while value >= 0x80:
+        out.append((value & 0x7F) | 0x80)
+        value >>= 7
+    out.append(value)
+
+
+def read_varint(data: bytes, pos: int) -> tuple[int, int]:
+    value = 0
+    shift = 0
+    while True:
+        if pos >= len(data) or shift > 28:
+            raise ValueError("truncated or malformed varint")
+        byte = data[pos]
+        pos += 1
+        value |= (byte & 0x7F) << shift
+        shift += 7
+        if not byte & 0x80:
+            return value, pos
+
+################################################################################
+# Patch creation
+################################################################################
+
+class _InPlaceRules:
+    """Which source ranges an in-place patch may still read when an operation ends."""
+
+    def __init__(self, source: bytes, target: bytes):
+        sectors = (len(target) + SECTOR_SIZE - 1) // SECTOR_SIZE
+        self.rewritten = []
+        for k in range(sectors):
+            sector = target[k * SECTOR_SIZE:(k + 1) * SECTOR_SIZE]
+            self.rewritten.append(sector != source[k * SECTOR_SIZE:k * SECTOR_SIZE + len(sector)])
+
+    def readable(self, source_offset: int, target_offset: int, length: int) -> bool:
+        # The device writes sector k once the target passes (k + 1) * SECTOR_SIZE, each source byte
+        # has to be read before that if the sector changes
+        for k in range(source_offset // SECTOR_SIZE, (source_offset + length - 1) // SECTOR_SIZE + 1):
+            if k >= len(self.rewritten) or not self.rewritten[k]:
+                continue
+            last = min(source_offset + length, (k + 1) * SECTOR_SIZE) - 1
+            if target_offset + last - source_offset >= (k + 1) * SECTOR_SIZE:
+                return False
+        return True
+
+
+def _build_index(source: bytes) -> dict[bytes, list[int]]:
+    index: dict[bytes, list[int]] = {}
+    for offset in range(0, len(source) - BLOCK_SIZE + 1, INDEX_STRIDE):
+        offsets = index.setdefault(source[offset:offset + BLOCK_SIZE], [])
+        if len(offsets) < MAX_CANDIDATES:
+            offsets.append(offset)
+    return index
+
+
+def _find_match(source: bytes, target: bytes, index: dict[bytes, list[int]], position: int, floor: int):
+    """Longest exact match of target around position, extended backwards down to floor"""
+    candidates = index.get(target[position:position + BLOCK_SIZE])
+    if not candidates:
+        return None
+    best = None
+    for source_offset in candidates:
+        end = BLOCK_SIZE
+        while position + end < len(target) and source_offset + end < len(source) and \
+                target[position + end] == source[source_offset + end]:
+            end += 1
+        start = 0
+        while position - start > floor and source_offset - start > 0 and \
+                target[position - start - 1] == source[source_offset - start - 1]:
+            start += 1
+        if best is None or start + end > best[2]:
+            best = (position - start, source_offset - start, start + end)
+    return best
+
+
+def _extend(source: bytes, target: bytes, target_offset: int, source_offset: int, length: int) -> int:
+    """Extend an exact match over following bytes that mostly still match, such as code with moved addresses"""
+    best_length = length
+    best_score = 0
+    score = 0
+    i = length
+    while target_offset + i < len(target) and source_offset + i < len(source):
+        score += 1 if target[target_offset + i] == source[source_offset + i] else -1
+        i += 1
+        if score > best_score:
+            best_score = score
+            best_length = i
+        elif score < best_score - EXTEND_GIVE_UP:
+            break
+    return best_length
+
+
+def _encode_diff(out: bytearray, source: bytes, target: bytes, target_offset: int, source_offset: int, length: int) -> None:
+    out.append(OP_DIFF)
+    write_varint(out, source_offset)
+    write_varint(out, length)
+    i = 0
+    while i < length:
+        same = 0
+        while i + same < length and target[target_offset + i + same] == source[source_offset + i + same]:
+            same += 1
+        i += same
+        delta = bytearray()
+        # Short equal runs inside a changed area are cheaper as zero deltas than as a new record
+        while i < length:
+            if target[target_offset + i] == source[source_offset + i]:
+                run = 0
+                while i + run < length and run < 4 and target[target_offset + i + run] == source[source_offset + i + run]:
+                    run += 1
+                if run >= 4 or i + run >= length:
+                    break
+                delta.extend(b"\x00" * run)
+                i += run
+                continue
+            delta.append((target[target_offset + i] - source[source_offset + i]) & 0xFF)
+            i += 1
+        write_varint(out, same)
+        write_varint(out, len(delta))
+        out.extend(delta)
+
+
+def _encode_insert(out: bytearray, data: bytes) -> None:
+    if data:
+        out.append(OP_INSERT)
+        write_varint(out, len(data))
+        out.extend(data)
+
+
+def create_patch(source: bytes, target: bytes, in_place: bool = False) -> bytes:
+    index = _build_index(source)
+    rules = _InPlaceRules(source, target) if in_place else None
+
+    out = bytearray(struct.pack(HEADER_FORMAT, MAGIC, VERSION, FLAG_IN_PLACE if in_place else 0,
+                                len(source), len(target), hashlib.sha256(source).digest(),
+                                hashlib.sha256(target).digest()))
+    literal_start = 0
+    position = 0
+    while position + BLOCK_SIZE <= len(target):
+        match = _find_match(source, target, index, position, literal_start)
+        if match is None or match[2] < MIN_MATCH:
+            position += 1
+            continue
+        target_offset, source_offset, length = match
+        length = _extend(source, target, target_offset, source_offset, length)
+        if rules and not rules.readable(source_offset, target_offset, length):
+            # The source has already been rewritten, a later part of the same match would not fare better
+            position = target_offset + length
+            continue
+        _encode_insert(out, target[literal_start:target_offset])
+        _encode_diff(out, source, target, target_offset, source_offset, length)
+        position = literal_start = target_offset + length
+    _encode_insert(out, target[literal_start:])
+    return bytes(out)
+
+################################################################################
+# Patch application, the same steps as the device
+################################################################################
+
+def apply_patch(source: bytes, patch: bytes, in_place: bool = False) -> bytes:
+    """Rebuild the target. With in_place, source sectors are overwritten as the device does."""
+    if len(patch) < HEADER_SIZE:
+        raise ValueError("patch is too short")
+    magic, version, flags, source_size, target_size, source_sha256, target_sha256 = \
+        struct.unpack_from(HEADER_FORMAT, patch)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("not a delta patch")
+    if in_place and not flags & FLAG_IN_PLACE:
+        raise ValueError("patch is not safe to apply in place")
+    if len(source) < source_size or hashlib.sha256(source[:source_size]).digest() != source_sha256:
+        raise ValueError("source does not match the patch")
+
+    flash = bytearray(source[:source_size])
+    flash.extend(b"\xff" * max(0, target_size - source_size))
+    target = bytearray()
+
+    def emit(data: bytes) -> None:
+        if len(target) + len(data) > target_size:
+            raise ValueError("patch produces more than target_size bytes")
+        written = len(target) // SECTOR_SIZE
+        target.extend(data)
+        if in_place:
+            # Sectors completed by this write replace the flash contents
+            for k in range(written, len(target) // SECTOR_SIZE):
+                flash[k * SECTOR_SIZE:(k + 1) * SECTOR_SIZE] = target[k * SECTOR_SIZE:(k + 1) * SECTOR_SIZE]
+
+    def read(offset: int, length: int) -> bytes:
+        if offset + length > source_size:
+            raise ValueError("operation reads past the source")
+        return bytes(flash[offset:offset + length] if in_place else source[offset:offset + length])
+
+    pos = HEADER_SIZE
+    while len(target) < target_size:
+        if pos >= len(patch):
+            raise ValueError("patch is truncated")
+        op = patch[pos]
+        pos += 1
+        if op == OP_DIFF:
+            source_offset, pos = read_varint(patch, pos)
+            length, pos = read_varint(patch, pos)
+            done = 0
+            while done < length:
+                same, pos = read_varint(patch, pos)
+                count, pos = read_varint(patch, pos)
+                if done + same + count > length or pos + count > len(patch):
+                    raise ValueError("diff record exceeds the operation")
+                emit(read(source_offset + done, same))
+                done += same
+                base = read(source_offset + done, count)
+                emit(bytes((b + d) & 0xFF for b, d in zip(base, patch[pos:pos + count])))
+                pos += count
+                done += count
+        elif op == OP_INSERT:
+            length, pos = read_varint(patch, pos)
+            if pos + length > len(patch):
+                raise ValueError("patch is truncated")
+            emit(patch[pos:pos + length])
+            pos += length
+        else:
+            raise ValueError(f"unknown operation 0x{op:02x} at offset {pos - 1}")
+    if pos != len(patch):
+        raise ValueError("trailing data after the last operation")
+    if hashlib.sha256(target).digest() != target_sha256:
+        raise ValueError("target hash mismatch")
+    return bytes(target)
+
+################################################################################
+# Command line
+################################################################################
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description="Delta patches for firmware and assets partitions")
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    create = sub.add_parser("create", help="create a patch from source to target")
+    create.add_argument("source", type=Path, help="image the device is running")
+    create.add_argument("target", type=Path, help="new image")
+    create.add_argument("patch", type=Path, help="output patch file")
+    create.add_argument("--in-place", action="store_true", help="the patch is applied over the source (assets partition)")
+
+    apply = sub.add_parser("apply", help="rebuild the target from a source and a patch")
+    apply.add_argument("source", type=Path)
+    apply.add_argument("patch", type=Path)
+    apply.add_argument("output", type=Path)
+    apply.add_argument("--in-place", action="store_true", help="simulate the in-place update of the device")
+
+    args = parser.parse_args()
+    source = args.source.read_bytes()
+    try:
+        if args.command == "create":
+            target = args.target.read_bytes()
+            patch = create_patch(source, target, args.in_place)
+            # Never ship a patch that does not rebuild the target
+            if apply_patch(source, patch, args.in_place) != target:
+                raise ValueError("patch verification failed")
+            args.patch.write_bytes(patch)
+            print(f"{args.patch}: {len(patch)} bytes, {len(patch) * 100 / max(1, len(target)):.1f}% of {args.target}")
+            print(f"target sha256: {hashlib.sha256(target).hexdigest()}")
+        else:
+            args.output.write_bytes(apply_patch(source, args.patch.read_bytes(), args.in_place))
+            print(f"{args.output} rebuilt and verified")
+    except ValueError as e:
+        print(f"[ERROR] {e}", file=sys.stderr)
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -56,9 +56,10 @@ def compute_checksum(data):
     checksum = sum(data) & 0xFFFF
     return checksum
 
-def sort_key(filename):
-    basename, extension = os.path.splitext(filename)
-    return extension, basename
+def table_name(filename, max_name_len):
+    """Name as stored in the asset table, zero padded to max_name_len bytes"""
+    fixed_name = filename.ljust(int(max_name_len), '\0')[:int(max_name_len)]
+    return fixed_name.encode('utf-8')
 
 def download_v8_script(convert_path):
     """
@@ -403,7 +404,8 @@ def pack_assets(config: PackModelsConfig):
     file_info_list = []
     skip_files = ['config.json', 'lvgl_image_converter']
 
-    file_list = sorted(os.listdir(target_path), key=sort_key)
+    # The table is sorted by the stored name bytes, so the device can binary search it in place
+    file_list = sorted(os.listdir(target_path), key=lambda filename: table_name(filename, max_name_len))
     for filename in file_list:
         if filename in skip_files:
             continue
@@ -444,8 +446,7 @@ def pack_assets(config: PackModelsConfig):
     for file_name, offset, file_size, width, height in file_info_list:
         if len(file_name) > int(max_name_len):
             print(f'\033[1;33mWarn:\033[0m "{file_name}" exceeds {max_name_len} bytes and will be truncated.')
-        fixed_name = file_name.ljust(int(max_name_len), '\0')[:int(max_name_len)]
-        mmap_table.extend(fixed_name.encode('utf-8'))
+        mmap_table.extend(table_name(file_name, max_name_len))
         mmap_table.extend(file_size.to_bytes(4, byteorder='little'))
         mmap_table.extend(offset.to_bytes(4, byteorder='little'))
         mmap_table.extend(width.to_bytes(2, byteorder='little'))
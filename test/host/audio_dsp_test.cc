@@ -0,0 +1,158 @@
+// Compares the audio_dsp kernels with the per-sample loops they replaced in the codecs, bit for bit
+#include "audio_dsp.h"
+#include "host_test.h"
+
+#include <climits>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+
+std::mt19937 random_engine(1);
+
+int16_t ReferenceClamp(int32_t value) {
+    return (value > INT16_MAX) ? INT16_MAX : (value < -INT16_MAX) ? -INT16_MAX : (int16_t)value;
+}
+
+std::vector<int16_t> RandomSamples(size_t size) {
+    std::vector<int16_t> samples(size);
+    for (auto& sample : samples) {
+        sample = (int16_t)random_engine();
+    }
+    // Full scale at both ends, and in the unrolled part of the loops
+    if (size > 0) {
+        samples[0] = INT16_MIN;
+        samples[size - 1] = INT16_MAX;
+        samples[size / 2] = INT16_MIN + 1;
+    }
+    return samples;
+}
+
+// Every length up to a few unrolled iterations plus the tail, then a frame sized one
+std::vector<size_t> Lengths() {
+    std::vector<size_t> lengths;
+    for (size_t i = 0; i <= 17; i++) {
+        lengths.push_back(i);
+    }
+    lengths.push_back(960);
+    lengths.push_back(1023);
+    return lengths;
+}
+
+void TestVolumeFactor() {
+    for (int volume = 0; volume <= 100; volume++) {
+        CHECK(AudioDspVolumeFactor(volume) == (int32_t)(pow(double(volume) / 100.0, 2) * 65536));
+    }
+    CHECK(AudioDspVolumeFactor(100) == 65536);
+}
+
+void TestScaleToInt32() {
+    // The volume range, and factors outside it that have to saturate
+    std::vector<int32_t> factors;
+    for (int volume = 0; volume <= 100; volume += 7) {
+        factors.push_back(AudioDspVolumeFactor(volume));
+    }
+    factors.insert(factors.end(), {65536, 65537, 70000, 1 << 20, INT32_MAX, -1, -65536, INT32_MIN});
+
+    for (size_t length : Lengths()) {
+        auto src = RandomSamples(length);
+        for (int32_t factor : factors) {
+            std::vector<int32_t> expected(length), actual(length);
+            for (size_t i = 0; i < length; i++) {
+                int64_t value = int64_t(src[i]) * factor;
+                expected[i] = (value > INT32_MAX) ? INT32_MAX : (value < INT32_MIN) ? INT32_MIN : (int32_t)value;
+            }
+            AudioDspScaleToInt32(src.data(), actual.data(), length, factor);
+            CHECK(actual == expected);
+        }
+    }
+}
+
+void TestInt32ToInt16() {
+    for (size_t length : Lengths()) {
+        std::vector<int32_t> src(length);
+        for (auto& sample : src) {
+            sample = (int32_t)random_engine();
+        }
+        if (length > 1) {
+            src[0] = INT32_MIN;
+            src[1] = INT32_MAX;
+        }
+        for (int shift : {0, 8, 12, 15, 16, 31}) {
+            std::vector<int16_t> expected(length), actual(length);
+            for (size_t i = 0; i < length; i++) {
+                expected[i] = ReferenceClamp(src[i] >> shift);
+            }
+            AudioDspInt32ToInt16(src.data(), actual.data(), length, shift);
+            CHECK(actual == expected);
+        }
+    }
+}
+
+void TestApplyGain() {
+    for (size_t length : Lengths()) {
+        auto src = RandomSamples(length);
+        for (int32_t gain : {0, 1, 2, 4, 7, 40, -1, -3}) {
+            auto expected = src;
+            for (auto& sample : expected) {
+                sample = ReferenceClamp(sample * gain);
+            }
+            auto actual = src;
+            AudioDspApplyGain(actual.data(), length, gain);
+            CHECK(actual == expected);
+        }
+    }
+}
+
+void TestExtractChannel() {
+    for (size_t length : Lengths()) {
+        auto src = RandomSamples(length);
+        for (int channels = 1; channels <= 4; channels++) {
+            size_t frames = length / channels;
+            for (int channel = 0; channel < channels; channel++) {
+                std::vector<int16_t> expected(frames);
+                for (size_t i = 0; i < frames; i++) {
+                    expected[i] = src[i * channels + channel];
+                }
+                std::vector<int16_t> actual(frames);
+                AudioDspExtractChannel(src.data(), actual.data(), frames, channels, channel);
+                CHECK(actual == expected);
+
+                // In place, as the audio input path does it
+                auto in_place = src;
+                AudioDspExtractChannel(in_place.data(), in_place.data(), frames, channels, channel);
+                in_place.resize(frames);
+                CHECK(in_place == expected);
+            }
+        }
+    }
+}
+
+// The output path of the codecs: volume, then back to 16 bits
+void TestVolumeChain() {
+    auto src = RandomSamples(960);
+    for (int volume : {0, 1, 50, 70, 99, 100}) {
+        int32_t factor = AudioDspVolumeFactor(volume);
+        std::vector<int32_t> scaled(src.size());
+        std::vector<int16_t> expected(src.size()), actual(src.size());
+        for (size_t i = 0; i < src.size(); i++) {
+            expected[i] = ReferenceClamp((int32_t)(int64_t(src[i]) * factor) >> 16);
+        }
+        AudioDspScaleToInt32(src.data(), scaled.data(), src.size(), factor);
+        AudioDspInt32ToInt16(scaled.data(), actual.data(), src.size(), 16);
+        CHECK(actual == expected);
+    }
+}
+
+} // namespace
+
+int main() {
+    TestVolumeFactor();
+    TestScaleToInt32();
+    TestInt32ToInt16();
+    TestApplyGain();
+    TestExtractChannel();
+    TestVolumeChain();
+    return host_test_result();
+}
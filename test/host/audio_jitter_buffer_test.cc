@@ -0,0 +1,109 @@
+// Feeds AudioJitterBuffer with packets arriving on a simulated clock, checking the target depth it
+// derives from the jitter and the order packets come out in
+#include "audio_jitter_buffer.h"
+#include "host_test.h"
+
+namespace {
+
+const int kFrameMs = 60;
+
+class Stream {
+public:
+    AudioBufferPool<AudioStreamPacket> pool{AUDIO_JITTER_BUFFER_CAPACITY};
+    AudioJitterBuffer buffer{pool};
+    uint32_t sequence = 1;
+    int64_t time_us = 1000 * 1000;
+
+    // The next packet arrives frame_ms after the previous one, and playback takes one frame
+    void Arrive(int frame_ms) {
+        time_us += frame_ms * 1000LL;
+        Push(sequence++);
+        std::unique_ptr<AudioStreamPacket> packet;
+        if (buffer.Pop(packet, time_us) == kAudioJitterPacket) {
+            pool.Release(std::move(packet));
+        }
+    }
+
+    void Push(uint32_t packet_sequence) {
+        auto packet = pool.Acquire();
+        packet->sequence = packet_sequence;
+        packet->frame_duration = kFrameMs;
+        packet->enqueue_time_us = time_us;
+        buffer.Push(std::move(packet));
+    }
+
+    int target() const { return buffer.GetStatistics().target_depth; }
+};
+
+void TestSteadyStreamKeepsTheMinimum() {
+    Stream stream;
+    for (int i = 0; i < 100; i++) {
+        stream.Arrive(kFrameMs);
+    }
+    CHECK(stream.target() == AUDIO_JITTER_MIN_MS / kFrameMs);
+    CHECK(stream.buffer.GetStatistics().jitter_ms == 0);
+}
+
+void TestTargetDecaysWhenSteady() {
+    Stream stream;
+    // Bursts: every other packet is 150 ms late
+    for (int i = 0; i < 50; i++) {
+        stream.Arrive(i % 2 == 0 ? kFrameMs + 150 : 0);
+    }
+    int peak = stream.target();
+    CHECK(peak > 3);
+
+    // Steady again: held for AUDIO_JITTER_DECAY_MS, then one frame at a time
+    int64_t steady_us = stream.time_us;
+    int previous = peak;
+    int64_t last_step_us = steady_us;
+    while (stream.time_us - steady_us < 60 * 1000 * 1000LL) {
+        stream.Arrive(kFrameMs);
+        int target = stream.target();
+        CHECK(target >= previous - 1);
+        if (target < previous) {
+            CHECK(stream.time_us - last_step_us >= AUDIO_JITTER_DECAY_MS * 1000LL);
+            last_step_us = stream.time_us;
+        }
+        previous = target;
+    }
+    CHECK(stream.target() == AUDIO_JITTER_MIN_MS / kFrameMs);
+
+    // A new burst raises it again at once
+    stream.Arrive(kFrameMs + 400);
+    CHECK(stream.target() > AUDIO_JITTER_MIN_MS / kFrameMs);
+}
+
+void TestReorderAndLoss() {
+    Stream stream;
+    stream.Push(1);
+    stream.Push(3);
+    stream.Push(2);
+    stream.Push(6);
+    std::unique_ptr<AudioStreamPacket> packet;
+    int64_t now_us = stream.time_us + AUDIO_JITTER_MAX_MS * 1000LL;
+    for (uint32_t expected = 1; expected <= 3; expected++) {
+        CHECK(stream.buffer.Pop(packet, now_us) == kAudioJitterPacket);
+        CHECK(packet->sequence == expected);
+        stream.pool.Release(std::move(packet));
+    }
+    CHECK(stream.buffer.Pop(packet, now_us) == kAudioJitterLost);
+    CHECK(stream.buffer.Pop(packet, now_us) == kAudioJitterLost);
+    CHECK(stream.buffer.Pop(packet, now_us) == kAudioJitterPacket);
+    CHECK(packet->sequence == 6);
+    stream.pool.Release(std::move(packet));
+
+    // Late and duplicate packets are dropped
+    stream.Push(2);
+    CHECK(stream.buffer.GetStatistics().late == 1);
+    CHECK(stream.buffer.Empty());
+}
+
+} // namespace
+
+int main() {
+    TestSteadyStreamKeepsTheMinimum();
+    TestTargetDecaysWhenSteady();
+    TestReorderAndLoss();
+    return host_test_result();
+}
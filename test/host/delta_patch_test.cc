@@ -0,0 +1,281 @@
+// Drives DeltaPatch with patches built here, fed in chunks of every size so varints, records and the header
+// are split at every possible position
+#include "delta_patch.h"
+#include "host_test.h"
+
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<uint8_t> Sha256(const std::vector<uint8_t>& data) {
+    std::vector<uint8_t> digest(32);
+    mbedtls_sha256_context sha256;
+    mbedtls_sha256_init(&sha256);
+    mbedtls_sha256_starts(&sha256, 0);
+    mbedtls_sha256_update(&sha256, data.data(), data.size());
+    mbedtls_sha256_finish(&sha256, digest.data());
+    mbedtls_sha256_free(&sha256);
+    return digest;
+}
+
+// Writes the operations in the format of scripts/delta_patch.py, and the target they produce
+class PatchBuilder {
+public:
+    explicit PatchBuilder(const std::vector<uint8_t>& source) : source_(source) {}
+
+    void Insert(const std::vector<uint8_t>& data) {
+        ops_.push_back(0x02);
+        WriteVarint(data.size());
+        ops_.insert(ops_.end(), data.begin(), data.end());
+        target_.insert(target_.end(), data.begin(), data.end());
+    }
+
+    // Each record copies same source bytes, then adds the deltas to the source bytes that follow
+    struct Record {
+        uint32_t same;
+        std::vector<uint8_t> deltas;
+    };
+
+    void Diff(uint32_t offset, const std::vector<Record>& records) {
+        uint32_t length = 0;
+        for (auto& record : records) {
+            length += record.same + record.deltas.size();
+        }
+        ops_.push_back(0x01);
+        WriteVarint(offset);
+        WriteVarint(length);
+        for (auto& record : records) {
+            WriteVarint(record.same);
+            WriteVarint(record.deltas.size());
+            ops_.insert(ops_.end(), record.deltas.begin(), record.deltas.end());
+            target_.insert(target_.end(), source_.begin() + offset, source_.begin() + offset + record.same);
+            offset += record.same;
+            for (uint8_t delta : record.deltas) {
+                target_.push_back(source_[offset++] + delta);
+            }
+        }
+    }
+
+    std::vector<uint8_t> Build(uint16_t flags = 0) const {
+        std::vector<uint8_t> patch(DELTA_PATCH_MAGIC, DELTA_PATCH_MAGIC + 4);
+        auto put = [&patch](uint32_t value, int bytes) {
+            for (int i = 0; i < bytes; i++) {
+                patch.push_back(value >> (i * 8));
+            }
+        };
+        put(DELTA_PATCH_VERSION, 2);
+        put(flags, 2);
+        put(source_.size(), 4);
+        put(target_.size(), 4);
+        auto source_sha256 = Sha256(source_);
+        auto target_sha256 = Sha256(target_);
+        patch.insert(patch.end(), source_sha256.begin(), source_sha256.end());
+        patch.insert(patch.end(), target_sha256.begin(), target_sha256.end());
+        patch.insert(patch.end(), ops_.begin(), ops_.end());
+        return patch;
+    }
+
+    // Operation bytes for malformed patches, the header claims target_size
+    void Raw(const std::vector<uint8_t>& bytes, uint32_t target_size) {
+        ops_.insert(ops_.end(), bytes.begin(), bytes.end());
+        target_.resize(target_size);
+    }
+
+    const std::vector<uint8_t>& target() const { return target_; }
+
+private:
+    const std::vector<uint8_t>& source_;
+    std::vector<uint8_t> ops_;
+    std::vector<uint8_t> target_;
+
+    void WriteVarint(uint32_t value) {
+        while (value >= 0x80) {
+            ops_.push_back((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        ops_.push_back(value);
+    }
+};
+
+struct Result {
+    bool fed = false;
+    bool finished = false;
+    std::vector<uint8_t> output;
+    int header_reads = 0;
+};
+
+Result Apply(const std::vector<uint8_t>& source, const std::vector<uint8_t>& patch, size_t chunk_size,
+    const DeltaPatch::SourceDigest* digest = nullptr) {
+    Result result;
+    bool header_done = false;
+    DeltaPatch delta_patch([&](size_t offset, uint8_t* data, size_t size) -> bool {
+        if (offset + size > source.size()) {
+            return false;
+        }
+        memcpy(data, source.data() + offset, size);
+        if (!header_done) {
+            result.header_reads++;
+        }
+        return true;
+    }, [&](const uint8_t* data, size_t size) -> bool {
+        result.output.insert(result.output.end(), data, data + size);
+        return true;
+    });
+    delta_patch.OnHeader([&header_done]() -> bool {
+        header_done = true;
+        return true;
+    });
+    if (digest != nullptr) {
+        delta_patch.SetSourceDigest(*digest);
+    }
+    result.fed = true;
+    for (size_t offset = 0; offset < patch.size() && result.fed; offset += chunk_size) {
+        result.fed = delta_patch.Feed(patch.data() + offset, std::min(chunk_size, patch.size() - offset));
+    }
+    result.finished = result.fed && delta_patch.Finish();
+    return result;
+}
+
+std::vector<uint8_t> RandomBytes(size_t size, uint32_t seed) {
+    std::mt19937 random(seed);
+    std::vector<uint8_t> data(size);
+    for (auto& byte : data) {
+        byte = random();
+    }
+    return data;
+}
+
+// The patches are only as good as the SHA-256 of the shim
+void TestSha256() {
+    const uint8_t expected[32] = {
+        0xba, 0x78, 0x16, 0xbf, 0x8f, 0x01, 0xcf, 0xea, 0x41, 0x41, 0x40, 0xde, 0x5d, 0xae, 0x22, 0x23,
+        0xb0, 0x03, 0x61, 0xa3, 0x96, 0x17, 0x7a, 0x9c, 0xb4, 0x10, 0xff, 0x61, 0xf2, 0x00, 0x15, 0xad,
+    };
+    CHECK(Sha256({'a', 'b', 'c'}) == std::vector<uint8_t>(expected, expected + 32));
+}
+
+void TestChunkedApply() {
+    auto source = RandomBytes(40000, 1);
+    PatchBuilder builder(source);
+    // Lengths and offsets from one to three varint bytes, records with and without deltas
+    builder.Insert(RandomBytes(5, 2));
+    builder.Diff(100, {{20, {1, 2, 3}}, {0, {0xFF}}, {300, {}}});
+    builder.Insert(RandomBytes(200, 3));
+    builder.Diff(20000, {{17000, {}}, {5, std::vector<uint8_t>(150, 7)}});
+    builder.Diff(0, {{0, RandomBytes(5000, 4)}});
+    builder.Insert(RandomBytes(1, 5));
+    auto patch = builder.Build();
+
+    const size_t chunk_sizes[] = {1, 2, 3, 5, 7, 13, 64, 77, 255, 4096, 5000, patch.size()};
+    for (size_t chunk_size : chunk_sizes) {
+        auto result = Apply(source, patch, chunk_size);
+        CHECK(result.finished);
+        CHECK(result.output == builder.target());
+    }
+}
+
+void TestSourceDigest() {
+    auto source = RandomBytes(10000, 6);
+    PatchBuilder builder(source);
+    builder.Diff(0, {{10000, {}}});
+    auto patch = builder.Build();
+
+    // A digest computed before the download spares the source reads while the header is checked
+    DeltaPatch::SourceDigest digest = {};
+    CHECK(DeltaPatch::HashSource([&source](size_t offset, uint8_t* data, size_t size) -> bool {
+        memcpy(data, source.data() + offset, size);
+        return true;
+    }, source.size(), digest));
+    auto result = Apply(source, patch, 100, &digest);
+    CHECK(result.finished);
+    CHECK(result.header_reads == 0);
+    CHECK(result.output == source);
+
+    // A digest of another size is not trusted, the source is hashed when the header arrives
+    DeltaPatch::SourceDigest other = digest;
+    other.size = source.size() - 1;
+    result = Apply(source, patch, 100, &other);
+    CHECK(result.finished);
+    CHECK(result.header_reads > 0);
+
+    // A digest of the right size but another image rejects the patch
+    DeltaPatch::SourceDigest wrong = digest;
+    wrong.sha256[0] ^= 1;
+    result = Apply(source, patch, 100, &wrong);
+    CHECK(!result.fed);
+    CHECK(result.output.empty());
+}
+
+void TestRejectedPatches() {
+    auto source = RandomBytes(3000, 7);
+    PatchBuilder builder(source);
+    builder.Diff(1000, {{500, {9, 9}}, {100, {}}});
+    builder.Insert(RandomBytes(300, 8));
+    auto patch = builder.Build();
+
+    // Another source image
+    auto other_source = source;
+    other_source[2999] ^= 0x80;
+    auto result = Apply(other_source, patch, 17);
+    CHECK(!result.fed);
+    CHECK(result.output.empty());
+
+    // Truncated download
+    auto truncated = patch;
+    truncated.resize(patch.size() - 10);
+    result = Apply(source, truncated, 17);
+    CHECK(result.fed);
+    CHECK(!result.finished);
+
+    // Corrupted insert data, caught by the target hash
+    auto corrupted = patch;
+    corrupted.back() ^= 1;
+    result = Apply(source, corrupted, 17);
+    CHECK(result.fed);
+    CHECK(!result.finished);
+
+    // Trailing bytes after the target is complete
+    auto trailing = patch;
+    trailing.push_back(0x02);
+    result = Apply(source, trailing, 17);
+    CHECK(!result.fed);
+
+    // Unknown operation, the first one follows the 80 byte header
+    auto unknown = patch;
+    unknown[80] = 0x7F;
+    result = Apply(source, unknown, 17);
+    CHECK(!result.fed);
+}
+
+void TestMalformedOperations() {
+    auto source = RandomBytes(1000, 9);
+
+    // A DIFF of 101 bytes at offset 900 reads past the end of the source
+    PatchBuilder past(source);
+    past.Raw({0x01, 0x84, 0x07, 0x65, 0x65, 0x00}, 101);
+    CHECK(!Apply(source, past.Build(), 1).fed);
+
+    // A record of 2 delta bytes in a DIFF of 11 bytes, after 10 same bytes
+    PatchBuilder record(source);
+    record.Raw({0x01, 0x00, 0x0B, 0x0A, 0x02, 0x01, 0x01}, 11);
+    CHECK(!Apply(source, record.Build(), 3).fed);
+
+    // A varint longer than 32 bits
+    PatchBuilder varint(source);
+    varint.Raw({0x02, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x01}, 100);
+    CHECK(!Apply(source, varint.Build(), 2).fed);
+}
+
+} // namespace
+
+int main() {
+    TestSha256();
+    TestChunkedApply();
+    TestSourceDigest();
+    TestRejectedPatches();
+    TestMalformedOperations();
+    return host_test_result();
+}
@@ -0,0 +1,25 @@
+#ifndef HOST_TEST_H
+#define HOST_TEST_H
+
+#include <cstdio>
+
+// Minimal checks for the host tests, a test returns host_test_result() from main()
+inline int host_test_failures = 0;
+
+#define CHECK(condition) do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            host_test_failures++; \
+        } \
+    } while (0)
+
+inline int host_test_result() {
+    if (host_test_failures > 0) {
+        fprintf(stderr, "%d check(s) failed\n", host_test_failures);
+        return 1;
+    }
+    printf("All checks passed\n");
+    return 0;
+}
+
+#endif // HOST_TEST_H
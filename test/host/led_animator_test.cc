@@ -0,0 +1,146 @@
+// Plays LedAnimations against the simulated esp_timer clock, checking what is written to the LEDs, when,
+// and how often the timer wakes up
+#include "led_animator.h"
+#include "host_test.h"
+
+#include <vector>
+
+namespace {
+
+struct Write {
+    int64_t time_us;
+    std::vector<StripColor> colors;
+};
+
+class Recorder {
+public:
+    std::vector<Write> writes;
+
+    LedAnimator::Writer writer() {
+        return [this](const StripColor* colors, int count) {
+            writes.push_back({esp_timer_get_time(), std::vector<StripColor>(colors, colors + count)});
+        };
+    }
+};
+
+const StripColor kRed = {30, 0, 0};
+const StripColor kGreen = {0, 40, 0};
+const StripColor kOff = {};
+
+esp_timer_handle_t AnimatorTimer() {
+    return host_timers.back();
+}
+
+void TestSolid() {
+    Recorder recorder;
+    LedAnimator animator(3, recorder.writer());
+    CHECK(!esp_timer_is_active(AnimatorTimer()));
+
+    animator.Play(LedAnimation::Solid(kRed));
+    host_timer_advance(0);
+    CHECK(recorder.writes.size() == 1);
+    CHECK(recorder.writes[0].colors == std::vector<StripColor>(3, kRed));
+    // Nothing changes after the only frame
+    CHECK(!esp_timer_is_active(AnimatorTimer()));
+
+    // The same color again is not restarted
+    animator.Play(LedAnimation::Solid(kRed));
+    CHECK(!esp_timer_is_active(AnimatorTimer()));
+    host_timer_advance(1000 * 1000);
+    CHECK(recorder.writes.size() == 1);
+}
+
+void TestCrossfade() {
+    Recorder recorder;
+    LedAnimator animator(2, recorder.writer());
+    animator.Play(LedAnimation::Solid(kRed));
+    host_timer_advance(0);
+    int64_t start_us = esp_timer_get_time();
+    int fires = AnimatorTimer()->fire_count;
+
+    animator.Play(LedAnimation::Solid(kGreen), 200);
+    host_timer_advance(1000 * 1000);
+    CHECK(!esp_timer_is_active(AnimatorTimer()));
+    // A tick every LED_ANIMATION_TICK_MS over the crossfade, and the last step
+    CHECK(AnimatorTimer()->fire_count - fires == 200 / LED_ANIMATION_TICK_MS + 1);
+    CHECK(recorder.writes.back().colors == std::vector<StripColor>(2, kGreen));
+    CHECK(recorder.writes.back().time_us == start_us + 200 * 1000);
+    for (size_t i = 2; i < recorder.writes.size(); i++) {
+        auto& previous = recorder.writes[i - 1].colors[0];
+        auto& color = recorder.writes[i].colors[0];
+        CHECK(color.red <= previous.red && color.green >= previous.green);
+    }
+}
+
+void TestBlinkWakesOnFrames() {
+    Recorder recorder;
+    LedAnimator animator(1, recorder.writer());
+    animator.Play(LedAnimation::Blink(kRed, 500));
+    host_timer_advance(0);
+    int64_t start_us = esp_timer_get_time();
+    int fires = AnimatorTimer()->fire_count;
+
+    host_timer_advance(5000 * 1000);
+    // One wakeup per frame instead of one every LED_ANIMATION_TICK_MS
+    CHECK(AnimatorTimer()->fire_count - fires == 10);
+    CHECK(recorder.writes.size() == 11);
+    for (size_t i = 0; i < recorder.writes.size(); i++) {
+        CHECK(recorder.writes[i].time_us == start_us + (int64_t)i * 500 * 1000);
+        CHECK(recorder.writes[i].colors[0] == (i % 2 == 0 ? kRed : kOff));
+    }
+    CHECK(esp_timer_is_active(AnimatorTimer()));
+
+    // A new animation does not wait for the next frame of the blink
+    host_timer_advance(100 * 1000);
+    animator.Play(LedAnimation::Solid(kGreen));
+    int64_t play_us = esp_timer_get_time();
+    host_timer_advance(0);
+    CHECK(recorder.writes.back().colors[0] == kGreen);
+    CHECK(recorder.writes.back().time_us == play_us);
+    CHECK(!esp_timer_is_active(AnimatorTimer()));
+}
+
+void TestFiniteBlink() {
+    Recorder recorder;
+    LedAnimator animator(1, recorder.writer());
+    animator.Play(LedAnimation::Blink(kRed, 100, 2));
+    host_timer_advance(1000 * 1000);
+    CHECK(recorder.writes.size() == 4);
+    CHECK(recorder.writes.back().colors[0] == kOff);
+    CHECK(!esp_timer_is_active(AnimatorTimer()));
+    // The timer stops with the last frame
+    CHECK(AnimatorTimer()->fire_count == 4);
+    CHECK(recorder.writes.back().time_us == 300 * 1000 + recorder.writes.front().time_us);
+}
+
+void TestCrossfadeIntoScroll() {
+    Recorder recorder;
+    LedAnimator animator(3, recorder.writer());
+    animator.Play(LedAnimation::Solid(kOff));
+    host_timer_advance(0);
+    int64_t start_us = esp_timer_get_time();
+
+    animator.Play(LedAnimation::Scroll(3, kOff, kRed, 1, 300), 100);
+    host_timer_advance(100 * 1000);
+    CHECK(recorder.writes.back().colors == std::vector<StripColor>({kRed, kOff, kOff}));
+    int fires = AnimatorTimer()->fire_count;
+
+    // After the crossfade the timer follows the 300 ms frames, on the clock of the animation
+    host_timer_advance(700 * 1000);
+    CHECK(AnimatorTimer()->fire_count - fires == 2);
+    CHECK(recorder.writes.back().colors == std::vector<StripColor>({kOff, kOff, kRed}));
+    CHECK(recorder.writes.back().time_us == start_us + 600 * 1000);
+    CHECK(recorder.writes[recorder.writes.size() - 2].time_us == start_us + 300 * 1000);
+    CHECK(esp_timer_is_active(AnimatorTimer()));
+}
+
+} // namespace
+
+int main() {
+    TestSolid();
+    TestCrossfade();
+    TestBlinkWakesOnFrames();
+    TestFiniteBlink();
+    TestCrossfadeIntoScroll();
+    return host_test_result();
+}
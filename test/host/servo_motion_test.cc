@@ -0,0 +1,213 @@
+// Plays ServoMotion segments on fake servos against the simulated esp_timer clock, checking the positions
+// written on every tick and when the timer runs
+#include "servo_motion.h"
+#include "host_test.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+namespace {
+
+struct Sample {
+    int64_t time_us;
+    int position;
+};
+
+class FakeServo : public MotionServo {
+public:
+    bool attached = true;
+    int position = 0;
+    int amplitude = 0;
+    int offset = 0;
+    std::vector<Sample> samples;
+
+    bool IsAttached() const override { return attached; }
+    int GetPosition() override { return position; }
+    void SetPosition(int value) override {
+        position = value;
+        samples.push_back({esp_timer_get_time(), value});
+    }
+    void GetKeyframes(int16_t* keyframes, int count) const override {
+        for (int k = 0; k < count; k++) {
+            keyframes[k] = (int16_t)std::lround((amplitude * std::sin(2 * M_PI * k / count) + offset) * 16);
+        }
+    }
+};
+
+// Position written at elapsed_ms after the first sample
+int PositionAt(const FakeServo& servo, int elapsed_ms) {
+    int64_t time_us = servo.samples.front().time_us + elapsed_ms * 1000;
+    for (auto& sample : servo.samples) {
+        if (sample.time_us == time_us) {
+            return sample.position;
+        }
+    }
+    fprintf(stderr, "No sample at %d ms\n", elapsed_ms);
+    host_test_failures++;
+    return -1000;
+}
+
+void TestTimerRunsOnlyWithSegments() {
+    FakeServo servos[2];
+    ServoMotion motion(servos, 2);
+    CHECK(!esp_timer_is_active(host_timers.back()));
+
+    // Queued before Start(), played once started
+    int target[2] = {10, -10};
+    CHECK(motion.QueueMove(target, 100));
+    host_timer_advance(50 * 1000);
+    CHECK(!esp_timer_is_active(host_timers.back()));
+    CHECK(servos[0].samples.empty());
+
+    motion.Start();
+    CHECK(esp_timer_is_active(host_timers.back()));
+    CHECK(motion.WaitIdle());
+    CHECK(servos[0].position == 10);
+    CHECK(servos[1].position == -10);
+    CHECK(!esp_timer_is_active(host_timers.back()));
+
+    // Idle while started, until the next segment
+    host_timer_advance(1000 * 1000);
+    CHECK(!esp_timer_is_active(host_timers.back()));
+    CHECK(motion.QueueMove(target, 0));
+    CHECK(esp_timer_is_active(host_timers.back()));
+    CHECK(motion.WaitIdle());
+    CHECK(!esp_timer_is_active(host_timers.back()));
+
+    motion.Stop();
+    CHECK(motion.QueueMove(target, 100));
+    CHECK(!esp_timer_is_active(host_timers.back()));
+}
+
+void TestLinearMove() {
+    FakeServo servos[2];
+    servos[1].attached = false;
+    ServoMotion motion(servos, 2);
+    motion.Start();
+
+    int target[2] = {90, 45};
+    CHECK(motion.QueueMove(target, 1000));
+    CHECK(motion.WaitIdle());
+
+    // One sample per tick from the position the servo had, ending on the target
+    auto& samples = servos[0].samples;
+    CHECK(samples.size() == 1000 / SERVO_MOTION_TICK_MS + 1);
+    CHECK(samples.front().position == 0);
+    CHECK(PositionAt(servos[0], 500) == 45);
+    CHECK(samples.back().position == 90);
+    for (size_t i = 1; i < samples.size(); i++) {
+        int elapsed_ms = (int)((samples[i].time_us - samples.front().time_us) / 1000);
+        CHECK(samples[i].time_us - samples[i - 1].time_us == SERVO_MOTION_TICK_MS * 1000);
+        CHECK(std::abs(samples[i].position - 90 * elapsed_ms / 1000) <= 1);
+    }
+    CHECK(servos[1].samples.empty());
+
+    // The next move starts from where the last one ended
+    size_t first = samples.size();
+    target[0] = 30;
+    CHECK(motion.QueueMove(target, 200));
+    CHECK(motion.WaitIdle());
+    CHECK(samples.size() == first + 200 / SERVO_MOTION_TICK_MS + 1);
+    CHECK(samples[first].position == 90);
+    CHECK(samples[first + 100 / SERVO_MOTION_TICK_MS].position == 60);
+    CHECK(samples.back().position == 30);
+}
+
+void TestOscillation() {
+    FakeServo servos[1];
+    servos[0].amplitude = 30;
+    servos[0].offset = 10;
+    ServoMotion motion(servos, 1);
+    motion.Start();
+
+    CHECK(motion.QueueOscillation(1000, 2000));
+    CHECK(motion.WaitIdle());
+
+    // Fades in from 0 over the blend, then follows the keyframes; 250 ms is keyframe 8, the crest
+    CHECK(PositionAt(servos[0], 0) == 0);
+    CHECK(std::abs(PositionAt(servos[0], 60)) < 15);
+    CHECK(PositionAt(servos[0], 250) == 40);
+    CHECK(PositionAt(servos[0], 750) == -20);
+    CHECK(PositionAt(servos[0], 1250) == 40);
+    CHECK(PositionAt(servos[0], 1500) == 10);
+    CHECK(servos[0].samples.back().position == 10);
+
+    // Between keyframes the position is interpolated, so after the blend it moves at the slope of the sine
+    auto& samples = servos[0].samples;
+    for (size_t i = SERVO_MOTION_BLEND_MS / SERVO_MOTION_TICK_MS + 1; i < samples.size(); i++) {
+        CHECK(std::abs(samples[i].position - samples[i - 1].position) <= 3);
+    }
+
+    // Nothing to play
+    CHECK(motion.QueueOscillation(0, 1000));
+    CHECK(motion.QueueOscillation(1000, 0));
+    CHECK(!esp_timer_is_active(host_timers.back()));
+}
+
+void TestLateTickKeepsTheClock() {
+    FakeServo servos[1];
+    ServoMotion motion(servos, 1);
+    motion.Start();
+
+    int up[1] = {100};
+    int down[1] = {0};
+    CHECK(motion.QueueMove(up, 100));
+    CHECK(motion.QueueMove(down, 100));
+    host_timer_advance(SERVO_MOTION_TICK_MS * 1000);
+    int64_t start_us = servos[0].samples.front().time_us;
+
+    // The timer task is held up past the end of the first move
+    host_timer_stall(135 * 1000);
+    host_timer_advance(1);
+    CHECK(servos[0].samples.back().position == 100);
+
+    // The second move runs from the end of the first on the timer clock, not from the late tick
+    host_timer_advance(SERVO_MOTION_TICK_MS * 1000);
+    int64_t time_us = servos[0].samples.back().time_us;
+    int expected = 100 - (int)((time_us - start_us) / 1000 - 100);
+    CHECK(std::abs(servos[0].samples.back().position - expected) <= 1);
+    CHECK(motion.WaitIdle());
+    CHECK(servos[0].samples.back().position == 0);
+    CHECK(servos[0].samples.back().time_us - start_us < 200 * 1000 + SERVO_MOTION_TICK_MS * 1000);
+}
+
+void TestCancel() {
+    FakeServo servos[1];
+    ServoMotion motion(servos, 1);
+    motion.Start();
+
+    int target[1] = {90};
+    CHECK(motion.QueueMove(target, 1000));
+    CHECK(motion.Wait(300));
+    int position = servos[0].position;
+    CHECK(position > 0 && position < 90);
+
+    motion.Cancel();
+    CHECK(motion.cancelled());
+    CHECK(!motion.WaitIdle());
+    CHECK(!motion.Wait(100));
+    CHECK(!motion.QueueMove(target, 100));
+    // Held where it was, and the timer stops on its next tick
+    host_timer_advance(SERVO_MOTION_TICK_MS * 1000);
+    CHECK(servos[0].position == position);
+    CHECK(!esp_timer_is_active(host_timers.back()));
+
+    motion.Resume();
+    CHECK(!motion.cancelled());
+    CHECK(motion.WaitIdle());
+    CHECK(motion.QueueMove(target, 100));
+    CHECK(motion.WaitIdle());
+    CHECK(servos[0].position == 90);
+}
+
+} // namespace
+
+int main() {
+    TestTimerRunsOnlyWithSegments();
+    TestLinearMove();
+    TestOscillation();
+    TestLateTickKeepsTheClock();
+    TestCancel();
+    return host_test_result();
+}
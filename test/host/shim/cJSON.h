@@ -0,0 +1,7 @@
+#ifndef HOST_SHIM_CJSON_H
+#define HOST_SHIM_CJSON_H
+
+// protocol.h only passes cJSON pointers around
+typedef struct cJSON cJSON;
+
+#endif // HOST_SHIM_CJSON_H
@@ -0,0 +1,9 @@
+#ifndef HOST_SHIM_DRIVER_GPIO_H
+#define HOST_SHIM_DRIVER_GPIO_H
+
+typedef enum {
+    GPIO_NUM_NC = -1,
+    GPIO_NUM_0 = 0,
+} gpio_num_t;
+
+#endif // HOST_SHIM_DRIVER_GPIO_H
@@ -0,0 +1,16 @@
+#ifndef HOST_SHIM_ESP_HEAP_CAPS_H
+#define HOST_SHIM_ESP_HEAP_CAPS_H
+
+#include <cstdlib>
+
+#define MALLOC_CAP_8BIT     (1 << 2)
+#define MALLOC_CAP_DMA      (1 << 3)
+#define MALLOC_CAP_SPIRAM   (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline void* heap_caps_malloc(size_t size, unsigned caps) { return malloc(size); }
+inline void* heap_caps_calloc(size_t count, size_t size, unsigned caps) { return calloc(count, size); }
+inline void* heap_caps_realloc(void* ptr, size_t size, unsigned caps) { return realloc(ptr, size); }
+inline void heap_caps_free(void* ptr) { free(ptr); }
+
+#endif // HOST_SHIM_ESP_HEAP_CAPS_H
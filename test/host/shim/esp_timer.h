@@ -0,0 +1,137 @@
+#ifndef HOST_SHIM_ESP_TIMER_H
+#define HOST_SHIM_ESP_TIMER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "esp_err.h"
+
+// Timers on a simulated clock: nothing fires until the test calls host_timer_advance(),
+// which moves the clock forward and runs the callbacks that come due on the way, in order
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef enum {
+    ESP_TIMER_TASK,
+    ESP_TIMER_ISR,
+} esp_timer_dispatch_t;
+
+typedef struct {
+    esp_timer_cb_t callback;
+    void* arg;
+    esp_timer_dispatch_t dispatch_method;
+    const char* name;
+    bool skip_unhandled_events;
+} esp_timer_create_args_t;
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    bool active;
+    uint64_t period_us;  // 0 for a one shot timer
+    int64_t due_us;
+    int fire_count;
+};
+typedef struct esp_timer* esp_timer_handle_t;
+
+inline int64_t host_timer_now_us = 0;
+inline std::vector<esp_timer_handle_t> host_timers;
+
+inline esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+    *handle = new esp_timer{args->callback, args->arg, false, 0, 0, 0};
+    host_timers.push_back(*handle);
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (auto it = host_timers.begin(); it != host_timers.end(); ++it) {
+        if (*it == timer) {
+            host_timers.erase(it);
+            break;
+        }
+    }
+    delete timer;
+    return ESP_OK;
+}
+
+inline esp_err_t host_timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period_us) {
+    if (timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = true;
+    timer->period_us = period_us;
+    timer->due_us = host_timer_now_us + timeout_us;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us) {
+    return host_timer_start(timer, timeout_us, 0);
+}
+
+inline esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us) {
+    return host_timer_start(timer, period_us, period_us);
+}
+
+inline esp_err_t esp_timer_restart(esp_timer_handle_t timer, uint64_t timeout_us) {
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (timer->period_us > 0) {
+        timer->period_us = timeout_us;
+    }
+    timer->due_us = host_timer_now_us + timeout_us;
+    return ESP_OK;
+}
+
+inline esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+    if (!timer->active) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->active = false;
+    return ESP_OK;
+}
+
+inline bool esp_timer_is_active(esp_timer_handle_t timer) {
+    return timer->active;
+}
+
+inline int64_t esp_timer_get_time() {
+    return host_timer_now_us;
+}
+
+inline void host_timer_advance(int64_t us) {
+    int64_t end = host_timer_now_us + us;
+    while (true) {
+        esp_timer_handle_t next = nullptr;
+        for (auto timer : host_timers) {
+            if (timer->active && timer->due_us <= end && (next == nullptr || timer->due_us < next->due_us)) {
+                next = timer;
+            }
+        }
+        if (next == nullptr) {
+            break;
+        }
+        // A timer that came due while the clock was stalled fires late, and only once
+        host_timer_now_us = std::max(host_timer_now_us, next->due_us);
+        if (next->period_us > 0) {
+            while (next->due_us <= host_timer_now_us) {
+                next->due_us += next->period_us;
+            }
+        } else {
+            next->active = false;
+        }
+        next->fire_count++;
+        next->callback(next->arg);
+    }
+    host_timer_now_us = end;
+}
+
+// Moves the clock without running the timers, as if the timer task was held up
+inline void host_timer_stall(int64_t us) {
+    host_timer_now_us += us;
+}
+
+#endif // HOST_SHIM_ESP_TIMER_H
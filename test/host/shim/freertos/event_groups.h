@@ -0,0 +1,64 @@
+#ifndef HOST_SHIM_FREERTOS_EVENT_GROUPS_H
+#define HOST_SHIM_FREERTOS_EVENT_GROUPS_H
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "FreeRTOS.h"
+#include "esp_timer.h"
+
+// Waiting advances the simulated clock one tick at a time, so the timers that would set the bits run
+// while the caller waits. Waiting forever with no timer left to set the bits aborts the test.
+#define HOST_EVENT_GROUP_DEADLOCK_TICKS (60 * 1000)
+
+typedef uint32_t EventBits_t;
+
+struct host_event_group {
+    EventBits_t bits;
+};
+typedef struct host_event_group* EventGroupHandle_t;
+
+inline EventGroupHandle_t xEventGroupCreate() {
+    return new host_event_group{0};
+}
+
+inline void vEventGroupDelete(EventGroupHandle_t group) {
+    delete group;
+}
+
+inline EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    group->bits |= bits;
+    return group->bits;
+}
+
+inline EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t previous = group->bits;
+    group->bits &= ~bits;
+    return previous;
+}
+
+inline EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    return group->bits;
+}
+
+inline EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                       BaseType_t wait_for_all, TickType_t ticks) {
+    auto satisfied = [&]() {
+        EventBits_t set = group->bits & bits;
+        return wait_for_all ? set == bits : set != 0;
+    };
+    for (TickType_t waited = 0; !satisfied() && waited < ticks; waited++) {
+        if (ticks == portMAX_DELAY && waited >= HOST_EVENT_GROUP_DEADLOCK_TICKS) {
+            fprintf(stderr, "Waiting forever for event bits 0x%x\n", (unsigned)bits);
+            abort();
+        }
+        host_timer_advance(portTICK_PERIOD_MS * 1000);
+    }
+    EventBits_t result = group->bits;
+    if (clear_on_exit && satisfied()) {
+        group->bits &= ~bits;
+    }
+    return result;
+}
+
+#endif // HOST_SHIM_FREERTOS_EVENT_GROUPS_H
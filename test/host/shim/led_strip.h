@@ -0,0 +1,44 @@
+#ifndef HOST_SHIM_LED_STRIP_H
+#define HOST_SHIM_LED_STRIP_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_err.h"
+#include "driver/gpio.h"
+
+// Only what LedAnimator::CreateWs2812Strip() needs to compile, the host tests never create a strip
+typedef struct led_strip_t* led_strip_handle_t;
+
+typedef enum {
+    LED_MODEL_WS2812,
+    LED_MODEL_SK6812,
+} led_model_t;
+
+#define LED_STRIP_COLOR_COMPONENT_FMT_GRB 0
+
+typedef struct {
+    int strip_gpio_num;
+    uint32_t max_leds;
+    led_model_t led_model;
+    uint32_t color_component_format;
+} led_strip_config_t;
+
+typedef struct {
+    uint32_t resolution_hz;
+    size_t mem_block_symbols;
+    struct {
+        uint32_t with_dma : 1;
+    } flags;
+} led_strip_rmt_config_t;
+
+inline esp_err_t led_strip_new_rmt_device(const led_strip_config_t* config, const led_strip_rmt_config_t* rmt_config,
+                                          led_strip_handle_t* handle) {
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+inline esp_err_t led_strip_clear(led_strip_handle_t handle) {
+    return ESP_OK;
+}
+
+#endif // HOST_SHIM_LED_STRIP_H
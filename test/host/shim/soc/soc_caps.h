@@ -0,0 +1,6 @@
+#ifndef HOST_SHIM_SOC_SOC_CAPS_H
+#define HOST_SHIM_SOC_SOC_CAPS_H
+
+// No RMT DMA on the host
+
+#endif // HOST_SHIM_SOC_SOC_CAPS_H